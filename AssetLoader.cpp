@@ -0,0 +1,303 @@
+#include "AssetLoader.h"
+#include "CPUProfiler.h"
+
+#include <wincodec.h>
+
+#include "DDSTextureLoader.h"
+
+#pragma comment(lib, "windowscodecs.lib")
+
+// Each worker gets its own WIC factory, created once COM is up on that thread
+static thread_local IWICImagingFactory* workerWICFactory = 0;
+
+AssetLoader::AssetLoader(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int threadCount)
+	:
+	device(device),
+	activeCount(0),
+	shuttingDown(false)
+{
+	if (threadCount == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.push_back(std::thread(&AssetLoader::WorkerMain, this));
+}
+
+// Finishes whatever is already queued, then stops the workers
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		shuttingDown = true;
+	}
+	queueChanged.notify_all();
+
+	for (auto& w : workers)
+		w.join();
+}
+
+// Queues a mesh load.  Meshes use the binary cache, so repeat
+// loads are mostly a file mapping and a buffer upload
+AssetLoader::MeshFuture AssetLoader::LoadMesh(const std::string& objFile, MeshVertexFormat format)
+{
+	Microsoft::WRL::ComPtr<ID3D11Device> device = this->device;
+	return Run<std::shared_ptr<Mesh>>([device, objFile, format]()
+	{
+		return std::make_shared<Mesh>(objFile.c_str(), device, format);
+	});
+}
+
+// Queues a texture load.  The future holds null if the file
+// can't be read or decoded.  Mips are always generated for
+// cooked textures
+AssetLoader::TextureFuture AssetLoader::LoadTexture(const std::wstring& file, TextureUsage usage, bool generateMips)
+{
+	return Run<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>([this, file, usage, generateMips]()
+	{
+		return CreateTexture(file, usage, generateMips);
+	});
+}
+
+void AssetLoader::WaitForAll()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	queueDrained.wait(lock, [this]() { return queue.empty() && activeCount == 0; });
+}
+
+// Loads that are queued or in progress
+unsigned int AssetLoader::GetPendingCount()
+{
+	std::lock_guard<std::mutex> lock(queueMutex);
+	return (unsigned int)queue.size() + activeCount;
+}
+
+void AssetLoader::WorkerMain()
+{
+	CPUProfiler::SetThreadName("Asset loader");
+
+	// WIC is a COM API, so each worker joins the multithreaded apartment
+	HRESULT comResult = CoInitializeEx(0, COINIT_MULTITHREADED);
+	CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&workerWICFactory));
+
+	while (true)
+	{
+		std::function<void()> work;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueChanged.wait(lock, [this]() { return shuttingDown || !queue.empty(); });
+			if (queue.empty())
+				break;
+
+			work = std::move(queue.front());
+			queue.pop_front();
+			activeCount++;
+		}
+
+		{
+			PROFILE_SCOPE("Asset load");
+			work();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			activeCount--;
+		}
+		queueDrained.notify_all();
+	}
+
+	if (workerWICFactory)
+	{
+		workerWICFactory->Release();
+		workerWICFactory = 0;
+	}
+	if (SUCCEEDED(comResult))
+		CoUninitialize();
+}
+
+// Halves an image with a box filter.  Odd edges reuse the last
+// row or column, so every source pixel still contributes
+static void DownsampleBox(const unsigned char* src, unsigned int srcWidth, unsigned int srcHeight, unsigned char* dst, unsigned int channels)
+{
+	unsigned int dstWidth = max(srcWidth / 2, 1u);
+	unsigned int dstHeight = max(srcHeight / 2, 1u);
+
+	for (unsigned int y = 0; y < dstHeight; y++)
+	{
+		unsigned int y0 = min(y * 2, srcHeight - 1);
+		unsigned int y1 = min(y * 2 + 1, srcHeight - 1);
+		for (unsigned int x = 0; x < dstWidth; x++)
+		{
+			unsigned int x0 = min(x * 2, srcWidth - 1);
+			unsigned int x1 = min(x * 2 + 1, srcWidth - 1);
+			for (unsigned int c = 0; c < channels; c++)
+			{
+				unsigned int sum =
+					src[(y0 * srcWidth + x0) * channels + c] +
+					src[(y0 * srcWidth + x1) * channels + c] +
+					src[(y1 * srcWidth + x0) * channels + c] +
+					src[(y1 * srcWidth + x1) * channels + c];
+				dst[(y * dstWidth + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+// Decodes an image with WIC into 8-bit pixels: R8 for grayscale images
+// (if allowed), and RGBA8 for everything else
+static bool DecodeImage(IWICImagingFactory* factory, const std::wstring& file, bool allowGray, std::vector<unsigned char>& pixels, unsigned int* width, unsigned int* height, unsigned int* channels)
+{
+	Microsoft::WRL::ComPtr<IWICBitmapDecoder> decoder;
+	Microsoft::WRL::ComPtr<IWICBitmapFrameDecode> frame;
+	if (FAILED(factory->CreateDecoderFromFilename(file.c_str(), 0, GENERIC_READ, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf())) ||
+		FAILED(decoder->GetFrame(0, frame.GetAddressOf())))
+		return false;
+
+	UINT w = 0;
+	UINT h = 0;
+	WICPixelFormatGUID sourceFormat = {};
+	frame->GetSize(&w, &h);
+	frame->GetPixelFormat(&sourceFormat);
+	if (w == 0 || h == 0 ||
+		w > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION ||
+		h > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+		return false;
+
+	bool gray = allowGray && sourceFormat == GUID_WICPixelFormat8bppGray;
+	unsigned int c = gray ? 1 : 4;
+
+	Microsoft::WRL::ComPtr<IWICFormatConverter> converter;
+	if (FAILED(factory->CreateFormatConverter(converter.GetAddressOf())) ||
+		FAILED(converter->Initialize(frame.Get(), gray ? GUID_WICPixelFormat8bppGray : GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, 0, 0.0, WICBitmapPaletteTypeCustom)))
+		return false;
+
+	pixels.resize((size_t)w * h * c);
+	if (FAILED(converter->CopyPixels(0, w * c, (UINT)pixels.size(), pixels.data())))
+		return false;
+
+	*width = w;
+	*height = h;
+	*channels = c;
+	return true;
+}
+
+// Loads a texture for the given usage.  Cooked usages load the cached
+// DDS file when it's current, and otherwise cook (and cache) it from the
+// source image.  Anything that can't be cooked is created uncompressed
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> AssetLoader::CreateTexture(const std::wstring& file, TextureUsage usage, bool generateMips)
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+
+	std::wstring cookedFile;
+	if (usage != TEXTURE_UNCOMPRESSED)
+	{
+		cookedFile = GetCookedTexturePath(file, usage);
+		if (IsCookedTextureCurrent(file, cookedFile) &&
+			SUCCEEDED(CreateDDSTextureFromFile(device.Get(), cookedFile.c_str(), 0, srv.GetAddressOf())))
+			return srv;
+	}
+
+	if (!workerWICFactory)
+		return 0;
+
+	// Cooking always starts from RGBA
+	std::vector<unsigned char> pixels;
+	unsigned int width = 0;
+	unsigned int height = 0;
+	unsigned int channels = 0;
+	if (!DecodeImage(workerWICFactory, file, usage == TEXTURE_UNCOMPRESSED, pixels, &width, &height, &channels))
+		return 0;
+
+	CookedTexture cooked;
+	if (usage != TEXTURE_UNCOMPRESSED && CookTexture(pixels.data(), width, height, usage, cooked))
+	{
+		WriteCookedTexture(cookedFile, cooked);
+
+		std::vector<D3D11_SUBRESOURCE_DATA> initialData(cooked.MipLevels);
+		for (unsigned int i = 0; i < cooked.MipLevels; i++)
+		{
+			initialData[i].pSysMem = &cooked.Data[cooked.LevelOffsets[i]];
+			initialData[i].SysMemPitch = cooked.LevelPitches[i];
+		}
+		return CreateTextureSRV(cooked.Width, cooked.Height, cooked.MipLevels, cooked.Format, initialData.data());
+	}
+
+	// Uncompressed, with the mips (if any) filtered here.  Albedo is
+	// still sRGB, so it reads the same as it would if it were cooked
+	DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	if (channels == 1) format = DXGI_FORMAT_R8_UNORM;
+	else if (usage == TEXTURE_ALBEDO) format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+
+	// Count the mips all the way down to 1x1
+	unsigned int mipLevels = 1;
+	if (generateMips)
+	{
+		unsigned int size = max(width, height);
+		while (size > 1) { size /= 2; mipLevels++; }
+	}
+
+	// Every level goes into one allocation, top level first
+	std::vector<size_t> levelOffsets(mipLevels);
+	size_t totalSize = 0;
+	for (unsigned int i = 0; i < mipLevels; i++)
+	{
+		levelOffsets[i] = totalSize;
+		totalSize += (size_t)max(width >> i, 1u) * max(height >> i, 1u) * channels;
+	}
+	pixels.resize(totalSize);
+
+	std::vector<D3D11_SUBRESOURCE_DATA> initialData(mipLevels);
+	for (unsigned int i = 0; i < mipLevels; i++)
+	{
+		unsigned int levelWidth = max(width >> i, 1u);
+		if (i > 0)
+			DownsampleBox(&pixels[levelOffsets[i - 1]], max(width >> (i - 1), 1u), max(height >> (i - 1), 1u), &pixels[levelOffsets[i]], channels);
+
+		initialData[i].pSysMem = &pixels[levelOffsets[i]];
+		initialData[i].SysMemPitch = levelWidth * channels;
+	}
+
+	return CreateTextureSRV(width, height, mipLevels, format, initialData.data());
+}
+
+// Decodes a source image and writes its cooked file, without creating
+// the texture.  Fails for uncompressed usages and uncookable images
+bool AssetLoader::CookTextureFile(const std::wstring& file, TextureUsage usage)
+{
+	if (usage == TEXTURE_UNCOMPRESSED || !workerWICFactory)
+		return false;
+
+	std::vector<unsigned char> pixels;
+	unsigned int width = 0;
+	unsigned int height = 0;
+	unsigned int channels = 0;
+	CookedTexture cooked;
+	return
+		DecodeImage(workerWICFactory, file, false, pixels, &width, &height, &channels) &&
+		CookTexture(pixels.data(), width, height, usage, cooked) &&
+		WriteCookedTexture(GetCookedTexturePath(file, usage), cooked);
+}
+
+// Creates an immutable texture with every mip level filled in, and its SRV
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> AssetLoader::CreateTextureSRV(unsigned int width, unsigned int height, unsigned int mipLevels, DXGI_FORMAT format, const D3D11_SUBRESOURCE_DATA* initialData)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = mipLevels;
+	desc.ArraySize = 1;
+	desc.Format = format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (FAILED(device->CreateTexture2D(&desc, initialData, texture.GetAddressOf())) ||
+		FAILED(device->CreateShaderResourceView(texture.Get(), 0, srv.GetAddressOf())))
+		return 0;
+
+	return srv;
+}
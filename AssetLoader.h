@@ -0,0 +1,89 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+#include "Mesh.h"
+#include "TextureCooker.h"
+
+// --------------------------------------------------------
+// Loads meshes and textures on a pool of worker threads.
+//
+// Each load returns a future right away; the file is read,
+// decoded and turned into D3D resources on a worker, using
+// only the device (which is free-threaded), so nothing is
+// waiting on the immediate context.  Textures are either
+// loaded from their cooked DDS files (see TextureCooker.h)
+// or decoded through WIC, and get their full mip chain on
+// the CPU, so they're complete the moment their future is
+// ready.
+//
+// Callers only need to wait (with get()) on the results
+// they need right now - see Material::AddTextureSRV() for
+// textures that are only needed once a material is drawn.
+// --------------------------------------------------------
+class AssetLoader
+{
+public:
+	typedef std::shared_future<std::shared_ptr<Mesh>> MeshFuture;
+	typedef std::shared_future<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> TextureFuture;
+
+	// A thread count of zero uses one worker per core, minus
+	// one for the main thread
+	AssetLoader(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int threadCount = 0);
+	~AssetLoader();
+
+	MeshFuture LoadMesh(const std::string& objFile, MeshVertexFormat format = MESH_VERTEX_FULL);
+	TextureFuture LoadTexture(const std::wstring& file, TextureUsage usage = TEXTURE_UNCOMPRESSED, bool generateMips = true);
+
+	// Blocks until every load queued so far has finished
+	void WaitForAll();
+
+	unsigned int GetThreadCount() { return (unsigned int)workers.size(); }
+	unsigned int GetPendingCount();
+
+	// Queues any other work on the pool and returns a future for its result
+	template<typename T>
+	std::shared_future<T> Run(std::function<T()> work)
+	{
+		std::shared_ptr<std::packaged_task<T()>> task = std::make_shared<std::packaged_task<T()>>(work);
+		std::shared_future<T> result = task->get_future().share();
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			queue.push_back([task]() { (*task)(); });
+		}
+		queueChanged.notify_one();
+		return result;
+	}
+
+	// The loads themselves, for work queued with Run().  These must be
+	// called on a worker, since decoding uses that worker's WIC factory
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateTexture(const std::wstring& file, TextureUsage usage, bool generateMips);
+	bool CookTextureFile(const std::wstring& file, TextureUsage usage);
+
+	// Only uses the device, so this is safe on any thread
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateTextureSRV(unsigned int width, unsigned int height, unsigned int mipLevels, DXGI_FORMAT format, const D3D11_SUBRESOURCE_DATA* initialData);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	// The worker pool and its queue
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> queue;
+	std::mutex queueMutex;
+	std::condition_variable queueChanged;
+	std::condition_variable queueDrained;
+	unsigned int activeCount;
+	bool shuttingDown;
+
+	void WorkerMain();
+};
@@ -0,0 +1,162 @@
+#include "Benchmark.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+using namespace DirectX;
+
+static const BenchmarkPreset presets[] =
+{
+	{ "small", 1000, 32, 2 },
+	{ "medium", 10000, 128, 4 },
+	{ "large", 100000, 1024, 6 },
+};
+
+Benchmark::Benchmark(const char* commandLine)
+	:
+	enabled(false),
+	offscreen(false),
+	seed(1234),
+	frameCount(1000),
+	warmupFrames(60),
+	outputPath("benchmark"),
+	preset(presets[0]),
+	frameIndex(0)
+{
+	std::istringstream args(commandLine ? commandLine : "");
+	std::string arg;
+	while (args >> arg)
+	{
+		if (arg == "-benchmark")
+		{
+			enabled = true;
+
+			// The preset name is optional
+			std::streampos next = args.tellg();
+			std::string name;
+			if (args >> name && name[0] != '-')
+			{
+				for (auto& p : presets)
+				{
+					if (name == p.Name)
+						preset = p;
+				}
+			}
+			else
+			{
+				args.clear();
+				args.seekg(next);
+			}
+		}
+		else if (arg == "-frames") args >> frameCount;
+		else if (arg == "-warmup") args >> warmupFrames;
+		else if (arg == "-seed") args >> seed;
+		else if (arg == "-offscreen") offscreen = true;
+		else if (arg == "-out") args >> outputPath;
+	}
+
+	frameCount = max(frameCount, 1);
+	warmupFrames = max(warmupFrames, 0);
+}
+
+// Circles the scene twice over the run, bobbing up and down and
+// moving in and out, always looking at the middle
+void Benchmark::GetCameraPose(int frame, XMFLOAT3* position, XMFLOAT3* pitchYawRoll)
+{
+	float t = (float)frame / (warmupFrames + frameCount);
+	float angle = t * XM_2PI * 2.0f;
+	float radius = 30.0f + 15.0f * sinf(t * XM_2PI * 3.0f);
+	float height = 4.0f + 6.0f * sinf(t * XM_2PI * 5.0f);
+
+	*position = XMFLOAT3(sinf(angle) * radius, height, cosf(angle) * radius);
+
+	// Forward is +Z, and positive pitch looks down
+	float yaw = atan2f(-position->x, -position->z);
+	float pitch = atan2f(height, radius);
+	*pitchYawRoll = XMFLOAT3(pitch, yaw, 0.0f);
+}
+
+void Benchmark::RecordFrame(float frameMs, unsigned int drawCalls, unsigned int stateChanges, GPUProfiler* gpuProfiler)
+{
+	frameIndex++;
+	if (frameIndex <= warmupFrames)
+	{
+		if (frameIndex == warmupFrames && gpuProfiler)
+			gpuProfiler->ResetTotals();
+		return;
+	}
+
+	if (!IsFinished())
+		frames.push_back({ frameMs, drawCalls, stateChanges });
+}
+
+// Picks from an already sorted list
+static float Percentile(const std::vector<float>& sorted, float p)
+{
+	if (sorted.empty())
+		return 0.0f;
+
+	size_t index = min((size_t)(sorted.size() * p), sorted.size() - 1);
+	return sorted[index];
+}
+
+bool Benchmark::WriteResults(GPUProfiler* gpuProfiler)
+{
+	FILE* csv = 0;
+	if (fopen_s(&csv, (outputPath + ".csv").c_str(), "wb") != 0 || !csv)
+		return false;
+
+	fprintf(csv, "frame,ms,draw_calls,state_changes\n");
+	for (size_t i = 0; i < frames.size(); i++)
+		fprintf(csv, "%zu,%.4f,%u,%u\n", i, frames[i].Ms, frames[i].DrawCalls, frames[i].StateChanges);
+	fclose(csv);
+
+	// Summary statistics
+	std::vector<float> sorted;
+	double totalMs = 0;
+	double totalDraws = 0;
+	double totalStateChanges = 0;
+	for (auto& f : frames)
+	{
+		sorted.push_back(f.Ms);
+		totalMs += f.Ms;
+		totalDraws += f.DrawCalls;
+		totalStateChanges += f.StateChanges;
+	}
+	std::sort(sorted.begin(), sorted.end());
+	double count = max((double)frames.size(), 1.0);
+
+	FILE* json = 0;
+	if (fopen_s(&json, (outputPath + ".json").c_str(), "wb") != 0 || !json)
+		return false;
+
+	fprintf(json, "{\n");
+	fprintf(json, "  \"preset\": \"%s\",\n", preset.Name);
+	fprintf(json, "  \"entities\": %d,\n", preset.EntityCount);
+	fprintf(json, "  \"lights\": %d,\n", preset.LightCount);
+	fprintf(json, "  \"materials\": %d,\n", preset.MaterialCount);
+	fprintf(json, "  \"seed\": %u,\n", seed);
+	fprintf(json, "  \"frames\": %zu,\n", frames.size());
+	fprintf(json, "  \"frame_ms\": { \"avg\": %.4f, \"p50\": %.4f, \"p99\": %.4f },\n",
+		totalMs / count, Percentile(sorted, 0.5f), Percentile(sorted, 0.99f));
+	fprintf(json, "  \"draw_calls\": %.1f,\n", totalDraws / count);
+	fprintf(json, "  \"state_changes\": %.1f,\n", totalStateChanges / count);
+
+	// Average GPU time for each pass, over the frames it was timed in
+	fprintf(json, "  \"gpu_ms\": {");
+	const char* separator = "\n";
+	for (unsigned int i = 0; gpuProfiler && i < gpuProfiler->GetPassCount(); i++)
+	{
+		unsigned int samples = gpuProfiler->GetPassTotalCount(i);
+		double avg = samples > 0 ? gpuProfiler->GetPassTotalMs(i) / samples : 0.0;
+		fprintf(json, "%s    \"%s\": %.4f", separator, gpuProfiler->GetPassName(i), avg);
+		separator = ",\n";
+	}
+	fprintf(json, "\n  }\n}\n");
+	fclose(json);
+	return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+#include "GPUProfiler.h"
+
+// How much of everything a benchmark run puts in the scene
+struct BenchmarkPreset
+{
+	const char* Name;
+	int EntityCount;	// Extra spheres, on top of the regular scene
+	int LightCount;
+	int MaterialCount;	// How many of the spawnable materials they use
+};
+
+// --------------------------------------------------------
+// Runs the scene the same way every time and records how
+// long each frame takes, so builds can be compared.
+//
+// Selected on the command line:
+//   -benchmark [small|medium|large]
+//   -frames N     Frames to record (after warming up)
+//   -warmup N     Frames to skip first, while assets settle
+//   -seed N       Seed for the random scene layout
+//   -offscreen    Never show the window
+//   -out path     Results go to path.csv and path.json
+//
+// The camera follows a scripted flythrough, and the game
+// steps its simulation by a fixed time per frame.
+// --------------------------------------------------------
+class Benchmark
+{
+public:
+	Benchmark(const char* commandLine);
+
+	bool IsEnabled() { return enabled; }
+	bool IsOffscreen() { return offscreen; }
+	unsigned int GetSeed() { return seed; }
+	const BenchmarkPreset& GetPreset() { return preset; }
+
+	// Fixed time step for the simulation
+	float GetFrameStep() { return 1.0f / 60.0f; }
+
+	// Where the camera is on a given frame of the flythrough
+	void GetCameraPose(int frame, DirectX::XMFLOAT3* position, DirectX::XMFLOAT3* pitchYawRoll);
+
+	// Records the frame that just finished.  GPU timings are reset once
+	// warm up is over, so their totals only cover the recorded frames
+	void RecordFrame(float frameMs, unsigned int drawCalls, unsigned int stateChanges, GPUProfiler* gpuProfiler);
+	bool IsFinished() { return (int)frames.size() >= frameCount; }
+	int GetFrameIndex() { return frameIndex; }
+
+	// Writes the per-frame CSV and the summary JSON
+	bool WriteResults(GPUProfiler* gpuProfiler);
+
+private:
+	struct FrameRecord
+	{
+		float Ms;
+		unsigned int DrawCalls;
+		unsigned int StateChanges;
+	};
+
+	bool enabled;
+	bool offscreen;
+	unsigned int seed;
+	int frameCount;
+	int warmupFrames;
+	std::string outputPath;
+	BenchmarkPreset preset;
+
+	int frameIndex;
+	std::vector<FrameRecord> frames;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include "Lights.h"
+
+// --------------------------------------------------------
+// C++ mirrors of constant buffers that are owned by the
+// game rather than by an individual shader.  The layouts
+// here must match the cbuffers declared in the shaders
+// (16-byte packing rules apply).
+// --------------------------------------------------------
+
+// Matches "perFrame" (register b1) in PixelShader.hlsl
+// and PixelShaderPBR.hlsl.  Lights themselves live in a
+// structured buffer, so there's no cap on their count here
+struct PerFrameData
+{
+	DirectX::XMFLOAT3	cameraPosition;
+	int					specIBLTotalMipLevels;	// 16 bytes
+
+	float				clusterDepthScale;
+	float				clusterDepthBias;
+	DirectX::XMFLOAT2	clusterTileSize;		// 32 bytes
+
+	// Cascaded shadows for one directional light (see CascadedShadowMap)
+	DirectX::XMFLOAT4X4	shadowMatrices[MAX_SHADOW_CASCADES];	// World to shadow map uv and depth
+	DirectX::XMFLOAT4	shadowSplits;			// View depth where each cascade ends
+	DirectX::XMFLOAT4	shadowNormalOffsets;	// About a texel of each cascade, in world units
+	int					shadowLightIndex;		// -1 when nothing casts shadows
+	int					shadowCascadeCount;
+	float				shadowTexelSize;		// One texel, in uv units
+	float				shadowPadding;
+};
+
+static_assert(sizeof(PerFrameData) % 16 == 0, "Constant buffer structs must be a multiple of 16 bytes");
@@ -0,0 +1,226 @@
+#include "CPUProfiler.h"
+
+#include <Windows.h>
+#include <mutex>
+#include <stdio.h>
+
+std::atomic<bool> CPUProfiler::enabled(true);
+
+// Each thread's ring.  Only the owning thread writes to it, and Head
+// counts every event it has ever written
+struct ThreadBuffer
+{
+	std::string Name;
+	unsigned int Index;
+	unsigned int Depth;
+	std::atomic<unsigned long long> Head;
+	CPUProfileEvent Events[CPUProfiler::EventsPerThread];
+};
+
+// Buffers are registered once per thread and never freed, since
+// their events can be read after the thread is gone
+static std::mutex threadsMutex;
+static std::vector<ThreadBuffer*> threads;
+static thread_local ThreadBuffer* threadBuffer = 0;
+
+// Frame boundaries and trace capture belong to the main thread
+static long long lastFrameStart = 0;
+static long long lastFrameEnd = 0;
+static unsigned int captureFramesLeft = 0;
+static std::wstring capturePath;
+static std::vector<CPUProfileEvent> captureEvents;
+
+static ThreadBuffer* GetThreadBuffer()
+{
+	if (!threadBuffer)
+	{
+		threadBuffer = new ThreadBuffer();
+		threadBuffer->Depth = 0;
+		threadBuffer->Head = 0;
+
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		threadBuffer->Index = (unsigned int)threads.size();
+		threadBuffer->Name = "Thread " + std::to_string(threadBuffer->Index);
+		threads.push_back(threadBuffer);
+	}
+	return threadBuffer;
+}
+
+static long long Now()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+void CPUProfiler::SetThreadName(const char* name)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(threadsMutex);
+	buffer->Name = name;
+}
+
+long long CPUProfiler::BeginScope()
+{
+	GetThreadBuffer()->Depth++;
+	return Now();
+}
+
+void CPUProfiler::EndScope(const char* name, long long start)
+{
+	long long end = Now();
+	ThreadBuffer* buffer = GetThreadBuffer();
+	buffer->Depth--;
+
+	// Fill the slot, then publish it
+	unsigned long long head = buffer->Head.load(std::memory_order_relaxed);
+	CPUProfileEvent& e = buffer->Events[head % EventsPerThread];
+	e.Name = name;
+	e.Start = start;
+	e.End = end;
+	e.Depth = buffer->Depth;
+	e.Thread = buffer->Index;
+	buffer->Head.store(head + 1, std::memory_order_release);
+}
+
+void CPUProfiler::MarkFrame()
+{
+	// The first call only starts the first frame
+	long long now = Now();
+	if (lastFrameEnd == 0)
+	{
+		lastFrameEnd = now;
+		return;
+	}
+
+	lastFrameStart = lastFrameEnd;
+	lastFrameEnd = now;
+
+	if (captureFramesLeft > 0)
+	{
+		CopyEvents(lastFrameStart, lastFrameEnd, captureEvents);
+		if (--captureFramesLeft == 0)
+		{
+			WriteTrace();
+			captureEvents.clear();
+		}
+	}
+}
+
+void CPUProfiler::GetLastFrame(std::vector<CPUProfileEvent>& events, long long* start, long long* end)
+{
+	events.clear();
+	CopyEvents(lastFrameStart, lastFrameEnd, events);
+	*start = lastFrameStart;
+	*end = lastFrameEnd;
+}
+
+// Events that ended in (start, end].  Each thread's events are in the
+// order they ended, so this walks back from the newest.  Only the newer
+// half of the ring is read, since the owner may be overwriting the oldest
+void CPUProfiler::CopyEvents(long long start, long long end, std::vector<CPUProfileEvent>& events)
+{
+	std::vector<ThreadBuffer*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		buffers = threads;
+	}
+
+	for (ThreadBuffer* buffer : buffers)
+	{
+		unsigned long long head = buffer->Head.load(std::memory_order_acquire);
+		unsigned long long oldest = head > EventsPerThread / 2 ? head - EventsPerThread / 2 : 0;
+		for (unsigned long long i = head; i > oldest; i--)
+		{
+			const CPUProfileEvent& e = buffer->Events[(i - 1) % EventsPerThread];
+			if (e.End <= start)
+				break;
+			if (e.End <= end)
+				events.push_back(e);
+		}
+	}
+}
+
+unsigned int CPUProfiler::GetThreadCount()
+{
+	std::lock_guard<std::mutex> lock(threadsMutex);
+	return (unsigned int)threads.size();
+}
+
+std::string CPUProfiler::GetThreadName(unsigned int thread)
+{
+	std::lock_guard<std::mutex> lock(threadsMutex);
+	return thread < threads.size() ? threads[thread]->Name : std::string();
+}
+
+double CPUProfiler::GetTicksPerMs()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart / 1000.0;
+}
+
+void CPUProfiler::CaptureTrace(unsigned int frameCount, const std::wstring& path)
+{
+	captureEvents.clear();
+	capturePath = path;
+	captureFramesLeft = frameCount;
+}
+
+bool CPUProfiler::IsCapturing()
+{
+	return captureFramesLeft > 0;
+}
+
+// Names are plain identifiers, but quotes and backslashes still
+// need escaping
+static void WriteJSONString(FILE* out, const std::string& text)
+{
+	fputc('"', out);
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			fputc('\\', out);
+		fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+// Complete ("X") events in microseconds, plus a name for each thread
+bool CPUProfiler::WriteTrace()
+{
+	FILE* out = 0;
+	if (_wfopen_s(&out, capturePath.c_str(), L"wb") != 0 || !out)
+		return false;
+
+	double ticksPerUs = GetTicksPerMs() / 1000.0;
+	long long origin = captureEvents.empty() ? 0 : captureEvents[0].Start;
+	for (auto& e : captureEvents)
+		origin = min(origin, e.Start);
+
+	fprintf(out, "{\"traceEvents\":[");
+	const char* separator = "\n";
+	unsigned int threadCount = GetThreadCount();
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":", separator, i);
+		WriteJSONString(out, GetThreadName(i));
+		fprintf(out, "}}");
+		separator = ",\n";
+	}
+
+	for (auto& e : captureEvents)
+	{
+		fprintf(out, "%s{\"name\":", separator);
+		WriteJSONString(out, e.Name);
+		fprintf(out, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			e.Thread,
+			(e.Start - origin) / ticksPerUs,
+			(e.End - e.Start) / ticksPerUs);
+		separator = ",\n";
+	}
+
+	fprintf(out, "\n]}\n");
+	fclose(out);
+	return true;
+}
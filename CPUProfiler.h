@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Set to 0 to compile every PROFILE_SCOPE() out entirely
+#ifndef CPU_PROFILER_ENABLED
+#define CPU_PROFILER_ENABLED 1
+#endif
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope.  The name must be a string
+// literal (or otherwise outlive the profiler), since only the pointer
+// is recorded
+#if CPU_PROFILER_ENABLED
+#define PROFILE_SCOPE(name) CPUProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+// One finished scope, with times in performance counter ticks
+struct CPUProfileEvent
+{
+	const char* Name;
+	long long Start;
+	long long End;
+	unsigned int Depth;
+	unsigned int Thread;
+};
+
+// --------------------------------------------------------
+// Records timed scopes from any thread.
+//
+// Each thread writes its scopes into a ring buffer of its
+// own as they end, publishing them with an atomic index, so
+// recording never takes a lock.  Readers copy out the most
+// recent events, keeping clear of the part of the ring the
+// thread may be overwriting.  When disabled, a scope costs
+// a single relaxed load.
+//
+// The main thread marks frame boundaries, and a scope
+// belongs to the frame it ended in.
+// --------------------------------------------------------
+class CPUProfiler
+{
+public:
+	static const unsigned int EventsPerThread = 8192;
+
+	static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+	static void SetEnabled(bool enable) { enabled = enable; }
+
+	// Shows up in the timeline and in traces
+	static void SetThreadName(const char* name);
+
+	// Ends one frame and starts the next.  Call once per frame
+	static void MarkFrame();
+
+	// The most recently finished frame's events, and its bounds
+	static void GetLastFrame(std::vector<CPUProfileEvent>& events, long long* start, long long* end);
+	static unsigned int GetThreadCount();
+	static std::string GetThreadName(unsigned int thread);
+	static double GetTicksPerMs();
+
+	// Saves the next frameCount frames as trace event JSON, which
+	// chrome://tracing and similar tools can open
+	static void CaptureTrace(unsigned int frameCount, const std::wstring& path);
+	static bool IsCapturing();
+
+	// Used by CPUProfileScope
+	static long long BeginScope();
+	static void EndScope(const char* name, long long start);
+
+private:
+	static std::atomic<bool> enabled;
+
+	static void CopyEvents(long long start, long long end, std::vector<CPUProfileEvent>& events);
+	static bool WriteTrace();
+};
+
+// --------------------------------------------------------
+// Times everything until it goes out of scope (see
+// PROFILE_SCOPE())
+// --------------------------------------------------------
+class CPUProfileScope
+{
+public:
+	CPUProfileScope(const char* name) : name(CPUProfiler::IsEnabled() ? name : 0), start(0)
+	{
+		if (this->name) start = CPUProfiler::BeginScope();
+	}
+	~CPUProfileScope()
+	{
+		if (name) CPUProfiler::EndScope(name, start);
+	}
+
+	CPUProfileScope(const CPUProfileScope&) = delete;
+	CPUProfileScope& operator=(const CPUProfileScope&) = delete;
+
+private:
+	const char* name;
+	long long start;
+};
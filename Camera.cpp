@@ -10,6 +10,10 @@ Camera::Camera(float x, float y, float z, float moveSpeed, float mouseLookSpeed,
 	this->mouseLookSpeed = mouseLookSpeed;
 	transform.SetPosition(x, y, z);
 
+	// Both matrices feed the frustum, so start from something valid
+	XMStoreFloat4x4(&viewMatrix, XMMatrixIdentity());
+	XMStoreFloat4x4(&projMatrix, XMMatrixIdentity());
+
 	UpdateViewMatrix();
 	UpdateProjectionMatrix(aspectRatio);
 }
@@ -69,17 +73,32 @@ void Camera::UpdateViewMatrix()
 		XMVectorSet(0, 1, 0, 0));
 
 	XMStoreFloat4x4(&viewMatrix, view);
+	UpdateFrustum();
 }
 
 // Updates the projection matrix
 void Camera::UpdateProjectionMatrix(float aspectRatio)
 {
+	this->aspectRatio = aspectRatio;
+
 	XMMATRIX P = XMMatrixPerspectiveFovLH(
-		0.25f * XM_PI,		// Field of View Angle
+		fieldOfView,		// Field of View Angle
 		aspectRatio,		// Aspect ratio
-		0.01f,				// Near clip plane distance
-		100.0f);			// Far clip plane distance
+		nearClip,			// Near clip plane distance
+		farClip);			// Far clip plane distance
 	XMStoreFloat4x4(&projMatrix, P);
+	UpdateFrustum();
+}
+
+// Rebuilds the world space frustum from the current view and projection
+void Camera::UpdateFrustum()
+{
+	XMMATRIX view = XMLoadFloat4x4(&viewMatrix);
+	XMMATRIX proj = XMLoadFloat4x4(&projMatrix);
+
+	BoundingFrustum viewSpaceFrustum;
+	BoundingFrustum::CreateFromMatrix(viewSpaceFrustum, proj);
+	viewSpaceFrustum.Transform(frustum, XMMatrixInverse(0, view));
 }
 
 Transform* Camera::GetTransform()
@@ -1,5 +1,6 @@
 #pragma once
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include <Windows.h>
 
 #include "Transform.h"
@@ -18,6 +19,13 @@ public:
 	// Getters
 	DirectX::XMFLOAT4X4 GetView() { return viewMatrix; }
 	DirectX::XMFLOAT4X4 GetProjection() { return projMatrix; }
+	float GetFieldOfView() { return fieldOfView; }
+	float GetAspectRatio() { return aspectRatio; }
+	float GetNearClip() { return nearClip; }
+	float GetFarClip() { return farClip; }
+
+	// World space view frustum, kept up to date with the view and projection
+	DirectX::BoundingFrustum GetFrustum() { return frustum; }
 
 	Transform* GetTransform();
 
@@ -25,9 +33,17 @@ private:
 	// Camera matrices
 	DirectX::XMFLOAT4X4 viewMatrix;
 	DirectX::XMFLOAT4X4 projMatrix;
+	DirectX::BoundingFrustum frustum;
+	void UpdateFrustum();
 
 	Transform transform;
 
+	// Projection parameters
+	float fieldOfView = 0.25f * DirectX::XM_PI;
+	float aspectRatio = 1.0f;
+	float nearClip = 0.01f;
+	float farClip = 100.0f;
+
 	float movementSpeed;
 	float mouseLookSpeed;
 };
@@ -0,0 +1,227 @@
+#include "CascadedShadowMap.h"
+
+using namespace DirectX;
+
+// How much of each split is logarithmic rather than even
+#define SHADOW_SPLIT_LAMBDA 0.8f
+
+// Cached cascades are fit around a sphere this much bigger than their
+// slice, which is how far the camera can move before they're redrawn
+#define SHADOW_CACHE_PADDING 1.5f
+
+CascadedShadowMap::CascadedShadowMap(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<RenderStateCache> renderStates,
+	unsigned int resolution,
+	unsigned int cascadeCount)
+	:
+	context(context),
+	cascadeCount(max(1u, min(cascadeCount, (unsigned int)MAX_SHADOW_CASCADES))),
+	resolution(resolution),
+	firstCachedCascade(2),
+	shadowDistance(60.0f),
+	casterDistance(50.0f),
+	renderedCascadeCount(0),
+	cachedLightDirection(0, 0, 0)
+{
+	// One slice per cascade, drawn as depth and read as a texture
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = resolution;
+	texDesc.Height = resolution;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = this->cascadeCount;
+	texDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	device->CreateTexture2D(&texDesc, 0, texture.GetAddressOf());
+
+	for (unsigned int i = 0; i < this->cascadeCount; i++)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		dsvDesc.Texture2DArray.FirstArraySlice = i;
+		dsvDesc.Texture2DArray.ArraySize = 1;
+		device->CreateDepthStencilView(texture.Get(), &dsvDesc, cascades[i].DSV.GetAddressOf());
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.ArraySize = this->cascadeCount;
+	device->CreateShaderResourceView(texture.Get(), &srvDesc, srv.GetAddressOf());
+
+	// Hardware filtered comparisons, with everything outside the map lit
+	D3D11_SAMPLER_DESC sampDesc = {};
+	sampDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_BORDER;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
+	sampDesc.BorderColor[0] = 1.0f;
+	sampDesc.BorderColor[1] = 1.0f;
+	sampDesc.BorderColor[2] = 1.0f;
+	sampDesc.BorderColor[3] = 1.0f;
+	sampDesc.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL;
+	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	comparisonSampler = renderStates->GetSamplerState(sampDesc);
+
+	// Biased depth, and no depth clipping so casters between the light
+	// and the near plane still land (flattened) on the map
+	D3D11_RASTERIZER_DESC rastDesc = {};
+	rastDesc.FillMode = D3D11_FILL_SOLID;
+	rastDesc.CullMode = D3D11_CULL_BACK;
+	rastDesc.DepthBias = 1000;
+	rastDesc.SlopeScaledDepthBias = 2.0f;
+	rastDesc.DepthClipEnable = false;
+	rasterizerState = renderStates->GetRasterizerState(rastDesc);
+}
+
+void CascadedShadowMap::Update(
+	std::shared_ptr<Camera> camera,
+	XMFLOAT3 lightDirection,
+	const std::vector<BoundingBox>& changedBounds,
+	bool everythingChanged)
+{
+	renderedCascadeCount = 0;
+	XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&lightDirection));
+
+	// A turned light makes every cached cascade stale
+	float turn = XMVectorGetX(XMVector3Dot(dir, XMLoadFloat3(&cachedLightDirection)));
+	if (turn < 0.99999f || everythingChanged)
+	{
+		Invalidate();
+		XMStoreFloat3(&cachedLightDirection, dir);
+	}
+
+	// Otherwise only changes inside what a cached cascade drew matter to it
+	for (unsigned int i = firstCachedCascade; i < cascadeCount; i++)
+	{
+		Cascade& cascade = cascades[i];
+		for (size_t b = 0; cascade.Valid && b < changedBounds.size(); b++)
+		{
+			if (cascade.CasterBounds.Intersects(changedBounds[b]))
+				cascade.Valid = false;
+		}
+	}
+
+	float nearClip = camera->GetNearClip();
+	float farClip = min(shadowDistance, camera->GetFarClip());
+	float tanY = tanf(camera->GetFieldOfView() * 0.5f);
+	float tanX = tanY * camera->GetAspectRatio();
+	float cornerSlope = tanX * tanX + tanY * tanY;
+
+	XMFLOAT4X4 view = camera->GetView();
+	XMMATRIX invView = XMMatrixInverse(0, XMLoadFloat4x4(&view));
+
+	float splitNear = nearClip;
+	for (unsigned int i = 0; i < cascadeCount; i++)
+	{
+		// Split distances blend even and logarithmic spacing, which keeps
+		// the near cascades small without the far ones getting huge
+		float t = (i + 1) / (float)cascadeCount;
+		float logSplit = nearClip * powf(farClip / nearClip, t);
+		float evenSplit = nearClip + (farClip - nearClip) * t;
+		float splitFar = evenSplit + (logSplit - evenSplit) * SHADOW_SPLIT_LAMBDA;
+
+		// Smallest sphere around the slice.  Its center is on the view
+		// axis, so it doesn't move as the camera turns, and its radius
+		// only depends on the projection
+		float centerZ = min((splitNear + splitFar) * (1.0f + cornerSlope) * 0.5f, splitFar);
+		float radius = sqrtf((splitFar - centerZ) * (splitFar - centerZ) + splitFar * splitFar * cornerSlope);
+		XMFLOAT3 center;
+		XMStoreFloat3(&center, XMVector3TransformCoord(XMVectorSet(0, 0, centerZ, 1), invView));
+
+		// Rounded up a little, so float error can't change its size
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		Cascade& cascade = cascades[i];
+		cascade.SplitFar = splitFar;
+		if (i < firstCachedCascade)
+		{
+			PlaceCascade(cascade, center, radius, dir);
+			cascade.NeedsRender = true;
+		}
+		else
+		{
+			// Cached cascades stay put as long as the slice is still inside
+			float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&center) - XMLoadFloat3(&cascade.Center)));
+			cascade.NeedsRender = !cascade.Valid || distance + radius > cascade.Radius;
+			if (cascade.NeedsRender)
+				PlaceCascade(cascade, center, ceilf(radius * SHADOW_CACHE_PADDING), dir);
+		}
+
+		cascade.Valid = true;
+		if (cascade.NeedsRender)
+			renderedCascadeCount++;
+		splitNear = splitFar;
+	}
+}
+
+// Fits a cascade's view and projection around a sphere
+void CascadedShadowMap::PlaceCascade(Cascade& cascade, XMFLOAT3 center, float radius, FXMVECTOR lightDirection)
+{
+	// The light always looks down its direction from the same up vector,
+	// so every frame snaps to the same grid of texels
+	XMVECTOR up = fabsf(XMVectorGetY(lightDirection)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+	XMMATRIX lightRotation = XMMatrixLookToLH(XMVectorZero(), lightDirection, up);
+	XMMATRIX invLightRotation = XMMatrixTranspose(lightRotation);
+
+	// Snap the center to whole texels, in the light's space
+	XMVECTOR texelSize = XMVectorReplicate(radius * 2.0f / resolution);
+	XMVECTOR lightCenter = XMVector3TransformCoord(XMLoadFloat3(&center), lightRotation);
+	lightCenter = XMVectorMultiply(XMVectorFloor(XMVectorDivide(lightCenter, texelSize)), texelSize);
+	XMVECTOR snappedCenter = XMVector3TransformCoord(lightCenter, invLightRotation);
+
+	// Back up toward the light, so casters outside the sphere are drawn too
+	float depthRange = radius * 2.0f + casterDistance;
+	XMVECTOR eye = snappedCenter - lightDirection * (radius + casterDistance);
+	XMMATRIX viewMat = XMMatrixLookToLH(eye, lightDirection, up);
+	XMMATRIX projMat = XMMatrixOrthographicLH(radius * 2.0f, radius * 2.0f, 0.0f, depthRange);
+
+	// Shadow map lookups want 0-1 uvs, with v pointing down
+	XMMATRIX toUV = XMMatrixScaling(0.5f, -0.5f, 1.0f) * XMMatrixTranslation(0.5f, 0.5f, 0.0f);
+
+	XMStoreFloat3(&cascade.Center, snappedCenter);
+	cascade.Radius = radius;
+	XMStoreFloat4x4(&cascade.View, viewMat);
+	XMStoreFloat4x4(&cascade.Projection, projMat);
+	XMStoreFloat4x4(&cascade.ShadowMatrix, viewMat * projMat * toUV);
+	XMStoreFloat3(&cascade.LightPosition, eye);
+	cascade.DepthRange = depthRange;
+
+	// Everything the projection covers, for finding casters
+	XMStoreFloat3(&cascade.CasterBounds.Center, snappedCenter - lightDirection * (casterDistance * 0.5f));
+	cascade.CasterBounds.Extents = XMFLOAT3(radius, radius, radius + casterDistance * 0.5f);
+	XMStoreFloat4(&cascade.CasterBounds.Orientation, XMQuaternionRotationMatrix(invLightRotation));
+}
+
+// Binds and clears one cascade's slice for depth drawing
+void CascadedShadowMap::BeginCascade(unsigned int cascade)
+{
+	ID3D11DepthStencilView* dsv = cascades[cascade].DSV.Get();
+	context->OMSetRenderTargets(0, 0, dsv);
+	context->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)resolution;
+	viewport.Height = (float)resolution;
+	viewport.MaxDepth = 1.0f;
+	context->RSSetViewports(1, &viewport);
+}
+
+// Unbinds the map so it can be read
+void CascadedShadowMap::End()
+{
+	context->OMSetRenderTargets(0, 0, 0);
+}
+
+void CascadedShadowMap::Invalidate()
+{
+	for (auto& c : cascades)
+		c.Valid = false;
+}
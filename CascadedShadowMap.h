@@ -0,0 +1,132 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <memory>
+#include <vector>
+
+#include "Camera.h"
+#include "Lights.h"
+#include "RenderStateCache.h"
+
+// --------------------------------------------------------
+// Cascaded shadow maps for one directional light
+//
+// The camera's view frustum, out to the shadow distance, is
+// split into slices, and each slice gets an orthographic
+// shadow map fit around its bounding sphere.  All of the
+// cascades live in the slices of a single Texture2DArray.
+//
+// Each cascade's size depends only on the camera's projection,
+// and its position is snapped to whole shadow map texels, so
+// the shadows don't shimmer as the camera moves or turns.
+//
+// Far cascades are cached: they're fit around a sphere with
+// room to spare, and only redrawn once the camera leaves that
+// room, the light turns, or something changes inside them.
+// Entities moving near the camera leave them alone.
+// --------------------------------------------------------
+class CascadedShadowMap
+{
+public:
+	CascadedShadowMap(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<RenderStateCache> renderStates,
+		unsigned int resolution = 2048,
+		unsigned int cascadeCount = MAX_SHADOW_CASCADES);
+
+	// Places the cascades for this frame, and decides which of them need
+	// redrawing.  changedBounds are where casters were added, removed or
+	// moved since the last call (see SceneBVH::GetChangedBounds), and only
+	// the cached cascades they touch are redrawn
+	void Update(
+		std::shared_ptr<Camera> camera,
+		DirectX::XMFLOAT3 lightDirection,
+		const std::vector<DirectX::BoundingBox>& changedBounds,
+		bool everythingChanged);
+
+	// Drawing a cascade that needs it: begin, draw every caster in its
+	// bounds (depth only, with GetRasterizerState()), and once every
+	// cascade is done, end.  The caller has to put back its own render
+	// target and viewport
+	bool NeedsRender(unsigned int cascade) { return cascades[cascade].NeedsRender; }
+	void BeginCascade(unsigned int cascade);
+	void End();
+
+	// Per cascade, for drawing its depth
+	DirectX::XMFLOAT4X4 GetView(unsigned int cascade) { return cascades[cascade].View; }
+	DirectX::XMFLOAT4X4 GetProjection(unsigned int cascade) { return cascades[cascade].Projection; }
+	DirectX::XMFLOAT3 GetLightPosition(unsigned int cascade) { return cascades[cascade].LightPosition; }
+	float GetDepthRange(unsigned int cascade) { return cascades[cascade].DepthRange; }
+	DirectX::BoundingOrientedBox GetCasterBounds(unsigned int cascade) { return cascades[cascade].CasterBounds; }
+
+	// Per cascade, for the lit pixel shaders (see Shadows.hlsli)
+	DirectX::XMFLOAT4X4 GetShadowMatrix(unsigned int cascade) { return cascades[cascade].ShadowMatrix; }
+	float GetSplitDistance(unsigned int cascade) { return cascades[cascade].SplitFar; }
+	float GetTexelWorldSize(unsigned int cascade) { return cascades[cascade].Radius * 2.0f / resolution; }
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV() { return srv; }
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> GetSampler() { return comparisonSampler; }
+
+	// Biased, unclipped depth for drawing casters (see RenderQueue::SetRenderStates)
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> GetRasterizerState() { return rasterizerState; }
+	unsigned int GetCascadeCount() { return cascadeCount; }
+	unsigned int GetResolution() { return resolution; }
+
+	// Cascades from this one on are cached rather than redrawn every frame
+	void SetFirstCachedCascade(unsigned int cascade) { firstCachedCascade = cascade; }
+	unsigned int GetFirstCachedCascade() { return firstCachedCascade; }
+
+	// How far out shadows reach, and how far toward the light (past each
+	// cascade) casters are still drawn from
+	void SetShadowDistance(float distance) { shadowDistance = distance; }
+	void SetCasterDistance(float distance) { casterDistance = distance; }
+	float GetShadowDistance() { return shadowDistance; }
+
+	// Drops every cached cascade, so they're all redrawn next Update()
+	void Invalidate();
+
+	// Cascades drawn in the most recent Update()
+	unsigned int GetRenderedCascadeCount() { return renderedCascadeCount; }
+
+private:
+	struct Cascade
+	{
+		// Where the cascade sits, in world space
+		DirectX::XMFLOAT3 Center;
+		float Radius;
+		float SplitFar;
+
+		DirectX::XMFLOAT4X4 View;
+		DirectX::XMFLOAT4X4 Projection;
+		DirectX::XMFLOAT4X4 ShadowMatrix;
+		DirectX::XMFLOAT3 LightPosition;
+		float DepthRange;
+		DirectX::BoundingOrientedBox CasterBounds;
+
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilView> DSV;
+		bool Valid = false;
+		bool NeedsRender = false;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> comparisonSampler;
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizerState;
+
+	Cascade cascades[MAX_SHADOW_CASCADES];
+	unsigned int cascadeCount;
+	unsigned int resolution;
+	unsigned int firstCachedCascade;
+	float shadowDistance;
+	float casterDistance;
+	unsigned int renderedCascadeCount;
+
+	// What the cached cascades were drawn with
+	DirectX::XMFLOAT3 cachedLightDirection;
+
+	void PlaceCascade(Cascade& cascade, DirectX::XMFLOAT3 center, float radius, DirectX::FXMVECTOR lightDirection);
+};
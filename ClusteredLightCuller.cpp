@@ -0,0 +1,93 @@
+#include "ClusteredLightCuller.h"
+
+using namespace DirectX;
+
+ClusteredLightCuller::ClusteredLightCuller(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<SimpleComputeShader> cullingCS)
+	:
+	context(context),
+	cullingCS(cullingCS),
+	depthScale(0),
+	depthBias(0),
+	tileSize(1, 1)
+{
+	// The grid holds a uint2 per cluster, and each cluster gets
+	// a fixed size section of the index list
+	CreateStructuredBuffer(device, sizeof(unsigned int) * 2, CLUSTER_COUNT, gridSRV, gridUAV);
+	CreateStructuredBuffer(device, sizeof(unsigned int), CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER, indexSRV, indexUAV);
+}
+
+// Runs the culling pass over the given lights
+void ClusteredLightCuller::Cull(
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightSRV,
+	int lightCount,
+	std::shared_ptr<Camera> camera,
+	unsigned int screenWidth,
+	unsigned int screenHeight)
+{
+	float nearClip = camera->GetNearClip();
+	float farClip = camera->GetFarClip();
+	XMFLOAT4X4 proj = camera->GetProjection();
+
+	// Mapping used by the pixel shaders:
+	//  slice = log(depth) * scale + bias
+	float logDepthRange = logf(farClip / nearClip);
+	depthScale = CLUSTER_GRID_Z / logDepthRange;
+	depthBias = -CLUSTER_GRID_Z * logf(nearClip) / logDepthRange;
+	tileSize = XMFLOAT2((float)screenWidth / CLUSTER_GRID_X, (float)screenHeight / CLUSTER_GRID_Y);
+
+	// Set up and run the culling pass
+	cullingCS->SetShader();
+	cullingCS->SetMatrix4x4("view", camera->GetView());
+	cullingCS->SetFloat2("projScale", XMFLOAT2(proj._11, proj._22));
+	cullingCS->SetFloat("nearClip", nearClip);
+	cullingCS->SetFloat("farClip", farClip);
+	cullingCS->SetInt("lightCount", lightCount);
+	cullingCS->CopyAllBufferData();
+
+	cullingCS->SetShaderResourceView("Lights", lightSRV);
+	cullingCS->SetUnorderedAccessView("ClusterLightGrid", gridUAV);
+	cullingCS->SetUnorderedAccessView("ClusterLightIndices", indexUAV);
+
+	cullingCS->DispatchByThreads(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z);
+
+	// Unbind the outputs so they can be read by the pixel shaders
+	cullingCS->SetUnorderedAccessView("ClusterLightGrid", nullptr);
+	cullingCS->SetUnorderedAccessView("ClusterLightIndices", nullptr);
+}
+
+// Helper for creating a structured buffer readable by pixel
+// shaders and writable by the culling pass
+void ClusteredLightCuller::CreateStructuredBuffer(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	unsigned int stride,
+	unsigned int count,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv,
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>& uav)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = stride * count;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = stride;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = count;
+	device->CreateShaderResourceView(buffer.Get(), &srvDesc, srv.GetAddressOf());
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = count;
+	device->CreateUnorderedAccessView(buffer.Get(), &uavDesc, uav.GetAddressOf());
+}
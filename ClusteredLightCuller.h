@@ -0,0 +1,74 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <memory>
+
+#include "SimpleShader.h"
+#include "Camera.h"
+
+// Cluster grid dimensions - must match ClusteredLighting.hlsli
+#define CLUSTER_GRID_X				16
+#define CLUSTER_GRID_Y				9
+#define CLUSTER_GRID_Z				24
+#define MAX_LIGHTS_PER_CLUSTER		256
+#define CLUSTER_COUNT				(CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
+// --------------------------------------------------------
+// Clustered (Forward+) light culling
+//
+// Splits the view frustum into a grid of clusters (screen
+// tiles by exponential depth slices) and runs a compute pass
+// that builds the list of lights touching each cluster.  Lit
+// pixel shaders then find their cluster and only iterate over
+// that cluster's lights.
+// --------------------------------------------------------
+class ClusteredLightCuller
+{
+public:
+	ClusteredLightCuller(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<SimpleComputeShader> cullingCS);
+
+	// Builds the per-cluster light lists for this frame
+	void Cull(
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightSRV,
+		int lightCount,
+		std::shared_ptr<Camera> camera,
+		unsigned int screenWidth,
+		unsigned int screenHeight);
+
+	// Results, for binding to the lit pixel shaders
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetClusterLightGridSRV() { return gridSRV; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetClusterLightIndicesSRV() { return indexSRV; }
+
+	// Values the pixel shaders need to find their cluster
+	float GetDepthScale() { return depthScale; }
+	float GetDepthBias() { return depthBias; }
+	DirectX::XMFLOAT2 GetTileSize() { return tileSize; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<SimpleComputeShader> cullingCS;
+
+	// Per cluster (offset, count) pairs
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> gridSRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> gridUAV;
+
+	// Light indices for all clusters
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> indexSRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> indexUAV;
+
+	float depthScale;
+	float depthBias;
+	DirectX::XMFLOAT2 tileSize;
+
+	void CreateStructuredBuffer(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		unsigned int stride,
+		unsigned int count,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv,
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>& uav);
+};
@@ -0,0 +1,37 @@
+// Include guard
+#ifndef _CLUSTERED_LIGHTING_HLSL
+#define _CLUSTERED_LIGHTING_HLSL
+
+// Cluster grid dimensions - must match ClusteredLightCuller.h
+// - X and Y split the screen into tiles
+// - Z splits view depth into exponentially larger slices
+#define CLUSTER_GRID_X				16
+#define CLUSTER_GRID_Y				9
+#define CLUSTER_GRID_Z				24
+#define MAX_LIGHTS_PER_CLUSTER		256
+
+// Thread group size for the culling pass
+#define CLUSTER_THREADS_X			4
+#define CLUSTER_THREADS_Y			4
+#define CLUSTER_THREADS_Z			4
+
+// Flattens a 3D cluster coordinate into an index
+uint ClusterIndex(uint3 cluster)
+{
+	return cluster.x + cluster.y * CLUSTER_GRID_X + cluster.z * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+}
+
+// Finds the cluster a pixel belongs to
+// - pixelPos is SV_POSITION.xy
+// - viewDepth is the view space depth of the pixel (SV_POSITION.w)
+// - depthScale and depthBias map log(depth) to a slice
+uint GetClusterIndex(float2 pixelPos, float viewDepth, float2 tileSize, float depthScale, float depthBias)
+{
+	uint3 cluster;
+	cluster.xy = (uint2)(pixelPos / tileSize);
+	cluster.z = (uint)max(log(viewDepth) * depthScale + depthBias, 0.0f);
+	cluster = min(cluster, uint3(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1, CLUSTER_GRID_Z - 1));
+	return ClusterIndex(cluster);
+}
+
+#endif
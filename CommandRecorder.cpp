@@ -0,0 +1,132 @@
+#include "CommandRecorder.h"
+#include "SimpleShader.h"
+
+CommandRecorder::CommandRecorder(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<JobSystem> jobSystem,
+	unsigned int contextCount,
+	unsigned int ringSizeInBytes)
+	:
+	context(context),
+	jobSystem(jobSystem),
+	driverCommandLists(false),
+	state()
+{
+	D3D11_FEATURE_DATA_THREADING threading = {};
+	if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading))))
+		driverCommandLists = threading.DriverCommandLists != 0;
+
+	// One context per job system thread by default.  Slot 0 of
+	// every shader belongs to the immediate context
+	if (contextCount == 0)
+		contextCount = jobSystem->GetThreadCount();
+	contextCount = max(1u, min(contextCount, (unsigned int)SIMPLE_SHADER_MAX_CONTEXTS - 1));
+
+	for (unsigned int i = 0; i < contextCount; i++)
+	{
+		RecordingContext rc;
+		if (FAILED(device->CreateDeferredContext(0, rc.Context.GetAddressOf())))
+			break;
+
+		rc.Ring = std::make_shared<ConstantBufferRing>(device, rc.Context, ringSizeInBytes);
+		contexts.push_back(rc);
+	}
+}
+
+void CommandRecorder::Record(unsigned int chunkCount, const std::function<void(unsigned int chunk, ID3D11DeviceContext* context)>& record)
+{
+	chunkCount = min(chunkCount, (unsigned int)contexts.size());
+	if (chunkCount == 0)
+		return;
+
+	CaptureState();
+
+	// Every chunk but the last is a job, and the last is recorded here
+	JobCounter recorded;
+	for (unsigned int i = 0; i + 1 < chunkCount; i++)
+		jobSystem->Run([this, i, &record]() { RecordChunk(i, record); }, &recorded);
+	RecordChunk(chunkCount - 1, record);
+	jobSystem->Wait(&recorded);
+
+	// Play everything back in order.  Each list leaves the immediate
+	// context with default state, so put back what it had before
+	for (unsigned int i = 0; i < chunkCount; i++)
+	{
+		if (contexts[i].CommandList)
+			context->ExecuteCommandList(contexts[i].CommandList.Get(), FALSE);
+		contexts[i].CommandList.Reset();
+	}
+
+	ApplyState(context.Get());
+	ReleaseState();
+}
+
+// Records one chunk into the context of the same index, on whichever
+// thread runs it
+void CommandRecorder::RecordChunk(unsigned int chunk, const std::function<void(unsigned int, ID3D11DeviceContext*)>& record)
+{
+	RecordingContext& rc = contexts[chunk];
+	rc.Ring->BeginFrame();
+	ApplyState(rc.Context.Get());
+
+	SimpleShaderContextScope scope(chunk + 1, rc.Context.Get(), rc.Ring.get());
+	record(chunk, rc.Context.Get());
+	rc.Context->FinishCommandList(FALSE, rc.CommandList.ReleaseAndGetAddressOf());
+}
+
+// Takes references to the immediate context's current state.  Nothing
+// else touches the immediate context while the chunks record
+void CommandRecorder::CaptureState()
+{
+	context->OMGetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, state.RenderTargets, &state.DepthStencil);
+	state.ViewportCount = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+	context->RSGetViewports(&state.ViewportCount, state.Viewports);
+	context->RSGetState(&state.Rasterizer);
+	context->OMGetDepthStencilState(&state.DepthStencilState, &state.StencilRef);
+	context->OMGetBlendState(&state.Blend, state.BlendFactor, &state.SampleMask);
+	context->IAGetPrimitiveTopology(&state.Topology);
+	context->VSGetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, state.VSResources);
+	context->PSGetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, state.PSResources);
+	context->VSGetSamplers(0, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, state.VSSamplers);
+	context->PSGetSamplers(0, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, state.PSSamplers);
+}
+
+void CommandRecorder::ApplyState(ID3D11DeviceContext* target)
+{
+	target->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, state.RenderTargets, state.DepthStencil);
+	target->RSSetViewports(state.ViewportCount, state.Viewports);
+	target->RSSetState(state.Rasterizer);
+	target->OMSetDepthStencilState(state.DepthStencilState, state.StencilRef);
+	target->OMSetBlendState(state.Blend, state.BlendFactor, state.SampleMask);
+	target->IASetPrimitiveTopology(state.Topology);
+	target->VSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, state.VSResources);
+	target->PSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, state.PSResources);
+	target->VSSetSamplers(0, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, state.VSSamplers);
+	target->PSSetSamplers(0, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, state.PSSamplers);
+}
+
+// The Get*() calls above each added a reference
+template<typename T>
+static void ReleaseAll(T** objects, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (objects[i])
+			objects[i]->Release();
+		objects[i] = 0;
+	}
+}
+
+void CommandRecorder::ReleaseState()
+{
+	ReleaseAll(state.RenderTargets, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT);
+	ReleaseAll(&state.DepthStencil, 1);
+	ReleaseAll(&state.Rasterizer, 1);
+	ReleaseAll(&state.DepthStencilState, 1);
+	ReleaseAll(&state.Blend, 1);
+	ReleaseAll(state.VSResources, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT);
+	ReleaseAll(state.PSResources, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT);
+	ReleaseAll(state.VSSamplers, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT);
+	ReleaseAll(state.PSSamplers, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT);
+}
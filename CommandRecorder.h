@@ -0,0 +1,86 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include "ConstantBufferRing.h"
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// Records draws on several threads at once, each into its
+// own deferred context, and plays the command lists back in
+// order on the immediate context.
+//
+// Work is split into chunks, recorded as jobs, with the
+// calling thread recording the last.  Each chunk's
+// context starts with the immediate context's output,
+// rasterizer and input assembler state, plus the vertex and
+// pixel shader resources and samplers bound at the time, so
+// recording picks up where the immediate context left off.
+// Shaders are redirected to the chunk's context with a
+// SimpleShaderContextScope, and upload their constant data
+// to a ring of the chunk's own.
+// --------------------------------------------------------
+class CommandRecorder
+{
+public:
+	CommandRecorder(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<JobSystem> jobSystem,
+		unsigned int contextCount = 0,
+		unsigned int ringSizeInBytes = 512 * 1024);
+
+	// Records chunkCount chunks (at most GetContextCount()) at once, then
+	// executes them in chunk order.  Returns once they've been executed
+	void Record(unsigned int chunkCount, const std::function<void(unsigned int chunk, ID3D11DeviceContext* context)>& record);
+
+	// Contexts (and so chunks) available
+	unsigned int GetContextCount() { return (unsigned int)contexts.size(); }
+
+	// Whether the driver records command lists itself, rather than
+	// the runtime emulating them (which scales much less)
+	bool HasDriverCommandLists() { return driverCommandLists; }
+
+private:
+	struct RecordingContext
+	{
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> Context;
+		Microsoft::WRL::ComPtr<ID3D11CommandList> CommandList;
+		std::shared_ptr<ConstantBufferRing> Ring;
+	};
+
+	// Immediate context state each chunk starts from
+	struct InheritedState
+	{
+		ID3D11RenderTargetView* RenderTargets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+		ID3D11DepthStencilView* DepthStencil;
+		D3D11_VIEWPORT Viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		UINT ViewportCount;
+		ID3D11RasterizerState* Rasterizer;
+		ID3D11DepthStencilState* DepthStencilState;
+		UINT StencilRef;
+		ID3D11BlendState* Blend;
+		FLOAT BlendFactor[4];
+		UINT SampleMask;
+		D3D11_PRIMITIVE_TOPOLOGY Topology;
+		ID3D11ShaderResourceView* VSResources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+		ID3D11ShaderResourceView* PSResources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+		ID3D11SamplerState* VSSamplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+		ID3D11SamplerState* PSSamplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<JobSystem> jobSystem;
+	std::vector<RecordingContext> contexts;
+	bool driverCommandLists;
+	InheritedState state;
+
+	void CaptureState();
+	void ApplyState(ID3D11DeviceContext* target);
+	void ReleaseState();
+	void RecordChunk(unsigned int chunk, const std::function<void(unsigned int, ID3D11DeviceContext*)>& record);
+};
@@ -0,0 +1,84 @@
+#include "ConstantBufferRing.h"
+
+// Offsets passed to *SetConstantBuffers1() must be multiples of 16 constants
+#define RING_ALIGNMENT 256
+
+ConstantBufferRing::ConstantBufferRing(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int sizeInBytes)
+	:
+	supported(false),
+	capacity(0),
+	offset(0),
+	discardNext(true),
+	frameAllocations(0),
+	frameBytes(0),
+	frameOverflows(0)
+{
+	// Offsets need an 11.1 context, and NO_OVERWRITE on constant
+	// buffers needs driver support on top of that
+	if (FAILED(context.As(&context1)))
+		return;
+
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+		!options.ConstantBufferOffsetting ||
+		!options.MapNoOverwriteOnDynamicConstantBuffer)
+		return;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = (sizeInBytes + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	if (FAILED(device->CreateBuffer(&desc, 0, buffer.GetAddressOf())))
+		return;
+
+	capacity = desc.ByteWidth;
+	supported = true;
+}
+
+// Starts a new frame.  Chunks from the previous frame may still be in
+// use by the GPU, so the next Map() discards rather than overwriting them
+void ConstantBufferRing::BeginFrame()
+{
+	offset = 0;
+	discardNext = true;
+
+	frameAllocations = 0;
+	frameBytes = 0;
+	frameOverflows = 0;
+}
+
+// Copies data into the ring and reports its location in constants
+bool ConstantBufferRing::Allocate(const void* data, unsigned int size, unsigned int* firstConstant, unsigned int* numConstants)
+{
+	if (!supported)
+		return false;
+
+	// Out of room until the next frame
+	unsigned int alignedSize = (size + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+	if (offset + alignedSize > capacity)
+	{
+		frameOverflows++;
+		return false;
+	}
+
+	// Everything already written this frame may be bound for a pending
+	// draw, so only ever write past it
+	D3D11_MAP mapType = discardNext ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context1->Map(buffer.Get(), 0, mapType, 0, &mapped)))
+		return false;
+	discardNext = false;
+
+	memcpy((char*)mapped.pData + offset, data, size);
+	context1->Unmap(buffer.Get(), 0);
+
+	*firstConstant = offset / 16;
+	*numConstants = alignedSize / 16;
+	offset += alignedSize;
+
+	frameAllocations++;
+	frameBytes += alignedSize;
+	return true;
+}
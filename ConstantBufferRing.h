@@ -0,0 +1,59 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+
+// --------------------------------------------------------
+// A large DYNAMIC constant buffer that hands out 256-byte
+// aligned chunks in order over the course of a frame.
+//
+// The first chunk each frame is written with Map(DISCARD),
+// giving us a fresh buffer while the GPU finishes with the
+// last one; every chunk after that uses Map(NO_OVERWRITE),
+// so the driver never copies anything.  Chunks are bound
+// with the D3D11.1 *SetConstantBuffers1() offsets, so shaders
+// can use the ring in place of their own DEFAULT buffers.
+//
+// The ring never wraps mid-frame, since chunks that are
+// still bound must stay valid until the frame ends.  Once
+// it's full, Allocate() fails and callers fall back to
+// their own buffers until the next BeginFrame().
+//
+// Requires D3D11.1 constant buffer offsetting and NO_OVERWRITE
+// on constant buffers - check IsSupported() before use.
+// --------------------------------------------------------
+class ConstantBufferRing
+{
+public:
+	ConstantBufferRing(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int sizeInBytes = 1024 * 1024);
+
+	// Starts handing out chunks from the beginning of a fresh buffer
+	void BeginFrame();
+
+	// Copies data into the next free chunk, reporting where it
+	// landed in shader constants (16 bytes each) for binding
+	bool Allocate(const void* data, unsigned int size, unsigned int* firstConstant, unsigned int* numConstants);
+
+	bool IsSupported() { return supported; }
+	ID3D11Buffer* GetBuffer() { return buffer.Get(); }
+	ID3D11DeviceContext1* GetContext1() { return context1.Get(); }
+
+	// Stats for the current frame
+	unsigned int GetFrameAllocationCount() { return frameAllocations; }
+	unsigned int GetFrameBytesUsed() { return frameBytes; }
+	unsigned int GetFrameOverflowCount() { return frameOverflows; }
+	unsigned int GetCapacity() { return capacity; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	bool supported;
+
+	unsigned int capacity;
+	unsigned int offset;
+	bool discardNext;
+
+	unsigned int frameAllocations;
+	unsigned int frameBytes;
+	unsigned int frameOverflows;
+};
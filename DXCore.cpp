@@ -55,6 +55,22 @@ DXCore::DXCore(
 
 	// Initialize fields
 	this->hasFocus = true; 
+	this->showWindow = true;
+
+	this->vsync = false;
+	this->allowTearing = false;
+	this->waitForSwapChain = true;
+	this->frameRateLimit = 0.0f;
+	this->swapChainFlags = 0;
+	this->frameLatencyWaitable = 0;
+	this->maxFrameLatency = 2;
+	this->tearingSupported = false;
+	this->lastLimiterTime = 0;
+	for (int i = 0; i < LatencyHistoryLength; i++)
+		this->presentStartTimes[i] = 0;
+	this->lastStatsPresentCount = 0;
+	this->framePacingMs = 0.0f;
+	this->presentLatencyMs = 0.0f;
 	
 	this->fpsFrameCount = 0;
 	this->fpsTimeElapsed = 0.0f;
@@ -67,6 +83,9 @@ DXCore::DXCore(
 	__int64 perfFreq = 0;
 	QueryPerformanceFrequency((LARGE_INTEGER*)&perfFreq);
 	perfCounterSeconds = 1.0 / (double)perfFreq;
+
+	// One worker per core, besides this thread
+	jobSystem = std::make_shared<JobSystem>();
 }
 
 // --------------------------------------------------------
@@ -79,6 +98,9 @@ DXCore::~DXCore()
 	// - If we weren't using smart pointers, we'd need
 	//   to call Release() on each DirectX object
 
+	if (frameLatencyWaitable)
+		CloseHandle(frameLatencyWaitable);
+
 	// Delete singletons
 	delete& Input::GetInstance();
 }
@@ -154,7 +176,8 @@ HRESULT DXCore::InitWindow()
 
 	// The window exists but is not visible yet
 	// We need to tell Windows to show it, and how to show it
-	ShowWindow(hWnd, SW_SHOW);
+	if (showWindow)
+		ShowWindow(hWnd, SW_SHOW);
 
 	// Initialize the input manager now that we definitely have a window
 	Input::GetInstance().Initialize(hWnd);
@@ -182,6 +205,21 @@ HRESULT DXCore::InitDirectX()
 	deviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
 #endif
 
+	// Tearing needs both a new enough DXGI and a display that supports it
+	BOOL tearing = FALSE;
+	Microsoft::WRL::ComPtr<IDXGIFactory1> factory;
+	Microsoft::WRL::ComPtr<IDXGIFactory5> factory5;
+	if (SUCCEEDED(CreateDXGIFactory1(IID_PPV_ARGS(factory.GetAddressOf()))) &&
+		SUCCEEDED(factory.As(&factory5)))
+		factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &tearing, sizeof(tearing));
+	tearingSupported = tearing == TRUE;
+
+	// Both flags have to be there from the start, so the
+	// pacing options can be switched at any time
+	swapChainFlags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+	if (tearingSupported)
+		swapChainFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+
 	// Create a description of how our swap
 	// chain should work
 	DXGI_SWAP_CHAIN_DESC swapDesc = {};
@@ -194,7 +232,7 @@ HRESULT DXCore::InitDirectX()
 	swapDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
 	swapDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
 	swapDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	swapDesc.Flags = 0;
+	swapDesc.Flags = swapChainFlags;
 	swapDesc.OutputWindow = hWnd;
 	swapDesc.SampleDesc.Count = 1;
 	swapDesc.SampleDesc.Quality = 0;
@@ -220,6 +258,14 @@ HRESULT DXCore::InitDirectX()
 		context.GetAddressOf());	// Pointer to our Device Context pointer
 	if (FAILED(hr)) return hr;
 
+	// Frame latency is set on the swap chain itself once it's waitable
+	Microsoft::WRL::ComPtr<IDXGISwapChain2> swapChain2;
+	if (SUCCEEDED(swapChain.As(&swapChain2)))
+	{
+		swapChain2->SetMaximumFrameLatency(maxFrameLatency);
+		frameLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
+	}
+
 	// The above function created the back buffer render target
 	// for us, but we need a reference to it
 	ID3D11Texture2D* backBufferTexture = 0;
@@ -246,24 +292,21 @@ HRESULT DXCore::InitDirectX()
 	depthStencilDesc.Height				= height;
 	depthStencilDesc.MipLevels			= 1;
 	depthStencilDesc.ArraySize			= 1;
-	depthStencilDesc.Format				= DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthStencilDesc.Format				= DXGI_FORMAT_R24G8_TYPELESS;
 	depthStencilDesc.Usage				= D3D11_USAGE_DEFAULT;
-	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL;
+	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	depthStencilDesc.CPUAccessFlags		= 0;
 	depthStencilDesc.MiscFlags			= 0;
 	depthStencilDesc.SampleDesc.Count	= 1;
 	depthStencilDesc.SampleDesc.Quality = 0;
 
-	// Create the depth buffer and its view, then 
+	// Create the depth buffer and its views, then 
 	// release our reference to the texture
 	ID3D11Texture2D* depthBufferTexture = 0;
 	device->CreateTexture2D(&depthStencilDesc, 0, &depthBufferTexture);
 	if (depthBufferTexture != 0)
 	{
-		device->CreateDepthStencilView(
-			depthBufferTexture, 
-			0, 
-			depthStencilView.GetAddressOf());
+		CreateDepthViews(depthBufferTexture);
 		depthBufferTexture->Release();
 	}
 
@@ -302,6 +345,7 @@ void DXCore::OnResize()
 	// Release the buffers before resizing the swap chain
 	backBufferRTV.Reset();
 	depthStencilView.Reset();
+	depthStencilSRV.Reset();
 
 	// Resize the underlying swap chain buffers
 	swapChain->ResizeBuffers(
@@ -309,7 +353,7 @@ void DXCore::OnResize()
 		width,
 		height,
 		DXGI_FORMAT_R8G8B8A8_UNORM,
-		0);
+		swapChainFlags);
 
 	// Recreate the render target view for the back buffer
 	// texture, then release our local texture reference
@@ -330,9 +374,9 @@ void DXCore::OnResize()
 	depthStencilDesc.Height				= height;
 	depthStencilDesc.MipLevels			= 1;
 	depthStencilDesc.ArraySize			= 1;
-	depthStencilDesc.Format				= DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthStencilDesc.Format				= DXGI_FORMAT_R24G8_TYPELESS;
 	depthStencilDesc.Usage				= D3D11_USAGE_DEFAULT;
-	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL;
+	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	depthStencilDesc.CPUAccessFlags		= 0;
 	depthStencilDesc.MiscFlags			= 0;
 	depthStencilDesc.SampleDesc.Count	= 1;
@@ -344,10 +388,7 @@ void DXCore::OnResize()
 	device->CreateTexture2D(&depthStencilDesc, 0, &depthBufferTexture);
 	if (depthBufferTexture != 0)
 	{
-		device->CreateDepthStencilView(
-			depthBufferTexture, 
-			0, 
-			depthStencilView.ReleaseAndGetAddressOf()); // ReleaseAndGetAddressOf() cleans up the old object before giving us the pointer
+		CreateDepthViews(depthBufferTexture);
 		depthBufferTexture->Release();
 	}
 
@@ -371,6 +412,31 @@ void DXCore::OnResize()
 }
 
 
+// --------------------------------------------------------
+// Creates the views of the depth buffer.  It's typeless, so
+// it can be both the depth target and read by shaders
+// --------------------------------------------------------
+void DXCore::CreateDepthViews(ID3D11Texture2D* depthBufferTexture)
+{
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(
+		depthBufferTexture,
+		&dsvDesc,
+		depthStencilView.ReleaseAndGetAddressOf()); // ReleaseAndGetAddressOf() cleans up the old object before giving us the pointer
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(
+		depthBufferTexture,
+		&srvDesc,
+		depthStencilSRV.ReleaseAndGetAddressOf());
+}
+
+
 // --------------------------------------------------------
 // This is the main game loop, handling the following:
 //  - OS-level messages coming in from Windows itself
@@ -387,6 +453,7 @@ HRESULT DXCore::Run()
 	previousTime = now;
 
 	// Give subclass a chance to initialize
+	CPUProfiler::SetThreadName("Main");
 	Init();
 
 	// Our overall game and message loop
@@ -396,6 +463,10 @@ HRESULT DXCore::Run()
 		// Determine if there is a message waiting
 		if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
 		{
+			// Messages can resize the swap chain, so
+			// the last frame needs to be out of the way
+			WaitForPresent();
+
 			// Translate and dispatch the message
 			// to our custom WindowProc function
 			TranslateMessage(&msg);
@@ -403,6 +474,11 @@ HRESULT DXCore::Run()
 		}
 		else
 		{
+			// Hold the frame back until the swap chain and
+			// the limiter are ready for it, then start it
+			CPUProfiler::MarkFrame();
+			WaitForNextFrame();
+
 			// Update timer and title bar (if necessary)
 			UpdateTimer();
 			if (titleBarStats)
@@ -411,10 +487,25 @@ HRESULT DXCore::Run()
 			// Update the input manager
 			Input::GetInstance().Update();
 
-			// The game loop
+			// The game loop.  Update overlaps the last frame's
+			// present, and Draw waits for it to finish
 			Update(deltaTime, totalTime);
+			WaitForPresent();
+			UpdatePresentLatency();
 			Draw(deltaTime, totalTime);
 
+			// Remember when the frame started, to match it up
+			// with when it's shown
+			__int64 frameStart = currentTime;
+			jobSystem->Run([this, frameStart]()
+			{
+				Present();
+
+				UINT presentCount = 0;
+				if (SUCCEEDED(swapChain->GetLastPresentCount(&presentCount)))
+					presentStartTimes[presentCount % LatencyHistoryLength] = frameStart;
+			}, &presentCounter);
+
 			// Frame is over, notify the input manager
 			Input::GetInstance().EndOfFrame();
 		}
@@ -422,10 +513,130 @@ HRESULT DXCore::Run()
 
 	// We'll end up here once we get a WM_QUIT message,
 	// which usually comes from the user closing the window
+	WaitForPresent();
 	return (HRESULT)msg.wParam;
 }
 
 
+// --------------------------------------------------------
+// Presents the back buffer to the user
+//  - Puts the final frame we've drawn into the window so the user can see it
+//  - Happens exactly ONCE PER FRAME, after Draw()
+// --------------------------------------------------------
+void DXCore::Present()
+{
+	PROFILE_SCOPE("Present");
+
+	// Tearing is only allowed without vsync
+	UINT syncInterval = vsync ? 1 : 0;
+	UINT presentFlags = !vsync && allowTearing && tearingSupported ? DXGI_PRESENT_ALLOW_TEARING : 0;
+	swapChain->Present(syncInterval, presentFlags);
+
+	// Due to the usage of a more sophisticated swap chain,
+	// the render target must be re-bound after every call to Present()
+	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
+}
+
+
+// --------------------------------------------------------
+// Blocks until the previous frame has been presented, running
+// other jobs in the meantime
+// --------------------------------------------------------
+void DXCore::WaitForPresent()
+{
+	PROFILE_SCOPE("WaitForPresent");
+	jobSystem->Wait(&presentCounter);
+}
+
+
+// --------------------------------------------------------
+// Waits for the swap chain to have room for another frame
+// and for the frame rate limiter, if they're enabled
+// --------------------------------------------------------
+void DXCore::WaitForNextFrame()
+{
+	PROFILE_SCOPE("WaitForNextFrame");
+
+	__int64 start = 0;
+	QueryPerformanceCounter((LARGE_INTEGER*)&start);
+
+	// Present() doesn't block once the swap chain is waitable, so
+	// finish it off and then let the swap chain say when to start
+	if (waitForSwapChain && frameLatencyWaitable)
+	{
+		WaitForPresent();
+		WaitForSingleObjectEx(frameLatencyWaitable, 1000, true);
+	}
+
+	__int64 now = 0;
+	QueryPerformanceCounter((LARGE_INTEGER*)&now);
+	if (frameRateLimit > 0.0f)
+	{
+		// Sleep most of the way, since sleeps are only accurate
+		// to a millisecond or so, then spin the rest
+		__int64 interval = (__int64)(1.0 / (frameRateLimit * perfCounterSeconds));
+		__int64 target = lastLimiterTime + interval;
+		while (now < target)
+		{
+			double remainingMs = (target - now) * perfCounterSeconds * 1000.0;
+			if (remainingMs > 2.0)
+				Sleep((DWORD)(remainingMs - 2.0));
+			else
+				YieldProcessor();
+			QueryPerformanceCounter((LARGE_INTEGER*)&now);
+		}
+
+		// Keep to the schedule, unless a frame fell a whole interval
+		// behind, so slow frames don't cause a burst of fast ones
+		lastLimiterTime = now - target < interval ? target : now;
+	}
+
+	float ms = (float)((now - start) * perfCounterSeconds * 1000.0);
+	framePacingMs += (ms - framePacingMs) * 0.1f;
+}
+
+
+// --------------------------------------------------------
+// Matches the most recently shown frame with when it was
+// started.  Must run when no present is in flight
+// --------------------------------------------------------
+void DXCore::UpdatePresentLatency()
+{
+	DXGI_FRAME_STATISTICS stats = {};
+	if (FAILED(swapChain->GetFrameStatistics(&stats)) ||
+		stats.PresentCount == lastStatsPresentCount ||
+		stats.SyncQPCTime.QuadPart == 0)
+		return;
+	lastStatsPresentCount = stats.PresentCount;
+
+	// Only recent frames are remembered
+	UINT presentCount = 0;
+	if (FAILED(swapChain->GetLastPresentCount(&presentCount)) ||
+		presentCount - stats.PresentCount >= LatencyHistoryLength)
+		return;
+
+	__int64 start = presentStartTimes[stats.PresentCount % LatencyHistoryLength];
+	if (start == 0 || stats.SyncQPCTime.QuadPart < start)
+		return;
+
+	float ms = (float)((stats.SyncQPCTime.QuadPart - start) * perfCounterSeconds * 1000.0);
+	presentLatencyMs = presentLatencyMs == 0.0f ? ms : presentLatencyMs + (ms - presentLatencyMs) * 0.1f;
+}
+
+
+// --------------------------------------------------------
+// Changes how many frames can be queued up at once
+// --------------------------------------------------------
+void DXCore::SetMaxFrameLatency(unsigned int frames)
+{
+	maxFrameLatency = max(1u, min(frames, 16u));
+
+	Microsoft::WRL::ComPtr<IDXGISwapChain2> swapChain2;
+	if (swapChain && SUCCEEDED(swapChain.As(&swapChain2)))
+		swapChain2->SetMaximumFrameLatency(maxFrameLatency);
+}
+
+
 // --------------------------------------------------------
 // Sends an OS-level window close message to our process, which
 // will be handled by our message processing function
@@ -2,12 +2,18 @@
 
 #include <Windows.h>
 #include <d3d11.h>
+#include <dxgi1_5.h>
 #include <string>
+#include <memory>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 
+#include "JobSystem.h"
+#include "CPUProfiler.h"
+
 // We can include the correct library files here
 // instead of in Visual Studio settings if we want
 #pragma comment(lib, "d3d11.lib")
+#pragma comment(lib, "dxgi.lib")
 
 class DXCore
 {
@@ -44,11 +50,16 @@ public:
 	virtual void Update(float deltaTime, float totalTime) = 0;
 	virtual void Draw(float deltaTime, float totalTime) = 0;
 
+	// Shows the frame Draw() just finished.  Runs as a job, while
+	// the next frame's Update() runs on the main thread
+	virtual void Present();
+
 protected:
 	HINSTANCE	hInstance;		// The handle to the application
 	HWND		hWnd;			// The handle to the window itself
 	std::string titleBarText;	// Custom text in window's title bar
 	bool		titleBarStats;	// Show extra stats in title bar?
+	bool		showWindow;		// False keeps the window hidden (for offscreen runs)
 
 	// Size of the window's client area
 	unsigned int width;
@@ -66,6 +77,9 @@ protected:
 
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV;
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthStencilView;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthStencilSRV;	// Depth only, for reading once it's unbound
+
+	void CreateDepthViews(ID3D11Texture2D* depthBufferTexture);
 
 	// Helper function for allocating a console window
 	void CreateConsoleWindow(int bufferLines, int bufferColumns, int windowLines, int windowColumns);
@@ -77,6 +91,36 @@ protected:
 	std::string GetFullPathTo(std::string relativeFilePath);
 	std::wstring GetFullPathTo_Wide(std::wstring relativeFilePath);
 
+	// Shared worker threads for the game's parallel work
+	std::shared_ptr<JobSystem> jobSystem;
+
+	// Update() runs alongside the previous frame's Present(), so
+	// anything in it that uses the context must wait for it first
+	void WaitForPresent();
+
+	// Frame pacing, which can be changed between any two frames
+	//  - vsync waits for vertical blanks, and tearing (when vsync is off
+	//    and the display supports it) lets variable refresh displays show
+	//    frames as soon as they're done
+	//  - Waiting on the swap chain starts each frame only once the queue
+	//    has room, so input is read as late as possible
+	//  - The limiter, when above zero, caps the frame rate on top of that
+	bool vsync;
+	bool allowTearing;
+	bool waitForSwapChain;
+	float frameRateLimit;
+	void SetMaxFrameLatency(unsigned int frames);
+	unsigned int GetMaxFrameLatency() { return maxFrameLatency; }
+	bool IsTearingSupported() { return tearingSupported; }
+	bool IsSwapChainWaitable() { return frameLatencyWaitable != 0; }
+
+	// Measured each frame, smoothed over the last several
+	//  - Pacing is the time spent waiting on the swap chain and limiter
+	//  - Latency is from the start of a frame (where input is read) to
+	//    when it was shown, or 0 if the swap chain can't report it
+	float GetFramePacingMs() { return framePacingMs; }
+	float GetPresentLatencyMs() { return presentLatencyMs; }
+
 
 private:
 	// Timing related data
@@ -91,6 +135,24 @@ private:
 	int fpsFrameCount;
 	float fpsTimeElapsed;
 
+	// The previous frame's Present() job
+	JobCounter presentCounter;
+
+	// Frame pacing state
+	static const int LatencyHistoryLength = 16;
+	UINT swapChainFlags;
+	HANDLE frameLatencyWaitable;
+	unsigned int maxFrameLatency;
+	bool tearingSupported;
+	__int64 lastLimiterTime;
+	__int64 presentStartTimes[LatencyHistoryLength];	// Keyed by present count
+	UINT lastStatsPresentCount;
+	float framePacingMs;
+	float presentLatencyMs;
+
+	void WaitForNextFrame();
+	void UpdatePresentLatency();
+
 	void UpdateTimer();			// Updates the timer for this frame
 	void UpdateTitleBarStats();	// Puts debug info in the title bar
 };
@@ -0,0 +1,44 @@
+#include "PackedVertex.hlsli"
+
+// Constant Buffer for external (C++) data
+// - World matrices come from the per-instance vertex stream instead
+cbuffer externalData : register(b0)
+{
+	matrix view;
+	matrix projection;
+
+	// Maps packed 0-1 positions back to local space (1 and 0 for
+	// meshes with full float positions)
+	float3 positionScale;
+	float3 positionOffset;
+};
+
+// Just the position, from the mesh's position only stream, and the
+// instance's world matrix (see Mesh::CreatePositionInputLayout)
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+
+	float4 world0		: WORLD_PER_INSTANCE0;
+	float4 world1		: WORLD_PER_INSTANCE1;
+	float4 world2		: WORLD_PER_INSTANCE2;
+	float4 world3		: WORLD_PER_INSTANCE3;
+};
+
+// --------------------------------------------------------
+// Instanced depth only vertex shader for the depth pre-pass
+//
+// Matches the position math of VertexShaderInstanced and
+// VertexShaderPackedInstanced exactly (see DepthOnlyVS)
+// --------------------------------------------------------
+float4 main(VertexShaderInput input) : SV_POSITION
+{
+	float3 position = DecodePosition(input.position, positionScale, positionOffset);
+
+	float4x4 world = float4x4(input.world0, input.world1, input.world2, input.world3);
+	float4 worldPos = mul(float4(position, 1.0f), world);
+
+	matrix viewProj = mul(projection, view);
+	precise float4 screenPosition = mul(viewProj, worldPos);
+	return screenPosition;
+}
@@ -0,0 +1,38 @@
+#include "PackedVertex.hlsli"
+
+// Constant Buffer for external (C++) data
+cbuffer externalData : register(b0)
+{
+	matrix world;
+	matrix view;
+	matrix projection;
+
+	// Maps packed 0-1 positions back to local space (1 and 0 for
+	// meshes with full float positions)
+	float3 positionScale;
+	float3 positionOffset;
+};
+
+// Just the position, from the mesh's position only stream
+// (see Mesh::CreatePositionInputLayout)
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+};
+
+// --------------------------------------------------------
+// Depth only vertex shader for the depth pre-pass
+//
+// The main pass tests for EQUAL depth, so this has to match
+// the position math of VertexShader and VertexShaderPacked
+// exactly.  Both sides mark it precise to keep the compiler
+// from reordering or fusing any of it
+// --------------------------------------------------------
+float4 main(VertexShaderInput input) : SV_POSITION
+{
+	float3 position = DecodePosition(input.position, positionScale, positionOffset);
+
+	matrix worldViewProj = mul(projection, mul(view, world));
+	precise float4 screenPosition = mul(worldViewProj, float4(position, 1.0f));
+	return screenPosition;
+}
@@ -0,0 +1,201 @@
+#include "DynamicResolution.h"
+
+#include <math.h>
+
+// How much of each new frame time goes into the smoothed one
+#define DYNAMIC_RESOLUTION_SMOOTHING	0.2f
+
+// Frame times to ignore after a change, since the ones still coming
+// back are for frames drawn at the old scale (see GPUProfiler)
+#define DYNAMIC_RESOLUTION_SETTLE		6
+
+DynamicResolution::DynamicResolution(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<RenderStateCache> renderStates,
+	std::shared_ptr<SimpleVertexShader> fullscreenVS,
+	std::shared_ptr<SimplePixelShader> upscalePS)
+	:
+	device(device),
+	context(context),
+	fullscreenVS(fullscreenVS),
+	upscalePS(upscalePS),
+	targetWidth(0),
+	targetHeight(0),
+	allocationCount(0),
+	windowWidth(1),
+	windowHeight(1),
+	renderWidth(1),
+	renderHeight(1),
+	scale(1.0f),
+	minScale(0.5f),
+	maxScale(1.0f),
+	targetFrameMs(1000.0f / 60.0f),
+	smoothedFrameMs(0.0f),
+	settleFrames(0)
+{
+	D3D11_SAMPLER_DESC sampDesc = {};
+	sampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	linearClampSampler = renderStates->GetSamplerState(sampDesc);
+}
+
+// Reallocates only when the window's size lands in a different bucket
+// than the targets were made for
+void DynamicResolution::Resize(unsigned int windowWidth, unsigned int windowHeight)
+{
+	this->windowWidth = max(windowWidth, 1u);
+	this->windowHeight = max(windowHeight, 1u);
+
+	unsigned int width = (this->windowWidth + DYNAMIC_RESOLUTION_BUCKET - 1) / DYNAMIC_RESOLUTION_BUCKET * DYNAMIC_RESOLUTION_BUCKET;
+	unsigned int height = (this->windowHeight + DYNAMIC_RESOLUTION_BUCKET - 1) / DYNAMIC_RESOLUTION_BUCKET * DYNAMIC_RESOLUTION_BUCKET;
+	if (width != targetWidth || height != targetHeight)
+		CreateTargets(width, height);
+
+	UpdateRenderSize();
+}
+
+void DynamicResolution::Update(float gpuFrameMs)
+{
+	if (gpuFrameMs <= 0.0f)
+		return;
+
+	if (settleFrames > 0)
+	{
+		settleFrames--;
+		return;
+	}
+
+	// Single slow frames shouldn't drop the resolution on their own
+	if (smoothedFrameMs <= 0.0f)
+		smoothedFrameMs = gpuFrameMs;
+	else
+		smoothedFrameMs += (gpuFrameMs - smoothedFrameMs) * DYNAMIC_RESOLUTION_SMOOTHING;
+
+	// The scale that would hit the target, if cost goes with the pixel count
+	float ideal = scale * sqrtf(targetFrameMs / smoothedFrameMs);
+	ideal = max(minScale, min(ideal, maxScale));
+	if (fabsf(ideal - scale) < DYNAMIC_RESOLUTION_STEP)
+		return;
+
+	SetScale(ideal);
+}
+
+void DynamicResolution::SetScale(float scale)
+{
+	// Whole steps only, so the size doesn't creep a pixel at a time
+	float stepped = floorf(scale / DYNAMIC_RESOLUTION_STEP + 0.5f) * DYNAMIC_RESOLUTION_STEP;
+	stepped = max(minScale, min(stepped, maxScale));
+	if (stepped == this->scale)
+		return;
+
+	this->scale = stepped;
+	smoothedFrameMs = 0.0f;
+	settleFrames = DYNAMIC_RESOLUTION_SETTLE;
+	UpdateRenderSize();
+}
+
+void DynamicResolution::SetScaleRange(float minScale, float maxScale)
+{
+	// Never past the targets' size, which is the window's
+	this->maxScale = max(0.1f, min(maxScale, 1.0f));
+	this->minScale = max(0.1f, min(minScale, this->maxScale));
+	SetScale(scale);
+}
+
+void DynamicResolution::UpdateRenderSize()
+{
+	renderWidth = max(1u, min((unsigned int)(windowWidth * scale + 0.5f), targetWidth));
+	renderHeight = max(1u, min((unsigned int)(windowHeight * scale + 0.5f), targetHeight));
+}
+
+void DynamicResolution::Upscale(Microsoft::WRL::ComPtr<ID3D11RenderTargetView> target)
+{
+	context->OMSetRenderTargets(1, target.GetAddressOf(), 0);
+
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)windowWidth;
+	viewport.Height = (float)windowHeight;
+	viewport.MaxDepth = 1.0f;
+	context->RSSetViewports(1, &viewport);
+
+	// The scene only covers the top left of its target, and filtering
+	// stops half a texel inside it so nothing outside bleeds in
+	DirectX::XMFLOAT2 uvScale(renderWidth / (float)targetWidth, renderHeight / (float)targetHeight);
+	DirectX::XMFLOAT2 uvMax((renderWidth - 0.5f) / targetWidth, (renderHeight - 0.5f) / targetHeight);
+
+	fullscreenVS->SetShader();
+	upscalePS->SetShader();
+	upscalePS->SetFloat2("uvScale", uvScale);
+	upscalePS->SetFloat2("uvMax", uvMax);
+	upscalePS->CopyAllBufferData();
+	upscalePS->SetShaderResourceView("Scene", sceneSRV);
+	upscalePS->SetSamplerState("LinearClamp", linearClampSampler);
+
+	// One triangle that covers the screen, made from the vertex IDs,
+	// with the default states so nothing drawn before can cull it
+	context->RSSetState(0);
+	context->OMSetBlendState(0, 0, 0xFFFFFFFF);
+	context->OMSetDepthStencilState(0, 0);
+	context->IASetInputLayout(0);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	context->Draw(3, 0);
+
+	// Unbound again, so the scene can be drawn to next frame
+	upscalePS->SetShaderResourceView("Scene", nullptr);
+}
+
+// The color target is read by the upscale, and the depth by Hi-Z
+// culling, so both are typeless or shader readable like the back
+// buffer and depth buffer they stand in for (see DXCore::OnResize)
+void DynamicResolution::CreateTargets(unsigned int width, unsigned int height)
+{
+	sceneRTV.Reset();
+	sceneSRV.Reset();
+	sceneDSV.Reset();
+	sceneDepthSRV.Reset();
+	targetWidth = 0;
+	targetHeight = 0;
+
+	D3D11_TEXTURE2D_DESC colorDesc = {};
+	colorDesc.Width = width;
+	colorDesc.Height = height;
+	colorDesc.MipLevels = 1;
+	colorDesc.ArraySize = 1;
+	colorDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	colorDesc.SampleDesc.Count = 1;
+	colorDesc.Usage = D3D11_USAGE_DEFAULT;
+	colorDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> color;
+	if (FAILED(device->CreateTexture2D(&colorDesc, 0, color.GetAddressOf())))
+		return;
+	device->CreateRenderTargetView(color.Get(), 0, sceneRTV.GetAddressOf());
+	device->CreateShaderResourceView(color.Get(), 0, sceneSRV.GetAddressOf());
+
+	D3D11_TEXTURE2D_DESC depthDesc = colorDesc;
+	depthDesc.Format = DXGI_FORMAT_R24G8_TYPELESS;
+	depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> depth;
+	if (FAILED(device->CreateTexture2D(&depthDesc, 0, depth.GetAddressOf())))
+		return;
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(depth.Get(), &dsvDesc, sceneDSV.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(depth.Get(), &srvDesc, sceneDepthSRV.GetAddressOf());
+
+	targetWidth = width;
+	targetHeight = height;
+	allocationCount++;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+
+#include "SimpleShader.h"
+#include "RenderStateCache.h"
+
+// Targets are allocated in whole multiples of this many pixels, so
+// resizing the window only reallocates when it crosses one
+#define DYNAMIC_RESOLUTION_BUCKET	256
+
+// The scale only changes in steps this big, since every change means
+// size dependent work (like the Hi-Z pyramid) is redone
+#define DYNAMIC_RESOLUTION_STEP		0.05f
+
+// --------------------------------------------------------
+// Renders the scene at a fraction of the window's size, and
+// adjusts that fraction to hold a GPU frame time.
+//
+// The scene is drawn into the top left of an offscreen color
+// and depth target, at the scaled size, then stretched over
+// the back buffer before the UI.  The targets are allocated
+// at the window's size, rounded up to a bucket, so changing
+// the scale never reallocates, and resizing the window only
+// does when it crosses a bucket.
+//
+// Update() takes the GPU's frame time (see GPUProfiler),
+// which arrives a few frames late, and moves the scale
+// toward whatever would land on the target: shading cost
+// goes roughly with the pixel count, so with the square of
+// the scale.
+// --------------------------------------------------------
+class DynamicResolution
+{
+public:
+	DynamicResolution(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<RenderStateCache> renderStates,
+		std::shared_ptr<SimpleVertexShader> fullscreenVS,
+		std::shared_ptr<SimplePixelShader> upscalePS);
+
+	// Call whenever the window changes size
+	void Resize(unsigned int windowWidth, unsigned int windowHeight);
+
+	// Feeds in a new GPU frame time, for a frame drawn at the current scale
+	void Update(float gpuFrameMs);
+
+	// Stretches the scene over the given target, which is the window's size
+	void Upscale(Microsoft::WRL::ComPtr<ID3D11RenderTargetView> target);
+
+	// The scaled size the scene is drawn at
+	unsigned int GetRenderWidth() { return renderWidth; }
+	unsigned int GetRenderHeight() { return renderHeight; }
+
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> GetSceneRTV() { return sceneRTV; }
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> GetSceneDSV() { return sceneDSV; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSceneDepthSRV() { return sceneDepthSRV; }
+
+	float GetScale() { return scale; }
+	void SetScale(float scale);
+	void SetScaleRange(float minScale, float maxScale);
+	float GetMinScale() { return minScale; }
+	float GetMaxScale() { return maxScale; }
+
+	void SetTargetFrameMs(float ms) { targetFrameMs = ms; }
+	float GetTargetFrameMs() { return targetFrameMs; }
+
+	// How many times the targets have been created
+	unsigned int GetAllocationCount() { return allocationCount; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<SimpleVertexShader> fullscreenVS;
+	std::shared_ptr<SimplePixelShader> upscalePS;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> linearClampSampler;
+
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneRTV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneSRV;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> sceneDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneDepthSRV;
+	unsigned int targetWidth;
+	unsigned int targetHeight;
+	unsigned int allocationCount;
+
+	unsigned int windowWidth;
+	unsigned int windowHeight;
+	unsigned int renderWidth;
+	unsigned int renderHeight;
+
+	float scale;
+	float minScale;
+	float maxScale;
+	float targetFrameMs;
+	float smoothedFrameMs;
+	unsigned int settleFrames;
+
+	void CreateTargets(unsigned int width, unsigned int height);
+	void UpdateRenderSize();
+};
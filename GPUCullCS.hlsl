@@ -0,0 +1,177 @@
+// Data for this culling pass
+cbuffer externalData : register(b0)
+{
+	// World space, with normals pointing out of the frustum
+	float4 frustumPlanes[6];
+
+	// The camera the Hi-Z pyramid's depth was drawn with
+	matrix occlusionViewProj;
+
+	float3 cameraPosition;
+	float lodPixelScale;	// Pixels per unit of radius at a distance of one
+	float lodMaxErrorPixels;
+	float lodHysteresis;
+
+	// Size of the pyramid's mip 0, 0 when there's no occlusion culling
+	float2 pyramidSize;
+	int mipCount;
+	int instanceCount;
+};
+
+// World space bounds and bucket of each entity - must match
+// GPUDrivenRenderer::CullInstance
+struct CullInstance
+{
+	float3 Center;
+	float Radius;
+	float3 Extents;
+	uint Bucket;
+};
+
+// The mesh LODs of each bucket - must match GPUDrivenRenderer::CullBucket
+struct CullBucket
+{
+	float4 LodErrors;
+	uint LodCount;
+	uint FirstSlot;
+	uint2 Padding;
+};
+
+// Both rows of InstanceData (see Vertex.h), copied as they are
+struct InstanceData
+{
+	float4 Rows[8];
+};
+
+StructuredBuffer<CullInstance> Instances		: register(t0);
+StructuredBuffer<CullBucket> Buckets			: register(t1);
+StructuredBuffer<InstanceData> Transforms		: register(t2);
+Texture2D<float> Pyramid						: register(t3);
+
+// One set of DrawIndexedInstancedIndirect arguments per bucket LOD
+// (5 uints: index count, instance count, start index, base vertex,
+// start instance), with the instance counts starting at zero
+RWByteAddressBuffer DrawArgs					: register(u0);
+
+// Visible instances' InstanceData, starting at each draw's start
+// instance, read as the per-instance vertex stream
+RWByteAddressBuffer VisibleInstances			: register(u1);
+
+// The LOD each entity last drew with, for hysteresis
+RWStructuredBuffer<uint> Lods					: register(u2);
+
+#define ARGS_STRIDE			20
+#define INSTANCE_STRIDE		128
+
+// Same as HiZCullCS: whether any of the box could be in front of the
+// farthest depth under its screen rectangle
+bool MaybeVisible(float3 center, float3 extents)
+{
+	float2 minUV = 1.0f;
+	float2 maxUV = 0.0f;
+	float nearestDepth = 1.0f;
+	bool crossesNearPlane = false;
+
+	[unroll]
+	for (uint i = 0; i < 8; i++)
+	{
+		float3 corner = center + extents * float3(
+			(i & 1) ? 1.0f : -1.0f,
+			(i & 2) ? 1.0f : -1.0f,
+			(i & 4) ? 1.0f : -1.0f);
+
+		float4 clip = mul(occlusionViewProj, float4(corner, 1.0f));
+		crossesNearPlane = crossesNearPlane || clip.w <= 0.0f;
+
+		float3 ndc = clip.xyz / max(clip.w, 1e-6f);
+		float2 uv = ndc.xy * float2(0.5f, -0.5f) + 0.5f;
+		minUV = min(minUV, uv);
+		maxUV = max(maxUV, uv);
+		nearestDepth = min(nearestDepth, ndc.z);
+	}
+
+	if (crossesNearPlane || nearestDepth <= 0.0f)
+		return true;
+
+	minUV = saturate(minUV);
+	maxUV = saturate(maxUV);
+
+	float2 rectSize = (maxUV - minUV) * pyramidSize;
+	uint mip = (uint)min(ceil(log2(max(max(rectSize.x, rectSize.y), 1.0f))), mipCount - 1);
+
+	// Texels come from the mip's own size, since each mip is half the one
+	// above rounded down, with odd edges folded in (see HiZBuildCS).  A
+	// texel there covers at least the same uvs, where a shifted mip 0
+	// texel wouldn't once the size stops being a power of two
+	uint mipWidth, mipHeight, levels;
+	Pyramid.GetDimensions(mip, mipWidth, mipHeight, levels);
+	float2 mipSize = float2(mipWidth, mipHeight);
+	uint2 minTexel = (uint2)min(minUV * mipSize, mipSize - 1.0f);
+	uint2 maxTexel = (uint2)min(maxUV * mipSize, mipSize - 1.0f);
+
+	float farthest = max(
+		max(Pyramid.Load(int3(minTexel.x, minTexel.y, mip)), Pyramid.Load(int3(maxTexel.x, minTexel.y, mip))),
+		max(Pyramid.Load(int3(minTexel.x, maxTexel.y, mip)), Pyramid.Load(int3(maxTexel.x, maxTexel.y, mip))));
+
+	return nearestDepth <= farthest;
+}
+
+// Same as Mesh::SelectLod: the coarsest LOD whose error stays under
+// the limit, with moves away from the current one needing some margin
+uint SelectLod(CullBucket b, float radiusPixels, uint currentLod)
+{
+	for (uint i = b.LodCount - 1; i > 0; i--)
+	{
+		float threshold = lodMaxErrorPixels;
+		if (i > currentLod) threshold *= 1.0f - lodHysteresis;
+		else if (i == currentLod) threshold *= 1.0f + lodHysteresis;
+
+		if (b.LodErrors[i] * radiusPixels <= threshold)
+			return i;
+	}
+	return 0;
+}
+
+// --------------------------------------------------------
+// Culls one entity against the frustum and the Hi-Z pyramid,
+// picks its LOD, and appends it to that LOD's draw
+// --------------------------------------------------------
+[numthreads(64, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= (uint)instanceCount)
+		return;
+
+	CullInstance inst = Instances[id.x];
+
+	[unroll]
+	for (uint p = 0; p < 6; p++)
+	{
+		if (dot(frustumPlanes[p].xyz, inst.Center) + frustumPlanes[p].w > inst.Radius)
+			return;
+	}
+
+	if (mipCount > 0 && !MaybeVisible(inst.Center, inst.Extents))
+		return;
+
+	// Inside the sphere, the entity is as close as it gets
+	CullBucket b = Buckets[inst.Bucket];
+	uint lod = 0;
+	if (lodMaxErrorPixels > 0.0f && b.LodCount > 1)
+	{
+		float distance = length(inst.Center - cameraPosition);
+		if (distance > inst.Radius)
+			lod = SelectLod(b, inst.Radius * lodPixelScale / distance, min(Lods[id.x], b.LodCount - 1));
+		Lods[id.x] = lod;
+	}
+
+	uint args = (b.FirstSlot + lod) * ARGS_STRIDE;
+	uint index;
+	DrawArgs.InterlockedAdd(args + 4, 1, index);
+	uint dest = (DrawArgs.Load(args + 16) + index) * INSTANCE_STRIDE;
+
+	InstanceData data = Transforms[id.x];
+	[unroll]
+	for (uint r = 0; r < 8; r++)
+		VisibleInstances.Store4(dest + r * 16, asuint(data.Rows[r]));
+}
@@ -0,0 +1,447 @@
+#include "GPUDrivenRenderer.h"
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <stdio.h>
+
+#include "RenderStateCache.h"
+
+using namespace DirectX;
+
+// Creates a structured buffer, with a view for reading it or (if uav is
+// given) for writing it.  Dynamic buffers are rewritten with Map()
+static bool CreateStructuredBuffer(
+	ID3D11Device* device, unsigned int stride, unsigned int count, bool dynamic, const void* data,
+	ID3D11Buffer** buffer, ID3D11ShaderResourceView** srv, ID3D11UnorderedAccessView** uav = 0)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = stride * count;
+	desc.Usage = dynamic ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT;
+	desc.BindFlags = uav ? D3D11_BIND_UNORDERED_ACCESS : D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = stride;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = data;
+	if (FAILED(device->CreateBuffer(&desc, data ? &initialData : 0, buffer)))
+		return false;
+
+	if (uav)
+	{
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		uavDesc.Buffer.NumElements = count;
+		return SUCCEEDED(device->CreateUnorderedAccessView(*buffer, &uavDesc, uav));
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.NumElements = count;
+	return SUCCEEDED(device->CreateShaderResourceView(*buffer, &srvDesc, srv));
+}
+
+// Creates a buffer the compute shader writes as a RWByteAddressBuffer,
+// which is then read some other way (as draw arguments or vertices)
+static bool CreateRawBuffer(
+	ID3D11Device* device, unsigned int byteWidth, unsigned int bindFlags, unsigned int miscFlags, const void* data,
+	ID3D11Buffer** buffer, ID3D11UnorderedAccessView** uav)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = byteWidth;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | bindFlags;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS | miscFlags;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = data;
+	if (FAILED(device->CreateBuffer(&desc, data ? &initialData : 0, buffer)))
+		return false;
+	if (!uav)
+		return true;
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.NumElements = byteWidth / 4;
+	uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+	return SUCCEEDED(device->CreateUnorderedAccessView(*buffer, &uavDesc, uav));
+}
+
+
+GPUDrivenRenderer::GPUDrivenRenderer(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<SimpleComputeShader> cullCS)
+	:
+	device(device),
+	context(context),
+	cullCS(cullCS),
+	sourceEntityCount(0),
+	bucketsDirty(true),
+	uploadDirty(true),
+	uploadedVersion(0),
+	slotCount(0),
+	lastPyramidBuild(0),
+	drawCallCount(0)
+{
+	meshPool = std::make_shared<MeshPool>(device, context);
+	XMStoreFloat4x4(&lastViewProj, XMMatrixIdentity());
+}
+
+void GPUDrivenRenderer::SetVertexShaders(std::shared_ptr<SimpleVertexShader> instancedVS, std::shared_ptr<SimpleVertexShader> packedInstancedVS)
+{
+	this->instancedVS = instancedVS;
+	this->packedInstancedVS = packedInstancedVS;
+	instancedHandles = VertexHandles();
+	packedInstancedHandles = VertexHandles();
+}
+
+void GPUDrivenRenderer::ResolveCullHandles()
+{
+	if (cullHandles.Version == cullCS->GetReflectionVersion())
+		return;
+
+	cullHandles.Version = cullCS->GetReflectionVersion();
+	cullHandles.FrustumPlanes = cullCS->GetVariableHandle("frustumPlanes");
+	cullHandles.OcclusionViewProj = cullCS->GetVariableHandle("occlusionViewProj");
+	cullHandles.CameraPosition = cullCS->GetVariableHandle("cameraPosition");
+	cullHandles.LodPixelScale = cullCS->GetVariableHandle("lodPixelScale");
+	cullHandles.LodMaxErrorPixels = cullCS->GetVariableHandle("lodMaxErrorPixels");
+	cullHandles.LodHysteresis = cullCS->GetVariableHandle("lodHysteresis");
+	cullHandles.PyramidSize = cullCS->GetVariableHandle("pyramidSize");
+	cullHandles.MipCount = cullCS->GetVariableHandle("mipCount");
+	cullHandles.InstanceCount = cullCS->GetVariableHandle("instanceCount");
+	cullHandles.Instances = cullCS->GetShaderResourceViewHandle("Instances");
+	cullHandles.Buckets = cullCS->GetShaderResourceViewHandle("Buckets");
+	cullHandles.Transforms = cullCS->GetShaderResourceViewHandle("Transforms");
+	cullHandles.Pyramid = cullCS->GetShaderResourceViewHandle("Pyramid");
+	cullHandles.DrawArgs = cullCS->GetUnorderedAccessViewHandle("DrawArgs");
+	cullHandles.VisibleInstances = cullCS->GetUnorderedAccessViewHandle("VisibleInstances");
+	cullHandles.Lods = cullCS->GetUnorderedAccessViewHandle("Lods");
+}
+
+void GPUDrivenRenderer::ResolveVertexHandles(SimpleVertexShader* vs, VertexHandles& handles)
+{
+	if (handles.Version == vs->GetReflectionVersion())
+		return;
+
+	handles.Version = vs->GetReflectionVersion();
+	handles.View = vs->GetVariableHandle("view");
+	handles.Projection = vs->GetVariableHandle("projection");
+	handles.PositionScale = vs->GetVariableHandle("positionScale");
+	handles.PositionOffset = vs->GetVariableHandle("positionOffset");
+}
+
+void GPUDrivenRenderer::SetEntities(const std::vector<std::shared_ptr<GameEntity>>& entities)
+{
+	if (!bucketsDirty && entities.size() == sourceEntityCount)
+		return;
+
+	// Failures aren't retried until the entities change again
+	sourceEntityCount = entities.size();
+	bucketsDirty = false;
+	BuildBuckets(entities);
+	uploadDirty = true;
+}
+
+// Buckets are ordered by mesh pool, then shaders and material, so
+// neighbouring draws share as much as they can.  Each bucket LOD gets
+// room for every one of the bucket's entities, since any of them could
+// pick it
+void GPUDrivenRenderer::BuildBuckets(const std::vector<std::shared_ptr<GameEntity>>& entities)
+{
+	this->entities.clear();
+	cullInstances.clear();
+	transforms.clear();
+	buckets.clear();
+	slotCount = 0;
+
+	std::map<std::pair<Mesh*, Material*>, unsigned int> lookup;
+	for (auto& ge : entities)
+	{
+		std::pair<Mesh*, Material*> key(ge->GetMesh().get(), ge->GetMaterial().get());
+		if (lookup.find(key) != lookup.end())
+			continue;
+
+		// Meshes that can't be pooled leave their entities out
+		Bucket b = {};
+		if (!meshPool->Add(ge->GetMesh(), &b.Offsets))
+			continue;
+
+		b.MeshPtr = ge->GetMesh();
+		b.MaterialPtr = ge->GetMaterial();
+		b.LodCount = b.MeshPtr->GetLodCount();
+		lookup[key] = (unsigned int)buckets.size();
+		buckets.push_back(b);
+	}
+
+	std::sort(buckets.begin(), buckets.end(), [](const Bucket& a, const Bucket& b)
+		{
+			if (a.Offsets.Pool != b.Offsets.Pool) return a.Offsets.Pool < b.Offsets.Pool;
+			SimplePixelShader* psA = a.MaterialPtr->GetPixelShader().get();
+			SimplePixelShader* psB = b.MaterialPtr->GetPixelShader().get();
+			if (psA != psB) return psA < psB;
+			if (a.MaterialPtr != b.MaterialPtr) return a.MaterialPtr < b.MaterialPtr;
+			return a.MeshPtr < b.MeshPtr;
+		});
+
+	std::vector<unsigned int> entityCounts(buckets.size(), 0);
+	for (unsigned int i = 0; i < buckets.size(); i++)
+		lookup[{ buckets[i].MeshPtr.get(), buckets[i].MaterialPtr.get() }] = i;
+
+	for (auto& ge : entities)
+	{
+		auto it = lookup.find({ ge->GetMesh().get(), ge->GetMaterial().get() });
+		if (it == lookup.end())
+			continue;
+
+		CullInstance inst = {};
+		inst.Bucket = it->second;
+		entityCounts[it->second]++;
+		this->entities.push_back(ge.get());
+		cullInstances.push_back(inst);
+	}
+	transforms.resize(cullInstances.size());
+
+	// Each bucket LOD's draw, with no instances until they're culled
+	std::vector<CullBucket> cullBuckets(buckets.size());
+	std::vector<DrawArgs> args;
+	unsigned int instanceCapacity = 0;
+	for (unsigned int i = 0; i < buckets.size(); i++)
+	{
+		Bucket& b = buckets[i];
+		b.FirstSlot = (unsigned int)args.size();
+
+		CullBucket& cb = cullBuckets[i];
+		cb = {};
+		cb.LodCount = b.LodCount;
+		cb.FirstSlot = b.FirstSlot;
+		for (unsigned int lod = 0; lod < b.LodCount; lod++)
+		{
+			const MeshLod& l = b.MeshPtr->GetLod(lod);
+			cb.LodErrors[lod] = l.Error;
+
+			DrawArgs a = {};
+			a.IndexCountPerInstance = l.IndexCount;
+			a.StartIndexLocation = b.Offsets.StartIndex + l.StartIndex;
+			a.BaseVertexLocation = b.Offsets.BaseVertex;
+			a.StartInstanceLocation = instanceCapacity;
+			args.push_back(a);
+			instanceCapacity += entityCounts[i];
+		}
+	}
+	slotCount = (unsigned int)args.size();
+
+	instanceBuffer.Reset();
+	instanceSRV.Reset();
+	transformBuffer.Reset();
+	transformSRV.Reset();
+	bucketBuffer.Reset();
+	bucketSRV.Reset();
+	lodBuffer.Reset();
+	lodUAV.Reset();
+	argsBuffer.Reset();
+	argsTemplate.Reset();
+	argsUAV.Reset();
+	visibleBuffer.Reset();
+	visibleUAV.Reset();
+	if (cullInstances.empty())
+		return;
+
+	unsigned int count = (unsigned int)cullInstances.size();
+	std::vector<unsigned int> lods(count, 0);
+	bool created =
+		CreateStructuredBuffer(device.Get(), sizeof(CullInstance), count, true, 0, instanceBuffer.GetAddressOf(), instanceSRV.GetAddressOf()) &&
+		CreateStructuredBuffer(device.Get(), sizeof(InstanceData), count, true, 0, transformBuffer.GetAddressOf(), transformSRV.GetAddressOf()) &&
+		CreateStructuredBuffer(device.Get(), sizeof(CullBucket), (unsigned int)cullBuckets.size(), false, cullBuckets.data(), bucketBuffer.GetAddressOf(), bucketSRV.GetAddressOf()) &&
+		CreateStructuredBuffer(device.Get(), sizeof(unsigned int), count, false, lods.data(), lodBuffer.GetAddressOf(), 0, lodUAV.GetAddressOf()) &&
+		CreateRawBuffer(device.Get(), sizeof(DrawArgs) * slotCount, 0, D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS, args.data(), argsBuffer.GetAddressOf(), argsUAV.GetAddressOf()) &&
+		CreateRawBuffer(device.Get(), sizeof(DrawArgs) * slotCount, 0, D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS, args.data(), argsTemplate.GetAddressOf(), 0) &&
+		CreateRawBuffer(device.Get(), sizeof(InstanceData) * instanceCapacity, D3D11_BIND_VERTEX_BUFFER, 0, 0, visibleBuffer.GetAddressOf(), visibleUAV.GetAddressOf());
+
+	if (!created)
+	{
+		printf("Couldn't create the GPU driven rendering buffers\n");
+		this->entities.clear();
+		cullInstances.clear();
+		transforms.clear();
+		buckets.clear();
+	}
+}
+
+// Rewrites every entity's bounds and matrices.  Only needed when the
+// scene changes, which the scene's version says
+bool GPUDrivenRenderer::Upload()
+{
+	for (size_t i = 0; i < entities.size(); i++)
+	{
+		BoundingBox box = entities[i]->GetWorldBoundingBox();
+		BoundingSphere sphere = entities[i]->GetWorldBoundingSphere();
+		cullInstances[i].Center = box.Center;
+		cullInstances[i].Radius = sphere.Radius;
+		cullInstances[i].Extents = box.Extents;
+		transforms[i] = entities[i]->GetTransform()->GetMatrices();
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+	memcpy(mapped.pData, cullInstances.data(), sizeof(CullInstance) * cullInstances.size());
+	context->Unmap(instanceBuffer.Get(), 0);
+
+	if (FAILED(context->Map(transformBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+	memcpy(mapped.pData, transforms.data(), sizeof(InstanceData) * transforms.size());
+	context->Unmap(transformBuffer.Get(), 0);
+	return true;
+}
+
+void GPUDrivenRenderer::Cull(std::shared_ptr<Camera> camera, unsigned int sceneVersion, float screenHeight, float maxErrorPixels, HiZCuller* hiZCuller)
+{
+	XMFLOAT4X4 view = camera->GetView();
+	XMFLOAT4X4 proj = camera->GetProjection();
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&proj)));
+
+	// The pyramid is only the last frame's if it's been built exactly
+	// once since the last cull, from depth drawn with that cull's camera
+	bool occlusion = hiZCuller && hiZCuller->GetPyramidSRV() && hiZCuller->GetBuildCount() == lastPyramidBuild + 1;
+	XMFLOAT4X4 occlusionViewProj = lastViewProj;
+	lastViewProj = viewProj;
+	lastPyramidBuild = hiZCuller ? hiZCuller->GetBuildCount() : 0;
+
+	if (cullInstances.empty())
+		return;
+
+	if (uploadDirty || sceneVersion != uploadedVersion)
+	{
+		if (!Upload())
+			return;
+		uploadDirty = false;
+		uploadedVersion = sceneVersion;
+	}
+
+	// Every draw starts with no instances
+	context->CopyResource(argsBuffer.Get(), argsTemplate.Get());
+
+	XMVECTOR planes[6];
+	camera->GetFrustum().GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+	XMFLOAT4 frustumPlanes[6];
+	for (int i = 0; i < 6; i++)
+		XMStoreFloat4(&frustumPlanes[i], planes[i]);
+
+	XMFLOAT2 pyramidSize(0.0f, 0.0f);
+	if (occlusion)
+		pyramidSize = XMFLOAT2((float)hiZCuller->GetPyramidWidth(), (float)hiZCuller->GetPyramidHeight());
+
+	ResolveCullHandles();
+	cullCS->SetShader();
+	cullCS->SetData(cullHandles.FrustumPlanes, frustumPlanes, sizeof(frustumPlanes));
+	cullCS->SetMatrix4x4(cullHandles.OcclusionViewProj, occlusionViewProj);
+	cullCS->SetFloat3(cullHandles.CameraPosition, camera->GetTransform()->GetPosition());
+	cullCS->SetFloat(cullHandles.LodPixelScale, screenHeight * 0.5f / tanf(camera->GetFieldOfView() * 0.5f));
+	cullCS->SetFloat(cullHandles.LodMaxErrorPixels, maxErrorPixels);
+	cullCS->SetFloat(cullHandles.LodHysteresis, 0.25f);
+	cullCS->SetFloat2(cullHandles.PyramidSize, pyramidSize);
+	cullCS->SetInt(cullHandles.MipCount, occlusion ? (int)hiZCuller->GetMipCount() : 0);
+	cullCS->SetInt(cullHandles.InstanceCount, (int)cullInstances.size());
+	cullCS->CopyAllBufferData();
+
+	cullCS->SetShaderResourceView(cullHandles.Instances, instanceSRV.Get());
+	cullCS->SetShaderResourceView(cullHandles.Buckets, bucketSRV.Get());
+	cullCS->SetShaderResourceView(cullHandles.Transforms, transformSRV.Get());
+	cullCS->SetShaderResourceView(cullHandles.Pyramid, occlusion ? hiZCuller->GetPyramidSRV().Get() : 0);
+	cullCS->SetUnorderedAccessView(cullHandles.DrawArgs, argsUAV.Get());
+	cullCS->SetUnorderedAccessView(cullHandles.VisibleInstances, visibleUAV.Get());
+	cullCS->SetUnorderedAccessView(cullHandles.Lods, lodUAV.Get());
+	cullCS->DispatchByThreads((unsigned int)cullInstances.size(), 1, 1);
+
+	// Both outputs are read by the draws next, and the pyramid is
+	// rebuilt once they're done
+	cullCS->SetUnorderedAccessView(cullHandles.DrawArgs, 0);
+	cullCS->SetUnorderedAccessView(cullHandles.VisibleInstances, 0);
+	cullCS->SetUnorderedAccessView(cullHandles.Lods, 0);
+	cullCS->SetShaderResourceView(cullHandles.Pyramid, 0);
+}
+
+void GPUDrivenRenderer::Draw(std::shared_ptr<Camera> camera)
+{
+	drawCallCount = 0;
+	if (buckets.empty() || !visibleBuffer)
+		return;
+
+	UINT stride = sizeof(InstanceData);
+	UINT offset = 0;
+	context->IASetVertexBuffers(1, 1, visibleBuffer.GetAddressOf(), &stride, &offset);
+
+	// Copied once each shader is set, below
+	if (instancedVS)
+	{
+		ResolveVertexHandles(instancedVS.get(), instancedHandles);
+		instancedVS->SetMatrix4x4(instancedHandles.View, camera->GetView());
+		instancedVS->SetMatrix4x4(instancedHandles.Projection, camera->GetProjection());
+	}
+	if (packedInstancedVS)
+	{
+		ResolveVertexHandles(packedInstancedVS.get(), packedInstancedHandles);
+		packedInstancedVS->SetMatrix4x4(packedInstancedHandles.View, camera->GetView());
+		packedInstancedVS->SetMatrix4x4(packedInstancedHandles.Projection, camera->GetProjection());
+	}
+
+	PipelineBinder binder(context.Get());
+	Material* lastMaterial = 0;
+	unsigned int lastPool = MeshPool::PoolCount;
+	for (auto& b : buckets)
+	{
+		bool packed = b.MeshPtr->GetVertexFormat() == MESH_VERTEX_PACKED;
+		SimpleVertexShader* vs = packed ? packedInstancedVS.get() : instancedVS.get();
+		if (!vs)
+			continue;
+
+		// The material's pixel shader can change with its permutation
+		b.MaterialPtr->Bake();
+		PipelineBundle bundle;
+		bundle.VertexShader = vs;
+		bundle.PixelShader = b.MaterialPtr->GetPixelShader().get();
+		unsigned int bound = binder.Bind(bundle);
+
+		// Packed meshes each have their own position scale and offset
+		if (packed)
+		{
+			vs->SetFloat3(packedInstancedHandles.PositionScale, b.MeshPtr->GetPositionScale());
+			vs->SetFloat3(packedInstancedHandles.PositionOffset, b.MeshPtr->GetPositionOffset());
+			vs->CopyAllBufferData();
+		}
+		else if (bound & PIPELINE_VERTEX_SHADER)
+		{
+			vs->CopyAllBufferData();
+		}
+
+		if (b.MaterialPtr.get() != lastMaterial)
+		{
+			b.MaterialPtr->BindResources();
+			lastMaterial = b.MaterialPtr.get();
+		}
+
+		if (b.Offsets.Pool != lastPool)
+		{
+			meshPool->SetBuffers(b.Offsets.Pool);
+			lastPool = b.Offsets.Pool;
+		}
+
+		// Whatever the culling left in each LOD
+		for (unsigned int lod = 0; lod < b.LodCount; lod++)
+		{
+			context->DrawIndexedInstancedIndirect(argsBuffer.Get(), (b.FirstSlot + lod) * sizeof(DrawArgs));
+			drawCallCount++;
+		}
+	}
+
+	// Culling writes the instances again next frame
+	ID3D11Buffer* none = 0;
+	context->IASetVertexBuffers(1, 1, &none, &stride, &offset);
+}
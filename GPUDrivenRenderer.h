@@ -0,0 +1,183 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+
+#include "GameEntity.h"
+#include "Camera.h"
+#include "SimpleShader.h"
+#include "MeshPool.h"
+#include "HiZCuller.h"
+
+// --------------------------------------------------------
+// Draws every entity with a fixed number of indirect draws,
+// whatever the entity count, by culling and picking LODs on
+// the GPU.
+//
+// Entities are grouped into buckets sharing a mesh and a
+// material, and their meshes are copied into a MeshPool.
+// Each entity's bounds, bucket and matrices live in structured
+// buffers, uploaded only when the scene changes.  Each frame,
+// a compute pass (GPUCullCS) tests every entity against the
+// frustum and, optionally, the Hi-Z pyramid, picks its LOD,
+// and appends its matrices to the instances of that bucket
+// LOD's DrawIndexedInstancedIndirect arguments.  Drawing is
+// then one indirect draw per bucket LOD, reading the appended
+// matrices as the usual per-instance vertex stream.
+//
+// The pyramid has to be the one built from the previous
+// frame's depth, so entities that come into view can be a
+// frame late, just like with HiZCuller's own tests.
+// --------------------------------------------------------
+class GPUDrivenRenderer
+{
+public:
+	GPUDrivenRenderer(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<SimpleComputeShader> cullCS);
+
+	// The instanced shaders for each mesh format (see VertexShaderInstanced
+	// and VertexShaderPackedInstanced).  Buckets of a format without
+	// one are skipped
+	void SetVertexShaders(std::shared_ptr<SimpleVertexShader> instancedVS, std::shared_ptr<SimpleVertexShader> packedInstancedVS);
+
+	// Rebuilds the buckets when the entities change, which is assumed
+	// when their count does, or after Invalidate()
+	void SetEntities(const std::vector<std::shared_ptr<GameEntity>>& entities);
+	void Invalidate() { bucketsDirty = true; }
+
+	// Uploads the entities' bounds and matrices if the scene has changed
+	// since (see SceneBVH::GetVersion), then culls them and picks their
+	// LODs (like RenderQueue::SetLodSelection).  Occlusion culling uses
+	// the Hi-Z pyramid, when one was built since the last call
+	void Cull(std::shared_ptr<Camera> camera, unsigned int sceneVersion, float screenHeight, float maxErrorPixels, HiZCuller* hiZCuller);
+
+	// One indirect draw per bucket LOD, with the default render states
+	void Draw(std::shared_ptr<Camera> camera);
+
+	unsigned int GetEntityCount() { return (unsigned int)cullInstances.size(); }
+	unsigned int GetBucketCount() { return (unsigned int)buckets.size(); }
+	unsigned int GetDrawCallCount() { return drawCallCount; }
+	unsigned int GetPooledMeshCount() { return meshPool->GetMeshCount(); }
+
+private:
+	// Must match GPUCullCS
+	struct CullInstance
+	{
+		DirectX::XMFLOAT3 Center;
+		float Radius;
+		DirectX::XMFLOAT3 Extents;
+		unsigned int Bucket;
+	};
+
+	struct CullBucket
+	{
+		float LodErrors[MESH_MAX_LODS];
+		unsigned int LodCount;
+		unsigned int FirstSlot;
+		unsigned int Padding[2];
+	};
+
+	// The arguments of DrawIndexedInstancedIndirect
+	struct DrawArgs
+	{
+		unsigned int IndexCountPerInstance;
+		unsigned int InstanceCount;
+		unsigned int StartIndexLocation;
+		int BaseVertexLocation;
+		unsigned int StartInstanceLocation;
+	};
+
+	struct Bucket
+	{
+		std::shared_ptr<Mesh> MeshPtr;
+		std::shared_ptr<Material> MaterialPtr;
+		MeshPool::Range Offsets;
+		unsigned int LodCount;
+		unsigned int FirstSlot;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<SimpleComputeShader> cullCS;
+	std::shared_ptr<SimpleVertexShader> instancedVS;
+	std::shared_ptr<SimpleVertexShader> packedInstancedVS;
+	std::shared_ptr<MeshPool> meshPool;
+
+	// Per entity, in the order of the buffers below
+	std::vector<GameEntity*> entities;
+	std::vector<CullInstance> cullInstances;
+	std::vector<InstanceData> transforms;
+	std::vector<Bucket> buckets;
+	size_t sourceEntityCount;
+	bool bucketsDirty;
+	bool uploadDirty;
+	unsigned int uploadedVersion;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> instanceSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> transformBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> transformSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> bucketBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bucketSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lodBuffer;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> lodUAV;
+
+	// The draws' arguments, reset from the template each frame, and
+	// where the visible instances are appended
+	Microsoft::WRL::ComPtr<ID3D11Buffer> argsBuffer;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> argsTemplate;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> argsUAV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> visibleBuffer;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> visibleUAV;
+	unsigned int slotCount;
+
+	// The camera from the last Cull(), which the next pyramid is drawn with
+	DirectX::XMFLOAT4X4 lastViewProj;
+	unsigned int lastPyramidBuild;
+
+	// Shader variables and resources, looked up again whenever their
+	// shader's reflection version changes
+	struct CullHandles
+	{
+		unsigned int Version = 0;
+		SimpleShaderHandle FrustumPlanes;
+		SimpleShaderHandle OcclusionViewProj;
+		SimpleShaderHandle CameraPosition;
+		SimpleShaderHandle LodPixelScale;
+		SimpleShaderHandle LodMaxErrorPixels;
+		SimpleShaderHandle LodHysteresis;
+		SimpleShaderHandle PyramidSize;
+		SimpleShaderHandle MipCount;
+		SimpleShaderHandle InstanceCount;
+		SimpleShaderHandle Instances;
+		SimpleShaderHandle Buckets;
+		SimpleShaderHandle Transforms;
+		SimpleShaderHandle Pyramid;
+		SimpleShaderHandle DrawArgs;
+		SimpleShaderHandle VisibleInstances;
+		SimpleShaderHandle Lods;
+	};
+	struct VertexHandles
+	{
+		unsigned int Version = 0;
+		SimpleShaderHandle View;
+		SimpleShaderHandle Projection;
+		SimpleShaderHandle PositionScale;
+		SimpleShaderHandle PositionOffset;
+	};
+	CullHandles cullHandles;
+	VertexHandles instancedHandles;
+	VertexHandles packedInstancedHandles;
+	void ResolveCullHandles();
+	static void ResolveVertexHandles(SimpleVertexShader* vs, VertexHandles& handles);
+
+	unsigned int drawCallCount;
+
+	void BuildBuckets(const std::vector<std::shared_ptr<GameEntity>>& entities);
+	bool Upload();
+};
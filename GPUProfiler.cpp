@@ -0,0 +1,219 @@
+#include "GPUProfiler.h"
+
+GPUProfiler::GPUProfiler(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	:
+	device(device),
+	context(context),
+	inFlight(),
+	frameIndex(0),
+	frameOpen(false),
+	frameTimed(false),
+	skippedFrameCount(0)
+{
+	// Annotations are optional, since they need the 11.1 runtime
+	context.As(&annotation);
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	for (int i = 0; i < FrameLatency; i++)
+		device->CreateQuery(&queryDesc, disjoint[i].GetAddressOf());
+
+	FindPass("Frame");
+}
+
+// Starts timing a frame, if its query set has been read back
+void GPUProfiler::BeginFrame()
+{
+	if (frameOpen)
+		return;
+
+	ReadResults();
+
+	unsigned int slot = frameIndex % FrameLatency;
+	frameOpen = true;
+	frameTimed = !inFlight[slot] && disjoint[slot];
+	if (!frameTimed)
+		skippedFrameCount++;
+
+	// The set's old results are read by now, unless it's still in flight
+	if (frameTimed)
+	{
+		for (auto& p : passes)
+			p.State[slot] = 0;
+		context->Begin(disjoint[slot].Get());
+	}
+	StartTimestamp(0);
+}
+
+void GPUProfiler::EndFrame()
+{
+	if (!frameOpen)
+		return;
+
+	// Close anything left open, so the events stay balanced
+	while (!openPasses.empty())
+		EndPass();
+
+	unsigned int slot = frameIndex % FrameLatency;
+	EndTimestamp(0);
+	if (frameTimed)
+	{
+		context->End(disjoint[slot].Get());
+		inFlight[slot] = true;
+	}
+
+	frameOpen = false;
+	frameIndex++;
+}
+
+void GPUProfiler::BeginPass(const char* name)
+{
+	BeginFrame();
+
+	unsigned int pass = FindPass(name);
+	if (annotation)
+		annotation->BeginEvent(passes[pass].EventName.c_str());
+
+	openPasses.push_back(pass);
+	StartTimestamp(pass);
+}
+
+void GPUProfiler::EndPass()
+{
+	if (openPasses.empty())
+		return;
+
+	unsigned int pass = openPasses.back();
+	openPasses.pop_back();
+
+	EndTimestamp(pass);
+	if (annotation)
+		annotation->EndEvent();
+}
+
+// Finds a pass by name, adding it the first time it's seen
+unsigned int GPUProfiler::FindPass(const char* name)
+{
+	for (unsigned int i = 0; i < passes.size(); i++)
+	{
+		if (passes[i].Name == name)
+			return i;
+	}
+
+	Pass p = {};
+	p.Name = name;
+	p.EventName = std::wstring(p.Name.begin(), p.Name.end());
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+	for (int i = 0; i < FrameLatency; i++)
+	{
+		device->CreateQuery(&queryDesc, p.Start[i].GetAddressOf());
+		device->CreateQuery(&queryDesc, p.End[i].GetAddressOf());
+	}
+
+	passes.push_back(p);
+	return (unsigned int)passes.size() - 1;
+}
+
+void GPUProfiler::StartTimestamp(unsigned int pass)
+{
+	unsigned int slot = frameIndex % FrameLatency;
+	Pass& p = passes[pass];
+	if (!frameTimed || p.State[slot] != 0 || !p.Start[slot])
+		return;
+
+	context->End(p.Start[slot].Get());
+	p.State[slot] = 1;
+}
+
+void GPUProfiler::EndTimestamp(unsigned int pass)
+{
+	unsigned int slot = frameIndex % FrameLatency;
+	Pass& p = passes[pass];
+	if (!frameTimed || p.State[slot] != 1)
+		return;
+
+	context->End(p.End[slot].Get());
+	p.State[slot] = 2;
+}
+
+// Picks up every finished frame, oldest first, without waiting
+void GPUProfiler::ReadResults()
+{
+	for (int i = 0; i < FrameLatency; i++)
+	{
+		unsigned int slot = (frameIndex + i) % FrameLatency;
+		if (!inFlight[slot])
+			continue;
+
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData = {};
+		if (context->GetData(disjoint[slot].Get(), &disjointData, sizeof(disjointData), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			continue;
+
+		inFlight[slot] = false;
+		if (disjointData.Disjoint || disjointData.Frequency == 0)
+			continue;
+
+		for (auto& p : passes)
+		{
+			if (p.State[slot] != 2)
+				continue;
+
+			UINT64 start = 0;
+			UINT64 end = 0;
+			if (context->GetData(p.Start[slot].Get(), &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+				context->GetData(p.End[slot].Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+				end < start)
+				continue;
+
+			double ms = (end - start) * 1000.0 / disjointData.Frequency;
+			p.TotalMs += ms;
+			p.TotalCount++;
+
+			p.History[p.HistoryNext] = (float)ms;
+			p.HistoryNext = (p.HistoryNext + 1) % HistoryLength;
+			p.HistoryCount = min(p.HistoryCount + 1, HistoryLength);
+		}
+	}
+}
+
+void GPUProfiler::ResetTotals()
+{
+	for (auto& p : passes)
+	{
+		p.TotalMs = 0;
+		p.TotalCount = 0;
+	}
+}
+
+float GPUProfiler::GetPassAverageMs(unsigned int pass)
+{
+	Pass& p = passes[pass];
+	if (p.HistoryCount == 0)
+		return 0.0f;
+
+	float total = 0.0f;
+	for (int i = 0; i < p.HistoryCount; i++)
+		total += p.History[i];
+	return total / p.HistoryCount;
+}
+
+float GPUProfiler::GetPassLatestMs(unsigned int pass)
+{
+	Pass& p = passes[pass];
+	if (p.HistoryCount == 0)
+		return 0.0f;
+
+	return p.History[(p.HistoryNext + HistoryLength - 1) % HistoryLength];
+}
+
+const float* GPUProfiler::GetPassHistory(unsigned int pass, int* count, int* offset)
+{
+	Pass& p = passes[pass];
+	*count = p.HistoryCount;
+	*offset = p.HistoryCount < HistoryLength ? 0 : p.HistoryNext;
+	return p.History;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Times passes on the GPU with timestamp queries.
+//
+// Each frame's queries are read back a few frames later,
+// without waiting, so timing doesn't stall the pipeline.
+// If a frame's queries still haven't finished when their
+// set comes around again, that frame just isn't timed.
+// Passes are named, and each also emits a user defined
+// annotation event so graphics debugger captures show
+// the same breakdown.
+//
+// Pass 0 is always the whole frame.  Passes begun outside
+// of BeginFrame() and EndFrame() (like one-off work done
+// during Update()) start the frame early.
+// --------------------------------------------------------
+class GPUProfiler
+{
+public:
+	static const int FrameLatency = 4;
+	static const int HistoryLength = 120;
+
+	GPUProfiler(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	void BeginFrame();
+	void EndFrame();
+
+	// Passes can nest, and each is timed at most once per frame
+	void BeginPass(const char* name);
+	void EndPass();
+
+	unsigned int GetPassCount() { return (unsigned int)passes.size(); }
+	const char* GetPassName(unsigned int pass) { return passes[pass].Name.c_str(); }
+
+	// The average over the history, which holds one entry per timed
+	// frame the pass was used in.  Offset is where the oldest entry is
+	float GetPassAverageMs(unsigned int pass);
+	float GetPassLatestMs(unsigned int pass);
+	const float* GetPassHistory(unsigned int pass, int* count, int* offset);
+
+	// Running totals over every timed frame since the last reset, for
+	// averages over longer runs than the history holds
+	double GetPassTotalMs(unsigned int pass) { return passes[pass].TotalMs; }
+	unsigned int GetPassTotalCount(unsigned int pass) { return passes[pass].TotalCount; }
+	void ResetTotals();
+
+	// Frames whose queries weren't free in time
+	unsigned int GetSkippedFrameCount() { return skippedFrameCount; }
+
+private:
+	struct Pass
+	{
+		std::string Name;
+		std::wstring EventName;
+		Microsoft::WRL::ComPtr<ID3D11Query> Start[FrameLatency];
+		Microsoft::WRL::ComPtr<ID3D11Query> End[FrameLatency];
+
+		// Whether each frame's queries were begun (1) and ended (2)
+		int State[FrameLatency];
+
+		float History[HistoryLength];
+		int HistoryCount;
+		int HistoryNext;
+
+		double TotalMs;
+		unsigned int TotalCount;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3DUserDefinedAnnotation> annotation;
+
+	Microsoft::WRL::ComPtr<ID3D11Query> disjoint[FrameLatency];
+	bool inFlight[FrameLatency];
+
+	std::vector<Pass> passes;
+	std::vector<unsigned int> openPasses;
+	unsigned int frameIndex;
+	bool frameOpen;
+	bool frameTimed;
+	unsigned int skippedFrameCount;
+
+	unsigned int FindPass(const char* name);
+	void StartTimestamp(unsigned int pass);
+	void EndTimestamp(unsigned int pass);
+	void ReadResults();
+};
+
+// --------------------------------------------------------
+// Times everything until it goes out of scope
+// --------------------------------------------------------
+class GPUProfileScope
+{
+public:
+	GPUProfileScope(GPUProfiler* profiler, const char* name) : profiler(profiler) { profiler->BeginPass(name); }
+	~GPUProfileScope() { profiler->EndPass(); }
+
+	GPUProfileScope(const GPUProfileScope&) = delete;
+	GPUProfileScope& operator=(const GPUProfileScope&) = delete;
+
+private:
+	GPUProfiler* profiler;
+};
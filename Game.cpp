@@ -1,12 +1,12 @@
 
 #include <stdlib.h>     // For seeding random and rand()
 #include <time.h>       // For grabbing time (to seed random)
+#include <stdio.h>      // For formatting overlay text
 
 #include "Game.h"
 #include "Vertex.h"
 #include "Input.h"
-
-#include "WICTextureLoader.h"
+#include "TransformPool.h"
 
 
 // Needed for a helper function to read compiled shader files from the hard drive
@@ -25,8 +25,8 @@ using namespace DirectX;
 #define RandomRange(min, max) (float)rand() / RAND_MAX * (max - min) + min
 
 // Helper macros for making texture and shader loading code more succinct
-#define LoadTexture(file, srv) CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(file).c_str(), 0, srv.GetAddressOf())
-#define LoadShader(type, file) std::make_shared<type>(device.Get(), context.Get(), GetFullPathTo_Wide(file).c_str())
+#define LoadTexture(file, usage, srv) srv = textureStreamer->Load(GetFullPathTo_Wide(file), usage)
+#define LoadShader(type, file) shaderManager->Watch(std::make_shared<type>(device.Get(), context.Get(), GetFullPathTo_Wide(file).c_str()), file)
 
 
 // --------------------------------------------------------
@@ -36,22 +36,26 @@ using namespace DirectX;
 // DirectX itself, and our window, are not ready yet!
 //
 // hInstance - the application's OS-level handle (unique ID)
+// commandLine - the application's arguments (see Benchmark)
 // --------------------------------------------------------
-Game::Game(HINSTANCE hInstance)
+Game::Game(HINSTANCE hInstance, const char* commandLine)
 	: DXCore(
 		hInstance,		   // The application's handle
 		"DirectX Game",	   // Text for the window's title bar
 		1280,			   // Width of the window's client area
 		720,			   // Height of the window's client area
 		true),			   // Show extra stats (fps) in title bar?
+	benchmark(commandLine),
 	camera(0),
 	sky(0),
 	spriteBatch(0),
 	lightCount(0),
 	arial(0)
 {
-	// Seed random
-	srand((unsigned int)time(0));
+	// Seed random, the same way every time when benchmarking
+	srand(benchmark.IsEnabled() ? benchmark.GetSeed() : (unsigned int)time(0));
+	if (benchmark.IsOffscreen())
+		showWindow = false;
 
 #if defined(DEBUG) || defined(_DEBUG)
 	// Do we want a console window?  Probably only in debug mode
@@ -96,6 +100,9 @@ void Game::Init()
 	ImGui_ImplWin32_Init(hWnd);
 	ImGui_ImplDX11_Init(device.Get(), context.Get());
 
+	// Time GPU work from the start, so the one-off IBL generation shows up
+	gpuProfiler = std::make_shared<GPUProfiler>(device, context);
+
 	// Asset loading and entity creation
 	LoadAssetsAndCreateEntities();
 	
@@ -105,9 +112,13 @@ void Game::Init()
 	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// Set up lights initially
-	lightCount = 32;
+	lightCount = benchmark.IsEnabled() ? benchmark.GetPreset().LightCount : 32;
 	GenerateLights();
 
+	// Benchmarks fill the scene out to the preset's size
+	if (benchmark.IsEnabled())
+		SpawnEntities(benchmark.GetPreset().EntityCount, benchmark.GetPreset().MaterialCount);
+
 	// Make our camera
 	camera = std::make_shared<Camera>(
 		0.0f, 0.0f, -10.0f,	// Position
@@ -122,76 +133,255 @@ void Game::Init()
 // --------------------------------------------------------
 void Game::LoadAssetsAndCreateEntities()
 {
-	// Load shaders using our succinct LoadShader() macro
+	PROFILE_SCOPE("Game::LoadAssetsAndCreateEntities");
+
+	// Identical render states are only ever created once
+	renderStates = std::make_shared<RenderStateCache>(device);
+
+	// Shader sources sit two folders up from the executable, like the
+	// assets, and compiled variants of them are cached next to it
+	shaderManager = std::make_shared<ShaderManager>(GetFullPathTo_Wide(L"../../"), GetFullPathTo_Wide(L"ShaderCache"));
+
+	// Load shaders using our succinct LoadShader() macro, which also
+	// watches their sources for changes
 	std::shared_ptr<SimpleVertexShader> vertexShader	= LoadShader(SimpleVertexShader, L"VertexShader.cso");
+	instancedVS = LoadShader(SimpleVertexShader, L"VertexShaderInstanced.cso");
 	std::shared_ptr<SimplePixelShader> pixelShader		= LoadShader(SimplePixelShader, L"PixelShader.cso");
 	std::shared_ptr<SimplePixelShader> pixelShaderPBR	= LoadShader(SimplePixelShader, L"PixelShaderPBR.cso");
-	std::shared_ptr<SimplePixelShader> solidColorPS		= LoadShader(SimplePixelShader, L"SolidColorPS.cso");
+	lightVS = LoadShader(SimpleVertexShader, L"LightImpostorVS.cso");
+	lightPS = LoadShader(SimplePixelShader, L"LightImpostorPS.cso");
+
+	// Lit materials use variants of these specialized for their own
+	// textures, compiled from the sources as they're first needed
+	std::shared_ptr<ShaderPermutations> pixelShaderPermutations = std::make_shared<ShaderPermutations>(
+		device, context, shaderManager, L"PixelShader.hlsl", pixelShader,
+		SHADER_FEATURE_NORMAL_MAP | SHADER_FEATURE_ROUGHNESS_MAP);
+	std::shared_ptr<ShaderPermutations> pixelShaderPBRPermutations = std::make_shared<ShaderPermutations>(
+		device, context, shaderManager, L"PixelShaderPBR.hlsl", pixelShaderPBR,
+		SHADER_FEATURE_NORMAL_MAP | SHADER_FEATURE_ROUGHNESS_MAP | SHADER_FEATURE_METAL_MAP | SHADER_FEATURE_IBL);
+	litShaderPermutations.push_back(pixelShaderPermutations);
+	litShaderPermutations.push_back(pixelShaderPBRPermutations);
 	
+	// Packed vertices need their own input layouts
+	packedVS = LoadPackedVertexShader(L"VertexShaderPacked.cso", false);
+	packedInstancedVS = LoadPackedVertexShader(L"VertexShaderPackedInstanced.cso", true);
+
+	// Depth only shaders read just positions, in each mesh format
+	std::shared_ptr<SimpleVertexShader> depthVS[2];
+	std::shared_ptr<SimpleVertexShader> depthInstancedVS[2];
+	for (int f = 0; f < 2; f++)
+	{
+		depthVS[f] = LoadDepthVertexShader(L"DepthOnlyVS.cso", (MeshVertexFormat)f, false);
+		depthInstancedVS[f] = LoadDepthVertexShader(L"DepthOnlyInstancedVS.cso", (MeshVertexFormat)f, true);
+	}
+	depthPrepassAvailable = depthVS[0] && depthVS[1] && depthInstancedVS[0] && depthInstancedVS[1];
+
 	std::shared_ptr<SimpleVertexShader> skyVS = LoadShader(SimpleVertexShader, L"SkyVS.cso");
 	std::shared_ptr<SimplePixelShader> skyPS  = LoadShader(SimplePixelShader, L"SkyPS.cso");
 
-	// Set up the sprite batch and load the sprite font
-	spriteBatch = std::make_shared<SpriteBatch>(context.Get());
-	arial = std::make_shared<SpriteFont>(device.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/arial.spritefont").c_str());
+	// Everything from disk is decoded and created on the loader's worker
+	// threads, while the rest of the setup continues here.  Only what the
+	// first frame needs is waited on.  Material textures are streamed, so
+	// only their low mips are loaded up front
+	assetLoader = std::make_shared<AssetLoader>(device);
+	textureStreamer = std::make_shared<TextureStreamer>(assetLoader, (size_t)textureBudgetMB * 1024 * 1024);
+
+	// Queue every sky's faces.  The first is needed before anything is
+	// drawn, and the rest can be switched to later
+	const wchar_t* skyFolders[skyCount] = { L"Clouds Blue", L"Night" };
+	const wchar_t* skyFaceNames[6] = { L"right", L"left", L"up", L"down", L"front", L"back" };
+	for (int skyIndex = 0; skyIndex < skyCount; skyIndex++)
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			std::wstring file = std::wstring(L"..\\..\\Assets\\Skies\\") + skyFolders[skyIndex] + L"\\" + skyFaceNames[i] + L".png";
+			skyFaceLoads[skyIndex][i] = assetLoader->LoadTexture(GetFullPathTo_Wide(file), TEXTURE_UNCOMPRESSED, false);
+		}
+	}
 
-	// Make the meshes
-	std::shared_ptr<Mesh> sphereMesh = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/sphere.obj").c_str(), device);
-	std::shared_ptr<Mesh> helixMesh = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/helix.obj").c_str(), device);
-	std::shared_ptr<Mesh> cubeMesh = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/cube.obj").c_str(), device);
-	std::shared_ptr<Mesh> coneMesh = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/cone.obj").c_str(), device);
+	// Queue the meshes
+	AssetLoader::MeshFuture sphereMeshLoad = assetLoader->LoadMesh(GetFullPathTo("../../Assets/Models/sphere.obj"));
+	AssetLoader::MeshFuture helixMeshLoad = assetLoader->LoadMesh(GetFullPathTo("../../Assets/Models/helix.obj"));
+	AssetLoader::MeshFuture cubeMeshLoad = assetLoader->LoadMesh(GetFullPathTo("../../Assets/Models/cube.obj"));
+	AssetLoader::MeshFuture coneMeshLoad = assetLoader->LoadMesh(GetFullPathTo("../../Assets/Models/cone.obj"));
+
+	// Entities drawn through the render queue can use packed vertices, but
+	// the sky and point lights draw with the full-vertex shaders.  Without
+	// the packed shaders, everything stays full
+	MeshVertexFormat entityFormat = packedVS ? MESH_VERTEX_PACKED : MESH_VERTEX_FULL;
+	AssetLoader::MeshFuture packedSphereMeshLoad = assetLoader->LoadMesh(GetFullPathTo("../../Assets/Models/sphere.obj"), entityFormat);
 	
 	// Declare the textures we'll need
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobbleA,  cobbleN,  cobbleR,  cobbleM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorA,  floorN,  floorR,  floorM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintA,  paintN,  paintR,  paintM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedA,  scratchedN,  scratchedR,  scratchedM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeA,  bronzeN,  bronzeR,  bronzeM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughA,  roughN,  roughR,  roughM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodA,  woodN,  woodR,  woodM;
-
-	// Load the textures using our succinct LoadTexture() macro
-	LoadTexture(L"../../Assets/Textures/cobblestone_albedo.png", cobbleA);
-	LoadTexture(L"../../Assets/Textures/cobblestone_normals.png", cobbleN);
-	LoadTexture(L"../../Assets/Textures/cobblestone_roughness.png", cobbleR);
-	LoadTexture(L"../../Assets/Textures/cobblestone_metal.png", cobbleM);
-
-	LoadTexture(L"../../Assets/Textures/floor_albedo.png", floorA);
-	LoadTexture(L"../../Assets/Textures/floor_normals.png", floorN);
-	LoadTexture(L"../../Assets/Textures/floor_roughness.png", floorR);
-	LoadTexture(L"../../Assets/Textures/floor_metal.png", floorM);
+	std::shared_ptr<StreamedTexture> cobbleA,  cobbleN,  cobbleR,  cobbleM;
+	std::shared_ptr<StreamedTexture> floorA,  floorN,  floorR,  floorM;
+	std::shared_ptr<StreamedTexture> paintA,  paintN,  paintR,  paintM;
+	std::shared_ptr<StreamedTexture> scratchedA,  scratchedN,  scratchedR,  scratchedM;
+	std::shared_ptr<StreamedTexture> bronzeA,  bronzeN,  bronzeR,  bronzeM;
+	std::shared_ptr<StreamedTexture> roughA,  roughN,  roughR,  roughM;
+	std::shared_ptr<StreamedTexture> woodA,  woodN,  woodR,  woodM;
+
+	// Queue the textures using our succinct LoadTexture() macro
+	LoadTexture(L"../../Assets/Textures/cobblestone_albedo.png", TEXTURE_ALBEDO, cobbleA);
+	LoadTexture(L"../../Assets/Textures/cobblestone_normals.png", TEXTURE_NORMAL_MAP, cobbleN);
+	LoadTexture(L"../../Assets/Textures/cobblestone_roughness.png", TEXTURE_SINGLE_CHANNEL, cobbleR);
+	LoadTexture(L"../../Assets/Textures/cobblestone_metal.png", TEXTURE_SINGLE_CHANNEL, cobbleM);
+
+	LoadTexture(L"../../Assets/Textures/floor_albedo.png", TEXTURE_ALBEDO, floorA);
+	LoadTexture(L"../../Assets/Textures/floor_normals.png", TEXTURE_NORMAL_MAP, floorN);
+	LoadTexture(L"../../Assets/Textures/floor_roughness.png", TEXTURE_SINGLE_CHANNEL, floorR);
+	LoadTexture(L"../../Assets/Textures/floor_metal.png", TEXTURE_SINGLE_CHANNEL, floorM);
 	
-	LoadTexture(L"../../Assets/Textures/paint_albedo.png", paintA);
-	LoadTexture(L"../../Assets/Textures/paint_normals.png", paintN);
-	LoadTexture(L"../../Assets/Textures/paint_roughness.png", paintR);
-	LoadTexture(L"../../Assets/Textures/paint_metal.png", paintM);
+	LoadTexture(L"../../Assets/Textures/paint_albedo.png", TEXTURE_ALBEDO, paintA);
+	LoadTexture(L"../../Assets/Textures/paint_normals.png", TEXTURE_NORMAL_MAP, paintN);
+	LoadTexture(L"../../Assets/Textures/paint_roughness.png", TEXTURE_SINGLE_CHANNEL, paintR);
+	LoadTexture(L"../../Assets/Textures/paint_metal.png", TEXTURE_SINGLE_CHANNEL, paintM);
 	
-	LoadTexture(L"../../Assets/Textures/scratched_albedo.png", scratchedA);
-	LoadTexture(L"../../Assets/Textures/scratched_normals.png", scratchedN);
-	LoadTexture(L"../../Assets/Textures/scratched_roughness.png", scratchedR);
-	LoadTexture(L"../../Assets/Textures/scratched_metal.png", scratchedM);
+	LoadTexture(L"../../Assets/Textures/scratched_albedo.png", TEXTURE_ALBEDO, scratchedA);
+	LoadTexture(L"../../Assets/Textures/scratched_normals.png", TEXTURE_NORMAL_MAP, scratchedN);
+	LoadTexture(L"../../Assets/Textures/scratched_roughness.png", TEXTURE_SINGLE_CHANNEL, scratchedR);
+	LoadTexture(L"../../Assets/Textures/scratched_metal.png", TEXTURE_SINGLE_CHANNEL, scratchedM);
 	
-	LoadTexture(L"../../Assets/Textures/bronze_albedo.png", bronzeA);
-	LoadTexture(L"../../Assets/Textures/bronze_normals.png", bronzeN);
-	LoadTexture(L"../../Assets/Textures/bronze_roughness.png", bronzeR);
-	LoadTexture(L"../../Assets/Textures/bronze_metal.png", bronzeM);
+	LoadTexture(L"../../Assets/Textures/bronze_albedo.png", TEXTURE_ALBEDO, bronzeA);
+	LoadTexture(L"../../Assets/Textures/bronze_normals.png", TEXTURE_NORMAL_MAP, bronzeN);
+	LoadTexture(L"../../Assets/Textures/bronze_roughness.png", TEXTURE_SINGLE_CHANNEL, bronzeR);
+	LoadTexture(L"../../Assets/Textures/bronze_metal.png", TEXTURE_SINGLE_CHANNEL, bronzeM);
 	
-	LoadTexture(L"../../Assets/Textures/rough_albedo.png", roughA);
-	LoadTexture(L"../../Assets/Textures/rough_normals.png", roughN);
-	LoadTexture(L"../../Assets/Textures/rough_roughness.png", roughR);
-	LoadTexture(L"../../Assets/Textures/rough_metal.png", roughM);
+	LoadTexture(L"../../Assets/Textures/rough_albedo.png", TEXTURE_ALBEDO, roughA);
+	LoadTexture(L"../../Assets/Textures/rough_normals.png", TEXTURE_NORMAL_MAP, roughN);
+	LoadTexture(L"../../Assets/Textures/rough_roughness.png", TEXTURE_SINGLE_CHANNEL, roughR);
+	LoadTexture(L"../../Assets/Textures/rough_metal.png", TEXTURE_SINGLE_CHANNEL, roughM);
 	
-	LoadTexture(L"../../Assets/Textures/wood_albedo.png", woodA);
-	LoadTexture(L"../../Assets/Textures/wood_normals.png", woodN);
-	LoadTexture(L"../../Assets/Textures/wood_roughness.png", woodR);
-	LoadTexture(L"../../Assets/Textures/wood_metal.png", woodM);
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> whiteA, flatN, whiteM, blackR, grayR, whiteR;
-	LoadTexture(L"../../Assets/Textures/white_albedo.png", whiteA);
-	LoadTexture(L"../../Assets/Textures/white_metal.png", whiteM);
-	LoadTexture(L"../../Assets/Textures/black_roughness.png", blackR);
-	LoadTexture(L"../../Assets/Textures/gray_roughness.png", grayR);
-	LoadTexture(L"../../Assets/Textures/white_roughness.png", whiteR);
+	LoadTexture(L"../../Assets/Textures/wood_albedo.png", TEXTURE_ALBEDO, woodA);
+	LoadTexture(L"../../Assets/Textures/wood_normals.png", TEXTURE_NORMAL_MAP, woodN);
+	LoadTexture(L"../../Assets/Textures/wood_roughness.png", TEXTURE_SINGLE_CHANNEL, woodR);
+	LoadTexture(L"../../Assets/Textures/wood_metal.png", TEXTURE_SINGLE_CHANNEL, woodM);
+
+	// Flat roughness and metal are material constants now, rather than
+	// textures sampled just to read one value (see SetRoughness)
+	std::shared_ptr<StreamedTexture> whiteA;
+	LoadTexture(L"../../Assets/Textures/white_albedo.png", TEXTURE_ALBEDO, whiteA);
+
+	// Shaders used for many draws per frame write their constant buffers
+	// into one ring instead of updating their own buffers per draw
+	constantBufferRing = std::make_shared<ConstantBufferRing>(device, context);
+	if (constantBufferRing->IsSupported())
+	{
+		vertexShader->SetConstantBufferRing(constantBufferRing);
+		instancedVS->SetConstantBufferRing(constantBufferRing);
+		pixelShaderPermutations->SetConstantBufferRing(constantBufferRing);
+		pixelShaderPBRPermutations->SetConstantBufferRing(constantBufferRing);
+		if (packedVS) packedVS->SetConstantBufferRing(constantBufferRing);
+		if (packedInstancedVS) packedInstancedVS->SetConstantBufferRing(constantBufferRing);
+		for (int f = 0; f < 2; f++)
+		{
+			if (depthVS[f]) depthVS[f]->SetConstantBufferRing(constantBufferRing);
+			if (depthInstancedVS[f]) depthInstancedVS[f]->SetConstantBufferRing(constantBufferRing);
+		}
+	}
+
+	// Create the per-frame buffer that every lit pixel shader shares, so
+	// lights and camera data are uploaded once per frame, not per entity
+	D3D11_BUFFER_DESC perFrameDesc = {};
+	perFrameDesc.ByteWidth = sizeof(PerFrameData);
+	perFrameDesc.Usage = D3D11_USAGE_DEFAULT;
+	perFrameDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	device->CreateBuffer(&perFrameDesc, 0, perFrameConstantBuffer.GetAddressOf());
+
+	litPixelShaders.push_back(pixelShader);
+	litPixelShaders.push_back(pixelShaderPBR);
+	for (auto& p : litShaderPermutations)
+		p->SetSharedConstantBuffer("perFrame", perFrameConstantBuffer);
+	litShaderHandles.resize(litPixelShaders.size());
+
+	// Lights are stored on the GPU in a structured buffer, and are culled
+	// into clusters each frame before being used by the shaders above
+	lightBuffer = std::make_shared<LightBuffer>(device, context);
+	lightCuller = std::make_shared<ClusteredLightCuller>(device, context, LoadShader(SimpleComputeShader, L"LightCullingCS.cso"));
+
+	// Occlusion culling against the previous frames' depth
+	hiZCuller = std::make_shared<HiZCuller>(
+		device,
+		context,
+		LoadShader(SimpleComputeShader, L"HiZBuildCS.cso"),
+		LoadShader(SimpleComputeShader, L"HiZCullCS.cso"));
+
+	// Offscreen targets for scaling the scene's resolution
+	dynamicResolution = std::make_shared<DynamicResolution>(
+		device,
+		context,
+		renderStates,
+		LoadShader(SimpleVertexShader, L"FullscreenVS.cso"),
+		LoadShader(SimplePixelShader, L"UpscalePS.cso"));
+	dynamicResolution->Resize(width, height);
+
+	// Set up the render queue for entity drawing
+	renderQueue = std::make_shared<RenderQueue>(device, context);
+	renderQueue->SetPackedVertexShaders(packedVS, packedInstancedVS);
+	renderQueue->SetDepthVertexShaders(MESH_VERTEX_FULL, depthVS[MESH_VERTEX_FULL], depthInstancedVS[MESH_VERTEX_FULL]);
+	renderQueue->SetDepthVertexShaders(MESH_VERTEX_PACKED, depthVS[MESH_VERTEX_PACKED], depthInstancedVS[MESH_VERTEX_PACKED]);
+
+	// Or every entity at once, with indirect draws
+	gpuRenderer = std::make_shared<GPUDrivenRenderer>(device, context, LoadShader(SimpleComputeShader, L"GPUCullCS.cso"));
+	gpuRenderer->SetVertexShaders(instancedVS, packedInstancedVS);
+
+	// Shadow casters are drawn depth only, through a queue of their own
+	shadowMap = std::make_shared<CascadedShadowMap>(device, context, renderStates);
+	shadowQueue = std::make_shared<RenderQueue>(device, context);
+	shadowQueue->SetPackedVertexShaders(packedVS, packedInstancedVS);
+	shadowQueue->SetDepthVertexShaders(MESH_VERTEX_FULL, depthVS[MESH_VERTEX_FULL], depthInstancedVS[MESH_VERTEX_FULL]);
+	shadowQueue->SetDepthVertexShaders(MESH_VERTEX_PACKED, depthVS[MESH_VERTEX_PACKED], depthInstancedVS[MESH_VERTEX_PACKED]);
+	shadowQueue->SetRenderStates(shadowMap->GetRasterizerState());
+
+	// After the pre-pass, the entities only draw where they're the
+	// nearest surface, and the depth is already written
+	D3D11_DEPTH_STENCIL_DESC depthEqualDesc = {};
+	depthEqualDesc.DepthEnable = true;
+	depthEqualDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	depthEqualDesc.DepthFunc = D3D11_COMPARISON_EQUAL;
+	depthEqualState = renderStates->GetDepthStencilState(depthEqualDesc);
+
+	// Big queues are recorded on several threads, into deferred contexts
+	commandRecorder = std::make_shared<CommandRecorder>(device, context, jobSystem);
+
+	// Set up the sprite batch and load the sprite font
+	spriteBatch = std::make_shared<SpriteBatch>(context.Get());
+
+	// The states the sprite batch would make for itself: premultiplied
+	// alpha, linear clamped sampling, no depth and back face culling
+	D3D11_BLEND_DESC uiBlendDesc = {};
+	uiBlendDesc.RenderTarget[0].BlendEnable = true;
+	uiBlendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+	uiBlendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	uiBlendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	uiBlendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	uiBlendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+	uiBlendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	uiBlendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	uiBlendState = renderStates->GetBlendState(uiBlendDesc);
+
+	D3D11_SAMPLER_DESC uiSamplerDesc = {};
+	uiSamplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	uiSamplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	uiSamplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	uiSamplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	uiSamplerDesc.MaxAnisotropy = D3D11_MAX_MAXANISOTROPY;
+	uiSamplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	uiSamplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	uiSamplerState = renderStates->GetSamplerState(uiSamplerDesc);
+
+	D3D11_DEPTH_STENCIL_DESC uiDepthDesc = {};
+	uiDepthDesc.DepthEnable = false;
+	uiDepthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	uiDepthDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+	uiDepthState = renderStates->GetDepthStencilState(uiDepthDesc);
+
+	D3D11_RASTERIZER_DESC uiRasterizerDesc = {};
+	uiRasterizerDesc.FillMode = D3D11_FILL_SOLID;
+	uiRasterizerDesc.CullMode = D3D11_CULL_BACK;
+	uiRasterizerDesc.DepthClipEnable = true;
+	uiRasterizerDesc.MultisampleEnable = true;
+	uiRasterizerState = renderStates->GetRasterizerState(uiRasterizerDesc);
+	arial = std::make_shared<SpriteFont>(device.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/arial.spritefont").c_str());
 
 	// Describe and create our sampler states
 	D3D11_SAMPLER_DESC sampDesc = {};
@@ -201,7 +391,7 @@ void Game::LoadAssetsAndCreateEntities()
 	sampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
 	sampDesc.MaxAnisotropy = 16;
 	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	device->CreateSamplerState(&sampDesc, samplerOptions.GetAddressOf());
+	samplerOptions = renderStates->GetSamplerState(sampDesc);
 
 	D3D11_SAMPLER_DESC clampSamplerDesc = {};
 	clampSamplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
@@ -210,77 +400,87 @@ void Game::LoadAssetsAndCreateEntities()
 	clampSamplerDesc.Filter = D3D11_FILTER_ANISOTROPIC;
 	clampSamplerDesc.MaxAnisotropy = 16;
 	clampSamplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	device->CreateSamplerState(&clampSamplerDesc, clampSamplerOptions.GetAddressOf());
+	clampSamplerOptions = renderStates->GetSamplerState(clampSamplerDesc);
+
+	// The IBL maps are only rendered the first time a sky is seen, and
+	// are loaded from this cache after that
+	iblCache = std::make_shared<IBLCache>(device, context, GetFullPathTo_Wide(L"IBLCache"));
 
 	// IBL shaders
-	std::shared_ptr<SimplePixelShader> irradiancePS = LoadShader(SimplePixelShader, L"IBLIrradianceMapPS.cso");
-	std::shared_ptr<SimplePixelShader> iblSpecPS = LoadShader(SimplePixelShader, L"IBLSpecularConvolutionPS.cso");
-	std::shared_ptr<SimplePixelShader> iblBrdfLookupPS = LoadShader(SimplePixelShader, L"IBLBrdfLookupTablePS.cso");
-	std::shared_ptr<SimpleVertexShader> fullscreenVS = LoadShader(SimpleVertexShader, L"FullscreenVS.cso");
-
-	// Create the sky using 6 images
-	sky = std::make_shared<Sky>(
-		GetFullPathTo_Wide(L"..\\..\\Assets\\Skies\\Clouds Blue\\right.png").c_str(),
-		GetFullPathTo_Wide(L"..\\..\\Assets\\Skies\\Clouds Blue\\left.png").c_str(),
-		GetFullPathTo_Wide(L"..\\..\\Assets\\Skies\\Clouds Blue\\up.png").c_str(),
-		GetFullPathTo_Wide(L"..\\..\\Assets\\Skies\\Clouds Blue\\down.png").c_str(),
-		GetFullPathTo_Wide(L"..\\..\\Assets\\Skies\\Clouds Blue\\front.png").c_str(),
-		GetFullPathTo_Wide(L"..\\..\\Assets\\Skies\\Clouds Blue\\back.png").c_str(),
-		cubeMesh,
-		skyVS,
-		skyPS,
-		samplerOptions,
-		device,
-		context,
-		irradiancePS,
-		iblSpecPS,
-		iblBrdfLookupPS,
-		fullscreenVS);
+	std::shared_ptr<SimpleComputeShader> irradianceCS = LoadShader(SimpleComputeShader, L"IBLIrradianceMapCS.cso");
+	std::shared_ptr<SimpleComputeShader> iblSpecCS = LoadShader(SimpleComputeShader, L"IBLSpecularConvolutionCS.cso");
+	std::shared_ptr<SimpleComputeShader> iblBrdfLookupCS = LoadShader(SimpleComputeShader, L"IBLBrdfLookUpTableCS.cso");
+
+	// The sky and the scene's entities are needed for the first frame,
+	// so wait for their meshes
+	std::shared_ptr<Mesh> sphereMesh = sphereMeshLoad.get();
+	std::shared_ptr<Mesh> cubeMesh = cubeMeshLoad.get();
+	packedSphereMesh = packedSphereMeshLoad.get();
+
+	// Create the sky from its 6 faces, once they've loaded
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> skyFaceTextures[6];
+	GetSkyFaces(currentSky, skyFaceTextures);
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "IBL generation");
+		sky = std::make_shared<Sky>(
+			skyFaceTextures,
+			cubeMesh,
+			skyVS,
+			skyPS,
+			samplerOptions,
+			device,
+			context,
+			irradianceCS,
+			iblSpecCS,
+			iblBrdfLookupCS,
+			iblCache,
+			renderStates);
+	}
 
 	// Create non-PBR materials
-	std::shared_ptr<Material> cobbleMat2x = std::make_shared<Material>(pixelShader, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> cobbleMat2x = std::make_shared<Material>(pixelShaderPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	cobbleMat2x->AddSampler("BasicSampler", samplerOptions);
 	cobbleMat2x->AddTextureSRV("Albedo", cobbleA);
 	cobbleMat2x->AddTextureSRV("NormalMap", cobbleN);
 	cobbleMat2x->AddTextureSRV("RoughnessMap", cobbleR);
 
-	std::shared_ptr<Material> cobbleMat4x = std::make_shared<Material>(pixelShader, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(4, 4));
+	std::shared_ptr<Material> cobbleMat4x = std::make_shared<Material>(pixelShaderPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(4, 4));
 	cobbleMat4x->AddSampler("BasicSampler", samplerOptions);
 	cobbleMat4x->AddTextureSRV("Albedo", cobbleA);
 	cobbleMat4x->AddTextureSRV("NormalMap", cobbleN);
 	cobbleMat4x->AddTextureSRV("RoughnessMap", cobbleR);
 
-	std::shared_ptr<Material> floorMat = std::make_shared<Material>(pixelShader, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> floorMat = std::make_shared<Material>(pixelShaderPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	floorMat->AddSampler("BasicSampler", samplerOptions);
 	floorMat->AddTextureSRV("Albedo", floorA);
 	floorMat->AddTextureSRV("NormalMap", floorN);
 	floorMat->AddTextureSRV("RoughnessMap", floorR);
 
-	std::shared_ptr<Material> paintMat = std::make_shared<Material>(pixelShader, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> paintMat = std::make_shared<Material>(pixelShaderPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	paintMat->AddSampler("BasicSampler", samplerOptions);
 	paintMat->AddTextureSRV("Albedo", paintA);
 	paintMat->AddTextureSRV("NormalMap", paintN);
 	paintMat->AddTextureSRV("RoughnessMap", paintR);
 
-	std::shared_ptr<Material> scratchedMat = std::make_shared<Material>(pixelShader, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> scratchedMat = std::make_shared<Material>(pixelShaderPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	scratchedMat->AddSampler("BasicSampler", samplerOptions);
 	scratchedMat->AddTextureSRV("Albedo", scratchedA);
 	scratchedMat->AddTextureSRV("NormalMap", scratchedN);
 	scratchedMat->AddTextureSRV("RoughnessMap", scratchedR);
 
-	std::shared_ptr<Material> bronzeMat = std::make_shared<Material>(pixelShader, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> bronzeMat = std::make_shared<Material>(pixelShaderPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	bronzeMat->AddSampler("BasicSampler", samplerOptions);
 	bronzeMat->AddTextureSRV("Albedo", bronzeA);
 	bronzeMat->AddTextureSRV("NormalMap", bronzeN);
 	bronzeMat->AddTextureSRV("RoughnessMap", bronzeR);
 
-	std::shared_ptr<Material> roughMat = std::make_shared<Material>(pixelShader, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> roughMat = std::make_shared<Material>(pixelShaderPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	roughMat->AddSampler("BasicSampler", samplerOptions);
 	roughMat->AddTextureSRV("Albedo", roughA);
 	roughMat->AddTextureSRV("NormalMap", roughN);
 	roughMat->AddTextureSRV("RoughnessMap", roughR);
 
-	std::shared_ptr<Material> woodMat = std::make_shared<Material>(pixelShader, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> woodMat = std::make_shared<Material>(pixelShaderPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	woodMat->AddSampler("BasicSampler", samplerOptions);
 	woodMat->AddTextureSRV("Albedo", woodA);
 	woodMat->AddTextureSRV("NormalMap", woodN);
@@ -288,7 +488,7 @@ void Game::LoadAssetsAndCreateEntities()
 
 
 	// Create PBR materials
-	std::shared_ptr<Material> cobbleMat2xPBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> cobbleMat2xPBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	cobbleMat2xPBR->AddSampler("BasicSampler", samplerOptions);
 	cobbleMat2xPBR->AddSampler("ClampSampler", clampSamplerOptions);
 	cobbleMat2xPBR->AddTextureSRV("Albedo", cobbleA);
@@ -296,7 +496,7 @@ void Game::LoadAssetsAndCreateEntities()
 	cobbleMat2xPBR->AddTextureSRV("RoughnessMap", cobbleR);
 	cobbleMat2xPBR->AddTextureSRV("MetalMap", cobbleM);
 
-	std::shared_ptr<Material> cobbleMat4xPBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(4, 4));
+	std::shared_ptr<Material> cobbleMat4xPBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(4, 4));
 	cobbleMat4xPBR->AddSampler("BasicSampler", samplerOptions);
 	cobbleMat4xPBR->AddSampler("ClampSampler", clampSamplerOptions);
 	cobbleMat4xPBR->AddTextureSRV("Albedo", cobbleA);
@@ -304,7 +504,7 @@ void Game::LoadAssetsAndCreateEntities()
 	cobbleMat4xPBR->AddTextureSRV("RoughnessMap", cobbleR);
 	cobbleMat4xPBR->AddTextureSRV("MetalMap", cobbleM);
 
-	std::shared_ptr<Material> floorMatPBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> floorMatPBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	floorMatPBR->AddSampler("BasicSampler", samplerOptions);
 	floorMatPBR->AddSampler("ClampSampler", clampSamplerOptions);
 	floorMatPBR->AddTextureSRV("Albedo", floorA);
@@ -312,7 +512,7 @@ void Game::LoadAssetsAndCreateEntities()
 	floorMatPBR->AddTextureSRV("RoughnessMap", floorR);
 	floorMatPBR->AddTextureSRV("MetalMap", floorM);
 
-	std::shared_ptr<Material> paintMatPBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> paintMatPBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	paintMatPBR->AddSampler("BasicSampler", samplerOptions);
 	paintMatPBR->AddSampler("ClampSampler", clampSamplerOptions);
 	paintMatPBR->AddTextureSRV("Albedo", paintA);
@@ -320,7 +520,7 @@ void Game::LoadAssetsAndCreateEntities()
 	paintMatPBR->AddTextureSRV("RoughnessMap", paintR);
 	paintMatPBR->AddTextureSRV("MetalMap", paintM);
 
-	std::shared_ptr<Material> scratchedMatPBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> scratchedMatPBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	scratchedMatPBR->AddSampler("BasicSampler", samplerOptions);
 	scratchedMatPBR->AddSampler("ClampSampler", clampSamplerOptions);
 	scratchedMatPBR->AddTextureSRV("Albedo", scratchedA);
@@ -328,7 +528,7 @@ void Game::LoadAssetsAndCreateEntities()
 	scratchedMatPBR->AddTextureSRV("RoughnessMap", scratchedR);
 	scratchedMatPBR->AddTextureSRV("MetalMap", scratchedM);
 
-	std::shared_ptr<Material> bronzeMatPBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> bronzeMatPBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	bronzeMatPBR->AddSampler("BasicSampler", samplerOptions);
 	bronzeMatPBR->AddSampler("ClampSampler", clampSamplerOptions);
 	bronzeMatPBR->AddTextureSRV("Albedo", bronzeA);
@@ -336,7 +536,7 @@ void Game::LoadAssetsAndCreateEntities()
 	bronzeMatPBR->AddTextureSRV("RoughnessMap", bronzeR);
 	bronzeMatPBR->AddTextureSRV("MetalMap", bronzeM);
 
-	std::shared_ptr<Material> roughMatPBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> roughMatPBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	roughMatPBR->AddSampler("BasicSampler", samplerOptions);
 	roughMatPBR->AddSampler("ClampSampler", clampSamplerOptions);
 	roughMatPBR->AddTextureSRV("Albedo", roughA);
@@ -344,7 +544,7 @@ void Game::LoadAssetsAndCreateEntities()
 	roughMatPBR->AddTextureSRV("RoughnessMap", roughR);
 	roughMatPBR->AddTextureSRV("MetalMap", roughM);
 
-	std::shared_ptr<Material> woodMatPBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> woodMatPBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	woodMatPBR->AddSampler("BasicSampler", samplerOptions);
 	woodMatPBR->AddSampler("ClampSampler", clampSamplerOptions);
 	woodMatPBR->AddTextureSRV("Albedo", woodA);
@@ -352,68 +552,68 @@ void Game::LoadAssetsAndCreateEntities()
 	woodMatPBR->AddTextureSRV("RoughnessMap", woodR);
 	woodMatPBR->AddTextureSRV("MetalMap", woodM);
 
-	std::shared_ptr<Material> metal1PBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> metal1PBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	metal1PBR->AddSampler("BasicSampler", samplerOptions);
 	metal1PBR->AddSampler("ClampSampler", clampSamplerOptions);
 	metal1PBR->AddTextureSRV("Albedo", whiteA);
 	metal1PBR->AddTextureSRV("NormalMap", scratchedN);
-	metal1PBR->AddTextureSRV("RoughnessMap", whiteR);
-	metal1PBR->AddTextureSRV("MetalMap", whiteM);
+	metal1PBR->SetRoughness(1.0f);
+	metal1PBR->SetMetal(1.0f);
 	metal1PBR->AddTextureSRV("BrdfLookupMap", sky->GetBRDFLookupTexture());
 	metal1PBR->AddTextureSRV("IrradianceIBLMap", sky->GetIrradianceMap());
 	metal1PBR->AddTextureSRV("SpecularIBLMap", sky->GetConvolvedSpecularMap());
 
-	std::shared_ptr<Material> metal2PBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> metal2PBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	metal2PBR->AddSampler("BasicSampler", samplerOptions);
 	metal2PBR->AddSampler("ClampSampler", clampSamplerOptions);
 	metal2PBR->AddTextureSRV("Albedo", whiteA);
 	metal2PBR->AddTextureSRV("NormalMap", scratchedN);
-	metal2PBR->AddTextureSRV("RoughnessMap", grayR);
-	metal2PBR->AddTextureSRV("MetalMap", whiteM);
+	metal2PBR->SetRoughness(0.5f);
+	metal2PBR->SetMetal(1.0f);
 	metal2PBR->AddTextureSRV("BrdfLookupMap", sky->GetBRDFLookupTexture());
 	metal2PBR->AddTextureSRV("IrradianceIBLMap", sky->GetIrradianceMap());
 	metal2PBR->AddTextureSRV("SpecularIBLMap", sky->GetConvolvedSpecularMap());
 
-	std::shared_ptr<Material> metal3PBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> metal3PBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	metal3PBR->AddSampler("BasicSampler", samplerOptions);
 	metal3PBR->AddSampler("ClampSampler", clampSamplerOptions);
 	metal3PBR->AddTextureSRV("Albedo", whiteA);
 	metal3PBR->AddTextureSRV("NormalMap", scratchedN);
-	metal3PBR->AddTextureSRV("RoughnessMap", blackR);
-	metal3PBR->AddTextureSRV("MetalMap", whiteM);
+	metal3PBR->SetRoughness(0.0f);
+	metal3PBR->SetMetal(1.0f);
 	metal3PBR->AddTextureSRV("BrdfLookupMap", sky->GetBRDFLookupTexture());
 	metal3PBR->AddTextureSRV("IrradianceIBLMap", sky->GetIrradianceMap());
 	metal3PBR->AddTextureSRV("SpecularIBLMap", sky->GetConvolvedSpecularMap());
 
-	std::shared_ptr<Material> plastic1PBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> plastic1PBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	plastic1PBR->AddSampler("BasicSampler", samplerOptions);
 	plastic1PBR->AddSampler("ClampSampler", clampSamplerOptions);
 	plastic1PBR->AddTextureSRV("Albedo", whiteA);
 	plastic1PBR->AddTextureSRV("NormalMap", scratchedN);
-	plastic1PBR->AddTextureSRV("RoughnessMap", whiteR);
-	plastic1PBR->AddTextureSRV("MetalMap", blackR);
+	plastic1PBR->SetRoughness(1.0f);
+	plastic1PBR->SetMetal(0.0f);
 	plastic1PBR->AddTextureSRV("BrdfLookupMap", sky->GetBRDFLookupTexture());
 	plastic1PBR->AddTextureSRV("IrradianceIBLMap", sky->GetIrradianceMap());
 	plastic1PBR->AddTextureSRV("SpecularIBLMap", sky->GetConvolvedSpecularMap());
 
-	std::shared_ptr<Material> plastic2PBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> plastic2PBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	plastic2PBR->AddSampler("BasicSampler", samplerOptions);
 	plastic2PBR->AddSampler("ClampSampler", clampSamplerOptions);
 	plastic2PBR->AddTextureSRV("Albedo", whiteA);
 	plastic2PBR->AddTextureSRV("NormalMap", scratchedN);
-	plastic2PBR->AddTextureSRV("RoughnessMap", grayR);
-	plastic2PBR->AddTextureSRV("MetalMap", blackR);
+	plastic2PBR->SetRoughness(0.5f);
+	plastic2PBR->SetMetal(0.0f);
 	plastic2PBR->AddTextureSRV("BrdfLookupMap", sky->GetBRDFLookupTexture());
 	plastic2PBR->AddTextureSRV("IrradianceIBLMap", sky->GetIrradianceMap());
 	plastic2PBR->AddTextureSRV("SpecularIBLMap", sky->GetConvolvedSpecularMap());
 
-	std::shared_ptr<Material> plastic3PBR = std::make_shared<Material>(pixelShaderPBR, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
+	std::shared_ptr<Material> plastic3PBR = std::make_shared<Material>(pixelShaderPBRPermutations, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 2));
 	plastic3PBR->AddSampler("BasicSampler", samplerOptions);
 	plastic3PBR->AddSampler("ClampSampler", clampSamplerOptions);
 	plastic3PBR->AddTextureSRV("Albedo", whiteA);
 	plastic3PBR->AddTextureSRV("NormalMap", scratchedN);
-	plastic3PBR->AddTextureSRV("RoughnessMap", blackR);
-	plastic3PBR->AddTextureSRV("MetalMap", blackR);
+	plastic3PBR->SetRoughness(0.0f);
+	plastic3PBR->SetMetal(0.0f);
 	plastic3PBR->AddTextureSRV("BrdfLookupMap", sky->GetBRDFLookupTexture());
 	plastic3PBR->AddTextureSRV("IrradianceIBLMap", sky->GetIrradianceMap());
 	plastic3PBR->AddTextureSRV("SpecularIBLMap", sky->GetConvolvedSpecularMap());
@@ -421,32 +621,47 @@ void Game::LoadAssetsAndCreateEntities()
 
 	// === Create the PBR entities =====================================
 	//std::shared_ptr<GameEntity> cobSpherePBR = std::make_shared<GameEntity>(sphereMesh, cobbleMat2xPBR);
-	std::shared_ptr<GameEntity> metalSphere1 = std::make_shared<GameEntity>(sphereMesh, metal1PBR);
+	std::shared_ptr<GameEntity> metalSphere1 = std::make_shared<GameEntity>(packedSphereMesh, metal1PBR);
 	metalSphere1->GetTransform()->SetPosition(-6, 2, 0);
 
 	//std::shared_ptr<GameEntity> floorSpherePBR = std::make_shared<GameEntity>(sphereMesh, floorMatPBR);
-	std::shared_ptr<GameEntity> metalSphere2 = std::make_shared<GameEntity>(sphereMesh, metal2PBR);
+	std::shared_ptr<GameEntity> metalSphere2 = std::make_shared<GameEntity>(packedSphereMesh, metal2PBR);
 	metalSphere2->GetTransform()->SetPosition(-4, 2, 0);
 
 	//std::shared_ptr<GameEntity> paintSpherePBR = std::make_shared<GameEntity>(sphereMesh, paintMatPBR);
-	std::shared_ptr<GameEntity> metalSphere3 = std::make_shared<GameEntity>(sphereMesh, metal3PBR);
+	std::shared_ptr<GameEntity> metalSphere3 = std::make_shared<GameEntity>(packedSphereMesh, metal3PBR);
 	metalSphere3->GetTransform()->SetPosition(-2, 2, 0);
 
 	//std::shared_ptr<GameEntity> scratchSpherePBR = std::make_shared<GameEntity>(sphereMesh, scratchedMatPBR);
-	std::shared_ptr<GameEntity> plasticSphere1 = std::make_shared<GameEntity>(sphereMesh, plastic1PBR);
+	std::shared_ptr<GameEntity> plasticSphere1 = std::make_shared<GameEntity>(packedSphereMesh, plastic1PBR);
 	plasticSphere1->GetTransform()->SetPosition(0, 2, 0);
 
 	//std::shared_ptr<GameEntity> bronzeSpherePBR = std::make_shared<GameEntity>(sphereMesh, bronzeMatPBR);
-	std::shared_ptr<GameEntity> plasticSphere2 = std::make_shared<GameEntity>(sphereMesh, plastic2PBR);
+	std::shared_ptr<GameEntity> plasticSphere2 = std::make_shared<GameEntity>(packedSphereMesh, plastic2PBR);
 	plasticSphere2->GetTransform()->SetPosition(2, 2, 0);
 
 	//std::shared_ptr<GameEntity> roughSpherePBR = std::make_shared<GameEntity>(sphereMesh, roughMatPBR);
-	std::shared_ptr<GameEntity> plasticSphere3 = std::make_shared<GameEntity>(sphereMesh, plastic3PBR);
+	std::shared_ptr<GameEntity> plasticSphere3 = std::make_shared<GameEntity>(packedSphereMesh, plastic3PBR);
 	plasticSphere3->GetTransform()->SetPosition(4, 2, 0);
 
 	//std::shared_ptr<GameEntity> woodSpherePBR = std::make_shared<GameEntity>(sphereMesh, woodMatPBR);
 	//woodSpherePBR->GetTransform()->SetPosition(6, 2, 0);
 
+	spawnableMaterials.push_back(metal1PBR);
+	spawnableMaterials.push_back(metal2PBR);
+	spawnableMaterials.push_back(metal3PBR);
+	spawnableMaterials.push_back(plastic1PBR);
+	spawnableMaterials.push_back(plastic2PBR);
+	spawnableMaterials.push_back(plastic3PBR);
+
+	// Rebound whenever the sky's IBL maps change
+	iblMaterials.push_back(metal1PBR);
+	iblMaterials.push_back(metal2PBR);
+	iblMaterials.push_back(metal3PBR);
+	iblMaterials.push_back(plastic1PBR);
+	iblMaterials.push_back(plastic2PBR);
+	iblMaterials.push_back(plastic3PBR);
+
 	entities.push_back(metalSphere1);
 	entities.push_back(metalSphere2);
 	entities.push_back(metalSphere3);
@@ -491,11 +706,94 @@ void Game::LoadAssetsAndCreateEntities()
 	entities.push_back(roughSphere);
 	entities.push_back(woodSphere);*/
 
+	// The first frame needs at least the low mips of every texture
+	textureStreamer->Flush();
+
+	// Build the spatial structure over everything in the scene
+	sceneBVH = std::make_shared<SceneBVH>();
+	for (auto& ge : entities)
+		sceneBVH->Insert(ge.get());
+
 
 	// Save assets needed for drawing point lights
 	lightMesh = sphereMesh;
-	lightVS = vertexShader;
-	lightPS = solidColorPS;
+	ResolveShaderHandles();
+}
+
+// --------------------------------------------------------
+// Looks up the handles for the light resources and point
+// light shaders.  Handles only last until their shader is
+// reloaded, so this is checked each frame, and only does
+// the lookups when a reflection version has changed
+// --------------------------------------------------------
+void Game::ResolveShaderHandles()
+{
+	for (size_t i = 0; i < litPixelShaders.size(); i++)
+	{
+		std::shared_ptr<SimplePixelShader> ps = litPixelShaders[i];
+		LitShaderHandles& handles = litShaderHandles[i];
+		if (handles.Version == ps->GetReflectionVersion())
+			continue;
+
+		handles.Version = ps->GetReflectionVersion();
+		handles.Lights = ps->GetShaderResourceViewHandle("Lights");
+		handles.ClusterLightGrid = ps->GetShaderResourceViewHandle("ClusterLightGrid");
+		handles.ClusterLightIndices = ps->GetShaderResourceViewHandle("ClusterLightIndices");
+		handles.ShadowMap = ps->GetShaderResourceViewHandle("ShadowMap");
+		handles.ShadowSampler = ps->GetSamplerHandle("ShadowSampler");
+	}
+
+	if (lightVSVersion != lightVS->GetReflectionVersion())
+	{
+		lightVSVersion = lightVS->GetReflectionVersion();
+		lightViewHandle = lightVS->GetVariableHandle("view");
+		lightProjectionHandle = lightVS->GetVariableHandle("projection");
+		lightBufferHandle = lightVS->GetShaderResourceViewHandle("Lights");
+	}
+}
+
+// --------------------------------------------------------
+// Loads a vertex shader that reads PackedVertex data.  The
+// packed formats can't be inferred from the shader's inputs,
+// so the input layout is built by the mesh instead.
+// Returns null if the shader or its layout can't be created
+// --------------------------------------------------------
+std::shared_ptr<SimpleVertexShader> Game::LoadPackedVertexShader(const std::wstring& file, bool perInstance)
+{
+	std::wstring path = GetFullPathTo_Wide(file);
+
+	Microsoft::WRL::ComPtr<ID3DBlob> blob;
+	if (FAILED(D3DReadFileToBlob(path.c_str(), blob.GetAddressOf())))
+		return nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> layout;
+	if (FAILED(Mesh::CreatePackedInputLayout(device, blob, perInstance, layout.GetAddressOf())))
+		return nullptr;
+
+	std::shared_ptr<SimpleVertexShader> vs = std::make_shared<SimpleVertexShader>(device.Get(), context.Get(), path.c_str(), layout, perInstance);
+	return vs->IsShaderValid() ? shaderManager->Watch(vs, file) : nullptr;
+}
+
+
+// --------------------------------------------------------
+// Loads a depth only vertex shader for meshes in the given
+// format, with an input layout for just their positions.
+// Returns null if the shader or its layout can't be created
+// --------------------------------------------------------
+std::shared_ptr<SimpleVertexShader> Game::LoadDepthVertexShader(const std::wstring& file, MeshVertexFormat format, bool perInstance)
+{
+	std::wstring path = GetFullPathTo_Wide(file);
+
+	Microsoft::WRL::ComPtr<ID3DBlob> blob;
+	if (FAILED(D3DReadFileToBlob(path.c_str(), blob.GetAddressOf())))
+		return nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> layout;
+	if (FAILED(Mesh::CreatePositionInputLayout(device, blob, format, perInstance, layout.GetAddressOf())))
+		return nullptr;
+
+	std::shared_ptr<SimpleVertexShader> vs = std::make_shared<SimpleVertexShader>(device.Get(), context.Get(), path.c_str(), layout, perInstance);
+	return vs->IsShaderValid() ? shaderManager->Watch(vs, file) : nullptr;
 }
 
 
@@ -534,18 +832,76 @@ void Game::GenerateLights()
 
 	// Create the rest of the lights
 	while (lights.size() < lightCount)
-	{
-		Light point = {};
-		point.Type = LIGHT_TYPE_POINT;
-		point.Position = XMFLOAT3(RandomRange(-10.0f, 10.0f), RandomRange(-5.0f, 5.0f), RandomRange(-10.0f, 10.0f));
-		point.Color = XMFLOAT3(RandomRange(0, 1), RandomRange(0, 1), RandomRange(0, 1));
-		point.Range = RandomRange(5.0f, 10.0f);
-		point.Intensity = RandomRange(0.1f, 3.0f);
+		lights.push_back(CreateRandomPointLight());
+
+	// Everything changed
+	lightBuffer->MarkAllDirty();
+}
 
-		// Add to the list
-		lights.push_back(point);
+
+// --------------------------------------------------------
+// Adds or removes point lights until there are exactly
+// count lights, leaving the existing ones untouched
+// --------------------------------------------------------
+void Game::ResizeLights(int count)
+{
+	unsigned int oldCount = (unsigned int)lights.size();
+	if (count < (int)oldCount)
+	{
+		lights.resize(max(count, 0));
+		return;
 	}
 
+	while ((int)lights.size() < count)
+		lights.push_back(CreateRandomPointLight());
+
+	// Only the new lights need to be uploaded
+	lightBuffer->MarkDirty(oldCount, (unsigned int)lights.size() - oldCount);
+}
+
+
+// --------------------------------------------------------
+// Makes a point light at a random position, with a random
+// color, range and intensity
+// --------------------------------------------------------
+Light Game::CreateRandomPointLight()
+{
+	Light point = {};
+	point.Type = LIGHT_TYPE_POINT;
+	point.Position = XMFLOAT3(RandomRange(-10.0f, 10.0f), RandomRange(-5.0f, 5.0f), RandomRange(-10.0f, 10.0f));
+	point.Color = XMFLOAT3(RandomRange(0, 1), RandomRange(0, 1), RandomRange(0, 1));
+	point.Range = RandomRange(5.0f, 10.0f);
+	point.Intensity = RandomRange(0.1f, 3.0f);
+	return point;
+}
+
+
+// --------------------------------------------------------
+// Slowly orbits the point and spot lights around the
+// world's Y axis
+// --------------------------------------------------------
+void Game::AnimateLights(float deltaTime)
+{
+	float angle = deltaTime * 0.5f;
+	float c = cosf(angle);
+	float s = sinf(angle);
+
+	jobSystem->ParallelFor(0, lights.size(), 1024, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			Light& light = lights[i];
+			if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+				continue;
+
+			float x = light.Position.x;
+			float z = light.Position.z;
+			light.Position.x = x * c - z * s;
+			light.Position.z = x * s + z * c;
+		}
+	});
+
+	lightBuffer->MarkAllDirty();
 }
 
 
@@ -562,6 +918,10 @@ void Game::OnResize()
 	// Update our projection matrix to match the new aspect ratio
 	if (camera)
 		camera->UpdateProjectionMatrix(this->width / (float)this->height);
+
+	// Only reallocates when the size crosses a bucket
+	if (dynamicResolution)
+		dynamicResolution->Resize(this->width, this->height);
 }
 
 // --------------------------------------------------------
@@ -569,19 +929,50 @@ void Game::OnResize()
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	PROFILE_SCOPE("Game::Update");
+
+	// Benchmarks step the simulation by the same amount every frame
+	if (benchmark.IsEnabled())
+	{
+		UpdateBenchmark(deltaTime);
+		deltaTime = benchmark.GetFrameStep();
+	}
+
 	UpdateImGui(deltaTime, totalTime);
 	UpdateImGuiWindowManager();
 	if (showDemoWindow) ImGui::ShowDemoWindow();
+	if (showCPUProfiler) UpdateImGuiCPUProfiler();
 	if (showInfoWindow) UpdateImGuiInfoWindow(deltaTime);
 	if (showWorldEditor) UpdateImGuiWorldEditor(deltaTime);
 
-	// Update the camera
-	camera->Update(deltaTime);
+	// Update the camera, unless a benchmark is flying it
+	if (!benchmark.IsEnabled())
+		camera->Update(deltaTime);
+
+	if (animateLights)
+		AnimateLights(deltaTime);
+
+	// Rebuild every changed matrix in one pass, so the refit and
+	// the draw below only read them
+	{
+		PROFILE_SCOPE("Transforms");
+		TransformPool::GetInstance().UpdateMatrices(jobSystem.get());
+	}
+
+	// Keep the spatial structure in sync with anything that moved
+	{
+		PROFILE_SCOPE("BVH refit");
+		sceneBVH->Refit();
+	}
 
 	// Check individual input
 	Input& input = Input::GetInstance();
 	if (input.KeyDown(VK_ESCAPE)) Quit();
 	if (input.KeyPress(VK_TAB)) GenerateLights();
+
+	// Select entities in the world editor by right clicking them
+	if (showWorldEditor && input.MouseRightPress())
+		PickEntity(input.GetMouseX(), input.GetMouseY());
 }
 
 void Game::UpdateImGui(float deltaTime, float totalTime)
@@ -609,15 +1000,28 @@ void Game::UpdateImGui(float deltaTime, float totalTime)
 	input.GetKeyArray(io.KeysDown, 256);
 	
 	// Reset the frame
-	ImGui_ImplDX11_NewFrame();
-	ImGui_ImplWin32_NewFrame();
-	ImGui::NewFrame();
+	{
+		PROFILE_SCOPE("ImGui::NewFrame");
+		ImGui_ImplDX11_NewFrame();
+		ImGui_ImplWin32_NewFrame();
+		ImGui::NewFrame();
+	}
 	
 	// Determine new input capture
 	input.SetGuiKeyboardCapture(io.WantCaptureKeyboard);
 	input.SetGuiMouseCapture(io.WantCaptureMouse);
 }
 
+// Waits for one of the skies' faces to load and gets their textures
+void Game::GetSkyFaces(int skyIndex, Microsoft::WRL::ComPtr<ID3D11Texture2D> faces[6])
+{
+	for (int i = 0; i < 6; i++)
+	{
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> faceSRV = skyFaceLoads[skyIndex][i].get();
+		if (faceSRV) faceSRV->GetResource((ID3D11Resource**)faces[i].GetAddressOf());
+	}
+}
+
 // Outputs some basic info about the renderer:
 // FPS, window width/height, aspect ratio, and the number of lights and entities
 void Game::UpdateImGuiInfoWindow(float deltaTime)
@@ -631,6 +1035,134 @@ void Game::UpdateImGuiInfoWindow(float deltaTime)
 
 	ImGui::Text("Number of entities: %d", entities.size());
 	ImGui::Text("Number of lights: %d", lightCount);
+	ImGui::Text("Transforms: %u (%u updated)", TransformPool::GetInstance().GetCount(), TransformPool::GetInstance().GetLastUpdateCount());
+	ImGui::Text("Lights uploaded: %u (capacity %u)", lightBuffer->GetLastUploadCount(), lightBuffer->GetCapacity());
+
+	ImGui::Text("Visible entities: %u", visibleEntityCount);
+	ImGui::Text("Culled entities: %u", culledEntityCount);
+	if (useOcclusionCulling && useFrustumCulling)
+		ImGui::Text("  Occluded: %u", occludedEntityCount);
+	ImGui::Text("BVH height: %d (%u nodes, %u reinserted)", sceneBVH->GetHeight(), sceneBVH->GetNodeCount(), sceneBVH->GetLastRefitCount());
+	if (useGPUDrivenRendering)
+		ImGui::Text("Indirect draws: %u (%u buckets, %u entities)", gpuRenderer->GetDrawCallCount(), gpuRenderer->GetBucketCount(), gpuRenderer->GetEntityCount());
+	else
+		ImGui::Text("Draw calls: %u", renderQueue->GetDrawCallCount());
+	if (useDepthPrepass && depthPrepassAvailable)
+		ImGui::Text("Depth pre-pass draw calls: %u", renderQueue->GetDepthDrawCallCount());
+	if (useShadows)
+		ImGui::Text("Shadow cascades drawn: %u / %u", shadowMap->GetRenderedCascadeCount(), shadowMap->GetCascadeCount());
+	if (useMeshLods)
+	{
+		ImGui::Text("Items per LOD: %u / %u / %u / %u",
+			renderQueue->GetLodItemCount(0), renderQueue->GetLodItemCount(1),
+			renderQueue->GetLodItemCount(2), renderQueue->GetLodItemCount(3));
+	}
+	ImGui::Text("State changes: %u", renderQueue->GetStateChangeCount());
+	unsigned int compiledPermutations = 0;
+	unsigned int failedPermutations = 0;
+	for (auto& p : litShaderPermutations)
+	{
+		compiledPermutations += p->GetCompiledCount();
+		failedPermutations += p->GetFailedCount();
+	}
+	ImGui::Text("Shader permutations: %u (%u failed)", compiledPermutations, failedPermutations);
+	ImGui::Text("Shader reloads: %u (%u watched)", shaderManager->GetReloadCount(), shaderManager->GetWatchedCount());
+	std::string shaderError = shaderManager->GetLastError();
+	if (!shaderError.empty() && ImGui::TreeNode("Last shader error"))
+	{
+		ImGui::TextWrapped("%s", shaderError.c_str());
+		ImGui::TreePop();
+	}
+	ImGui::Text("State changes avoided: %u", renderQueue->GetStateChangesAvoided());
+	ImGui::Text("Render states: %u (%u requested)", renderStates->GetStateCount(), renderStates->GetRequestCount());
+	ImGui::Text("Recording contexts: %u (%s command lists)",
+		commandRecorder->GetContextCount(),
+		commandRecorder->HasDriverCommandLists() ? "driver" : "emulated");
+	if (constantBufferRing->IsSupported())
+	{
+		ImGui::Text("Constant buffer ring: %u chunks, %u / %u KB (%u overflowed)",
+			constantBufferRing->GetFrameAllocationCount(),
+			constantBufferRing->GetFrameBytesUsed() / 1024,
+			constantBufferRing->GetCapacity() / 1024,
+			constantBufferRing->GetFrameOverflowCount());
+	}
+	else
+	{
+		ImGui::Text("Constant buffer ring: unsupported");
+	}
+
+	ImGui::Text("Streamed textures: %u (%u at full size, %u streaming)",
+		textureStreamer->GetTextureCount(),
+		textureStreamer->GetFullyResidentCount(),
+		textureStreamer->GetStreamingCount());
+	ImGui::Text("Texture memory: %.1f / %.1f MB",
+		textureStreamer->GetResidentBytes() / (1024.0f * 1024.0f),
+		textureStreamer->GetBudget() / (1024.0f * 1024.0f));
+	ImGui::Text("Mip loads: %u (%u evictions)", textureStreamer->GetStreamedInCount(), textureStreamer->GetEvictionCount());
+	if (ImGui::SliderInt("Texture budget (MB)", &textureBudgetMB, 1, 512))
+		textureStreamer->SetBudget((size_t)textureBudgetMB * 1024 * 1024);
+
+	// Re-convolves the sky's IBL maps in place
+	if (ImGui::Button("Rebuild IBL"))
+	{
+		WaitForPresent();
+		GPUProfileScope scope(gpuProfiler.get(), "IBL generation");
+		sky->RegenerateIBL();
+	}
+
+	// Or changes skies, a little at a time
+	const char* skyNames[skyCount] = { "Clouds Blue", "Night" };
+	if (ImGui::Combo("Sky", &currentSky, skyNames, skyCount))
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> faces[6];
+		GetSkyFaces(currentSky, faces);
+		WaitForPresent();
+		sky->ChangeEnvironment(faces);
+	}
+	ImGui::SliderFloat("IBL update budget (ms)", &iblBudgetMs, 0.1f, 8.0f);
+	if (sky->IsIBLUpdatePending())
+		ImGui::ProgressBar(sky->GetIBLUpdateProgress());
+
+	// Rolling GPU timings, a few frames behind
+	if (ImGui::CollapsingHeader("GPU timings"))
+	{
+		ImGui::Text("Untimed frames: %u", gpuProfiler->GetSkippedFrameCount());
+		for (unsigned int i = 0; i < gpuProfiler->GetPassCount(); i++)
+		{
+			int count = 0;
+			int offset = 0;
+			const float* history = gpuProfiler->GetPassHistory(i, &count, &offset);
+
+			char overlay[32];
+			sprintf_s(overlay, "%.3f ms", gpuProfiler->GetPassAverageMs(i));
+			ImGui::PlotLines(gpuProfiler->GetPassName(i), history, count, offset, overlay, 0.0f, FLT_MAX, ImVec2(0, 40));
+		}
+	}
+
+	// Switchable at any time, and picked up by the next frame
+	if (ImGui::CollapsingHeader("Frame pacing"))
+	{
+		ImGui::Checkbox("VSync", &vsync);
+
+		ImGui::BeginDisabled(vsync || !IsTearingSupported());
+		ImGui::Checkbox(IsTearingSupported() ? "Allow tearing" : "Allow tearing (unsupported)", &allowTearing);
+		ImGui::EndDisabled();
+
+		ImGui::BeginDisabled(!IsSwapChainWaitable());
+		ImGui::Checkbox("Wait on swap chain", &waitForSwapChain);
+		int latency = GetMaxFrameLatency();
+		if (ImGui::SliderInt("Max frame latency", &latency, 1, 4))
+			SetMaxFrameLatency(latency);
+		ImGui::EndDisabled();
+
+		ImGui::DragFloat("Frame rate limit", &frameRateLimit, 1.0f, 0.0f, 1000.0f, frameRateLimit > 0.0f ? "%.0f fps" : "Off");
+
+		ImGui::Text("Pacing wait: %.2f ms", GetFramePacingMs());
+		if (GetPresentLatencyMs() > 0.0f)
+			ImGui::Text("Frame start to display: %.2f ms", GetPresentLatencyMs());
+		else
+			ImGui::Text("Frame start to display: unavailable");
+	}
 
 	ImGui::End();
 }
@@ -640,14 +1172,65 @@ void Game::UpdateImGuiWorldEditor(float deltaTime)
 {
 	ImGui::Begin("World Editor");
 
+	if (ImGui::CollapsingHeader("Rendering"))
+	{
+		ImGui::Checkbox("Use instancing", &useInstancing);
+		ImGui::Checkbox("Frustum culling", &useFrustumCulling);
+		ImGui::BeginDisabled(!useFrustumCulling);
+		ImGui::Checkbox("Occlusion culling (Hi-Z)", &useOcclusionCulling);
+		ImGui::EndDisabled();
+		ImGui::Checkbox("Record draws in parallel", &useParallelSubmission);
+		ImGui::Checkbox("GPU driven rendering", &useGPUDrivenRendering);
+		ImGui::BeginDisabled(!depthPrepassAvailable);
+		ImGui::Checkbox("Depth pre-pass", &useDepthPrepass);
+		ImGui::EndDisabled();
+		ImGui::Checkbox("Shadows", &useShadows);
+		ImGui::Checkbox("Hot reload shaders", &hotReloadShaders);
+		ImGui::Checkbox("Mesh LODs", &useMeshLods);
+		ImGui::BeginDisabled(!useMeshLods);
+		ImGui::SliderFloat("LOD error (pixels)", &lodErrorPixels, 0.25f, 8.0f);
+		ImGui::EndDisabled();
+		ImGui::Checkbox("Dynamic resolution", &useDynamicResolution);
+		ImGui::BeginDisabled(!useDynamicResolution);
+		float targetMs = dynamicResolution->GetTargetFrameMs();
+		if (ImGui::SliderFloat("Target GPU time (ms)", &targetMs, 4.0f, 33.3f))
+			dynamicResolution->SetTargetFrameMs(targetMs);
+		float minScale = dynamicResolution->GetMinScale();
+		if (ImGui::SliderFloat("Minimum scale", &minScale, 0.25f, 1.0f))
+			dynamicResolution->SetScaleRange(minScale, dynamicResolution->GetMaxScale());
+		ImGui::Text("Scale: %.2f (%ux%u, %u allocations)",
+			dynamicResolution->GetScale(),
+			dynamicResolution->GetRenderWidth(),
+			dynamicResolution->GetRenderHeight(),
+			dynamicResolution->GetAllocationCount());
+		ImGui::EndDisabled();
+		ImGui::Checkbox("Spawn with packed vertices", &spawnPackedMeshes);
+		if (ImGui::Button("Spawn 1000 spheres"))
+			SpawnEntities(1000);
+	}
+
 	if (ImGui::CollapsingHeader("Entities")) 
 	{
+		if (selectedEntityIndex >= 0)
+			ImGui::Text("Selected: Entity %d (right click to pick)", selectedEntityIndex);
+		else
+			ImGui::Text("Right click an entity to select it");
+
 		// Draw UI for each entity if the Entities header is expanded
 		for (int i = 0; i < entities.size(); i++)
+		{
+			if (i == selectedEntityIndex)
+				ImGui::SetNextItemOpen(true);
 			EntityImGui(entities[i].get(), i);
+		}
 	}
 	if (ImGui::CollapsingHeader("Lights"))
 	{
+		// Changing the count only adds or removes lights at the end
+		if (ImGui::DragInt("Light count", &lightCount, 1.0f, 3, 8192))
+			ResizeLights(lightCount);
+		ImGui::Checkbox("Animate lights", &animateLights);
+
 		// Draw the UI for each light if the Lights header is expanded
 		for (int i = 0; i < lights.size(); i++)
 			LightsImGui(&lights[i], i);
@@ -663,10 +1246,83 @@ void Game::UpdateImGuiWindowManager()
 	ImGui::Checkbox("Show World Editor", &showWorldEditor);
 	ImGui::Checkbox("Show Info Window", &showInfoWindow);
 	ImGui::Checkbox("Show Demo Window", &showDemoWindow);
+	ImGui::Checkbox("Show CPU Profiler", &showCPUProfiler);
 
 	ImGui::End();
 }
 
+// Shows the last frame's CPU scopes as a timeline, with a row per
+// thread and nested scopes stacked below their parents
+void Game::UpdateImGuiCPUProfiler()
+{
+	ImGui::Begin("CPU Profiler");
+
+	bool enabled = CPUProfiler::IsEnabled();
+	if (ImGui::Checkbox("Enabled", &enabled))
+		CPUProfiler::SetEnabled(enabled);
+
+	// Dump a few frames for chrome://tracing or similar
+	ImGui::SliderInt("Trace frames", &traceFrameCount, 1, 300);
+	if (CPUProfiler::IsCapturing())
+		ImGui::Text("Capturing...");
+	else if (ImGui::Button("Save trace"))
+		CPUProfiler::CaptureTrace(traceFrameCount, GetFullPathTo_Wide(L"cpu_trace.json"));
+
+	long long frameStart = 0;
+	long long frameEnd = 0;
+	CPUProfiler::GetLastFrame(profileEvents, &frameStart, &frameEnd);
+	double ticksPerMs = CPUProfiler::GetTicksPerMs();
+	double frameTicks = (double)max(frameEnd - frameStart, 1ll);
+	ImGui::Text("Last frame: %.3f ms", frameTicks / ticksPerMs);
+
+	// Each thread needs as many rows as its deepest scope
+	unsigned int threadCount = CPUProfiler::GetThreadCount();
+	std::vector<int> rowCounts(threadCount, 0);
+	for (auto& e : profileEvents)
+		rowCounts[e.Thread] = max(rowCounts[e.Thread], (int)e.Depth + 1);
+
+	const float rowHeight = 18.0f;
+	const float labelWidth = 110.0f;
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	float timelineWidth = max(ImGui::GetContentRegionAvail().x - labelWidth, 100.0f);
+
+	std::vector<float> threadTops(threadCount, 0.0f);
+	float y = origin.y;
+	for (unsigned int t = 0; t < threadCount; t++)
+	{
+		if (rowCounts[t] == 0)
+			continue;
+
+		threadTops[t] = y;
+		drawList->AddText(ImVec2(origin.x, y), IM_COL32_WHITE, CPUProfiler::GetThreadName(t).c_str());
+		y += rowCounts[t] * rowHeight + 4.0f;
+	}
+
+	for (auto& e : profileEvents)
+	{
+		float x0 = origin.x + labelWidth + (float)(max(e.Start - frameStart, 0ll) / frameTicks) * timelineWidth;
+		float x1 = origin.x + labelWidth + (float)((e.End - frameStart) / frameTicks) * timelineWidth;
+		x1 = max(x1, x0 + 1.0f);
+		ImVec2 rectMin(x0, threadTops[e.Thread] + e.Depth * rowHeight);
+		ImVec2 rectMax(x1, rectMin.y + rowHeight - 1.0f);
+
+		// The same scope is always the same color
+		float hue = (float)(((size_t)e.Name * 2654435761u) % 1000) / 1000.0f;
+		drawList->AddRectFilled(rectMin, rectMax, ImColor::HSV(hue, 0.5f, 0.7f));
+		drawList->PushClipRect(rectMin, rectMax, true);
+		drawList->AddText(ImVec2(rectMin.x + 2.0f, rectMin.y + 1.0f), IM_COL32_WHITE, e.Name);
+		drawList->PopClipRect();
+
+		if (ImGui::IsMouseHoveringRect(rectMin, rectMax))
+			ImGui::SetTooltip("%s: %.3f ms", e.Name, (e.End - e.Start) / ticksPerMs);
+	}
+
+	// Make room for what was drawn
+	ImGui::Dummy(ImVec2(labelWidth + timelineWidth, y - origin.y));
+	ImGui::End();
+}
+
 // Takes care of entity UI. Allows the user to edit some fields in real time.
 // Note: Does not call Begin or End, and as such is only intended to be used in
 // an existing game window
@@ -725,34 +1381,47 @@ void Game::LightsImGui(Light* light, int lightIndex)
 			break;
 		}
 
+		// Track edits, so only this light is re-uploaded
+		bool changed = false;
+
 		// Display:
 		// Type
 		ImGui::Text(lightType.c_str());
 		// Direction
 		if (dir)
 		{
-			ImGui::DragFloat3("Direction", (float*)(&light->Direction), 0.1f, -3.14f, 3.14f);
+			changed |= ImGui::DragFloat3("Direction", (float*)(&light->Direction), 0.1f, -3.14f, 3.14f);
 		}
 		// Range
 		if (range)
 		{
-			ImGui::DragFloat("Range", &light->Range, 0.1f, 0.1f, 1000.0f);
+			changed |= ImGui::DragFloat("Range", &light->Range, 0.1f, 0.1f, 1000.0f);
 		}
 		// Position
 		if (position)
 		{
-			ImGui::DragFloat3("Position", (float*)(&light->Position), 0.1f, -10.0f, 10.0f);
+			changed |= ImGui::DragFloat3("Position", (float*)(&light->Position), 0.1f, -10.0f, 10.0f);
+		}
+		// Entities in range, which will be affected by this light
+		if (range && position)
+		{
+			queryResults.clear();
+			sceneBVH->QuerySphere(BoundingSphere(light->Position, light->Range), queryResults);
+			ImGui::Text("Entities in range: %d", (int)queryResults.size());
 		}
 		// Intensity
-		ImGui::DragFloat("Intensity", &light->Intensity, 0.1f, 0.1f, 100.0f);
+		changed |= ImGui::DragFloat("Intensity", &light->Intensity, 0.1f, 0.1f, 100.0f);
 		// Color
-		ImGui::ColorEdit3("Color", (float*)(&light->Color));
+		changed |= ImGui::ColorEdit3("Color", (float*)(&light->Color));
 		// SpotFalloff
 		if (spotFalloff)
 		{
-			ImGui::DragFloat("Spot Falloff", &light->Range, 0.1f, 0.1f, 10.0f);
+			changed |= ImGui::DragFloat("Spot Falloff", &light->Range, 0.1f, 0.1f, 10.0f);
 		}
 
+		if (changed)
+			lightBuffer->MarkDirty(lightIndex);
+
 		ImGui::TreePop();
 	}
 }
@@ -762,117 +1431,426 @@ void Game::LightsImGui(Light* light, int lightIndex)
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
+	PROFILE_SCOPE("Game::Draw");
+
 	// Background color for clearing
 	const float color[4] = { 0, 0, 0, 1 };
+	gpuProfiler->BeginFrame();
+
+	// Each whole frame time that comes back (a few frames late) moves
+	// the resolution toward the target
+	if (gpuProfiler->GetPassCount() > 0 && gpuProfiler->GetPassTotalCount(0) != dynamicResolutionFrames)
+	{
+		dynamicResolutionFrames = gpuProfiler->GetPassTotalCount(0);
+		if (useDynamicResolution)
+			dynamicResolution->Update(gpuProfiler->GetPassLatestMs(0));
+	}
+
+	// The scene goes to the scaled target, if there is one, and
+	// is upscaled to the back buffer before the UI
+	bool scaleScene = useDynamicResolution && dynamicResolution->GetSceneRTV();
+	sceneRTV = scaleScene ? dynamicResolution->GetSceneRTV() : backBufferRTV;
+	sceneDSV = scaleScene ? dynamicResolution->GetSceneDSV() : depthStencilView;
+	sceneDepthSRV = scaleScene ? dynamicResolution->GetSceneDepthSRV() : depthStencilSRV;
+	sceneWidth = scaleScene ? dynamicResolution->GetRenderWidth() : width;
+	sceneHeight = scaleScene ? dynamicResolution->GetRenderHeight() : height;
 
 	// Clear the render target and depth buffer (erases what's on the screen)
 	//  - Do this ONCE PER FRAME
 	//  - At the beginning of Draw (before drawing *anything*)
-	context->ClearRenderTargetView(backBufferRTV.Get(), color);
+	context->ClearRenderTargetView(sceneRTV.Get(), color);
 	context->ClearDepthStencilView(
-		depthStencilView.Get(),
+		sceneDSV.Get(),
 		D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
 		1.0f,
 		0);
+	if (scaleScene)
+	{
+		context->ClearDepthStencilView(depthStencilView.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+		BindSceneTarget();
+	}
 
+	// Swap in any shaders that were edited, before anything draws with them
+	shaderManager->SetWatching(hotReloadShaders);
+	if (shaderManager->Update() > 0)
+		ResolveShaderHandles();
 
-	// Draw all of the entities
-	for (auto& ge : entities)
+	// Start handing out constant buffer chunks from a fresh buffer
+	constantBufferRing->BeginFrame();
+
+	// Build the per-cluster light lists for this frame
 	{
-		// Set the "per frame" data
-		// Note that this should literally be set once PER FRAME, before
-		// the draw loop, but we're currently setting it per entity since 
-		// we are just using whichever shader the current entity has.  
-		// Inefficient!!!
-		std::shared_ptr<SimplePixelShader> ps = ge->GetMaterial()->GetPixelShader();
-		ps->SetData("lights", (void*)(&lights[0]), sizeof(Light) * lightCount);
-		ps->SetInt("lightCount", lightCount);
-		ps->SetFloat3("cameraPosition", camera->GetTransform()->GetPosition());
-		ps->SetInt("SpecIBLTotalMipLevels", sky->GetConvolvedSpecularMipLevels());
-		ps->CopyBufferData("perFrame");
+		GPUProfileScope scope(gpuProfiler.get(), "Light culling");
+		lightBuffer->Upload(lights);
+		lightCuller->Cull(lightBuffer->GetSRV(), (int)lights.size(), camera, sceneWidth, sceneHeight);
+	}
+
+	// Work on any sky change, and rebind the IBL maps once it swaps in
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "IBL update");
+		sky->UpdateIBL(iblBudgetMs);
+	}
+	if (sky->GetIBLVersion() != iblVersion)
+	{
+		iblVersion = sky->GetIBLVersion();
+		for (auto& m : iblMaterials)
+		{
+			m->RemoveTextureSRV("IrradianceIBLMap");
+			m->RemoveTextureSRV("SpecularIBLMap");
+			m->AddTextureSRV("IrradianceIBLMap", sky->GetIrradianceMap());
+			m->AddTextureSRV("SpecularIBLMap", sky->GetConvolvedSpecularMap());
+		}
+	}
+
+	// Draw whichever shadow cascades aren't cached
+	bool shadows = useShadows && !lights.empty() && lights[0].Type == LIGHT_TYPE_DIRECTIONAL;
+	if (shadows)
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "Shadows");
+		PROFILE_SCOPE("Shadows");
+		DrawShadows();
+	}
+
+	// Set the "per frame" data once, before the draw loop.  Every lit
+	// pixel shader shares this buffer (see LoadAssetsAndCreateEntities)
+	{
+		PerFrameData perFrame = {};
+		perFrame.cameraPosition = camera->GetTransform()->GetPosition();
+		perFrame.specIBLTotalMipLevels = sky->GetConvolvedSpecularMipLevels();
+		perFrame.clusterDepthScale = lightCuller->GetDepthScale();
+		perFrame.clusterDepthBias = lightCuller->GetDepthBias();
+		perFrame.clusterTileSize = lightCuller->GetTileSize();
+		perFrame.shadowLightIndex = shadows ? 0 : -1;
+		for (auto& p : litShaderPermutations)
+			p->SetFrameFeatures(shadows, (unsigned int)lights.size());
+		perFrame.shadowCascadeCount = (int)shadowMap->GetCascadeCount();
+		perFrame.shadowTexelSize = 1.0f / shadowMap->GetResolution();
+		float* splits = &perFrame.shadowSplits.x;
+		float* normalOffsets = &perFrame.shadowNormalOffsets.x;
+		for (unsigned int c = 0; c < shadowMap->GetCascadeCount(); c++)
+		{
+			perFrame.shadowMatrices[c] = shadowMap->GetShadowMatrix(c);
+			splits[c] = shadowMap->GetSplitDistance(c);
+			normalOffsets[c] = shadowMap->GetTexelWorldSize(c) * 1.5f;
+		}
+		context->UpdateSubresource(perFrameConstantBuffer.Get(), 0, 0, &perFrame, 0, 0);
+
+		// These are bound to the pixel shader stage, so they stay set
+		// across all of the materials that use these shaders
+		for (size_t i = 0; i < litPixelShaders.size(); i++)
+		{
+			std::shared_ptr<SimplePixelShader> ps = litPixelShaders[i];
+			ps->SetShaderResourceView(litShaderHandles[i].Lights, lightBuffer->GetSRV().Get());
+			ps->SetShaderResourceView(litShaderHandles[i].ClusterLightGrid, lightCuller->GetClusterLightGridSRV().Get());
+			ps->SetShaderResourceView(litShaderHandles[i].ClusterLightIndices, lightCuller->GetClusterLightIndicesSRV().Get());
+			ps->SetShaderResourceView(litShaderHandles[i].ShadowMap, shadowMap->GetSRV().Get());
+			ps->SetSamplerState(litShaderHandles[i].ShadowSampler, shadowMap->GetSampler().Get());
+		}
+	}
 
-		// Draw the entity
-		ge->Draw(context, camera);
+	// Draw all of the visible entities, sorted to minimize state changes.
+	// Each one also picks its mesh LOD and asks for the texture mips
+	// its size on screen needs
+	renderQueue->SetLodSelection((float)sceneHeight, useMeshLods ? lodErrorPixels : 0.0f);
+	renderQueue->Begin(camera);
+	textureStreamer->BeginFrame();
+	bool occlusionCulling = useOcclusionCulling && useFrustumCulling;
+	occludedEntityCount = 0;
+
+	// The GPU driven path culls on the GPU, so the queue stays empty and
+	// the entities here only ask for their texture mips
+	bool gpuDriven = useGPUDrivenRendering;
+	if (occlusionCulling && !gpuDriven)
+		hiZCuller->ReadResults();
+	if (useFrustumCulling)
+	{
+		visibleEntities.clear();
+		sceneBVH->QueryFrustum(camera->GetFrustum(), visibleEntities);
+		for (auto ge : visibleEntities)
+		{
+			if (occlusionCulling && !gpuDriven && hiZCuller->IsOccluded(ge))
+			{
+				occludedEntityCount++;
+				continue;
+			}
+
+			if (!gpuDriven)
+				renderQueue->Submit(ge);
+			textureStreamer->RequestMips(ge, camera, (float)sceneHeight);
+		}
+
+		visibleEntityCount = (unsigned int)visibleEntities.size() - occludedEntityCount;
+	}
+	else
+	{
+		for (auto& ge : entities)
+		{
+			if (!gpuDriven)
+				renderQueue->Submit(ge.get());
+			textureStreamer->RequestMips(ge.get(), camera, (float)sceneHeight);
+		}
+
+		visibleEntityCount = (unsigned int)entities.size();
+	}
+
+	// Swap in any mips that finished streaming, and queue more
+	textureStreamer->Update();
+	culledEntityCount = (unsigned int)entities.size() - visibleEntityCount;
+	renderQueue->Sort();
+	renderQueue->SetCommandRecorder(useParallelSubmission ? commandRecorder : nullptr);
+	bool depthPrepass = useDepthPrepass && depthPrepassAvailable && !gpuDriven;
+	if (gpuDriven)
+	{
+		// Tested against the pyramid built from last frame's depth
+		GPUProfileScope scope(gpuProfiler.get(), "GPU culling");
+		PROFILE_SCOPE("GPU culling");
+		gpuRenderer->SetEntities(entities);
+		gpuRenderer->Cull(camera, sceneBVH->GetVersion(), (float)sceneHeight, useMeshLods ? lodErrorPixels : 0.0f, occlusionCulling ? hiZCuller.get() : nullptr);
+	}
+	if (depthPrepass)
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "Depth pre-pass");
+		PROFILE_SCOPE("Depth pre-pass");
+		renderQueue->SetRenderStates(nullptr);
+		renderQueue->DrawDepth(useInstancing ? instancedVS : nullptr);
+	}
+	{
+		// The queue puts the default depth test back once it's done
+		GPUProfileScope scope(gpuProfiler.get(), "Entities");
+		PROFILE_SCOPE("Render queue");
+		if (gpuDriven)
+		{
+			gpuRenderer->Draw(camera);
+		}
+		else
+		{
+			renderQueue->SetRenderStates(nullptr, depthPrepass ? depthEqualState : nullptr);
+			renderQueue->Draw(useInstancing ? instancedVS : nullptr);
+		}
+	}
+
+	// Test everything in the frustum, drawn or not, against the depth
+	// just drawn, so hidden entities are skipped once the results arrive
+	if (occlusionCulling)
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "Hi-Z culling");
+		PROFILE_SCOPE("Hi-Z culling");
+
+		// The depth buffer can't be read while it's bound
+		context->OMSetRenderTargets(1, sceneRTV.GetAddressOf(), 0);
+		hiZCuller->BuildPyramid(sceneDepthSRV, sceneWidth, sceneHeight);
+		if (!gpuDriven)
+			hiZCuller->TestEntities(visibleEntities, camera);
+		BindSceneTarget();
 	}
 
 	// Draw the light sources
-	DrawPointLights();
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "Point lights");
+		DrawPointLights();
+	}
 
 	// Draw the sky
-	sky->Draw(camera);
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "Sky");
+		sky->Draw(camera);
+	}
+
+	// Stretch the scene over the window, which the UI then draws onto
+	if (scaleScene)
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "Upscale");
+		dynamicResolution->Upscale(backBufferRTV);
+		context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
+	}
 
 	// Draw some UI
-	DrawUI();
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "UI");
+		DrawUI();
+	}
 
 	// Draw ImGui
-	ImGui::Render();
-	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	{
+		GPUProfileScope scope(gpuProfiler.get(), "ImGui");
+		PROFILE_SCOPE("ImGui::Render");
+		ImGui::Render();
+		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	}
 
-	// Present the back buffer to the user
-	//  - Puts the final frame we're drawing into the window so the user can see it
-	//  - Do this exactly ONCE PER FRAME (always at the very end of the frame)
-	swapChain->Present(0, 0);
+	// DXCore presents the frame once this returns
+	gpuProfiler->EndFrame();
+	benchmarkFrameDrawn = true;
+}
 
-	// Due to the usage of a more sophisticated swap chain,
-	// the render target must be re-bound after every call to Present()
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
+
+// --------------------------------------------------------
+// Records the frame before this one, then moves the
+// camera along the benchmark's flythrough.  The real
+// delta time is how long that previous frame took
+// --------------------------------------------------------
+void Game::UpdateBenchmark(float deltaTime)
+{
+	if (benchmarkFrameDrawn)
+	{
+		benchmark.RecordFrame(
+			deltaTime * 1000.0f,
+			renderQueue->GetDrawCallCount(),
+			renderQueue->GetStateChangeCount(),
+			gpuProfiler.get());
+	}
+
+	// Closing the window takes a few frames, so only finish once
+	if (benchmark.IsFinished() && !benchmarkQuitting)
+	{
+		benchmarkQuitting = true;
+		// GPU timings lag a few frames behind, which is close enough
+		if (!benchmark.WriteResults(gpuProfiler.get()))
+			printf("Failed to write benchmark results\n");
+		Quit();
+	}
+
+	XMFLOAT3 position;
+	XMFLOAT3 pitchYawRoll;
+	benchmark.GetCameraPose(benchmark.GetFrameIndex(), &position, &pitchYawRoll);
+	camera->GetTransform()->SetPosition(position.x, position.y, position.z);
+	camera->GetTransform()->SetRotation(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
+	camera->UpdateViewMatrix();
 }
 
 
 // --------------------------------------------------------
-// Draws the point lights as solid color spheres
+// Adds the specified number of randomly placed spheres to
+// the scene, for testing how the renderer scales.  They use
+// the first materialCount spawnable materials (0 for all)
 // --------------------------------------------------------
-void Game::DrawPointLights()
+void Game::SpawnEntities(int count, int materialCount)
 {
-	// Turn on these shaders
-	lightVS->SetShader();
-	lightPS->SetShader();
+	if (spawnableMaterials.empty())
+		return;
 
-	// Set up vertex shader
-	lightVS->SetMatrix4x4("view", camera->GetView());
-	lightVS->SetMatrix4x4("projection", camera->GetProjection());
+	size_t materials = spawnableMaterials.size();
+	if (materialCount > 0)
+		materials = min((size_t)materialCount, materials);
 
-	for (int i = 0; i < lightCount; i++)
+	for (int i = 0; i < count; i++)
 	{
-		Light light = lights[i];
+		std::shared_ptr<Material> mat = spawnableMaterials[rand() % materials];
+		std::shared_ptr<GameEntity> ge = std::make_shared<GameEntity>(spawnPackedMeshes ? packedSphereMesh : lightMesh, mat);
+
+		float scale = RandomRange(0.1f, 0.5f);
+		ge->GetTransform()->SetPosition(RandomRange(-50.0f, 50.0f), RandomRange(-10.0f, 10.0f), RandomRange(-50.0f, 50.0f));
+		ge->GetTransform()->SetScale(scale, scale, scale);
+		entities.push_back(ge);
+		sceneBVH->Insert(ge.get());
+	}
+}
 
-		// Only drawing points, so skip others
-		if (light.Type != LIGHT_TYPE_POINT)
-			continue;
 
-		// Calc quick scale based on range
-		float scale = light.Range / 20.0f;
+// --------------------------------------------------------
+// Selects the closest entity under the given pixel by
+// casting a ray from the camera through the scene's BVH
+// --------------------------------------------------------
+void Game::PickEntity(int mouseX, int mouseY)
+{
+	XMFLOAT4X4 viewF = camera->GetView();
+	XMFLOAT4X4 projF = camera->GetProjection();
+	XMMATRIX view = XMLoadFloat4x4(&viewF);
+	XMMATRIX proj = XMLoadFloat4x4(&projF);
+
+	// Unproject the pixel at the near and far planes to build the ray
+	XMVECTOR nearPoint = XMVector3Unproject(XMVectorSet((float)mouseX, (float)mouseY, 0.0f, 1.0f),
+		0, 0, (float)width, (float)height, 0.0f, 1.0f, proj, view, XMMatrixIdentity());
+	XMVECTOR farPoint = XMVector3Unproject(XMVectorSet((float)mouseX, (float)mouseY, 1.0f, 1.0f),
+		0, 0, (float)width, (float)height, 0.0f, 1.0f, proj, view, XMMatrixIdentity());
+	XMVECTOR dir = XMVector3Normalize(farPoint - nearPoint);
+
+	selectedEntityIndex = -1;
+	GameEntity* hit = sceneBVH->Raycast(nearPoint, dir);
+	for (int i = 0; hit && i < entities.size(); i++)
+	{
+		if (entities[i].get() == hit)
+		{
+			selectedEntityIndex = i;
+			break;
+		}
+	}
+}
+
+
+// --------------------------------------------------------
+// Places the first light's shadow cascades around the camera and
+// draws the depth of every caster into the ones that need it
+// --------------------------------------------------------
+void Game::DrawShadows()
+{
+	// The map can't be drawn to while the lit shaders still have it bound
+	for (size_t i = 0; i < litPixelShaders.size(); i++)
+		litPixelShaders[i]->SetShaderResourceView(litShaderHandles[i].ShadowMap, nullptr);
+
+	shadowMap->Update(camera, lights[0].Direction, sceneBVH->GetChangedBounds(), sceneBVH->HasEverythingChanged());
+	sceneBVH->ClearChanges();
+	for (unsigned int c = 0; c < shadowMap->GetCascadeCount(); c++)
+	{
+		if (!shadowMap->NeedsRender(c))
+			continue;
 
-		// Make the transform for this light
-		XMMATRIX rotMat = XMMatrixIdentity();
-		XMMATRIX scaleMat = XMMatrixScaling(scale, scale, scale);
-		XMMATRIX transMat = XMMatrixTranslation(light.Position.x, light.Position.y, light.Position.z);
-		XMMATRIX worldMat = scaleMat * rotMat * transMat;
+		// Everything in the cascade's box, including casters outside the
+		// camera's view.  LOD selection is off without a camera, so these
+		// draw at full detail and leave the entities' own LODs alone
+		shadowCasters.clear();
+		sceneBVH->QueryBox(shadowMap->GetCasterBounds(c), shadowCasters);
+		shadowQueue->Begin(shadowMap->GetView(c), shadowMap->GetProjection(c), shadowMap->GetLightPosition(c), shadowMap->GetDepthRange(c));
+		for (auto ge : shadowCasters)
+			shadowQueue->Submit(ge);
+		shadowQueue->Sort();
+
+		shadowMap->BeginCascade(c);
+		shadowQueue->DrawDepth(useInstancing ? instancedVS : nullptr);
+	}
+	shadowMap->End();
 
-		XMFLOAT4X4 world;
-		XMFLOAT4X4 worldInvTrans;
-		XMStoreFloat4x4(&world, worldMat);
-		XMStoreFloat4x4(&worldInvTrans, XMMatrixInverse(0, XMMatrixTranspose(worldMat)));
+	// Back to the screen
+	BindSceneTarget();
+}
 
-		// Set up the world matrix for this light
-		lightVS->SetMatrix4x4("world", world);
-		lightVS->SetMatrix4x4("worldInverseTranspose", worldInvTrans);
 
-		// Set up the pixel shader data
-		XMFLOAT3 finalColor = light.Color;
-		finalColor.x *= light.Intensity;
-		finalColor.y *= light.Intensity;
-		finalColor.z *= light.Intensity;
-		lightPS->SetFloat3("Color", finalColor);
+// --------------------------------------------------------
+// Binds wherever this frame's scene is drawn, with a viewport
+// covering just the part of it that's used
+// --------------------------------------------------------
+void Game::BindSceneTarget()
+{
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)sceneWidth;
+	viewport.Height = (float)sceneHeight;
+	viewport.MaxDepth = 1.0f;
+	context->RSSetViewports(1, &viewport);
+	context->OMSetRenderTargets(1, sceneRTV.GetAddressOf(), sceneDSV.Get());
+}
 
-		// Copy data
-		lightVS->CopyAllBufferData();
-		lightPS->CopyAllBufferData();
 
-		// Draw
-		lightMesh->SetBuffersAndDraw(context);
-	}
+// --------------------------------------------------------
+// Draws the point lights as low poly, solid color spheres,
+// all in one instanced draw
+// --------------------------------------------------------
+void Game::DrawPointLights()
+{
+	// Turn on these shaders
+	lightVS->SetShader();
+	lightPS->SetShader();
 
+	// Only the camera comes from here.  Each light is an instance,
+	// placed and colored by the vertex shader from the light buffer
+	lightVS->SetMatrix4x4(lightViewHandle, camera->GetView());
+	lightVS->SetMatrix4x4(lightProjectionHandle, camera->GetProjection());
+	lightVS->CopyAllBufferData();
+	lightVS->SetShaderResourceView(lightBufferHandle, lightBuffer->GetSRV().Get());
+
+	// The sphere's coarsest LOD is plenty for a marker, and only its
+	// positions are read
+	lightMesh->SetPositionBuffers(context);
+	lightMesh->DrawInstanced(context, (unsigned int)lights.size(), 0, lightMesh->GetLodCount() - 1);
 }
 
 
@@ -881,7 +1859,8 @@ void Game::DrawPointLights()
 // --------------------------------------------------------
 void Game::DrawUI()
 {
-	spriteBatch->Begin();
+	// The sprite batch's usual states, but shared through the cache
+	spriteBatch->Begin(SpriteSortMode_Deferred, uiBlendState.Get(), uiSamplerState.Get(), uiDepthState.Get(), uiRasterizerState.Get());
 
 	// Basic controls
 	float h = 10.0f;
@@ -903,5 +1882,6 @@ void Game::DrawUI()
 	// Reset render states, since sprite batch changes these!
 	context->OMSetBlendState(0, 0, 0xFFFFFFFF);
 	context->OMSetDepthStencilState(0, 0);
+	context->RSSetState(0);
 
 }
@@ -8,7 +8,24 @@
 #include "SpriteFont.h"
 #include "SpriteBatch.h"
 #include "Lights.h"
+#include "BufferStructs.h"
 #include "Sky.h"
+#include "RenderQueue.h"
+#include "ShaderManager.h"
+#include "RenderStateCache.h"
+#include "ShaderPermutations.h"
+#include "SceneBVH.h"
+#include "ClusteredLightCuller.h"
+#include "HiZCuller.h"
+#include "GPUDrivenRenderer.h"
+#include "DynamicResolution.h"
+#include "CascadedShadowMap.h"
+#include "LightBuffer.h"
+#include "AssetLoader.h"
+#include "TextureStreamer.h"
+#include "GPUProfiler.h"
+#include "CPUProfiler.h"
+#include "Benchmark.h"
 
 #include <DirectXMath.h>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
@@ -19,7 +36,7 @@ class Game
 {
 
 public:
-	Game(HINSTANCE hInstance);
+	Game(HINSTANCE hInstance, const char* commandLine = "");
 	~Game();
 
 	// Overridden setup and game loop methods, which
@@ -31,12 +48,19 @@ public:
 	void UpdateImGuiInfoWindow(float deltaTime);
 	void UpdateImGuiWorldEditor(float deltaTime);
 	void UpdateImGuiWindowManager();
+	void UpdateImGuiCPUProfiler();
 	void EntityImGui(GameEntity* entity, int entityIndex);
 	void LightsImGui(Light* light, int lightIndex);
 	void Draw(float deltaTime, float totalTime);
 
 private:
 
+	// Set from the command line, and does nothing unless enabled
+	Benchmark benchmark;
+	bool benchmarkFrameDrawn = false;
+	bool benchmarkQuitting = false;
+	void UpdateBenchmark(float deltaTime);
+
 	// Our scene
 	std::vector<std::shared_ptr<GameEntity>> entities;
 	std::shared_ptr<Camera> camera;
@@ -45,31 +69,178 @@ private:
 	std::vector<Light> lights;
 	int lightCount;
 
+	// Per-frame data shared by all lit pixel shaders, filled once per frame
+	Microsoft::WRL::ComPtr<ID3D11Buffer> perFrameConstantBuffer;
+	std::vector<std::shared_ptr<SimplePixelShader>> litPixelShaders;
+	std::vector<std::shared_ptr<ShaderPermutations>> litShaderPermutations;
+
+	// Compiles shaders from source, and reloads them as they change
+	std::shared_ptr<ShaderManager> shaderManager;
+	bool hotReloadShaders = true;
+
+	// Looks up (again, after a reload) the handles Game keeps for its shaders
+	void ResolveShaderHandles();
+
+	// Handles to the light resources in each of the lit pixel shaders,
+	// resolved again whenever the shader is reloaded
+	struct LitShaderHandles
+	{
+		unsigned int Version;
+		SimpleShaderHandle Lights;
+		SimpleShaderHandle ClusterLightGrid;
+		SimpleShaderHandle ClusterLightIndices;
+		SimpleShaderHandle ShadowMap;
+		SimpleShaderHandle ShadowSampler;
+	};
+	std::vector<LitShaderHandles> litShaderHandles;
+
+	// GPU copy of the lights, and the clustered culling that uses them
+	std::shared_ptr<LightBuffer> lightBuffer;
+	std::shared_ptr<ClusteredLightCuller> lightCuller;
+	bool animateLights = false;
+
 	// These will be loaded along with other assets and
 	// saved to these variables for ease of access
 	std::shared_ptr<Mesh> lightMesh;
 	std::shared_ptr<SimpleVertexShader> lightVS;
 	std::shared_ptr<SimplePixelShader> lightPS;
+	SimpleShaderHandle lightViewHandle;
+	SimpleShaderHandle lightProjectionHandle;
+	SimpleShaderHandle lightBufferHandle;
+	unsigned int lightVSVersion = 0;
+
+	// Spatial structure over the entities, for culling and picking
+	std::shared_ptr<SceneBVH> sceneBVH;
+	std::vector<GameEntity*> visibleEntities;
+	std::vector<GameEntity*> queryResults;
+	int selectedEntityIndex = -1;
+
+	// Loads meshes and textures on worker threads
+	std::shared_ptr<AssetLoader> assetLoader;
+
+	// Streams material texture mips based on what's on screen
+	std::shared_ptr<TextureStreamer> textureStreamer;
+	int textureBudgetMB = 128;
+
+	// Sorts and submits entity draws each frame
+	std::shared_ptr<RenderQueue> renderQueue;
+	std::shared_ptr<CommandRecorder> commandRecorder;
+
+	// GPU timings for each pass, shown in the info window
+	std::shared_ptr<GPUProfiler> gpuProfiler;
+	bool useParallelSubmission = true;
+
+	// Per-draw constant buffer data for the scene's shaders
+	std::shared_ptr<ConstantBufferRing> constantBufferRing;
+
+	// Visibility and instanced rendering
+	bool useInstancing = true;
+	bool useFrustumCulling = true;
+	unsigned int visibleEntityCount = 0;
+	unsigned int culledEntityCount = 0;
+
+	// Skips frustum visible entities found hidden a few frames ago
+	std::shared_ptr<HiZCuller> hiZCuller;
+	bool useOcclusionCulling = false;
+	unsigned int occludedEntityCount = 0;
+	std::shared_ptr<SimpleVertexShader> instancedVS;
+
+	// Culls, picks LODs for and draws every entity on the GPU, in place
+	// of the render queue
+	std::shared_ptr<GPUDrivenRenderer> gpuRenderer;
+	bool useGPUDrivenRendering = false;
+
+	// Draws the scene below the window's resolution when the GPU falls
+	// behind the target frame time, then upscales it before the UI
+	std::shared_ptr<DynamicResolution> dynamicResolution;
+	bool useDynamicResolution = false;
+	unsigned int dynamicResolutionFrames = 0;
+
+	// Where this frame's scene is drawn: the dynamic resolution target,
+	// or straight to the back buffer
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneRTV;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> sceneDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneDepthSRV;
+	unsigned int sceneWidth = 1;
+	unsigned int sceneHeight = 1;
+
+	// Cascaded shadows for the first light, when it's directional.  The
+	// casters go through their own queue, so the camera's is left alone
+	std::shared_ptr<CascadedShadowMap> shadowMap;
+	std::shared_ptr<RenderQueue> shadowQueue;
+	std::vector<GameEntity*> shadowCasters;
+	bool useShadows = true;
+
+	// Meshes in the packed vertex format, and the shaders that decode them
+	bool spawnPackedMeshes = true;
+	std::shared_ptr<Mesh> packedSphereMesh;
+	std::shared_ptr<SimpleVertexShader> packedVS;
+	std::shared_ptr<SimpleVertexShader> packedInstancedVS;
+	std::shared_ptr<SimpleVertexShader> LoadPackedVertexShader(const std::wstring& file, bool perInstance);
+
+	// Optional depth only pass before the entities, after which they're
+	// drawn testing for equal depth, so each pixel is shaded once.
+	// Only available when every depth shader loaded
+	bool useDepthPrepass = false;
+	bool depthPrepassAvailable = false;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthEqualState;
+	std::shared_ptr<SimpleVertexShader> LoadDepthVertexShader(const std::wstring& file, MeshVertexFormat format, bool perInstance);
+
+	// Mesh LODs, picked so simplification errors stay under this many pixels
+	bool useMeshLods = true;
+	float lodErrorPixels = 1.0f;
+
+	// Materials that can be given to entities spawned at runtime
+	std::vector<std::shared_ptr<Material>> spawnableMaterials;
 
 	// Text & ui
 	std::shared_ptr<DirectX::SpriteFont> arial;
 	std::shared_ptr<DirectX::SpriteBatch> spriteBatch;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> uiBlendState;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> uiSamplerState;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> uiDepthState;
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> uiRasterizerState;
 
 	// Texture related resources
+	// Every rasterizer, blend, depth and sampler state comes from here
+	std::shared_ptr<RenderStateCache> renderStates;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> clampSamplerOptions;
 
 	// Skybox
 	std::shared_ptr<Sky> sky;
+	std::shared_ptr<IBLCache> iblCache;
+
+	// Skies that can be switched between, and the materials using
+	// the sky's IBL maps, rebound when a switch finishes
+	static const int skyCount = 2;
+	AssetLoader::TextureFuture skyFaceLoads[skyCount][6];
+	int currentSky = 0;
+	float iblBudgetMs = 1.0f;
+	unsigned int iblVersion = 0;
+	std::vector<std::shared_ptr<Material>> iblMaterials;
+	void GetSkyFaces(int skyIndex, Microsoft::WRL::ComPtr<ID3D11Texture2D> faces[6]);
 
 	// Bools that will determine which ImGui windows will show
 	bool showWorldEditor = false;
 	bool showInfoWindow = false;
 	bool showDemoWindow = false;
+	bool showCPUProfiler = false;
+
+	// The CPU profiler window's copy of the last frame's scopes
+	std::vector<CPUProfileEvent> profileEvents;
+	int traceFrameCount = 60;
 
 	// General helpers for setup and drawing
 	void GenerateLights();
+	void ResizeLights(int count);
+	Light CreateRandomPointLight();
+	void AnimateLights(float deltaTime);
 	void DrawPointLights();
+	void DrawShadows();
+	void BindSceneTarget();
+	void SpawnEntities(int count, int materialCount = 0);
+	void PickEntity(int mouseX, int mouseY);
 	void DrawUI();
 
 	// Initialization helper method
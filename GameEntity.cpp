@@ -7,11 +7,30 @@ GameEntity::GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> mat
 	// Save the data
 	this->mesh = mesh;
 	this->material = material;
+	this->lod = 0;
 }
 
 std::shared_ptr<Mesh> GameEntity::GetMesh() { return mesh; }
 std::shared_ptr<Material> GameEntity::GetMaterial() { return material; }
 Transform* GameEntity::GetTransform() { return &transform; }
+unsigned int GameEntity::GetLod() { return lod; }
+void GameEntity::SetLod(unsigned int lod) { this->lod = lod; }
+
+BoundingBox GameEntity::GetWorldBoundingBox()
+{
+	XMFLOAT4X4 world = transform.GetWorldMatrix();
+	BoundingBox box;
+	mesh->GetBoundingBox().Transform(box, XMLoadFloat4x4(&world));
+	return box;
+}
+
+BoundingSphere GameEntity::GetWorldBoundingSphere()
+{
+	XMFLOAT4X4 world = transform.GetWorldMatrix();
+	BoundingSphere sphere;
+	mesh->GetBoundingSphere().Transform(sphere, XMLoadFloat4x4(&world));
+	return sphere;
+}
 
 
 void GameEntity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera)
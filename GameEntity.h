@@ -2,6 +2,7 @@
 
 #include <wrl/client.h>
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include "Mesh.h"
 #include "Material.h"
 #include "Transform.h"
@@ -17,6 +18,15 @@ public:
 	std::shared_ptr<Material> GetMaterial();
 	Transform* GetTransform();
 
+	// World space bounds, from the mesh's bounds and this entity's transform
+	DirectX::BoundingBox GetWorldBoundingBox();
+	DirectX::BoundingSphere GetWorldBoundingSphere();
+
+	// The mesh LOD this entity last drew with, kept so the next
+	// pick can stick with it (see Mesh::SelectLod)
+	unsigned int GetLod();
+	void SetLod(unsigned int lod);
+
 	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera);
 
 private:
@@ -24,5 +34,6 @@ private:
 	std::shared_ptr<Mesh> mesh;
 	std::shared_ptr<Material> material;
 	Transform transform;
+	unsigned int lod;
 };
 
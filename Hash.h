@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+
+// --------------------------------------------------------
+// 64-bit FNV-1a over raw bytes.  Pass the result of one call
+// as the next one's hash to continue it across several
+// pieces of data.
+// --------------------------------------------------------
+inline unsigned long long HashBytes(const void* data, size_t size, unsigned long long hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
@@ -0,0 +1,35 @@
+// Sizes of the mip being read and the one being written
+cbuffer externalData : register(b0)
+{
+	uint2 sourceSize;
+	uint2 destSize;
+};
+
+// The depth buffer (for mip 0) or the previous mip
+Texture2D<float> Source		: register(t0);
+RWTexture2D<float> Dest		: register(u0);
+
+// --------------------------------------------------------
+// Builds one mip of the Hi-Z pyramid, where each texel is
+// the farthest depth of every source texel it overlaps.
+// When the source size is odd, edge texels overlap three
+// source texels instead of two, so nothing is left out
+// --------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (any(id.xy >= destSize))
+		return;
+
+	uint2 start = id.xy * sourceSize / destSize;
+	uint2 end = min(((id.xy + 1) * sourceSize + destSize - 1) / destSize, sourceSize);
+
+	float farthest = 0.0f;
+	for (uint y = start.y; y < end.y; y++)
+	{
+		for (uint x = start.x; x < end.x; x++)
+			farthest = max(farthest, Source.Load(int3(x, y, 0)));
+	}
+
+	Dest[id.xy] = farthest;
+}
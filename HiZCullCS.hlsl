@@ -0,0 +1,98 @@
+// Data for this culling pass
+cbuffer externalData : register(b0)
+{
+	matrix viewProj;
+
+	// Size of the pyramid's mip 0 (the depth buffer's size)
+	float2 pyramidSize;
+	int mipCount;
+	int entityCount;
+};
+
+// World space bounds of each entity - must match
+// HiZCuller::CullBounds
+struct CullBounds
+{
+	float3 Center;
+	float Padding0;
+	float3 Extents;
+	float Padding1;
+};
+
+StructuredBuffer<CullBounds> Bounds		: register(t0);
+Texture2D<float> Pyramid				: register(t1);
+
+// Output: 1 if any of the entity might be visible
+RWStructuredBuffer<uint> Visibility		: register(u0);
+
+// --------------------------------------------------------
+// Tests one entity's bounding box against the Hi-Z pyramid
+//
+// The box's corners give a screen rectangle and a nearest
+// depth.  The pyramid is read at the mip where the rectangle
+// covers at most 2x2 texels, and the entity is hidden if its
+// nearest depth is behind the farthest depth under it
+// --------------------------------------------------------
+[numthreads(64, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= (uint)entityCount)
+		return;
+
+	CullBounds b = Bounds[id.x];
+
+	float2 minUV = 1.0f;
+	float2 maxUV = 0.0f;
+	float nearestDepth = 1.0f;
+	bool crossesNearPlane = false;
+
+	[unroll]
+	for (uint i = 0; i < 8; i++)
+	{
+		float3 corner = b.Center + b.Extents * float3(
+			(i & 1) ? 1.0f : -1.0f,
+			(i & 2) ? 1.0f : -1.0f,
+			(i & 4) ? 1.0f : -1.0f);
+
+		float4 clip = mul(viewProj, float4(corner, 1.0f));
+		crossesNearPlane = crossesNearPlane || clip.w <= 0.0f;
+
+		// Clip space to texture space, with y flipped
+		float3 ndc = clip.xyz / max(clip.w, 1e-6f);
+		float2 uv = ndc.xy * float2(0.5f, -0.5f) + 0.5f;
+		minUV = min(minUV, uv);
+		maxUV = max(maxUV, uv);
+		nearestDepth = min(nearestDepth, ndc.z);
+	}
+
+	// Boxes reaching behind the camera can't be projected, so they stay
+	if (crossesNearPlane || nearestDepth <= 0.0f)
+	{
+		Visibility[id.x] = 1;
+		return;
+	}
+
+	minUV = saturate(minUV);
+	maxUV = saturate(maxUV);
+
+	// The mip where the rectangle spans at most one texel's width, so
+	// it touches at most two texels in each direction
+	float2 rectSize = (maxUV - minUV) * pyramidSize;
+	uint mip = (uint)min(ceil(log2(max(max(rectSize.x, rectSize.y), 1.0f))), mipCount - 1);
+
+	// Texels come from the mip's own size, since each mip is half the one
+	// above rounded down, with odd edges folded in (see HiZBuildCS).  A
+	// texel there covers at least the same uvs, where a shifted mip 0
+	// texel wouldn't once the size stops being a power of two
+	uint mipWidth, mipHeight, levels;
+	Pyramid.GetDimensions(mip, mipWidth, mipHeight, levels);
+	float2 mipSize = float2(mipWidth, mipHeight);
+	uint2 minTexel = (uint2)min(minUV * mipSize, mipSize - 1.0f);
+	uint2 maxTexel = (uint2)min(maxUV * mipSize, mipSize - 1.0f);
+
+	float farthest = max(
+		max(Pyramid.Load(int3(minTexel.x, minTexel.y, mip)), Pyramid.Load(int3(maxTexel.x, minTexel.y, mip))),
+		max(Pyramid.Load(int3(minTexel.x, maxTexel.y, mip)), Pyramid.Load(int3(maxTexel.x, maxTexel.y, mip))));
+
+	Visibility[id.x] = nearestDepth <= farthest ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+#include "HiZCuller.h"
+
+using namespace DirectX;
+
+HiZCuller::HiZCuller(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<SimpleComputeShader> buildCS,
+	std::shared_ptr<SimpleComputeShader> cullCS)
+	:
+	device(device),
+	context(context),
+	buildCS(buildCS),
+	cullCS(cullCS),
+	width(0),
+	height(0),
+	mipCount(0),
+	buildCount(0),
+	capacity(0),
+	frameIndex(1),
+	skippedTestCount(0)
+{
+}
+
+// Each mip is half the size of the one above it, rounded down, and the
+// build pass makes sure odd sizes still cover every texel
+void HiZCuller::CreatePyramid(unsigned int width, unsigned int height)
+{
+	this->width = width;
+	this->height = height;
+
+	mipCount = 1;
+	while ((width >> mipCount) > 0 || (height >> mipCount) > 0)
+		mipCount++;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = mipCount;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R32_FLOAT;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+
+	pyramid.Reset();
+	pyramidSRV.Reset();
+	mipSRVs.clear();
+	mipUAVs.clear();
+	if (FAILED(device->CreateTexture2D(&desc, 0, pyramid.GetAddressOf())))
+	{
+		mipCount = 0;
+		return;
+	}
+	device->CreateShaderResourceView(pyramid.Get(), 0, pyramidSRV.GetAddressOf());
+
+	mipSRVs.resize(mipCount);
+	mipUAVs.resize(mipCount);
+	for (unsigned int i = 0; i < mipCount; i++)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = desc.Format;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = i;
+		srvDesc.Texture2D.MipLevels = 1;
+		device->CreateShaderResourceView(pyramid.Get(), &srvDesc, mipSRVs[i].GetAddressOf());
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.Format = desc.Format;
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+		uavDesc.Texture2D.MipSlice = i;
+		device->CreateUnorderedAccessView(pyramid.Get(), &uavDesc, mipUAVs[i].GetAddressOf());
+	}
+}
+
+void HiZCuller::BuildPyramid(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthSRV, unsigned int width, unsigned int height)
+{
+	if (width == 0 || height == 0)
+		return;
+	if (width != this->width || height != this->height || !pyramid)
+		CreatePyramid(width, height);
+
+	buildCS->SetShader();
+
+	// Mip 0 is a copy of the depth buffer, and each mip after
+	// that reads from the one before it
+	unsigned int sourceSize[2] = { width, height };
+	for (unsigned int i = 0; i < mipCount; i++)
+	{
+		unsigned int destSize[2] = { max(width >> i, 1u), max(height >> i, 1u) };
+		buildCS->SetData("sourceSize", sourceSize, sizeof(sourceSize));
+		buildCS->SetData("destSize", destSize, sizeof(destSize));
+		buildCS->CopyAllBufferData();
+
+		buildCS->SetShaderResourceView("Source", i == 0 ? depthSRV : mipSRVs[i - 1]);
+		buildCS->SetUnorderedAccessView("Dest", mipUAVs[i]);
+		buildCS->DispatchByThreads(destSize[0], destSize[1], 1);
+
+		// The next mip reads this one
+		buildCS->SetUnorderedAccessView("Dest", nullptr);
+		sourceSize[0] = destSize[0];
+		sourceSize[1] = destSize[1];
+	}
+	buildCS->SetShaderResourceView("Source", nullptr);
+	buildCount++;
+}
+
+void HiZCuller::TestEntities(const std::vector<GameEntity*>& entities, std::shared_ptr<Camera> camera)
+{
+	frameIndex++;
+	if (!pyramid || entities.empty())
+		return;
+
+	// Still waiting on this slot's last results
+	Readback& rb = readbacks[frameIndex % FrameLatency];
+	if (rb.InFlight)
+	{
+		skippedTestCount++;
+		return;
+	}
+
+	unsigned int count = (unsigned int)entities.size();
+	if (!GrowBuffers(count))
+		return;
+
+	bounds.resize(count);
+	rb.Handles.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		BoundingBox box = entities[i]->GetWorldBoundingBox();
+		bounds[i].Center = box.Center;
+		bounds[i].Extents = box.Extents;
+		rb.Handles[i] = entities[i]->GetTransform()->GetHandle();
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(boundsBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, bounds.data(), sizeof(CullBounds) * count);
+	context->Unmap(boundsBuffer.Get(), 0);
+
+	XMFLOAT4X4 viewProj;
+	XMFLOAT4X4 view = camera->GetView();
+	XMFLOAT4X4 proj = camera->GetProjection();
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&proj)));
+
+	cullCS->SetShader();
+	cullCS->SetMatrix4x4("viewProj", viewProj);
+	cullCS->SetFloat2("pyramidSize", XMFLOAT2((float)width, (float)height));
+	cullCS->SetInt("mipCount", (int)mipCount);
+	cullCS->SetInt("entityCount", (int)count);
+	cullCS->CopyAllBufferData();
+
+	cullCS->SetShaderResourceView("Bounds", boundsSRV);
+	cullCS->SetShaderResourceView("Pyramid", pyramidSRV);
+	cullCS->SetUnorderedAccessView("Visibility", visibilityUAV);
+	cullCS->DispatchByThreads(count, 1, 1);
+
+	cullCS->SetUnorderedAccessView("Visibility", nullptr);
+	cullCS->SetShaderResourceView("Pyramid", nullptr);
+
+	// Only this frame's part of the buffer needs to come back
+	D3D11_BOX region = { 0, 0, 0, count * (UINT)sizeof(unsigned int), 1, 1 };
+	context->CopySubresourceRegion(rb.Staging.Get(), 0, 0, 0, 0, visibilityBuffer.Get(), 0, &region);
+	rb.TestFrame = frameIndex;
+	rb.InFlight = true;
+}
+
+void HiZCuller::ReadResults()
+{
+	for (int i = 1; i <= FrameLatency; i++)
+	{
+		Readback& rb = readbacks[(frameIndex + i) % FrameLatency];
+		if (!rb.InFlight)
+			continue;
+
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		if (context->Map(rb.Staging.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped) != S_OK)
+			continue;
+
+		const unsigned int* visible = (const unsigned int*)mapped.pData;
+		for (size_t e = 0; e < rb.Handles.size(); e++)
+		{
+			unsigned int handle = rb.Handles[e];
+			if (handle >= occludedFrames.size())
+				occludedFrames.resize(handle + 1, 0);
+			occludedFrames[handle] = visible[e] ? 0 : rb.TestFrame;
+		}
+
+		context->Unmap(rb.Staging.Get(), 0);
+		rb.InFlight = false;
+	}
+}
+
+// Results older than a few frames are ignored, since the entity
+// may not have been tested since (like when it left the frustum)
+bool HiZCuller::IsOccluded(GameEntity* entity)
+{
+	unsigned int handle = entity->GetTransform()->GetHandle();
+	if (handle >= occludedFrames.size() || occludedFrames[handle] == 0)
+		return false;
+	return frameIndex - occludedFrames[handle] <= FrameLatency + 1;
+}
+
+// Makes sure the buffers hold at least count entities.  Growing drops
+// any results still in flight, since their staging buffers are replaced
+bool HiZCuller::GrowBuffers(unsigned int count)
+{
+	if (count <= capacity)
+		return true;
+
+	unsigned int newCapacity = max(count, capacity * 2);
+	capacity = 0;
+	boundsBuffer.Reset();
+	boundsSRV.Reset();
+	visibilityBuffer.Reset();
+	visibilityUAV.Reset();
+
+	D3D11_BUFFER_DESC boundsDesc = {};
+	boundsDesc.ByteWidth = sizeof(CullBounds) * newCapacity;
+	boundsDesc.Usage = D3D11_USAGE_DYNAMIC;
+	boundsDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	boundsDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	boundsDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	boundsDesc.StructureByteStride = sizeof(CullBounds);
+	if (FAILED(device->CreateBuffer(&boundsDesc, 0, boundsBuffer.GetAddressOf())))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = newCapacity;
+	if (FAILED(device->CreateShaderResourceView(boundsBuffer.Get(), &srvDesc, boundsSRV.GetAddressOf())))
+		return false;
+
+	D3D11_BUFFER_DESC visibilityDesc = {};
+	visibilityDesc.ByteWidth = sizeof(unsigned int) * newCapacity;
+	visibilityDesc.Usage = D3D11_USAGE_DEFAULT;
+	visibilityDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	visibilityDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	visibilityDesc.StructureByteStride = sizeof(unsigned int);
+	if (FAILED(device->CreateBuffer(&visibilityDesc, 0, visibilityBuffer.GetAddressOf())))
+		return false;
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = newCapacity;
+	if (FAILED(device->CreateUnorderedAccessView(visibilityBuffer.Get(), &uavDesc, visibilityUAV.GetAddressOf())))
+		return false;
+
+	D3D11_BUFFER_DESC stagingDesc = {};
+	stagingDesc.ByteWidth = sizeof(unsigned int) * newCapacity;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	stagingDesc.StructureByteStride = sizeof(unsigned int);
+	for (auto& rb : readbacks)
+	{
+		rb.Staging.Reset();
+		rb.InFlight = false;
+		if (FAILED(device->CreateBuffer(&stagingDesc, 0, rb.Staging.GetAddressOf())))
+			return false;
+	}
+
+	capacity = newCapacity;
+	return true;
+}
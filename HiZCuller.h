@@ -0,0 +1,117 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+
+#include "SimpleShader.h"
+#include "GameEntity.h"
+#include "Camera.h"
+
+// --------------------------------------------------------
+// Hierarchical-Z occlusion culling
+//
+// Once a frame's opaque geometry is drawn, a compute pass
+// builds a pyramid from the depth buffer where each texel
+// holds the farthest depth of the area it covers.  A second
+// pass then tests the bounding box of each entity that was
+// in the frustum against the pyramid, and writes whether any
+// of it could be in front of what's already there.
+//
+// The results are read back a couple of frames later without
+// waiting, so entities hidden in one frame are skipped once
+// the result arrives.  Entities skipped this way still get
+// tested, so they come back when they're uncovered, but they
+// can be a frame or two late when the camera moves fast.
+// --------------------------------------------------------
+class HiZCuller
+{
+public:
+	static const int FrameLatency = 3;
+
+	HiZCuller(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<SimpleComputeShader> buildCS,
+		std::shared_ptr<SimpleComputeShader> cullCS);
+
+	// Builds the pyramid from the depth buffer, which must not be
+	// bound for output.  Resizes the pyramid to match as needed
+	void BuildPyramid(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthSRV, unsigned int width, unsigned int height);
+
+	// Tests entities against the pyramid, as seen by the camera the
+	// depth buffer was drawn with.  Skipped if the previous results
+	// for this frame's readback slot haven't come back yet
+	void TestEntities(const std::vector<GameEntity*>& entities, std::shared_ptr<Camera> camera);
+
+	// Picks up any finished tests without waiting, oldest first
+	void ReadResults();
+
+	// Whether the entity was hidden in a recent test
+	bool IsOccluded(GameEntity* entity);
+
+	unsigned int GetMipCount() { return mipCount; }
+
+	// The pyramid itself, for culling elsewhere (see GPUDrivenRenderer),
+	// and how many times it's been built, to tell whether it's current
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetPyramidSRV() { return pyramidSRV; }
+	unsigned int GetPyramidWidth() { return width; }
+	unsigned int GetPyramidHeight() { return height; }
+	unsigned int GetBuildCount() { return buildCount; }
+	unsigned int GetSkippedTestCount() { return skippedTestCount; }
+
+private:
+	// Must match HiZCullCS
+	struct CullBounds
+	{
+		DirectX::XMFLOAT3 Center;
+		float Padding0;
+		DirectX::XMFLOAT3 Extents;
+		float Padding1;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<SimpleComputeShader> buildCS;
+	std::shared_ptr<SimpleComputeShader> cullCS;
+
+	// The pyramid, with a view of each mip for building it
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> pyramid;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> pyramidSRV;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> mipSRVs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>> mipUAVs;
+	unsigned int width;
+	unsigned int height;
+	unsigned int mipCount;
+	unsigned int buildCount;
+
+	// Bounds in, one visibility flag per entity out
+	Microsoft::WRL::ComPtr<ID3D11Buffer> boundsBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> boundsSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> visibilityBuffer;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> visibilityUAV;
+	unsigned int capacity;
+	std::vector<CullBounds> bounds;
+
+	// Readback, with the transform handles of the entities each
+	// slot's results belong to
+	struct Readback
+	{
+		Microsoft::WRL::ComPtr<ID3D11Buffer> Staging;
+		std::vector<unsigned int> Handles;
+		unsigned int TestFrame = 0;
+		bool InFlight = false;
+	};
+	Readback readbacks[FrameLatency];
+	unsigned int frameIndex;
+	unsigned int skippedTestCount;
+
+	// Per transform handle, the frame of the test that last found
+	// the entity hidden (0 when it was visible)
+	std::vector<unsigned int> occludedFrames;
+
+	void CreatePyramid(unsigned int width, unsigned int height);
+	bool GrowBuffers(unsigned int count);
+};
@@ -0,0 +1,197 @@
+#include "IBLCache.h"
+#include "Hash.h"
+#include "TextureCooker.h"
+#include "DDSTextureLoader.h"
+
+#include <stdio.h>
+#include <string.h>
+
+IBLCache::IBLCache(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	const std::wstring& directory)
+	:
+	device(device),
+	context(context),
+	directory(directory)
+{
+	// Fails harmlessly if it already exists
+	CreateDirectoryW(directory.c_str(), 0);
+}
+
+static unsigned long long HashShader(std::shared_ptr<ISimpleShader> shader, unsigned long long hash)
+{
+	Microsoft::WRL::ComPtr<ID3DBlob> blob = shader->GetShaderBlob();
+	if (!blob)
+		return hash;
+
+	return HashBytes(blob->GetBufferPointer(), blob->GetBufferSize(), hash);
+}
+
+unsigned long long IBLCache::HashEnvironment(
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment,
+	std::shared_ptr<ISimpleShader> irradianceShader,
+	std::shared_ptr<ISimpleShader> specularShader,
+	int irradianceFaceSize,
+	int specularFaceSize,
+	int specularMipLevels)
+{
+	if (!environment)
+		return 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	environment->GetResource((ID3D11Resource**)texture.GetAddressOf());
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	std::vector<unsigned char> pixels;
+	if (!ReadBack(texture.Get(), desc, pixels))
+		return 0;
+
+	int params[] = { IBL_CACHE_VERSION, irradianceFaceSize, specularFaceSize, specularMipLevels };
+	unsigned long long hash = HashBytes(params, sizeof(params));
+	hash = HashBytes(&desc.Format, sizeof(desc.Format), hash);
+	hash = HashBytes(&desc.Width, sizeof(desc.Width), hash);
+	hash = HashBytes(&desc.Height, sizeof(desc.Height), hash);
+	hash = HashBytes(pixels.data(), pixels.size(), hash);
+	hash = HashShader(irradianceShader, hash);
+	hash = HashShader(specularShader, hash);
+	return hash;
+}
+
+unsigned long long IBLCache::HashBRDFLookupTable(std::shared_ptr<ISimpleShader> brdfShader, int size)
+{
+	int params[] = { IBL_CACHE_VERSION, size };
+	return HashShader(brdfShader, HashBytes(params, sizeof(params)));
+}
+
+std::wstring IBLCache::GetPath(const std::wstring& name, unsigned long long key)
+{
+	wchar_t keyText[17] = {};
+	swprintf_s(keyText, L"%016llx", key);
+	return directory + L"\\" + name + L"_" + keyText + L".dds";
+}
+
+bool IBLCache::Load(const std::wstring& name, unsigned long long key, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	std::wstring path = GetPath(name, key);
+	auto it = loaded.find(path);
+	if (it != loaded.end())
+	{
+		srv = it->second;
+		return true;
+	}
+
+	if (FAILED(CreateDDSTextureFromFile(device.Get(), path.c_str(), 0, srv.ReleaseAndGetAddressOf())))
+		return false;
+
+	loaded.insert({ path, srv });
+	return true;
+}
+
+bool IBLCache::Save(const std::wstring& name, unsigned long long key, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	if (!srv)
+		return false;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	srv->GetResource((ID3D11Resource**)texture.GetAddressOf());
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	std::vector<unsigned char> data;
+	if (!ReadBack(texture.Get(), desc, data))
+		return false;
+
+	std::wstring path = GetPath(name, key);
+	loaded[path] = srv;
+
+	bool cube = (desc.MiscFlags & D3D11_RESOURCE_MISC_TEXTURECUBE) != 0;
+	return WriteDDSFile(path, desc.Format, desc.Width, desc.Height, desc.MipLevels, desc.ArraySize, cube, data.data(), data.size());
+}
+
+// The size of one row (of pixels, or of 4x4 blocks) and the number of
+// rows in a mip level.  Zero for formats that aren't handled here
+static unsigned int GetRowLayout(DXGI_FORMAT format, unsigned int width, unsigned int height, unsigned int* rowCount)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM: case DXGI_FORMAT_BC4_SNORM:
+		*rowCount = (height + 3) / 4;
+		return ((width + 3) / 4) * 8;
+
+	case DXGI_FORMAT_BC2_UNORM: case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_UNORM: case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_UF16: case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB:
+		*rowCount = (height + 3) / 4;
+		return ((width + 3) / 4) * 16;
+
+	case DXGI_FORMAT_R8G8B8A8_UNORM: case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM: case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R16G16_UNORM: case DXGI_FORMAT_R16G16_FLOAT:
+	case DXGI_FORMAT_R11G11B10_FLOAT: case DXGI_FORMAT_R32_FLOAT:
+		*rowCount = height;
+		return width * 4;
+
+	case DXGI_FORMAT_R16G16B16A16_FLOAT: case DXGI_FORMAT_R32G32_FLOAT:
+		*rowCount = height;
+		return width * 8;
+
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		*rowCount = height;
+		return width * 16;
+
+	default:
+		*rowCount = 0;
+		return 0;
+	}
+}
+
+// Copies a texture to a staging texture and packs every subresource, in
+// DDS order (each array slice's mips in turn).  This waits on the GPU, so
+// it's only meant for one-off reads like these
+bool IBLCache::ReadBack(ID3D11Texture2D* texture, D3D11_TEXTURE2D_DESC& desc, std::vector<unsigned char>& data)
+{
+	if (!texture)
+		return false;
+
+	texture->GetDesc(&desc);
+	unsigned int rowCount = 0;
+	if (desc.SampleDesc.Count > 1 || GetRowLayout(desc.Format, desc.Width, desc.Height, &rowCount) == 0)
+		return false;
+
+	D3D11_TEXTURE2D_DESC stagingDesc = desc;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags &= D3D11_RESOURCE_MISC_TEXTURECUBE;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	if (FAILED(device->CreateTexture2D(&stagingDesc, 0, staging.GetAddressOf())))
+		return false;
+	context->CopyResource(staging.Get(), texture);
+
+	data.clear();
+	for (unsigned int slice = 0; slice < desc.ArraySize; slice++)
+	{
+		for (unsigned int mip = 0; mip < desc.MipLevels; mip++)
+		{
+			unsigned int subresource = D3D11CalcSubresource(mip, slice, desc.MipLevels);
+			unsigned int rowBytes = GetRowLayout(desc.Format, max(desc.Width >> mip, 1u), max(desc.Height >> mip, 1u), &rowCount);
+
+			D3D11_MAPPED_SUBRESOURCE mapped = {};
+			if (FAILED(context->Map(staging.Get(), subresource, D3D11_MAP_READ, 0, &mapped)))
+				return false;
+
+			// Rows are padded out to RowPitch in the mapping
+			size_t offset = data.size();
+			data.resize(offset + (size_t)rowBytes * rowCount);
+			for (unsigned int row = 0; row < rowCount; row++)
+				memcpy(&data[offset + (size_t)row * rowBytes], (unsigned char*)mapped.pData + (size_t)row * mapped.RowPitch, rowBytes);
+
+			context->Unmap(staging.Get(), subresource);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "SimpleShader.h"
+
+// Bump whenever the way the IBL maps are built changes in a
+// way the shaders' bytecode doesn't capture
+#define IBL_CACHE_VERSION 2
+
+// --------------------------------------------------------
+// Keeps precomputed IBL textures (irradiance cubes, convolved
+// specular cubes, BRDF look-up tables) on disk as DDS files,
+// so they're only rendered once.
+//
+// Each texture is stored under a name and a key: a hash of
+// everything it was built from (see the Hash functions).
+// The key is part of the file name, so a changed input just
+// never finds the old file.  Loaded textures are also kept
+// in memory, so anything with the same key - like the BRDF
+// look-up table, which doesn't depend on the environment -
+// is shared by every sky that asks for it.
+// --------------------------------------------------------
+class IBLCache
+{
+public:
+	IBLCache(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		const std::wstring& directory);
+
+	// Keys for environment maps (the source cube's pixels, plus the
+	// shaders and sizes used to convolve it) and for the BRDF look-up
+	// table.  An environment that can't be read back hashes to 0, and
+	// shouldn't be cached
+	unsigned long long HashEnvironment(
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment,
+		std::shared_ptr<ISimpleShader> irradianceShader,
+		std::shared_ptr<ISimpleShader> specularShader,
+		int irradianceFaceSize,
+		int specularFaceSize,
+		int specularMipLevels);
+	unsigned long long HashBRDFLookupTable(std::shared_ptr<ISimpleShader> brdfShader, int size);
+
+	// Finds a texture in memory or on disk
+	bool Load(const std::wstring& name, unsigned long long key, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+
+	// Reads a texture back from the GPU and writes it to disk.  Only
+	// uncompressed formats are supported
+	bool Save(const std::wstring& name, unsigned long long key, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::wstring directory;
+
+	std::unordered_map<std::wstring, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> loaded;
+
+	std::wstring GetPath(const std::wstring& name, unsigned long long key);
+	bool ReadBack(ID3D11Texture2D* texture, D3D11_TEXTURE2D_DESC& desc, std::vector<unsigned char>& data);
+};
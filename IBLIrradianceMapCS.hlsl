@@ -0,0 +1,49 @@
+#include "Lighting.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	int faceSize;
+	int firstFace; // Dispatches can cover just some of the faces
+};
+
+TextureCube EnvironmentMap : register(t0);
+SamplerState BasicSampler : register(s0);
+
+// All six faces, one per slice
+RWTexture2DArray<unorm float4> IrradianceMap : register(u0);
+
+// One thread per texel, with the face (from firstFace) in z
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= (uint)faceSize || id.y >= (uint)faceSize)
+		return;
+	id.z += firstFace;
+
+	// The "normal" of this texel, and a tangent basis around it
+	float3 N = CubeFaceDirection(id.z, (id.xy + 0.5f) / faceSize);
+	float3 up = abs(N.y) < 0.999f ? float3(0, 1, 0) : float3(0, 0, 1);
+	float3 T = normalize(cross(up, N));
+	float3 B = cross(N, T);
+
+	uint envSize, envHeight, envMips;
+	EnvironmentMap.GetDimensions(0, envSize, envHeight, envMips);
+
+	float3 totalColor = float3(0, 0, 0);
+	for (uint i = 0; i < IRRADIANCE_FILTERED_SAMPLES; i++)
+	{
+		// Cosine-weighted directions over the hemisphere, so the cosine
+		// term and the pdf cancel out, leaving a plain average
+		float2 Xi = Hammersley2d(i, IRRADIANCE_FILTERED_SAMPLES);
+		float phi = TWO_PI * Xi.x;
+		float cosT = sqrt(1 - Xi.y);
+		float sinT = sqrt(Xi.y);
+		float3 L = T * (sinT * cos(phi)) + B * (sinT * sin(phi)) + N * cosT;
+
+		float lod = FilteredSampleLevel(cosT / PI, IRRADIANCE_FILTERED_SAMPLES, envSize);
+		totalColor += pow(abs(EnvironmentMap.SampleLevel(BasicSampler, L, lod).rgb), 2.2f);
+	}
+
+	float3 finalColor = totalColor / IRRADIANCE_FILTERED_SAMPLES;
+	IrradianceMap[id] = float4(pow(abs(finalColor), 1.0f / 2.2f), 1);
+}
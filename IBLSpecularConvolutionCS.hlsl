@@ -0,0 +1,65 @@
+#include "Lighting.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	float roughness;
+	int faceSize; // Of the mip being written
+	int firstFace; // Dispatches can cover just some of the faces
+};
+
+TextureCube EnvironmentMap : register(t0);
+SamplerState BasicSampler : register(s0);
+
+// One mip of all six faces, one per slice
+RWTexture2DArray<unorm float4> SpecularMap : register(u0);
+
+float3 ConvolveTextureCube(float roughness, float3 R)
+{
+	// Assume N == V == R, a common assumption that simplifies the approximation
+	float3 N = R;
+	float3 V = R;
+
+	uint envSize, envHeight, envMips;
+	EnvironmentMap.GetDimensions(0, envSize, envHeight, envMips);
+
+	float3 finalColor = float3(0, 0, 0);
+	float totalWeight = 0;
+	for (uint i = 0; i < IBL_FILTERED_SAMPLES; i++)
+	{
+		// Grab this sample
+		float2 Xi = Hammersley2d(i, IBL_FILTERED_SAMPLES);
+		float3 H = ImportanceSampleGGX(Xi, roughness, N);
+		float3 L = 2 * dot(V, H) * H - V;
+
+		float nDotL = saturate(dot(N, L));
+		if (nDotL > 0)
+		{
+			// With N == V, the pdf of L works out to D(h) / 4
+			float pdf = SpecDistribution(N, H, roughness) * 0.25f;
+			float lod = FilteredSampleLevel(pdf, IBL_FILTERED_SAMPLES, envSize);
+
+			float3 thisColor = EnvironmentMap.SampleLevel(BasicSampler, L, lod).rgb;
+			finalColor += pow(abs(thisColor), 2.2f) * nDotL;
+			totalWeight += nDotL;
+		}
+	}
+
+	return pow(abs(finalColor / totalWeight), 1.0f / 2.2f);
+}
+
+// One thread per texel, with the face (from firstFace) in z
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= (uint)faceSize || id.y >= (uint)faceSize)
+		return;
+	id.z += firstFace;
+
+	float3 R = CubeFaceDirection(id.z, (id.xy + 0.5f) / faceSize);
+
+	// A perfect mirror is just the environment itself
+	float3 c = roughness > 0 ?
+		ConvolveTextureCube(roughness, R) :
+		EnvironmentMap.SampleLevel(BasicSampler, R, 0).rgb;
+	SpecularMap[id] = float4(c, 1);
+}
@@ -1,4 +1,5 @@
 #include "Input.h"
+#include "CPUProfiler.h"
 
 // Singleton requirement
 Input* Input::instance;
@@ -94,6 +95,8 @@ void Input::Initialize(HWND windowHandle)
 // ----------------------------------------------------------
 void Input::Update()
 {
+	PROFILE_SCOPE("Input::Update");
+
 	// Copy the old keys so we have last frame's data
 	memcpy(prevKbState, kbState, sizeof(unsigned char) * 256);
 
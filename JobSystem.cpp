@@ -0,0 +1,211 @@
+#include "JobSystem.h"
+#include "CPUProfiler.h"
+
+#include <Windows.h>
+
+// The queue the calling thread owns, if it belongs to a job system
+static thread_local JobSystem* threadJobSystem = 0;
+static thread_local unsigned int threadQueue = 0;
+
+JobSystem::JobSystem(unsigned int threadCount)
+	:
+	nextQueue(0),
+	queuedCount(0),
+	shuttingDown(false)
+{
+	if (threadCount == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < threadCount + 1; i++)
+		queues.push_back(std::make_unique<WorkerQueue>());
+
+	// The creating thread gets the last queue
+	threadJobSystem = this;
+	threadQueue = threadCount;
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.push_back(std::thread(&JobSystem::WorkerMain, this, i));
+}
+
+// Finishes whatever is already queued, then stops the workers
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		shuttingDown = true;
+	}
+	jobsAvailable.notify_all();
+
+	for (auto& w : workers)
+		w.join();
+
+	if (threadJobSystem == this)
+		threadJobSystem = 0;
+}
+
+void JobSystem::Run(std::function<void()> job, JobCounter* counter)
+{
+	if (counter)
+		counter->count++;
+	Push({ std::move(job), counter });
+}
+
+void JobSystem::RunAfter(JobCounter* dependency, std::function<void()> job, JobCounter* counter)
+{
+	if (counter)
+		counter->count++;
+
+	// Either the dependency is already done, or this is queued by
+	// whichever job finishes it (see Execute())
+	if (dependency)
+	{
+		std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+		if (!dependency->IsDone())
+		{
+			dependency->continuations.push_back({ std::move(job), counter });
+			return;
+		}
+	}
+
+	Push({ std::move(job), counter });
+}
+
+void JobSystem::Wait(JobCounter* counter)
+{
+	while (!counter->IsDone())
+	{
+		if (!TryRunOne())
+			std::this_thread::yield();
+	}
+
+	// The last job may still be releasing the counter's continuations
+	std::lock_guard<std::mutex> lock(counter->continuationMutex);
+}
+
+void JobSystem::ParallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body)
+{
+	if (end <= begin)
+		return;
+
+	// Small loops aren't worth splitting
+	grainSize = max(grainSize, (size_t)1);
+	if (end - begin <= grainSize)
+	{
+		body(begin, end);
+		return;
+	}
+
+	JobCounter counter;
+	for (size_t rangeStart = begin; rangeStart < end; rangeStart += grainSize)
+	{
+		size_t rangeEnd = min(rangeStart + grainSize, end);
+		Run([&body, rangeStart, rangeEnd]() { body(rangeStart, rangeEnd); }, &counter);
+	}
+	Wait(&counter);
+}
+
+// Queues on the calling thread's own queue, or spreads jobs from
+// other threads across the workers
+void JobSystem::Push(Job job)
+{
+	unsigned int queue = threadJobSystem == this ?
+		threadQueue :
+		nextQueue++ % (unsigned int)queues.size();
+	{
+		std::lock_guard<std::mutex> lock(queues[queue]->Mutex);
+		queues[queue]->Jobs.push_back(std::move(job));
+	}
+
+	// Lock so a worker deciding to sleep can't miss this
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queuedCount++;
+	}
+	jobsAvailable.notify_one();
+}
+
+bool JobSystem::TryPop(unsigned int queue, bool newest, Job& job)
+{
+	WorkerQueue& q = *queues[queue];
+	std::lock_guard<std::mutex> lock(q.Mutex);
+	if (q.Jobs.empty())
+		return false;
+
+	if (newest)
+	{
+		job = std::move(q.Jobs.back());
+		q.Jobs.pop_back();
+	}
+	else
+	{
+		job = std::move(q.Jobs.front());
+		q.Jobs.pop_front();
+	}
+	queuedCount--;
+	return true;
+}
+
+// Runs the newest job from this thread's queue, or steals the oldest
+// from another
+bool JobSystem::TryRunOne()
+{
+	unsigned int count = (unsigned int)queues.size();
+	unsigned int own = threadJobSystem == this ? threadQueue : 0;
+
+	Job job;
+	bool found = threadJobSystem == this && TryPop(own, true, job);
+	for (unsigned int i = 1; !found && i <= count; i++)
+		found = TryPop((own + i) % count, false, job);
+
+	if (!found)
+		return false;
+
+	Execute(job);
+	return true;
+}
+
+// Runs a job, then releases anything waiting on its counter
+void JobSystem::Execute(Job& job)
+{
+	{
+		PROFILE_SCOPE("Job");
+		job.Function();
+	}
+
+	JobCounter* counter = job.Counter;
+	if (!counter)
+		return;
+
+	// Counting down under the lock means a waiter that sees zero can't
+	// free the counter until this is done with it (see Wait())
+	std::vector<JobCounter::Continuation> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->continuationMutex);
+		if (--counter->count != 0)
+			return;
+		ready.swap(counter->continuations);
+	}
+	for (auto& c : ready)
+		Push({ std::move(c.Function), c.Counter });
+}
+
+void JobSystem::WorkerMain(unsigned int index)
+{
+	threadJobSystem = this;
+	threadQueue = index;
+	CPUProfiler::SetThreadName(("Job worker " + std::to_string(index)).c_str());
+
+	while (true)
+	{
+		if (TryRunOne())
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		jobsAvailable.wait(lock, [this]() { return shuttingDown || queuedCount > 0; });
+		if (shuttingDown && queuedCount == 0)
+			break;
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+// --------------------------------------------------------
+// Tracks a group of jobs.  Each job given a counter adds one
+// to it when queued and takes one away when it finishes, so
+// it reads zero once they're all done.  Jobs can also be
+// queued to start only once a counter reaches zero (see
+// JobSystem::RunAfter()).
+//
+// A counter must outlive every job that uses it, so wait
+// on it (see JobSystem::Wait()) before it goes away.
+// --------------------------------------------------------
+class JobCounter
+{
+public:
+	JobCounter() : count(0) {}
+	bool IsDone() { return count.load() == 0; }
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+private:
+	friend class JobSystem;
+
+	struct Continuation
+	{
+		std::function<void()> Function;
+		JobCounter* Counter;
+	};
+
+	std::atomic<int> count;
+	std::mutex continuationMutex;
+	std::vector<Continuation> continuations;
+};
+
+// --------------------------------------------------------
+// A fixed set of worker threads that run short jobs, like
+// chunks of a loop over the scene's entities.
+//
+// Every worker (and the thread that made the system, which
+// runs jobs while it waits) has its own queue.  Threads run
+// their own newest job first, and steal the oldest jobs from
+// the others when they run out.  Jobs shouldn't block on
+// anything but other jobs, since that holds up a worker.
+// --------------------------------------------------------
+class JobSystem
+{
+public:
+	// Zero threads means one per core, besides the calling thread
+	JobSystem(unsigned int threadCount = 0);
+	~JobSystem();
+
+	// Queues a job.  The counter (if any) is done once the job is
+	void Run(std::function<void()> job, JobCounter* counter = 0);
+
+	// Queues a job once another counter's jobs are all done
+	void RunAfter(JobCounter* dependency, std::function<void()> job, JobCounter* counter = 0);
+
+	// Runs other jobs until the counter's are all done
+	void Wait(JobCounter* counter);
+
+	// Splits [begin, end) into ranges of about grainSize and runs them
+	// as jobs, returning once they're all done
+	void ParallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body);
+
+	// Workers, plus the thread that made the system
+	unsigned int GetThreadCount() { return (unsigned int)queues.size(); }
+
+private:
+	struct Job
+	{
+		std::function<void()> Function;
+		JobCounter* Counter;
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex Mutex;
+		std::deque<Job> Jobs;
+	};
+
+	// One per worker, then one for the creating thread
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<unsigned int> nextQueue;
+
+	// Idle workers sleep until there are jobs again
+	std::mutex sleepMutex;
+	std::condition_variable jobsAvailable;
+	std::atomic<int> queuedCount;
+	bool shuttingDown;
+
+	void Push(Job job);
+	bool TryRunOne();
+	bool TryPop(unsigned int queue, bool newest, Job& job);
+	void Execute(Job& job);
+	void WorkerMain(unsigned int index);
+};
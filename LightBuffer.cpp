@@ -0,0 +1,132 @@
+#include "LightBuffer.h"
+
+LightBuffer::LightBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int initialCapacity)
+	:
+	device(device),
+	context(context),
+	capacity(0),
+	dirtyBegin(0),
+	dirtyEnd(0),
+	allDirty(true),
+	noOverwriteSupported(false),
+	lastUploadCount(0)
+{
+	// NO_OVERWRITE on dynamic buffers bound as SRVs requires D3D11.1 support
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+		noOverwriteSupported = options.MapNoOverwriteOnDynamicBufferSRV != 0;
+
+	CreateBuffer(max(initialCapacity, 1u));
+}
+
+// Marks a range of lights as changed
+void LightBuffer::MarkDirty(unsigned int index, unsigned int count)
+{
+	if (count == 0)
+		return;
+
+	if (dirtyBegin == dirtyEnd)
+	{
+		dirtyBegin = index;
+		dirtyEnd = index + count;
+	}
+	else
+	{
+		dirtyBegin = min(dirtyBegin, index);
+		dirtyEnd = max(dirtyEnd, index + count);
+	}
+}
+
+// Marks every light as changed, such as after regenerating them
+void LightBuffer::MarkAllDirty()
+{
+	allDirty = true;
+}
+
+// Copies changed lights to the GPU
+void LightBuffer::Upload(const std::vector<Light>& lights)
+{
+	lastUploadCount = 0;
+	unsigned int count = (unsigned int)lights.size();
+	if (count == 0)
+	{
+		dirtyBegin = dirtyEnd = 0;
+		return;
+	}
+
+	// Grow the buffer if necessary, which needs a full upload
+	if (count > capacity)
+	{
+		if (!CreateBuffer(max(count, capacity * 2)))
+			return;
+		allDirty = true;
+	}
+
+	// Clamp the dirty range to the lights that actually exist
+	dirtyEnd = min(dirtyEnd, count);
+	bool partial = !allDirty && dirtyBegin < dirtyEnd;
+
+	// Partial updates only pay off for small ranges; otherwise it's
+	// cheaper to let the driver hand us a fresh buffer
+	if (partial && noOverwriteSupported && (dirtyEnd - dirtyBegin) * 2 <= count)
+	{
+		// Note: the GPU may still be reading last frame's copy of these
+		// lights, so an edit can land a frame early.  That's harmless
+		// for light data, and avoids re-uploading the whole buffer
+		if (Write(lights, dirtyBegin, dirtyEnd, D3D11_MAP_WRITE_NO_OVERWRITE))
+			lastUploadCount = dirtyEnd - dirtyBegin;
+	}
+	else if (allDirty || partial)
+	{
+		// DISCARD loses the previous contents, so everything is written
+		if (Write(lights, 0, count, D3D11_MAP_WRITE_DISCARD))
+			lastUploadCount = count;
+	}
+
+	dirtyBegin = dirtyEnd = 0;
+	allDirty = false;
+}
+
+// (Re)creates the buffer and its view with the given capacity
+bool LightBuffer::CreateBuffer(unsigned int newCapacity)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = sizeof(Light) * newCapacity;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(Light);
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> newBuffer;
+	if (FAILED(device->CreateBuffer(&desc, 0, newBuffer.GetAddressOf())))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = newCapacity;
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> newSRV;
+	if (FAILED(device->CreateShaderResourceView(newBuffer.Get(), &srvDesc, newSRV.GetAddressOf())))
+		return false;
+
+	buffer = newBuffer;
+	srv = newSRV;
+	capacity = newCapacity;
+	return true;
+}
+
+// Maps the buffer and copies lights [begin, end) to the same place
+bool LightBuffer::Write(const std::vector<Light>& lights, unsigned int begin, unsigned int end, D3D11_MAP mapType)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer.Get(), 0, mapType, 0, &mapped)))
+		return false;
+
+	Light* gpuLights = (Light*)mapped.pData;
+	memcpy(&gpuLights[begin], &lights[begin], sizeof(Light) * (end - begin));
+	context->Unmap(buffer.Get(), 0);
+	return true;
+}
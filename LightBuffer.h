@@ -0,0 +1,57 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+
+#include "Lights.h"
+
+// --------------------------------------------------------
+// GPU storage for the scene's lights, as a dynamic
+// StructuredBuffer<Light> that grows as needed.
+//
+// Callers mark the lights they change, and Upload() only
+// writes those ranges (using Map(NO_OVERWRITE) where the
+// hardware supports it for buffers with SRVs).  Growing the
+// buffer, or changing more than half of it, falls back to
+// rewriting everything with Map(DISCARD).
+// --------------------------------------------------------
+class LightBuffer
+{
+public:
+	LightBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int initialCapacity = 64);
+
+	// Change tracking
+	void MarkDirty(unsigned int index, unsigned int count = 1);
+	void MarkAllDirty();
+
+	// Copies any changed lights to the GPU
+	void Upload(const std::vector<Light>& lights);
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV() { return srv; }
+	unsigned int GetCapacity() { return capacity; }
+
+	// Stats from the most recent Upload()
+	unsigned int GetLastUploadCount() { return lastUploadCount; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	unsigned int capacity;
+
+	// Range of lights needing upload: [dirtyBegin, dirtyEnd)
+	unsigned int dirtyBegin;
+	unsigned int dirtyEnd;
+	bool allDirty;
+
+	// Can partial updates use NO_OVERWRITE on this device?
+	bool noOverwriteSupported;
+
+	unsigned int lastUploadCount;
+
+	bool CreateBuffer(unsigned int newCapacity);
+	bool Write(const std::vector<Light>& lights, unsigned int begin, unsigned int end, D3D11_MAP mapType);
+};
@@ -0,0 +1,104 @@
+#include "Lighting.hlsli"
+#include "ClusteredLighting.hlsli"
+
+// Data for this culling pass
+cbuffer externalData : register(b0)
+{
+	matrix view;
+
+	// Projection matrix scale (_11 and _22) for unprojecting
+	float2 projScale;
+	float nearClip;
+	float farClip;
+
+	int lightCount;
+};
+
+// All lights this frame
+StructuredBuffer<Light> Lights					: register(t0);
+
+// Output: per cluster (offset, count) into the index list,
+// and the light indices themselves
+RWStructuredBuffer<uint2> ClusterLightGrid		: register(u0);
+RWStructuredBuffer<uint> ClusterLightIndices	: register(u1);
+
+// Lights are loaded into shared memory in batches, one per thread
+#define GROUP_SIZE (CLUSTER_THREADS_X * CLUSTER_THREADS_Y * CLUSTER_THREADS_Z)
+groupshared Light sharedLights[GROUP_SIZE];
+
+// View space depth of the given slice boundary
+float SliceDepth(uint slice)
+{
+	return nearClip * pow(farClip / nearClip, slice / (float)CLUSTER_GRID_Z);
+}
+
+// Squared distance from a point to an AABB
+float SqDistPointAABB(float3 p, float3 boxMin, float3 boxMax)
+{
+	float3 d = max(max(boxMin - p, 0), p - boxMax);
+	return dot(d, d);
+}
+
+[numthreads(CLUSTER_THREADS_X, CLUSTER_THREADS_Y, CLUSTER_THREADS_Z)]
+void main(uint3 id : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+	// The grid may not divide evenly into groups, but every thread
+	// still has to help load lights below
+	bool validCluster = all(id < uint3(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z));
+
+	// Tile bounds in NDC (note that pixel Y goes down, NDC Y goes up)
+	float2 ndcMin = float2(
+		id.x / (float)CLUSTER_GRID_X * 2.0f - 1.0f,
+		1.0f - (id.y + 1) / (float)CLUSTER_GRID_Y * 2.0f);
+	float2 ndcMax = float2(
+		(id.x + 1) / (float)CLUSTER_GRID_X * 2.0f - 1.0f,
+		1.0f - id.y / (float)CLUSTER_GRID_Y * 2.0f);
+
+	// View space AABB around the tile's slice of the frustum
+	float zNear = SliceDepth(id.z);
+	float zFar = SliceDepth(id.z + 1);
+	float2 nearMin = ndcMin * zNear / projScale;
+	float2 nearMax = ndcMax * zNear / projScale;
+	float2 farMin = ndcMin * zFar / projScale;
+	float2 farMax = ndcMax * zFar / projScale;
+	float3 boxMin = float3(min(nearMin, farMin), zNear);
+	float3 boxMax = float3(max(nearMax, farMax), zFar);
+
+	uint clusterIndex = ClusterIndex(id);
+	uint offset = clusterIndex * MAX_LIGHTS_PER_CLUSTER;
+	uint count = 0;
+
+	// Process the lights in batches
+	for (int batch = 0; batch < lightCount; batch += GROUP_SIZE)
+	{
+		int loadIndex = batch + groupIndex;
+		if (loadIndex < lightCount)
+			sharedLights[groupIndex] = Lights[loadIndex];
+		GroupMemoryBarrierWithGroupSync();
+
+		int batchCount = min(GROUP_SIZE, lightCount - batch);
+		for (int i = 0; validCluster && i < batchCount; i++)
+		{
+			Light light = sharedLights[i];
+			bool affects = true;
+
+			// Directional lights affect everything, while point and spot
+			// lights are treated as spheres of their range
+			if (light.Type != LIGHT_TYPE_DIRECTIONAL)
+			{
+				float3 viewPos = mul(view, float4(light.Position, 1.0f)).xyz;
+				affects = SqDistPointAABB(viewPos, boxMin, boxMax) <= light.Range * light.Range;
+			}
+
+			if (affects && count < MAX_LIGHTS_PER_CLUSTER)
+			{
+				ClusterLightIndices[offset + count] = batch + i;
+				count++;
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (validCluster)
+		ClusterLightGrid[clusterIndex] = uint2(offset, count);
+}
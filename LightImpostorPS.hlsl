@@ -0,0 +1,11 @@
+// Matches LightImpostorVS's output
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float3 color			: COLOR;
+};
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	return float4(input.color, 1);
+}
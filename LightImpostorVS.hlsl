@@ -0,0 +1,50 @@
+#include "Lighting.hlsli"
+
+// Constant Buffer for external (C++) data
+// - Everything per light comes from the light buffer instead
+cbuffer externalData : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+// All lights this frame, one per instance
+StructuredBuffer<Light> Lights		: register(t0);
+
+// Just the positions of the sphere (see Mesh::SetPositionBuffers)
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+	uint instanceID		: SV_InstanceID;
+};
+
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float3 color			: COLOR;
+};
+
+// --------------------------------------------------------
+// Places one vertex of one light's marker sphere, sized from
+// the light's range and tinted with its color
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput input)
+{
+	Light light = Lights[input.instanceID];
+
+	VertexToPixel output;
+	output.color = light.Color * light.Intensity;
+
+	// Only point lights get a sphere.  The rest put every vertex at
+	// the same spot in front of the near plane, so nothing is drawn
+	if (light.Type != LIGHT_TYPE_POINT)
+	{
+		output.screenPosition = float4(0, 0, -1, 1);
+		return output;
+	}
+
+	float3 worldPos = light.Position + input.position * (light.Range / 20.0f);
+	matrix viewProj = mul(projection, view);
+	output.screenPosition = mul(viewProj, float4(worldPos, 1.0f));
+	return output;
+}
@@ -9,8 +9,8 @@ static const float PI = 3.14159265359f;
 static const float TWO_PI = PI * 2.0f;
 static const float PI_OVER_2 = PI / 2.0f;
 #define MAX_IBL_SAMPLES 4096 // Or fewer as necessary for performance
-#define IRRADIANCE_SAMPLE_STEP_PHI 0.025f // Or larger for performance
-#define IRRADIANCE_SAMPLE_STEP_THETA 0.025f // Or larger for performance
+#define IBL_FILTERED_SAMPLES 128 // Per specular texel, with mip-filtered lookups
+#define IRRADIANCE_FILTERED_SAMPLES 256 // Per irradiance texel, with mip-filtered lookups
 
 #define LIGHT_TYPE_DIRECTIONAL	0
 #define LIGHT_TYPE_POINT		1
@@ -34,9 +34,12 @@ struct Light
 // === UTILITY FUNCTIONS ============================================
 
 // Basic sample and unpack
+// - Only x and y are read, since block-compressed (BC5) normal
+//   maps only store those, and z is rebuilt from them
 float3 SampleAndUnpackNormalMap(Texture2D map, SamplerState samp, float2 uv)
 {
-	return map.Sample(samp, uv).rgb * 2.0f - 1.0f;
+	float2 xy = map.Sample(samp, uv).rg * 2.0f - 1.0f;
+	return float3(xy, sqrt(saturate(1.0f - dot(xy, xy))));
 }
 
 // Handle converting tangent-space normal map to world space normal
@@ -446,4 +449,47 @@ float3 ImportanceSampleGGX(float2 Xi, float roughness, float3 N)
 	return TangentX * H.x + TangentY * H.y + N * H.z;
 }
 
+// Direction through a point on one face of a cube map
+//
+// face - 0 to 5, in +X, -X, +Y, -Y, +Z, -Z order
+// uv - Position on that face, 0 to 1
+//
+float3 CubeFaceDirection(uint face, float2 uv)
+{
+	float2 o = uv * 2 - 1;
+	float3 dir;
+	switch (face)
+	{
+	default:
+	case 0: dir = float3(+1, -o.y, -o.x); break;
+	case 1: dir = float3(-1, -o.y, +o.x); break;
+	case 2: dir = float3(+o.x, +1, +o.y); break;
+	case 3: dir = float3(+o.x, -1, -o.y); break;
+	case 4: dir = float3(+o.x, -o.y, +1); break;
+	case 5: dir = float3(-o.x, -o.y, -1); break;
+	}
+	return normalize(dir);
+}
+
+// Filtered importance sampling
+//
+// http://developer.nvidia.com/gpugems/gpugems3/part-iii-rendering/chapter-20-gpu-based-importance-sampling
+//
+// Picks the environment mip for one of many importance samples, so that
+// each sample averages over its share of the sphere instead of a single
+// texel.  This is what lets a few hundred samples look like thousands.
+//
+// pdf - Probability density of the sample's direction
+// sampleCount - Total number of samples being taken
+// faceSize - Size of the environment's top mip, in texels
+//
+float FilteredSampleLevel(float pdf, uint sampleCount, float faceSize)
+{
+	float sampleSolidAngle = 1.0f / (sampleCount * pdf + 0.0001f);
+	float texelSolidAngle = 4.0f * PI / (6.0f * faceSize * faceSize);
+
+	// The +1 biases towards blurrier lookups, which hides the sample pattern
+	return max(0.5f * log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f);
+}
+
 #endif
\ No newline at end of file
@@ -2,16 +2,16 @@
 
 #include <DirectXMath.h>
 
-// This define should match your
-// MAX_LIGHTS definition in your shader(s)
-#define MAX_LIGHTS 128
-
 // Light types
 // Must match definitions in shader
 #define LIGHT_TYPE_DIRECTIONAL	0
 #define LIGHT_TYPE_POINT		1
 #define LIGHT_TYPE_SPOT			2
 
+// Cascades in a directional light's shadow map
+// Must match Shadows.hlsli
+#define MAX_SHADOW_CASCADES		4
+
 struct Light
 {
 	int					Type;
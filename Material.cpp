@@ -1,4 +1,7 @@
 #include "Material.h"
+#include "TextureStreamer.h"
+
+#include <algorithm>
 
 Material::Material(
 	std::shared_ptr<SimplePixelShader> ps,
@@ -11,26 +14,60 @@ Material::Material(
 	vs(vs),
 	colorTint(tint),
 	uvScale(uvScale),
-	uvOffset(uvOffset)
+	uvOffset(uvOffset),
+	roughness(1.0f),
+	metal(0.0f),
+	boundMaps(0),
+	featuresDirty(false),
+	permutationVersion(0),
+	handlesDirty(true),
+	vsReflectionVersion(0),
+	psReflectionVersion(0),
+	lastInstancedVS(0),
+	instancedVSReflectionVersion(0),
+	streamedVersion(0)
 {
 
 }
 
+Material::Material(
+	std::shared_ptr<ShaderPermutations> permutations,
+	std::shared_ptr<SimpleVertexShader> vs,
+	DirectX::XMFLOAT3 tint,
+	DirectX::XMFLOAT2 uvScale,
+	DirectX::XMFLOAT2 uvOffset)
+	:
+	Material(permutations->GetFullShader(), vs, tint, uvScale, uvOffset)
+{
+	this->permutations = permutations;
+	featuresDirty = true;
+}
+
 // Getters
-std::shared_ptr<SimplePixelShader> Material::GetPixelShader() { return ps; }
+std::shared_ptr<SimplePixelShader> Material::GetPixelShader() { UpdatePermutation(); return ps; }
 std::shared_ptr<SimpleVertexShader> Material::GetVertexShader() { return vs; }
 DirectX::XMFLOAT2 Material::GetUVScale() { return uvScale; }
 DirectX::XMFLOAT2 Material::GetUVOffset() { return uvOffset; }
 DirectX::XMFLOAT3 Material::GetColorTint() { return colorTint; }
+float Material::GetRoughness() { return roughness; }
+float Material::GetMetal() { return metal; }
 
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Material::GetTextureSRV(std::string name)
 {
+	ResolvePendingTextures();
+
 	// Search for the key
 	auto it = textureSRVs.find(name);
 
-	// Not found, return null
+	// Not found, check the streamed textures
 	if (it == textureSRVs.end())
-		return 0;
+	{
+		auto streamed = streamedTextures.find(name);
+		if (streamed == streamedTextures.end())
+			return 0;
+
+		return streamed->second->SRV;
+	}
 
 	// Return the texture ComPtr
 	return it->second;
@@ -50,55 +87,279 @@ Microsoft::WRL::ComPtr<ID3D11SamplerState> Material::GetSampler(std::string name
 }
 
 // Setters
-void Material::SetPixelShader(std::shared_ptr<SimplePixelShader> ps) { this->ps = ps; }
-void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> vs) { this->vs = vs; }
+void Material::SetPixelShader(std::shared_ptr<SimplePixelShader> ps) { this->ps = ps; permutations = nullptr; handlesDirty = true; }
+void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> vs) { this->vs = vs; handlesDirty = true; }
 void Material::SetUVScale(DirectX::XMFLOAT2 scale) { uvScale = scale; }
 void Material::SetUVOffset(DirectX::XMFLOAT2 offset) { uvOffset = offset; }
 void Material::SetColorTint(DirectX::XMFLOAT3 tint) { this->colorTint = tint; }
+void Material::SetRoughness(float roughness) { this->roughness = roughness; }
+void Material::SetMetal(float metal) { this->metal = metal; }
 
 
 void Material::AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	textureSRVs.insert({ name, srv });
+	handlesDirty = true;
+	featuresDirty = true;
+}
+
+void Material::AddTextureSRV(std::string name, std::shared_future<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> pendingSRV)
+{
+	pendingSRVs.insert({ name, pendingSRV });
+	handlesDirty = true;
+	featuresDirty = true;
+}
+
+// Waits for any textures that are still loading and moves them in
+// with the rest.  Textures that failed to load are dropped
+void Material::ResolvePendingTextures()
+{
+	if (pendingSRVs.empty())
+		return;
+
+	for (auto& p : pendingSRVs)
+	{
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv = p.second.get();
+		if (srv) textureSRVs.insert({ p.first, srv });
+	}
+	pendingSRVs.clear();
+	handlesDirty = true;
+	featuresDirty = true;
+}
+
+void Material::AddTextureSRV(std::string name, std::shared_ptr<StreamedTexture> streamedTexture)
+{
+	streamedTextures.insert({ name, streamedTexture });
+	handlesDirty = true;
+	featuresDirty = true;
 }
 
 void Material::AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
 {
 	samplers.insert({ name, sampler });
+	handlesDirty = true;
 }
 
 void Material::RemoveTextureSRV(std::string name)
 {
 	textureSRVs.erase(name);
+	pendingSRVs.erase(name);
+	streamedTextures.erase(name);
+	handlesDirty = true;
+	featuresDirty = true;
 }
 
 void Material::RemoveSampler(std::string name)
 {
 	samplers.erase(name);
+	handlesDirty = true;
 }
 
 
 void Material::PrepareMaterial(Transform* transform, std::shared_ptr<Camera> camera)
 {
+	UpdatePermutation();
+
 	// Turn on these shaders
 	vs->SetShader();
 	ps->SetShader();
 
 	// Send data to the vertex shader
-	vs->SetMatrix4x4("world", transform->GetWorldMatrix());
-	vs->SetMatrix4x4("worldInverseTranspose", transform->GetWorldInverseTransposeMatrix());
-	vs->SetMatrix4x4("view", camera->GetView());
-	vs->SetMatrix4x4("projection", camera->GetProjection());
+	BindVertexData(transform, camera);
+
+	// Send data and resources to the pixel shader
+	BindResources();
+}
+
+// Sends the per-object matrices to this material's vertex shader.  Assumes
+// the vertex shader has already been set
+void Material::BindVertexData(Transform* transform, std::shared_ptr<Camera> camera)
+{
+	Bake();
+
+	vs->SetMatrix4x4(worldHandle, transform->GetWorldMatrix());
+	vs->SetMatrix4x4(worldInvTransHandle, transform->GetWorldInverseTransposeMatrix());
+	vs->SetMatrix4x4(viewHandle, camera->GetView());
+	vs->SetMatrix4x4(projectionHandle, camera->GetProjection());
 	vs->CopyAllBufferData();
+}
+
+// Prepares this material for an instanced draw.  The given vertex shader
+// replaces the material's own and reads world matrices per instance, so
+// only the camera matrices are sent here
+void Material::PrepareMaterialInstanced(std::shared_ptr<SimpleVertexShader> instancedVS, std::shared_ptr<Camera> camera)
+{
+	UpdatePermutation();
+
+	// Turn on these shaders
+	instancedVS->SetShader();
+	ps->SetShader();
+
+	// Send data to the vertex shader, looking its variables up again
+	// only when it's a different shader or has been reloaded
+	if (instancedVS.get() != lastInstancedVS || instancedVS->GetReflectionVersion() != instancedVSReflectionVersion)
+	{
+		lastInstancedVS = instancedVS.get();
+		instancedVSReflectionVersion = instancedVS->GetReflectionVersion();
+		instancedViewHandle = instancedVS->GetVariableHandle("view");
+		instancedProjectionHandle = instancedVS->GetVariableHandle("projection");
+	}
+	instancedVS->SetMatrix4x4(instancedViewHandle, camera->GetView());
+	instancedVS->SetMatrix4x4(instancedProjectionHandle, camera->GetProjection());
+	instancedVS->CopyAllBufferData();
+
+	// Send data and resources to the pixel shader
+	BindResources();
+}
+
+// Sends this material's pixel shader data, textures and samplers to the
+// pixel shader.  Assumes the pixel shader has already been set, which
+// allows callers that track bound state to skip redundant shader changes
+void Material::BindResources()
+{
+	Bake();
 
 	// Send data to the pixel shader
-	ps->SetFloat3("colorTint", colorTint);
-	ps->SetFloat3("cameraPosition", camera->GetTransform()->GetPosition());
-	ps->SetFloat2("uvScale", uvScale);
-	ps->SetFloat2("uvOffset", uvOffset);
+	ps->SetFloat3(colorTintHandle, colorTint);
+	ps->SetFloat2(uvScaleHandle, uvScale);
+	ps->SetFloat2(uvOffsetHandle, uvOffset);
+	ps->SetFloat(roughnessHandle, roughness);
+	ps->SetFloat(metalHandle, metal);
+	ps->SetInt(mapsHandle, boundMaps);
 	ps->CopyAllBufferData();
 
-	// Loop and set any other resources
-	for (auto& t : textureSRVs) { ps->SetShaderResourceView(t.first.c_str(), t.second.Get()); }
-	for (auto& s : samplers) { ps->SetSamplerState(s.first.c_str(), s.second.Get()); }
+	// Bind the textures and samplers, one call per run of slots
+	for (auto& r : srvRanges) { ps->SetShaderResourceViewRange(r.StartSlot, r.Count, &bakedSRVs[r.Offset]); }
+	for (auto& r : samplerRanges) { ps->SetSamplerStateRange(r.StartSlot, r.Count, &bakedSamplers[r.Offset]); }
+}
+
+// Sorts (slot, resource) pairs into register order and splits them into
+// runs of consecutive slots.  Gaps are left alone rather than filled with
+// nulls, so resources bound elsewhere (like the lights) aren't unbound
+template<typename T>
+void Material::BakeRanges(
+	std::vector<std::pair<unsigned int, T*>>& slots,
+	std::vector<T*>& baked,
+	std::vector<BindingRange>& ranges)
+{
+	std::sort(slots.begin(), slots.end(),
+		[](const std::pair<unsigned int, T*>& a, const std::pair<unsigned int, T*>& b) { return a.first < b.first; });
+
+	baked.clear();
+	ranges.clear();
+	for (auto& s : slots)
+	{
+		if (ranges.empty() || ranges.back().StartSlot + ranges.back().Count != s.first)
+			ranges.push_back({ s.first, 0, (unsigned int)baked.size() });
+
+		ranges.back().Count++;
+		baked.push_back(s.second);
+	}
+}
+
+// Looks up every shader handle and resource slot this material uses, but
+// only when the shaders, the resources, or the shaders' reflection data
+// have changed
+void Material::Bake()
+{
+	ResolvePendingTextures();
+	UpdatePermutation();
+
+	// Versions only ever go up, so any swap changes their sum
+	unsigned int version = 0;
+	for (auto& t : streamedTextures)
+		version += t.second->Version;
+
+	if (!handlesDirty &&
+		streamedVersion == version &&
+		vsReflectionVersion == vs->GetReflectionVersion() &&
+		psReflectionVersion == ps->GetReflectionVersion())
+		return;
+
+	worldHandle = vs->GetVariableHandle("world");
+	worldInvTransHandle = vs->GetVariableHandle("worldInverseTranspose");
+	viewHandle = vs->GetVariableHandle("view");
+	projectionHandle = vs->GetVariableHandle("projection");
+
+	colorTintHandle = ps->GetVariableHandle("colorTint");
+	uvScaleHandle = ps->GetVariableHandle("uvScale");
+	uvOffsetHandle = ps->GetVariableHandle("uvOffset");
+	roughnessHandle = ps->GetVariableHandle("materialRoughness");
+	metalHandle = ps->GetVariableHandle("materialMetal");
+	mapsHandle = ps->GetVariableHandle("materialMaps");
+
+	// Resources the shader doesn't use are dropped here rather than
+	// being looked up (and failing) on every bind
+	std::vector<std::pair<unsigned int, ID3D11ShaderResourceView*>> srvSlots;
+	for (auto& t : textureSRVs)
+	{
+		const SimpleSRV* info = ps->GetShaderResourceViewInfo(t.first);
+		if (info) srvSlots.push_back({ info->BindIndex, t.second.Get() });
+	}
+	for (auto& t : streamedTextures)
+	{
+		const SimpleSRV* info = ps->GetShaderResourceViewInfo(t.first);
+		if (info && t.second->SRV) srvSlots.push_back({ info->BindIndex, t.second->SRV.Get() });
+	}
+	BakeRanges(srvSlots, bakedSRVs, srvRanges);
+
+	// The full shader samples every map, and falls back to the constant
+	// values for any that aren't actually bound
+	auto isBound = [this](const char* name)
+	{
+		auto s = streamedTextures.find(name);
+		return textureSRVs.count(name) || (s != streamedTextures.end() && s->second->SRV);
+	};
+	boundMaps = 0;
+	if (isBound("RoughnessMap")) boundMaps |= SHADER_FEATURE_ROUGHNESS_MAP;
+	if (isBound("MetalMap")) boundMaps |= SHADER_FEATURE_METAL_MAP;
+
+	std::vector<std::pair<unsigned int, ID3D11SamplerState*>> samplerSlots;
+	for (auto& s : samplers)
+	{
+		const SimpleSampler* info = ps->GetSamplerInfo(s.first);
+		if (info) samplerSlots.push_back({ info->BindIndex, s.second.Get() });
+	}
+	BakeRanges(samplerSlots, bakedSamplers, samplerRanges);
+
+	vsReflectionVersion = vs->GetReflectionVersion();
+	psReflectionVersion = ps->GetReflectionVersion();
+	streamedVersion = version;
+	handlesDirty = false;
+}
+
+// Switches to the permutation for this material's textures and the
+// frame's features, if either changed since it was last picked
+void Material::UpdatePermutation()
+{
+	if (!permutations || (!featuresDirty && permutationVersion == permutations->GetVersion()))
+		return;
+
+	unsigned int features = 0;
+	if (HasTexture("NormalMap")) features |= SHADER_FEATURE_NORMAL_MAP;
+	if (HasTexture("RoughnessMap")) features |= SHADER_FEATURE_ROUGHNESS_MAP;
+	if (HasTexture("MetalMap")) features |= SHADER_FEATURE_METAL_MAP;
+	if (HasTexture("SpecularIBLMap")) features |= SHADER_FEATURE_IBL;
+
+	std::shared_ptr<SimplePixelShader> permutation = permutations->GetPixelShader(features);
+	if (permutation != ps)
+	{
+		ps = permutation;
+		handlesDirty = true;
+	}
+
+	permutationVersion = permutations->GetVersion();
+	featuresDirty = false;
+}
+
+// Whether a texture by this name has been added, loaded or not
+bool Material::HasTexture(std::string name)
+{
+	return textureSRVs.count(name) || pendingSRVs.count(name) || streamedTextures.count(name);
+}
+
+// The number of textures and samplers this material binds
+int Material::GetResourceCount()
+{
+	return (int)(textureSRVs.size() + pendingSRVs.size() + streamedTextures.size() + samplers.size());
 }
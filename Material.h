@@ -4,12 +4,18 @@
 #include <wrl/client.h>
 #include <DirectXMath.h>
 #include <memory>
+#include <future>
 #include <unordered_map>
+#include <vector>
 
 #include "SimpleShader.h"
+#include "ShaderPermutations.h"
 #include "Camera.h"
 #include "Transform.h"
 
+// See TextureStreamer.h
+struct StreamedTexture;
+
 class Material
 {
 public:
@@ -20,11 +26,22 @@ public:
 		DirectX::XMFLOAT2 uvScale = DirectX::XMFLOAT2(1, 1),
 		DirectX::XMFLOAT2 uvOffset = DirectX::XMFLOAT2(0, 0));
 
+	// Picks its pixel shader from the permutations, to match the textures
+	// it's given (and the frame's features) - see ShaderPermutations
+	Material(
+		std::shared_ptr<ShaderPermutations> permutations,
+		std::shared_ptr<SimpleVertexShader> vs,
+		DirectX::XMFLOAT3 tint = DirectX::XMFLOAT3(1, 1, 1),
+		DirectX::XMFLOAT2 uvScale = DirectX::XMFLOAT2(1, 1),
+		DirectX::XMFLOAT2 uvOffset = DirectX::XMFLOAT2(0, 0));
+
 	std::shared_ptr<SimplePixelShader> GetPixelShader();
 	std::shared_ptr<SimpleVertexShader> GetVertexShader();
 	DirectX::XMFLOAT2 GetUVScale();
 	DirectX::XMFLOAT2 GetUVOffset();
 	DirectX::XMFLOAT3 GetColorTint();
+	float GetRoughness();
+	float GetMetal();
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetTextureSRV(std::string name);
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> GetSampler(std::string name);
 
@@ -34,13 +51,35 @@ public:
 	void SetUVOffset(DirectX::XMFLOAT2 offset);
 	void SetColorTint(DirectX::XMFLOAT3 tint);
 
+	// Constant values used by permutations without a RoughnessMap or MetalMap
+	void SetRoughness(float roughness);
+	void SetMetal(float metal);
+
 	void AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+
+	// Adds a texture that's still loading (see AssetLoader).  It's only
+	// waited on when the material is first bound or the texture is asked for
+	void AddTextureSRV(std::string name, std::shared_future<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> pendingSRV);
+
+	// Adds a texture whose mips are streamed (see TextureStreamer).  The
+	// material rebinds it each time the streamer swaps in new mips
+	void AddTextureSRV(std::string name, std::shared_ptr<StreamedTexture> streamedTexture);
 	void AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
 
 	void RemoveTextureSRV(std::string name);
 	void RemoveSampler(std::string name);
 
 	void PrepareMaterial(Transform* transform, std::shared_ptr<Camera> camera);
+	void BindVertexData(Transform* transform, std::shared_ptr<Camera> camera);
+	void PrepareMaterialInstanced(std::shared_ptr<SimpleVertexShader> instancedVS, std::shared_ptr<Camera> camera);
+	void BindResources();
+	int GetResourceCount();
+
+	// Resolves handles and bakes bindings if anything changed.  Binding
+	// does this itself, but it has to happen on one thread before the
+	// material is bound from several (see RenderQueue)
+	void Bake();
+	const std::unordered_map<std::string, std::shared_ptr<StreamedTexture>>& GetStreamedTextures() { return streamedTextures; }
 
 private:
 
@@ -48,13 +87,66 @@ private:
 	std::shared_ptr<SimplePixelShader> ps;
 	std::shared_ptr<SimpleVertexShader> vs;
 
+	// Specialized pixel shaders to pick from, if any, and what the
+	// current one was picked for
+	std::shared_ptr<ShaderPermutations> permutations;
+	bool featuresDirty;
+	unsigned int permutationVersion;
+	void UpdatePermutation();
+	bool HasTexture(std::string name);
+
 	// Material properties
 	DirectX::XMFLOAT3 colorTint;
+	float roughness;
+	float metal;
+	int boundMaps;
 
 	// Texture-related
 	DirectX::XMFLOAT2 uvOffset;
 	DirectX::XMFLOAT2 uvScale;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+	std::unordered_map<std::string, std::shared_future<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>> pendingSRVs;
+	void ResolvePendingTextures();
+	std::unordered_map<std::string, std::shared_ptr<StreamedTexture>> streamedTextures;
+	unsigned int streamedVersion;
+
+	// Shader handles and bindings, resolved from the names above only
+	// when the shaders or resources change, so binding does no lookups
+	bool handlesDirty;
+	unsigned int vsReflectionVersion;
+	unsigned int psReflectionVersion;
+	SimpleShaderHandle worldHandle;
+	SimpleShaderHandle worldInvTransHandle;
+	SimpleShaderHandle viewHandle;
+	SimpleShaderHandle projectionHandle;
+	SimpleShaderHandle colorTintHandle;
+	SimpleShaderHandle uvScaleHandle;
+	SimpleShaderHandle uvOffsetHandle;
+	SimpleShaderHandle roughnessHandle;
+	SimpleShaderHandle metalHandle;
+	SimpleShaderHandle mapsHandle;
+
+	// The instanced vertex shader last prepared for, and its variables
+	SimpleVertexShader* lastInstancedVS;
+	unsigned int instancedVSReflectionVersion;
+	SimpleShaderHandle instancedViewHandle;
+	SimpleShaderHandle instancedProjectionHandle;
+
+	// Textures and samplers baked into register order, as runs of
+	// consecutive slots that can each be bound with a single call
+	struct BindingRange
+	{
+		unsigned int StartSlot;
+		unsigned int Count;
+		unsigned int Offset; // Into the baked array
+	};
+	std::vector<ID3D11ShaderResourceView*> bakedSRVs;
+	std::vector<ID3D11SamplerState*> bakedSamplers;
+	std::vector<BindingRange> srvRanges;
+	std::vector<BindingRange> samplerRanges;
+
+	template<typename T>
+	static void BakeRanges(std::vector<std::pair<unsigned int, T*>>& slots, std::vector<T*>& baked, std::vector<BindingRange>& ranges);
 };
 
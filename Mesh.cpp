@@ -1,233 +1,352 @@
 #include "Mesh.h"
 #include <DirectXMath.h>
+#include <DirectXPackedVector.h>
 #include <vector>
-#include <fstream>
+#include <stdio.h>
+#include <math.h>
+
+#include "ObjLoader.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 
 using namespace DirectX;
 
-Mesh::Mesh(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device)
+bool Mesh::OptimizeOnLoad = true;
+float Mesh::MaxLodError = 0.1f;
+
+Mesh::Mesh(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, MeshVertexFormat format)
+	:
+	numIndices(0),
+	indexFormat(DXGI_FORMAT_R32_UINT),
+	vertexFormat(format),
+	vertexStride(MeshCacheFile::GetVertexStride(format)),
+	positionStride(format == MESH_VERTEX_PACKED ? sizeof(PackedVertex::Position) : sizeof(Vertex::Position)),
+	positionScale(1, 1, 1),
+	positionOffset(0, 0, 0),
+	lods(1, MeshLod())
 {
 	CreateBuffers(vertArray, numVerts, indexArray, numIndices, device);
 }
 
-Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
+Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, MeshVertexFormat format)
+	:
+	numIndices(0),
+	indexFormat(DXGI_FORMAT_R32_UINT),
+	vertexFormat(format),
+	vertexStride(MeshCacheFile::GetVertexStride(format)),
+	positionStride(format == MESH_VERTEX_PACKED ? sizeof(PackedVertex::Position) : sizeof(Vertex::Position)),
+	positionScale(1, 1, 1),
+	positionOffset(0, 0, 0),
+	lods(1, MeshLod())
 {
-	// File input object
-	std::ifstream obj(objFile);
+	// Use the binary cache if it's up to date, which skips parsing and
+	// tangent generation, and uploads straight from the mapped file
+	MeshCacheFile cache;
+	if (cache.Open(objFile, vertexFormat, OptimizeOnLoad))
+	{
+		const MeshCacheHeader* header = cache.GetHeader();
+		SetBounds(BoundingBox(header->BoundsCenter, header->BoundsExtents));
+		lods.assign(header->Lods, header->Lods + header->LodCount);
+
+		UploadBuffers(
+			cache.GetVertices(), header->VertexCount,
+			cache.GetIndices(), header->IndexCount, header->IndexFormat,
+			device);
+		return;
+	}
 
-	// Check for successful open
-	if (!obj.is_open())
+	// Load the deduplicated, indexed geometry, and cache the
+	// finished result for next time
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	if (!LoadOBJ(objFile, verts, indices))
 		return;
 
-	// Variables used while reading the file
-	std::vector<XMFLOAT3> positions;     // Positions from the file
-	std::vector<XMFLOAT3> normals;       // Normals from the file
-	std::vector<XMFLOAT2> uvs;           // UVs from the file
-	std::vector<Vertex> verts;           // Verts we're assembling
-	std::vector<UINT> indices;           // Indices of these verts
-	unsigned int vertCounter = 0;        // Count of vertices/indices
-	char chars[100];                     // String for line reading
-
-	// Still have data left?
-	while (obj.good())
+	if (OptimizeOnLoad)
 	{
-		// Get the line (100 characters should be more than enough)
-		obj.getline(chars, 100);
-
-		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 norm;
-			sscanf_s(
-				chars,
-				"vn %f %f %f",
-				&norm.x, &norm.y, &norm.z);
-
-			// Add to the list of normals
-			normals.push_back(norm);
-		}
-		else if (chars[0] == 'v' && chars[1] == 't')
-		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
-			sscanf_s(
-				chars,
-				"vt %f %f",
-				&uv.x, &uv.y);
-
-			// Add to the list of uv's
-			uvs.push_back(uv);
-		}
-		else if (chars[0] == 'v')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
-			sscanf_s(
-				chars,
-				"v %f %f %f",
-				&pos.x, &pos.y, &pos.z);
-
-			// Add to the positions
-			positions.push_back(pos);
-		}
-		else if (chars[0] == 'f')
-		{
-			// Read the face indices into an array
-			// NOTE: This assumes the given obj file contains
-			//  vertex positions, uv coordinates AND normals.
-			//  If the model is missing any of these, this 
-			//  code will not handle the file correctly!
-			unsigned int i[12];
-			int facesRead = sscanf_s(
-				chars,
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-			// - Create the verts by looking up
-			//    corresponding data from vectors
-			// - OBJ File indices are 1-based, so
-			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// The model is most likely in a right-handed space,
-			// especially if it came from Maya.  We want to convert
-			// to a left-handed space for DirectX.  This means we 
-			// need to:
-			//  - Invert the Z position
-			//  - Invert the normal's Z
-			//  - Flip the winding order
-			// We also need to flip the UV coordinate since DirectX
-			// defines (0,0) as the top left of the texture, and many
-			// 3D modeling packages use the bottom left as (0,0)
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Flip Z (LH vs. RH)
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-
-			// Flip normal Z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
-
-			// Add three more indices
-			indices.push_back(vertCounter); vertCounter += 1;
-			indices.push_back(vertCounter); vertCounter += 1;
-			indices.push_back(vertCounter); vertCounter += 1;
-
-			// Was there a 4th face?
-			if (facesRead == 12)
-			{
-				// Make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				// Flip the UV, Z pos and normal
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-
-				// Add three more indices
-				indices.push_back(vertCounter); vertCounter += 1;
-				indices.push_back(vertCounter); vertCounter += 1;
-				indices.push_back(vertCounter); vertCounter += 1;
-			}
-		}
+		VertexCacheStats before = AnalyzeVertexCache(indices, verts.size());
+		OptimizeVertexCache(indices, verts.size());
+		OptimizeVertexFetch(verts, indices);
+		VertexCacheStats after = AnalyzeVertexCache(indices, verts.size());
+
+		printf("Optimized %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+			objFile, before.ACMR, after.ACMR, before.ATVR, after.ATVR);
 	}
 
-	// Close the file and create the actual buffers
-	obj.close();
+	CreateBuffers(&verts[0], (int)verts.size(), &indices[0], (int)indices.size(), device, objFile, OptimizeOnLoad);
+}
 
 
-	// - At this point, "verts" is a vector of Vertex structs, and can be used
-	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
-	//
-	// - The vector "indices" is similar. It's a vector of unsigned ints and
-	//    can be used directly for the index buffer: &indices[0] is the address of the first int
-	//
-	// - "vertCounter" is BOTH the number of vertices and the number of indices
-	// - Yes, the indices are a bit redundant here (one per vertex).  Could you skip using
-	//    an index buffer in this case?  Sure!  Though, if your mesh class assumes you have
-	//    one, you'll need to write some extra code to handle cases when you don't.
+Mesh::~Mesh(void)
+{
 
-	CreateBuffers(&verts[0], vertCounter, &indices[0], vertCounter, device);
+}
 
 
+// Finishes the vertex data (tangents and bounds) and creates the buffers.
+// If a source file is given, the finished data is also written to its
+// binary cache
+void Mesh::CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, const char* cacheSourceFile, bool optimized)
+{
+	// Always calculate the tangents before copying to buffer
+	CalculateTangents(vertArray, numVerts, indexArray, numIndices);
+
+	// Calculate the local space bounds, used for culling (and
+	// for quantizing positions)
+	if (numVerts > 0)
+	{
+		BoundingBox bounds;
+		BoundingBox::CreateFromPoints(bounds, numVerts, &vertArray[0].Position, sizeof(Vertex));
+		SetBounds(bounds);
+	}
+
+
+	// Meshes from files also get simplified LODs, which index the
+	// same vertices and follow LOD 0 in the index buffer
+	std::vector<unsigned int> allIndices(indexArray, indexArray + numIndices);
+	lods.assign(1, { 0, (unsigned int)numIndices, 0.0f });
+	if (cacheSourceFile)
+	{
+		BuildLods(vertArray, numVerts, allIndices, optimized);
+		printf("Simplified %s: %zu LODs, %u triangles in the coarsest\n",
+			cacheSourceFile, lods.size(), lods.back().IndexCount / 3);
+	}
+
+	// Use 16-bit indices whenever they can address every vertex,
+	// which halves the index buffer and its bandwidth
+	std::vector<unsigned short> shortIndices;
+	const void* indexData = allIndices.data();
+	DXGI_FORMAT format = DXGI_FORMAT_R32_UINT;
+	if (numVerts <= 65536)
+	{
+		shortIndices.assign(allIndices.begin(), allIndices.end());
+		indexData = &shortIndices[0];
+		format = DXGI_FORMAT_R16_UINT;
+	}
+
+	// Compress the vertices if this mesh uses the packed layout
+	std::vector<PackedVertex> packedVerts;
+	const void* vertexData = vertArray;
+	if (vertexFormat == MESH_VERTEX_PACKED)
+	{
+		PackVertices(vertArray, numVerts, packedVerts);
+		vertexData = &packedVerts[0];
+	}
+
+	UploadBuffers(vertexData, numVerts, indexData, (int)allIndices.size(), format, device);
+
+	if (cacheSourceFile)
+	{
+		MeshCacheFile::Write(
+			cacheSourceFile, vertexFormat, vertexData, numVerts,
+			indexData, (unsigned int)allIndices.size(), format,
+			lods.data(), (unsigned int)lods.size(),
+			boundingBox, optimized);
+	}
 }
 
+// Each LOD aims for half the triangles of the one before it, always
+// simplifying from LOD 0 so the errors don't compound.  Stops early
+// once a level wouldn't be much smaller than the last within the
+// allowed error
+void Mesh::BuildLods(const Vertex* verts, int numVerts, std::vector<unsigned int>& indices, bool optimized)
+{
+	std::vector<unsigned int> lod0(indices);
+	float radius = max(boundingSphere.Radius, 1e-6f);
 
-Mesh::~Mesh(void)
+	while (lods.size() < MESH_MAX_LODS)
+	{
+		size_t target = lods.back().IndexCount / 6 * 3;
+		if (target < 3 * 16)
+			break;
+
+		std::vector<unsigned int> simplified;
+		float error = SimplifyMesh(verts, numVerts, lod0, target, MaxLodError * radius, simplified);
+		if (simplified.empty() || simplified.size() > lods.back().IndexCount * 3 / 4)
+			break;
+
+		if (optimized)
+			OptimizeVertexCache(simplified, numVerts);
+
+		MeshLod lod = {};
+		lod.StartIndex = (unsigned int)indices.size();
+		lod.IndexCount = (unsigned int)simplified.size();
+		lod.Error = max(error / radius, lods.back().Error);
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		lods.push_back(lod);
+	}
+}
+
+// Walks from the coarsest LOD down, so the first one under its
+// threshold wins.  The current LOD gets a looser threshold and coarser
+// ones a tighter one, which is what keeps an entity where it is
+unsigned int Mesh::SelectLod(float radiusPixels, float maxErrorPixels, unsigned int currentLod, float hysteresis)
+{
+	for (unsigned int i = (unsigned int)lods.size() - 1; i > 0; i--)
+	{
+		float threshold = maxErrorPixels;
+		if (i > currentLod) threshold *= 1.0f - hysteresis;
+		else if (i == currentLod) threshold *= 1.0f + hysteresis;
+
+		if (lods[i].Error * radiusPixels <= threshold)
+			return i;
+	}
+	return 0;
+}
+
+// Saves the local space bounds, and the mapping from packed positions
+// (0-1 across the bounds) back to local space
+void Mesh::SetBounds(const BoundingBox& bounds)
+{
+	boundingBox = bounds;
+	BoundingSphere::CreateFromBoundingBox(boundingSphere, boundingBox);
+
+	// Flat meshes still need a non-zero scale to divide by
+	positionScale = XMFLOAT3(
+		max(bounds.Extents.x * 2.0f, 1e-6f),
+		max(bounds.Extents.y * 2.0f, 1e-6f),
+		max(bounds.Extents.z * 2.0f, 1e-6f));
+	positionOffset = XMFLOAT3(
+		bounds.Center.x - bounds.Extents.x,
+		bounds.Center.y - bounds.Extents.y,
+		bounds.Center.z - bounds.Extents.z);
+}
+
+// Octahedral encoding of a unit vector: project onto the octahedron
+// |x| + |y| + |z| = 1, then fold the lower half over the upper one
+static void OctEncode(const XMFLOAT3& v, short out[2])
 {
+	float l1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+	float x = l1 > 0.0f ? v.x / l1 : 0.0f;
+	float y = l1 > 0.0f ? v.y / l1 : 0.0f;
+	if (v.z < 0.0f)
+	{
+		float foldX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldX;
+		y = foldY;
+	}
 
+	out[0] = (short)roundf(max(-1.0f, min(x, 1.0f)) * 32767.0f);
+	out[1] = (short)roundf(max(-1.0f, min(y, 1.0f)) * 32767.0f);
 }
 
+// Converts full vertices to the packed layout, using the current bounds
+void Mesh::PackVertices(const Vertex* verts, int numVerts, std::vector<PackedVertex>& packed)
+{
+	packed.resize(numVerts);
+	for (int i = 0; i < numVerts; i++)
+	{
+		const Vertex& v = verts[i];
+		PackedVertex& p = packed[i];
+
+		float px = (v.Position.x - positionOffset.x) / positionScale.x;
+		float py = (v.Position.y - positionOffset.y) / positionScale.y;
+		float pz = (v.Position.z - positionOffset.z) / positionScale.z;
+		p.Position[0] = (unsigned short)roundf(max(0.0f, min(px, 1.0f)) * 65535.0f);
+		p.Position[1] = (unsigned short)roundf(max(0.0f, min(py, 1.0f)) * 65535.0f);
+		p.Position[2] = (unsigned short)roundf(max(0.0f, min(pz, 1.0f)) * 65535.0f);
+		p.Position[3] = 0;
+
+		p.UV[0] = PackedVector::XMConvertFloatToHalf(v.UV.x);
+		p.UV[1] = PackedVector::XMConvertFloatToHalf(v.UV.y);
+
+		OctEncode(v.Normal, p.Normal);
+		OctEncode(v.Tangent, p.Tangent);
+	}
+}
 
-void Mesh::CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device)
+// Describes PackedVertex (slot 0) and, optionally, InstanceData (slot 1)
+HRESULT Mesh::CreatePackedInputLayout(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3DBlob> vertexShaderBlob, bool perInstance, ID3D11InputLayout** inputLayout)
 {
-	// Always calculate the tangents before copying to buffer
-	CalculateTangents(vertArray, numVerts, indexArray, numIndices);
+	D3D11_INPUT_ELEMENT_DESC elements[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, 8,  D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL",   0, DXGI_FORMAT_R16G16_SNORM,       0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TANGENT",  0, DXGI_FORMAT_R16G16_SNORM,       0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+
+		{ "WORLD_PER_INSTANCE",         0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,   D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_PER_INSTANCE",         1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_PER_INSTANCE",         2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_PER_INSTANCE",         3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLDINVTRANS_PER_INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 64,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLDINVTRANS_PER_INSTANCE", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 80,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLDINVTRANS_PER_INSTANCE", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 96,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLDINVTRANS_PER_INSTANCE", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 112, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+
+	return device->CreateInputLayout(
+		elements,
+		perInstance ? ARRAYSIZE(elements) : 4,
+		vertexShaderBlob->GetBufferPointer(),
+		vertexShaderBlob->GetBufferSize(),
+		inputLayout);
+}
 
+// The position only stream is either full floats or the packed
+// 16-bit unorm positions, depending on the mesh's format
+HRESULT Mesh::CreatePositionInputLayout(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3DBlob> vertexShaderBlob, MeshVertexFormat format, bool perInstance, ID3D11InputLayout** inputLayout)
+{
+	D3D11_INPUT_ELEMENT_DESC elements[] =
+	{
+		{ "POSITION", 0, format == MESH_VERTEX_PACKED ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+
+		{ "WORLD_PER_INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,  D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_PER_INSTANCE", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_PER_INSTANCE", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD_PER_INSTANCE", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+
+	return device->CreateInputLayout(
+		elements,
+		perInstance ? ARRAYSIZE(elements) : 1,
+		vertexShaderBlob->GetBufferPointer(),
+		vertexShaderBlob->GetBufferSize(),
+		inputLayout);
+}
 
+// Creates the GPU buffers directly from finished data, in this mesh's
+// vertex format and the given index format
+void Mesh::UploadBuffers(const void* vertexData, int numVerts, const void* indexData, int numIndices, DXGI_FORMAT indexFormat, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
 	// Create the vertex buffer
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * numVerts; // Number of vertices
+	vbd.ByteWidth = vertexStride * numVerts; // Number of vertices
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
 	vbd.StructureByteStride = 0;
 	D3D11_SUBRESOURCE_DATA initialVertexData;
-	initialVertexData.pSysMem = vertArray;
+	initialVertexData.pSysMem = vertexData;
 	device->CreateBuffer(&vbd, &initialVertexData, vb.GetAddressOf());
 
+	// Positions come first in both formats, so the position only
+	// stream is the start of each vertex
+	std::vector<unsigned char> positions(positionStride * numVerts);
+	for (int i = 0; i < numVerts; i++)
+		memcpy(&positions[i * positionStride], (const unsigned char*)vertexData + i * vertexStride, positionStride);
+
+	vbd.ByteWidth = positionStride * numVerts;
+	initialVertexData.pSysMem = positions.data();
+	device->CreateBuffer(&vbd, &initialVertexData, positionVB.GetAddressOf());
+
 	// Create the index buffer
 	D3D11_BUFFER_DESC ibd;
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(unsigned int) * numIndices; // Number of indices
+	ibd.ByteWidth = (indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4) * numIndices; // Number of indices
 	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	ibd.CPUAccessFlags = 0;
 	ibd.MiscFlags = 0;
 	ibd.StructureByteStride = 0;
 	D3D11_SUBRESOURCE_DATA initialIndexData;
-	initialIndexData.pSysMem = indexArray;
+	initialIndexData.pSysMem = indexData;
 	device->CreateBuffer(&ibd, &initialIndexData, ib.GetAddressOf());
 
-	// Save the indices
-	this->numIndices = numIndices;
+	// Save the index format, and LOD 0's count for plain draws of this mesh
+	this->numIndices = lods[0].IndexCount;
+	this->indexFormat = indexFormat;
 }
 
 
@@ -270,8 +389,12 @@ void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices,
 		float s2 = v3->UV.x - v1->UV.x;
 		float t2 = v3->UV.y - v1->UV.y;
 
-		// Create vectors for tangent calculation
-		float r = 1.0f / (s1 * t2 - s2 * t1);
+		// Create vectors for tangent calculation, skipping triangles
+		// with no uv area (such as models without uvs at all)
+		float det = s1 * t2 - s2 * t1;
+		if (det == 0.0f)
+			continue;
+		float r = 1.0f / det;
 		
 		float tx = (t2 * x1 - t1 * x2) * r;
 		float ty = (t2 * y1 - t1 * y2) * r;
@@ -311,13 +434,43 @@ void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices,
 
 
 void Mesh::SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	SetBuffers(context);
+	Draw(context);
+}
+
+// Sets this mesh's vertex buffer (slot 0) and index buffer in the input
+// assembler.  Any other vertex buffer slots (like per-instance data) are
+// left untouched
+void Mesh::SetBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 {
 	// Set buffers in the input assembler
-	UINT stride = sizeof(Vertex);
+	UINT stride = vertexStride;
 	UINT offset = 0;
 	context->IASetVertexBuffers(0, 1, vb.GetAddressOf(), &stride, &offset);
-	context->IASetIndexBuffer(ib.Get(), DXGI_FORMAT_R32_UINT, 0);
+	context->IASetIndexBuffer(ib.Get(), indexFormat, 0);
+}
+
+// Sets the position only stream (slot 0) and index buffer instead,
+// leaving the other slots alone just like SetBuffers()
+void Mesh::SetPositionBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	UINT stride = positionStride;
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, positionVB.GetAddressOf(), &stride, &offset);
+	context->IASetIndexBuffer(ib.Get(), indexFormat, 0);
+}
 
-	// Draw this mesh
-	context->DrawIndexed(this->numIndices, 0, 0);
+// Draws one LOD of this mesh, assuming its buffers are already set
+void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod)
+{
+	context->DrawIndexed(lods[lod].IndexCount, lods[lod].StartIndex, 0);
+}
+
+// Draws several instances of this mesh with a single call, assuming its
+// buffers are already set along with per-instance data (see InstanceData
+// in Vertex.h) in vertex buffer slot 1
+void Mesh::DrawInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int instanceCount, unsigned int startInstance, unsigned int lod)
+{
+	context->DrawIndexedInstanced(lods[lod].IndexCount, instanceCount, lods[lod].StartIndex, 0, startInstance);
 }
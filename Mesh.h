@@ -2,29 +2,96 @@
 
 #include <d3d11.h>
 #include <wrl/client.h>
+#include <DirectXCollision.h>
+#include <vector>
 
 #include "Vertex.h"
+#include "MeshCache.h"
 
 
 class Mesh
 {
 public:
-	Mesh(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device);
-	Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	Mesh(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, MeshVertexFormat format = MESH_VERTEX_FULL);
+	Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, MeshVertexFormat format = MESH_VERTEX_FULL);
 	~Mesh(void);
 
+	// Should meshes loaded from files be optimized for the vertex cache?
+	// This happens before the mesh is cached, so it's only paid once
+	static bool OptimizeOnLoad;
+
+	// Largest error (as a fraction of the bounding radius) the simplified
+	// LODs of meshes loaded from files may have.  Like the optimization,
+	// LODs are built before the mesh is cached
+	static float MaxLodError;
+
+	// Creates an input layout for PackedVertex data, optionally with the
+	// per-instance matrices (see InstanceData) in vertex buffer slot 1
+	static HRESULT CreatePackedInputLayout(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3DBlob> vertexShaderBlob, bool perInstance, ID3D11InputLayout** inputLayout);
+
+	// Creates an input layout for the position only stream (see
+	// SetPositionBuffers) of meshes in the given format, optionally with
+	// the per-instance matrices in vertex buffer slot 1
+	static HRESULT CreatePositionInputLayout(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3DBlob> vertexShaderBlob, MeshVertexFormat format, bool perInstance, ID3D11InputLayout** inputLayout);
+
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer() { return vb; }
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer() { return ib; }
 	int GetIndexCount() { return numIndices; }
+	DXGI_FORMAT GetIndexFormat() { return indexFormat; }
+	MeshVertexFormat GetVertexFormat() { return vertexFormat; }
+	unsigned int GetVertexStride() { return vertexStride; }
+
+	// For packed meshes: position = positionOffset + packed * positionScale
+	DirectX::XMFLOAT3 GetPositionScale() { return positionScale; }
+	DirectX::XMFLOAT3 GetPositionOffset() { return positionOffset; }
+
+	// Local space bounds of the mesh's vertices
+	DirectX::BoundingBox GetBoundingBox() { return boundingBox; }
+	DirectX::BoundingSphere GetBoundingSphere() { return boundingSphere; }
+
+	// Levels of detail, finest (the full mesh) first.  They share the
+	// vertex and index buffers, so switching LODs needs no rebinding
+	unsigned int GetLodCount() { return (unsigned int)lods.size(); }
+	const MeshLod& GetLod(unsigned int lod) { return lods[lod]; }
+
+	// Picks the coarsest LOD whose error stays under maxErrorPixels when
+	// the bounding sphere's radius covers radiusPixels on screen.  Moving
+	// away from the current LOD has to clear the threshold by the given
+	// fraction, so entities right at a threshold don't flicker
+	unsigned int SelectLod(float radiusPixels, float maxErrorPixels, unsigned int currentLod, float hysteresis);
 
 	void SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
+	// Separate steps, for callers that track which mesh is already bound
+	void SetBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Binds just the positions (in this mesh's encoding) and indices,
+	// for depth only drawing that doesn't need the rest of the vertex
+	void SetPositionBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod = 0);
+	void DrawInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int instanceCount, unsigned int startInstance = 0, unsigned int lod = 0);
+
 private:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vb;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ib;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> positionVB;
 	int numIndices;
+	DXGI_FORMAT indexFormat;
+	MeshVertexFormat vertexFormat;
+	unsigned int vertexStride;
+	unsigned int positionStride;
+
+	DirectX::BoundingBox boundingBox;
+	DirectX::BoundingSphere boundingSphere;
+	DirectX::XMFLOAT3 positionScale;
+	DirectX::XMFLOAT3 positionOffset;
+	std::vector<MeshLod> lods;
 
-	void CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	void CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, const char* cacheSourceFile = 0, bool optimized = false);
+	void BuildLods(const Vertex* verts, int numVerts, std::vector<unsigned int>& indices, bool optimized);
+	void UploadBuffers(const void* vertexData, int numVerts, const void* indexData, int numIndices, DXGI_FORMAT indexFormat, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	void SetBounds(const DirectX::BoundingBox& bounds);
+	void PackVertices(const Vertex* verts, int numVerts, std::vector<PackedVertex>& packed);
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
 
 };
@@ -0,0 +1,171 @@
+#include "MeshCache.h"
+
+#include <stdio.h>
+
+MeshCacheFile::MeshCacheFile()
+	:
+	file(INVALID_HANDLE_VALUE),
+	mapping(0),
+	view(0),
+	header(0)
+{
+}
+
+MeshCacheFile::~MeshCacheFile()
+{
+	Close();
+}
+
+// Maps the cache file for the given source, and verifies that it
+// matches both the source and the current format.  Returns false
+// (with nothing mapped) if the cache is missing or out of date
+bool MeshCacheFile::Open(const char* sourceFile, MeshVertexFormat format, bool optimized)
+{
+	Close();
+
+	unsigned long long sourceSize = 0;
+	unsigned long long sourceWriteTime = 0;
+	if (!GetSourceStamp(sourceFile, &sourceSize, &sourceWriteTime))
+		return false;
+
+	std::string cachePath = GetCachePath(sourceFile, format);
+	file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(MeshCacheHeader))
+	{
+		Close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping)
+		view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		Close();
+		return false;
+	}
+
+	// Validate everything before trusting any of the offsets
+	const MeshCacheHeader* h = (const MeshCacheHeader*)view;
+	unsigned long long vertexStride = GetVertexStride(format);
+	unsigned long long indexSize = h->IndexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+	bool valid =
+		memcmp(h->Magic, "MESH", 4) == 0 &&
+		h->Version == MESH_CACHE_VERSION &&
+		h->VertexFormat == format &&
+		h->VertexStride == vertexStride &&
+		h->Optimized == (optimized ? 1u : 0u) &&
+		h->SourceSize == sourceSize &&
+		h->SourceWriteTime == sourceWriteTime &&
+		(h->IndexFormat == DXGI_FORMAT_R16_UINT || h->IndexFormat == DXGI_FORMAT_R32_UINT) &&
+		h->VertexCount > 0 && h->IndexCount > 0 &&
+		h->VertexOffset + (unsigned long long)h->VertexCount * vertexStride <= (unsigned long long)fileSize.QuadPart &&
+		h->IndexOffset + (unsigned long long)h->IndexCount * indexSize <= (unsigned long long)fileSize.QuadPart &&
+		h->LodCount > 0 && h->LodCount <= MESH_MAX_LODS;
+	for (unsigned int i = 0; valid && i < h->LodCount; i++)
+		valid = h->Lods[i].IndexCount > 0 && (unsigned long long)h->Lods[i].StartIndex + h->Lods[i].IndexCount <= h->IndexCount;
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	header = h;
+	return true;
+}
+
+// Unmaps and closes the file
+void MeshCacheFile::Close()
+{
+	if (view) UnmapViewOfFile(view);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+	file = INVALID_HANDLE_VALUE;
+	mapping = 0;
+	view = 0;
+	header = 0;
+}
+
+// Writes a new cache file for the given source.  The file is written
+// to a temporary name first, so a crash mid-write can't leave a
+// truncated cache behind that looks valid
+bool MeshCacheFile::Write(
+	const char* sourceFile,
+	MeshVertexFormat format, const void* verts, unsigned int vertexCount,
+	const void* indices, unsigned int indexCount, DXGI_FORMAT indexFormat,
+	const MeshLod* lods, unsigned int lodCount,
+	const DirectX::BoundingBox& bounds, bool optimized)
+{
+	if (lodCount == 0 || lodCount > MESH_MAX_LODS)
+		return false;
+
+	MeshCacheHeader h = {};
+	memcpy(h.Magic, "MESH", 4);
+	h.Version = MESH_CACHE_VERSION;
+	h.VertexFormat = format;
+	h.VertexStride = GetVertexStride(format);
+	h.Optimized = optimized ? 1 : 0;
+	if (!GetSourceStamp(sourceFile, &h.SourceSize, &h.SourceWriteTime))
+		return false;
+
+	h.VertexCount = vertexCount;
+	h.IndexCount = indexCount;
+	h.IndexFormat = indexFormat;
+	h.LodCount = lodCount;
+	memcpy(h.Lods, lods, sizeof(MeshLod) * lodCount);
+	h.BoundsCenter = bounds.Center;
+	h.BoundsExtents = bounds.Extents;
+
+	unsigned int indexSize = indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+	h.VertexOffset = sizeof(MeshCacheHeader);
+	h.IndexOffset = h.VertexOffset + vertexCount * h.VertexStride;
+
+	std::string cachePath = GetCachePath(sourceFile, format);
+	std::string tempPath = cachePath + ".tmp";
+
+	FILE* out = 0;
+	if (fopen_s(&out, tempPath.c_str(), "wb") != 0 || !out)
+		return false;
+
+	bool written =
+		fwrite(&h, sizeof(h), 1, out) == 1 &&
+		fwrite(verts, h.VertexStride, vertexCount, out) == vertexCount &&
+		fwrite(indices, indexSize, indexCount, out) == indexCount;
+	fclose(out);
+
+	if (!written || !MoveFileExA(tempPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+std::string MeshCacheFile::GetCachePath(const char* sourceFile, MeshVertexFormat format)
+{
+	return std::string(sourceFile) + (format == MESH_VERTEX_PACKED ? ".packed.meshcache" : ".meshcache");
+}
+
+unsigned int MeshCacheFile::GetVertexStride(MeshVertexFormat format)
+{
+	return format == MESH_VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+// Gets the size and last write time of the source file, which together
+// decide whether a cache built from it is still current
+bool MeshCacheFile::GetSourceStamp(const char* sourceFile, unsigned long long* size, unsigned long long* writeTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+	if (!GetFileAttributesExA(sourceFile, GetFileExInfoStandard, &attributes))
+		return false;
+
+	*size = ((unsigned long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	*writeTime = ((unsigned long long)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d11.h>
+#include <DirectXCollision.h>
+#include <string>
+
+#include "Vertex.h"
+
+// Bump whenever the layout below or the Vertex struct changes
+#define MESH_CACHE_VERSION 4
+
+// Most levels of detail a mesh (and its cache) can hold
+#define MESH_MAX_LODS 4
+
+// --------------------------------------------------------
+// One level of detail: a range of the mesh's index data,
+// and how far its surface strays from LOD 0 as a fraction
+// of the mesh's bounding sphere radius
+// --------------------------------------------------------
+struct MeshLod
+{
+	unsigned int StartIndex;
+	unsigned int IndexCount;
+	float Error;
+};
+
+// --------------------------------------------------------
+// The start of a binary mesh cache file, followed by the
+// vertex data (already in its final layout, with tangents)
+// and then the index data (16 or 32 bit, as stored) of
+// every LOD, back to back.
+// --------------------------------------------------------
+struct MeshCacheHeader
+{
+	char Magic[4];				// "MESH"
+	unsigned int Version;		// MESH_CACHE_VERSION
+	MeshVertexFormat VertexFormat;
+	unsigned int VertexStride;	// Size of that format's vertex when written
+	unsigned int Optimized;		// Reordered by the MeshOptimizer passes?
+
+	// Identifies the source file this was built from
+	unsigned long long SourceSize;
+	unsigned long long SourceWriteTime;
+
+	unsigned int VertexCount;
+	unsigned int IndexCount;	// Across all LODs
+	DXGI_FORMAT IndexFormat;
+
+	// Finest first, so LOD 0 is the full mesh
+	unsigned int LodCount;
+	MeshLod Lods[MESH_MAX_LODS];
+
+	// Local space bounds
+	DirectX::XMFLOAT3 BoundsCenter;
+	DirectX::XMFLOAT3 BoundsExtents;
+
+	// Byte offsets from the start of the file
+	unsigned int VertexOffset;
+	unsigned int IndexOffset;
+};
+
+// --------------------------------------------------------
+// A read-only, memory-mapped mesh cache file.  The vertex
+// and index pointers point straight into the mapping, so
+// they can be handed to the GPU with no copies, and stay
+// valid until the file is closed or destroyed.
+//
+// Cache files sit next to their source (model.obj becomes
+// model.obj.meshcache, or model.obj.packed.meshcache) and
+// are ignored if the source's size or last write time no
+// longer match.
+// --------------------------------------------------------
+class MeshCacheFile
+{
+public:
+	MeshCacheFile();
+	~MeshCacheFile();
+
+	// Maps the cache for the given source file, if there's a valid one
+	// in the given format that was (or wasn't) optimized
+	bool Open(const char* sourceFile, MeshVertexFormat format, bool optimized);
+	void Close();
+
+	const MeshCacheHeader* GetHeader() { return header; }
+	const void* GetVertices() { return view + header->VertexOffset; }
+	const void* GetIndices() { return view + header->IndexOffset; }
+
+	// Writes a cache for the given source file
+	static bool Write(
+		const char* sourceFile,
+		MeshVertexFormat format, const void* verts, unsigned int vertexCount,
+		const void* indices, unsigned int indexCount, DXGI_FORMAT indexFormat,
+		const MeshLod* lods, unsigned int lodCount,
+		const DirectX::BoundingBox& bounds, bool optimized);
+
+	static std::string GetCachePath(const char* sourceFile, MeshVertexFormat format);
+	static unsigned int GetVertexStride(MeshVertexFormat format);
+
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const char* view;
+	const MeshCacheHeader* header;
+
+	static bool GetSourceStamp(const char* sourceFile, unsigned long long* size, unsigned long long* writeTime);
+};
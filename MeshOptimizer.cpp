@@ -0,0 +1,435 @@
+#include "MeshOptimizer.h"
+
+#include <math.h>
+#include <algorithm>
+#include <unordered_set>
+
+// Tuning from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_MAX_VALENCE 32
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRI_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+// Scores for each cache position and each number of remaining
+// triangles, computed once since every vertex update needs them
+struct ForsythScoreTables
+{
+	float Cache[FORSYTH_CACHE_SIZE];
+	float Valence[FORSYTH_MAX_VALENCE];
+
+	ForsythScoreTables()
+	{
+		for (int i = 0; i < FORSYTH_CACHE_SIZE; i++)
+		{
+			// The most recent triangle's vertices get a fixed score, so
+			// there's no preference for which of them to reuse first
+			if (i < 3)
+				Cache[i] = FORSYTH_LAST_TRI_SCORE;
+			else
+				Cache[i] = powf(1.0f - (i - 3) / (float)(FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+		}
+
+		// Boost vertices with few triangles left, to finish them off
+		// rather than leaving lone triangles behind
+		Valence[0] = 0.0f;
+		for (int i = 1; i < FORSYTH_MAX_VALENCE; i++)
+			Valence[i] = FORSYTH_VALENCE_BOOST_SCALE * powf((float)i, -FORSYTH_VALENCE_BOOST_POWER);
+	}
+};
+
+static float ForsythVertexScore(const ForsythScoreTables& tables, int cachePosition, unsigned int remaining)
+{
+	if (remaining == 0)
+		return -1.0f;
+
+	float score = cachePosition >= 0 ? tables.Cache[cachePosition] : 0.0f;
+	return score + tables.Valence[remaining < FORSYTH_MAX_VALENCE ? remaining : FORSYTH_MAX_VALENCE - 1];
+}
+
+void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	static const ForsythScoreTables tables;
+
+	size_t triCount = indices.size() / 3;
+	if (triCount == 0 || vertexCount == 0)
+		return;
+
+	// Triangles around each vertex, as one flat array with per-vertex
+	// ranges.  remaining[v] counts the ones not yet emitted, which are
+	// kept at the front of each vertex's range
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triCount * 3; i++)
+		remaining[indices[i]]++;
+
+	std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+
+	std::vector<unsigned int> adjacency(triCount * 3);
+	std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t i = 0; i < triCount * 3; i++)
+		adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+	// Initial scores, with nothing in the cache
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = ForsythVertexScore(tables, -1, remaining[v]);
+
+	std::vector<float> triScore(triCount);
+	std::vector<bool> triEmitted(triCount, false);
+	int bestTri = 0;
+	for (size_t t = 0; t < triCount; t++)
+	{
+		triScore[t] =
+			vertexScore[indices[t * 3]] +
+			vertexScore[indices[t * 3 + 1]] +
+			vertexScore[indices[t * 3 + 2]];
+		if (triScore[t] > triScore[bestTri])
+			bestTri = (int)t;
+	}
+
+	// The cache holds up to 3 extra entries while a triangle is added
+	unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+	unsigned int cacheCount = 0;
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	size_t scanCursor = 0;
+
+	for (size_t emitted = 0; emitted < triCount; emitted++)
+	{
+		// Nothing in the cache has triangles left, so start anew with
+		// the next triangle that hasn't been emitted yet
+		if (bestTri < 0)
+		{
+			while (triEmitted[scanCursor]) scanCursor++;
+			bestTri = (int)scanCursor;
+		}
+
+		// Emit the triangle and remove it from its vertices' lists
+		const unsigned int* tri = &indices[bestTri * 3];
+		triEmitted[bestTri] = true;
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int v = tri[c];
+			output.push_back(v);
+
+			unsigned int* list = &adjacency[adjacencyStart[v]];
+			for (unsigned int a = 0; a < remaining[v]; a++)
+			{
+				if (list[a] == (unsigned int)bestTri)
+				{
+					list[a] = list[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// Move the triangle's vertices to the front of the cache
+		unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+		unsigned int newCount = 0;
+		for (int c = 0; c < 3; c++)
+			newCache[newCount++] = tri[c];
+		for (unsigned int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+
+		// Rescore everything that was or is now in the cache; the
+		// entries past the end are the ones being evicted
+		for (unsigned int i = 0; i < newCount; i++)
+		{
+			unsigned int v = newCache[i];
+			cachePosition[v] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+
+			float newScore = ForsythVertexScore(tables, cachePosition[v], remaining[v]);
+			float delta = newScore - vertexScore[v];
+			vertexScore[v] = newScore;
+
+			const unsigned int* list = &adjacency[adjacencyStart[v]];
+			for (unsigned int a = 0; a < remaining[v]; a++)
+				triScore[list[a]] += delta;
+		}
+
+		// The next triangle has to use a cached vertex, so only the
+		// triangles around those vertices need to be considered
+		bestTri = -1;
+		float bestScore = -1.0f;
+		cacheCount = newCount < FORSYTH_CACHE_SIZE ? newCount : FORSYTH_CACHE_SIZE;
+		for (unsigned int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = newCache[i];
+			cache[i] = v;
+
+			const unsigned int* list = &adjacency[adjacencyStart[v]];
+			for (unsigned int a = 0; a < remaining[v]; a++)
+			{
+				if (triScore[list[a]] > bestScore)
+				{
+					bestScore = triScore[list[a]];
+					bestTri = (int)list[a];
+				}
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	const unsigned int unassigned = 0xFFFFFFFF;
+	std::vector<unsigned int> remap(verts.size(), unassigned);
+	std::vector<Vertex> newVerts;
+	newVerts.reserve(verts.size());
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int& newIndex = remap[indices[i]];
+		if (newIndex == unassigned)
+		{
+			newIndex = (unsigned int)newVerts.size();
+			newVerts.push_back(verts[indices[i]]);
+		}
+		indices[i] = newIndex;
+	}
+
+	// Vertices no triangle uses are dropped
+	verts.swap(newVerts);
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats = {};
+	if (indices.size() < 3 || vertexCount == 0)
+		return stats;
+
+	// When each vertex last entered the FIFO, as a count of misses
+	std::vector<unsigned int> insertedAt(vertexCount, 0);
+	unsigned int misses = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if (insertedAt[v] == 0 || misses - insertedAt[v] + 1 > cacheSize)
+		{
+			misses++;
+			insertedAt[v] = misses;
+		}
+	}
+
+	stats.ACMR = misses / (float)(indices.size() / 3);
+	stats.ATVR = misses / (float)vertexCount;
+	return stats;
+}
+
+// Plane equations summed into a symmetric 4x4 matrix (just the upper
+// triangle), so the summed squared distance from a point to every one
+// of the planes is p^T Q p
+struct Quadric
+{
+	double A[10];
+};
+
+static void AddPlane(Quadric& q, double a, double b, double c, double d)
+{
+	q.A[0] += a * a; q.A[1] += a * b; q.A[2] += a * c; q.A[3] += a * d;
+	q.A[4] += b * b; q.A[5] += b * c; q.A[6] += b * d;
+	q.A[7] += c * c; q.A[8] += c * d;
+	q.A[9] += d * d;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other)
+{
+	for (int i = 0; i < 10; i++)
+		q.A[i] += other.A[i];
+}
+
+static double QuadricError(const Quadric& q, const DirectX::XMFLOAT3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double error =
+		q.A[0] * x * x + q.A[4] * y * y + q.A[7] * z * z + q.A[9] +
+		2.0 * (q.A[1] * x * y + q.A[2] * x * z + q.A[3] * x + q.A[5] * y * z + q.A[6] * y + q.A[8] * z);
+	return error > 0.0 ? error : 0.0;
+}
+
+// Unnormalized normal of a triangle
+static DirectX::XMFLOAT3 TriangleNormal(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, const DirectX::XMFLOAT3& c)
+{
+	float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+	float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+	return DirectX::XMFLOAT3(uy * vz - uz * vy, uz * vx - ux * vz, ux * vy - uy * vx);
+}
+
+struct EdgeCollapse
+{
+	double Cost;
+	unsigned int From;
+	unsigned int To;
+};
+
+float SimplifyMesh(const Vertex* verts, size_t vertexCount, const std::vector<unsigned int>& indices, size_t targetIndexCount, float maxError, std::vector<unsigned int>& result)
+{
+	result = indices;
+	if (vertexCount == 0 || result.size() < 3)
+		return 0.0f;
+
+	// An edge is open if no triangle uses it in the other direction
+	std::unordered_set<unsigned long long> edges;
+	edges.reserve(result.size());
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+			edges.insert(((unsigned long long)result[i + e] << 32) | result[i + (e + 1) % 3]);
+	}
+
+	std::vector<bool> locked(vertexCount, false);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			unsigned int a = result[i + e];
+			unsigned int b = result[i + (e + 1) % 3];
+			if (edges.count(((unsigned long long)b << 32) | a) == 0)
+				locked[a] = locked[b] = true;
+		}
+	}
+
+	// Each vertex starts out with the planes of its triangles
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		const DirectX::XMFLOAT3& p0 = verts[result[i]].Position;
+		DirectX::XMFLOAT3 n = TriangleNormal(p0, verts[result[i + 1]].Position, verts[result[i + 2]].Position);
+		double length = sqrt((double)n.x * n.x + (double)n.y * n.y + (double)n.z * n.z);
+		if (length == 0.0)
+			continue;
+
+		double a = n.x / length, b = n.y / length, c = n.z / length;
+		double d = -(a * p0.x + b * p0.y + c * p0.z);
+		for (int k = 0; k < 3; k++)
+			AddPlane(quadrics[result[i + k]], a, b, c, d);
+	}
+
+	double maxCost = (double)maxError * maxError;
+	double reachedCost = 0.0;
+	std::vector<unsigned int> adjacencyStart;
+	std::vector<unsigned int> adjacency;
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<EdgeCollapse> collapses;
+
+	// Each pass collapses as many edges as it can without two collapses
+	// sharing a triangle, then rebuilds everything for the next
+	while (result.size() > targetIndexCount)
+	{
+		// Triangles around each vertex, as one flat array with per-vertex ranges
+		adjacencyStart.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < result.size(); i++)
+			adjacencyStart[result[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			adjacencyStart[v + 1] += adjacencyStart[v];
+
+		adjacency.resize(result.size());
+		std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+			adjacency[fill[result[i]]++] = (unsigned int)(i / 3);
+
+		// Both directions of every edge, from whichever ends can move.  The
+		// cost is the merged quadric's error at the vertex that stays
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				unsigned int a = result[i + e];
+				unsigned int b = result[i + (e + 1) % 3];
+				if (!locked[a])
+					collapses.push_back({ QuadricError(quadrics[a], verts[b].Position) + QuadricError(quadrics[b], verts[b].Position), a, b });
+				if (!locked[b])
+					collapses.push_back({ QuadricError(quadrics[a], verts[a].Position) + QuadricError(quadrics[b], verts[a].Position), b, a });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(),
+			[](const EdgeCollapse& x, const EdgeCollapse& y) { return x.Cost < y.Cost; });
+
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			remap[v] = (unsigned int)v;
+			touched[v] = false;
+		}
+
+		size_t neededTriangles = (result.size() - targetIndexCount + 2) / 3;
+		size_t removedTriangles = 0;
+		for (auto& c : collapses)
+		{
+			if (c.Cost > maxCost || removedTriangles >= neededTriangles)
+				break;
+			if (touched[c.From] || touched[c.To])
+				continue;
+
+			// Skip collapses that would fold a remaining triangle over
+			bool flips = false;
+			size_t removes = 0;
+			for (unsigned int a = adjacencyStart[c.From]; a < adjacencyStart[c.From + 1] && !flips; a++)
+			{
+				const unsigned int* tri = &result[adjacency[a] * 3];
+				if (tri[0] == c.To || tri[1] == c.To || tri[2] == c.To)
+				{
+					removes++;
+					continue;
+				}
+
+				DirectX::XMFLOAT3 before = TriangleNormal(verts[tri[0]].Position, verts[tri[1]].Position, verts[tri[2]].Position);
+				DirectX::XMFLOAT3 after = TriangleNormal(
+					verts[tri[0] == c.From ? c.To : tri[0]].Position,
+					verts[tri[1] == c.From ? c.To : tri[1]].Position,
+					verts[tri[2] == c.From ? c.To : tri[2]].Position);
+				flips = before.x * after.x + before.y * after.y + before.z * after.z <= 0.0f;
+			}
+			if (flips)
+				continue;
+
+			// Keep this collapse's triangles out of the rest of the pass,
+			// so the later ones all see up to date triangles
+			for (unsigned int a = adjacencyStart[c.From]; a < adjacencyStart[c.From + 1]; a++)
+			{
+				const unsigned int* tri = &result[adjacency[a] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+
+			remap[c.From] = c.To;
+			AddQuadric(quadrics[c.To], quadrics[c.From]);
+			removedTriangles += removes;
+			if (c.Cost > reachedCost)
+				reachedCost = c.Cost;
+		}
+
+		if (removedTriangles == 0)
+			break;
+
+		// Apply the collapses, dropping the triangles that lost an edge
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			unsigned int a = remap[result[i]];
+			unsigned int b = remap[result[i + 1]];
+			unsigned int c = remap[result[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	return (float)sqrt(reachedCost);
+}
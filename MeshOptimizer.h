@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Offline optimizations for indexed triangle lists.  The
+// first two keep the same triangles and only change their
+// order; simplification removes triangles for LODs.
+// --------------------------------------------------------
+
+// Reorders triangles so consecutive triangles reuse recently
+// transformed vertices (Tom Forsyth's linear-speed algorithm)
+void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+// Reorders vertices into the order they're first used by the
+// indices, so vertex fetches walk through memory in order
+void OptimizeVertexFetch(std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
+// Simulates a FIFO post-transform cache to measure the average
+// (vertex) cache miss ratio - transforms per triangle - and the
+// average transform to vertex ratio
+struct VertexCacheStats
+{
+	float ACMR;
+	float ATVR;
+};
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Collapses edges, cheapest first by quadric error (Garland and
+// Heckbert), until there are at most targetIndexCount indices left or
+// every remaining collapse costs more than maxError.  Vertices only
+// collapse onto other existing vertices, so the result indexes the
+// same vertex buffer.  Vertices on open edges, including the seams
+// where vertices are split for UVs or hard normals, never move.
+// Returns the largest error reached, as a distance
+float SimplifyMesh(const Vertex* verts, size_t vertexCount, const std::vector<unsigned int>& indices, size_t targetIndexCount, float maxError, std::vector<unsigned int>& result);
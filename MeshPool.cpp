@@ -0,0 +1,104 @@
+#include "MeshPool.h"
+
+#include <stdio.h>
+
+MeshPool::MeshPool(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: device(device), context(context)
+{
+}
+
+bool MeshPool::Add(std::shared_ptr<Mesh> mesh, Range* range)
+{
+	auto it = ranges.find(mesh.get());
+	if (it != ranges.end())
+	{
+		*range = it->second.Offsets;
+		return true;
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> vb = mesh->GetVertexBuffer();
+	Microsoft::WRL::ComPtr<ID3D11Buffer> ib = mesh->GetIndexBuffer();
+	if (!vb || !ib)
+		return false;
+
+	D3D11_BUFFER_DESC vbDesc = {};
+	D3D11_BUFFER_DESC ibDesc = {};
+	vb->GetDesc(&vbDesc);
+	ib->GetDesc(&ibDesc);
+
+	unsigned int index = GetPoolIndex(mesh->GetVertexFormat(), mesh->GetIndexFormat());
+	Pool& p = pools[index];
+	p.VertexStride = mesh->GetVertexStride();
+	p.IndexFormat = mesh->GetIndexFormat();
+	unsigned int indexSize = p.IndexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+
+	if (!Reserve(p.VertexBuffer, D3D11_BIND_VERTEX_BUFFER, p.VertexCapacity, p.VertexBytes, p.VertexBytes + vbDesc.ByteWidth) ||
+		!Reserve(p.IndexBuffer, D3D11_BIND_INDEX_BUFFER, p.IndexCapacity, p.IndexBytes, p.IndexBytes + ibDesc.ByteWidth))
+	{
+		printf("Couldn't grow the mesh pool\n");
+		return false;
+	}
+
+	// Vertices start on a whole vertex, so the base vertex can find them
+	Range r = {};
+	r.Pool = index;
+	r.BaseVertex = (int)(p.VertexBytes / p.VertexStride);
+	r.StartIndex = p.IndexBytes / indexSize;
+
+	D3D11_BOX vbBox = { 0, 0, 0, vbDesc.ByteWidth, 1, 1 };
+	D3D11_BOX ibBox = { 0, 0, 0, ibDesc.ByteWidth, 1, 1 };
+	context->CopySubresourceRegion(p.VertexBuffer.Get(), 0, p.VertexBytes, 0, 0, vb.Get(), 0, &vbBox);
+	context->CopySubresourceRegion(p.IndexBuffer.Get(), 0, p.IndexBytes, 0, 0, ib.Get(), 0, &ibBox);
+	p.VertexBytes += vbDesc.ByteWidth;
+	p.IndexBytes += ibDesc.ByteWidth;
+
+	ranges.insert({ mesh.get(), { mesh, r } });
+	*range = r;
+	return true;
+}
+
+void MeshPool::SetBuffers(unsigned int pool)
+{
+	Pool& p = pools[pool];
+	UINT stride = p.VertexStride;
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, p.VertexBuffer.GetAddressOf(), &stride, &offset);
+	context->IASetIndexBuffer(p.IndexBuffer.Get(), p.IndexFormat, 0);
+}
+
+unsigned int MeshPool::GetUsedBytes()
+{
+	unsigned int total = 0;
+	for (auto& p : pools)
+		total += p.VertexBytes + p.IndexBytes;
+	return total;
+}
+
+// Makes sure the buffer holds at least needed bytes, keeping the used
+// ones.  Capacity doubles, so adding many meshes copies each only a few times
+bool MeshPool::Reserve(Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, unsigned int bindFlags, unsigned int& capacity, unsigned int used, unsigned int needed)
+{
+	if (needed <= capacity)
+		return true;
+
+	unsigned int newCapacity = max(needed, max(capacity * 2, 64u * 1024u));
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = newCapacity;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = bindFlags;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> grown;
+	if (FAILED(device->CreateBuffer(&desc, 0, grown.GetAddressOf())))
+		return false;
+
+	if (buffer && used > 0)
+	{
+		D3D11_BOX box = { 0, 0, 0, used, 1, 1 };
+		context->CopySubresourceRegion(grown.Get(), 0, 0, 0, 0, buffer.Get(), 0, &box);
+	}
+
+	buffer = grown;
+	capacity = newCapacity;
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <unordered_map>
+
+#include "Mesh.h"
+
+// --------------------------------------------------------
+// Vertex and index buffers shared by many meshes, so draws
+// of different meshes need no rebinding in between.
+//
+// There's one pair of buffers for each vertex format and
+// index size, since a draw can only read one of each.  Meshes
+// are copied in on the GPU from their own buffers, which they
+// keep for everything else, and are found again by the
+// offsets Add() returns (a base vertex and a start index,
+// which their LODs' own start indices are relative to).
+// Buffers grow by doubling, copying what's already in them.
+// --------------------------------------------------------
+class MeshPool
+{
+public:
+	struct Range
+	{
+		unsigned int Pool;
+		int BaseVertex;
+		unsigned int StartIndex;
+	};
+
+	MeshPool(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Copies the mesh in, the first time it's seen.  Returns false if
+	// the pool couldn't grow to fit it
+	bool Add(std::shared_ptr<Mesh> mesh, Range* range);
+
+	// Binds a pool's vertex buffer (slot 0) and index buffer, leaving
+	// the other slots alone like Mesh::SetBuffers()
+	void SetBuffers(unsigned int pool);
+
+	static unsigned int GetPoolIndex(MeshVertexFormat format, DXGI_FORMAT indexFormat) { return (unsigned int)format * 2 + (indexFormat == DXGI_FORMAT_R32_UINT ? 1 : 0); }
+	static const unsigned int PoolCount = 4;
+
+	unsigned int GetMeshCount() { return (unsigned int)ranges.size(); }
+	unsigned int GetUsedBytes();
+
+private:
+	struct Pool
+	{
+		Microsoft::WRL::ComPtr<ID3D11Buffer> VertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> IndexBuffer;
+		unsigned int VertexStride = 0;
+		unsigned int VertexBytes = 0;
+		unsigned int VertexCapacity = 0;
+		unsigned int IndexBytes = 0;
+		unsigned int IndexCapacity = 0;
+		DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+	};
+
+	struct Entry
+	{
+		std::shared_ptr<Mesh> Owner;	// Kept alive, so its address isn't reused
+		Range Offsets;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Pool pools[PoolCount];
+	std::unordered_map<Mesh*, Entry> ranges;
+
+	bool Reserve(Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, unsigned int bindFlags, unsigned int& capacity, unsigned int used, unsigned int needed);
+};
@@ -0,0 +1,332 @@
+#include "ObjLoader.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unordered_map>
+
+using namespace DirectX;
+
+// A face corner as it appears in the file: 0-based indices into the
+// position, uv and normal lists, or -1 when the corner doesn't have one
+struct ObjCorner
+{
+	int Position;
+	int UV;
+	int Normal;
+
+	bool operator==(const ObjCorner& other) const
+	{
+		return Position == other.Position && UV == other.UV && Normal == other.Normal;
+	}
+};
+
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner& c) const
+	{
+		uint64_t h = (uint32_t)c.Position * 0x9E3779B97F4A7C15ull;
+		h ^= ((uint32_t)c.UV + 0x7F4A7C15ull + (h << 6) + (h >> 2)) * 0xBF58476D1CE4E5B9ull;
+		h ^= ((uint32_t)c.Normal + 0x94D049BBull + (h << 6) + (h >> 2)) * 0x94D049BB133111EBull;
+		return (size_t)(h ^ (h >> 31));
+	}
+};
+
+// --------------------------------------------------------
+// Tokenizer helpers.  Each one advances the cursor past
+// what it reads, and never goes past the end of the line.
+// --------------------------------------------------------
+static bool IsLineEnd(char c) { return c == '\n' || c == '\r' || c == 0; }
+static bool IsSpace(char c) { return c == ' ' || c == '\t'; }
+static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+static void SkipSpaces(const char*& p)
+{
+	while (IsSpace(*p)) p++;
+}
+
+static void SkipLine(const char*& p)
+{
+	while (*p && *p != '\n') p++;
+	if (*p) p++;
+}
+
+// Parses a float in plain or exponent notation ("-1.25", "3e-05")
+static float ParseFloat(const char*& p)
+{
+	SkipSpaces(p);
+
+	bool negative = false;
+	if (*p == '-') { negative = true; p++; }
+	else if (*p == '+') p++;
+
+	double value = 0.0;
+	while (IsDigit(*p))
+		value = value * 10.0 + (*p++ - '0');
+
+	if (*p == '.')
+	{
+		p++;
+		double scale = 0.1;
+		while (IsDigit(*p))
+		{
+			value += (*p++ - '0') * scale;
+			scale *= 0.1;
+		}
+	}
+
+	if (*p == 'e' || *p == 'E')
+	{
+		p++;
+		bool negativeExp = false;
+		if (*p == '-') { negativeExp = true; p++; }
+		else if (*p == '+') p++;
+
+		int exponent = 0;
+		while (IsDigit(*p))
+			exponent = exponent * 10 + (*p++ - '0');
+
+		double power = 1.0;
+		double base = 10.0;
+		for (; exponent > 0; exponent >>= 1, base *= base)
+			if (exponent & 1) power *= base;
+		value = negativeExp ? value / power : value * power;
+	}
+
+	return (float)(negative ? -value : value);
+}
+
+// Parses a (possibly negative) integer, returning false if there are no digits
+static bool ParseInt(const char*& p, int* out)
+{
+	bool negative = false;
+	if (*p == '-') { negative = true; p++; }
+
+	if (!IsDigit(*p))
+		return false;
+
+	int value = 0;
+	while (IsDigit(*p))
+		value = value * 10 + (*p++ - '0');
+
+	*out = negative ? -value : value;
+	return true;
+}
+
+// Converts a 1-based (or negative, relative) OBJ index to 0-based
+static int ResolveIndex(int index, size_t count)
+{
+	int resolved = index > 0 ? index - 1 : (int)count + index;
+	return (resolved >= 0 && resolved < (int)count) ? resolved : -1;
+}
+
+// Parses one "p", "p/t", "p//n" or "p/t/n" face corner
+static bool ParseCorner(const char*& p, size_t positionCount, size_t uvCount, size_t normalCount, ObjCorner* corner)
+{
+	int index = 0;
+	if (!ParseInt(p, &index))
+		return false;
+
+	corner->Position = ResolveIndex(index, positionCount);
+	corner->UV = -1;
+	corner->Normal = -1;
+
+	if (*p == '/')
+	{
+		p++;
+		if (ParseInt(p, &index))
+			corner->UV = ResolveIndex(index, uvCount);
+
+		if (*p == '/')
+		{
+			p++;
+			if (ParseInt(p, &index))
+				corner->Normal = ResolveIndex(index, normalCount);
+		}
+	}
+
+	// Skip anything unexpected up to the next corner
+	while (!IsSpace(*p) && !IsLineEnd(*p)) p++;
+	return corner->Position >= 0;
+}
+
+bool LoadOBJ(const char* objFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	verts.clear();
+	indices.clear();
+
+	// Read the whole file into memory, with a terminator
+	// so the parser never has to check the length
+	FILE* file = 0;
+	if (fopen_s(&file, objFile, "rb") != 0 || !file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size <= 0)
+	{
+		fclose(file);
+		return false;
+	}
+
+	std::vector<char> text(size + 1);
+	size_t read = fread(&text[0], 1, size, file);
+	fclose(file);
+	text[read] = 0;
+
+	// A rough guess at the counts keeps the vectors from regrowing
+	// too often on big files (most lines are ~30 characters)
+	size_t lineGuess = read / 30;
+
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT2> uvs;
+	std::vector<XMFLOAT3> normals;
+	positions.reserve(lineGuess / 3);
+	uvs.reserve(lineGuess / 3);
+	normals.reserve(lineGuess / 3);
+	verts.reserve(lineGuess / 3);
+	indices.reserve(lineGuess * 2);
+
+	std::unordered_map<ObjCorner, unsigned int, ObjCornerHash> cornerToVertex;
+	cornerToVertex.reserve(lineGuess / 3);
+	bool anyMissingNormals = false;
+
+	std::vector<unsigned int> face;
+	const char* p = &text[0];
+	while (*p)
+	{
+		SkipSpaces(p);
+
+		if (p[0] == 'v' && IsSpace(p[1]))
+		{
+			p += 2;
+			XMFLOAT3 pos;
+			pos.x = ParseFloat(p);
+			pos.y = ParseFloat(p);
+			pos.z = ParseFloat(p);
+			positions.push_back(pos);
+		}
+		else if (p[0] == 'v' && p[1] == 't' && IsSpace(p[2]))
+		{
+			p += 3;
+			XMFLOAT2 uv;
+			uv.x = ParseFloat(p);
+			uv.y = ParseFloat(p);
+			uvs.push_back(uv);
+		}
+		else if (p[0] == 'v' && p[1] == 'n' && IsSpace(p[2]))
+		{
+			p += 3;
+			XMFLOAT3 norm;
+			norm.x = ParseFloat(p);
+			norm.y = ParseFloat(p);
+			norm.z = ParseFloat(p);
+			normals.push_back(norm);
+		}
+		else if (p[0] == 'f' && IsSpace(p[1]))
+		{
+			p += 2;
+
+			// Gather the face's corners, creating vertices for new ones
+			face.clear();
+			for (SkipSpaces(p); !IsLineEnd(*p); SkipSpaces(p))
+			{
+				ObjCorner corner;
+				if (!ParseCorner(p, positions.size(), uvs.size(), normals.size(), &corner))
+				{
+					// Skip a malformed corner, but keep the rest of the face
+					while (!IsSpace(*p) && !IsLineEnd(*p)) p++;
+					continue;
+				}
+
+				auto it = cornerToVertex.find(corner);
+				if (it != cornerToVertex.end())
+				{
+					face.push_back(it->second);
+					continue;
+				}
+
+				// The model is most likely in a right-handed space,
+				// especially if it came from Maya.  We want to convert
+				// to a left-handed space for DirectX, so we invert the
+				// Z position and normal here and flip the winding order
+				// below.  The V coordinate is flipped too, since DirectX
+				// defines (0,0) as the top left of the texture.
+				Vertex v = {};
+				v.Position = positions[corner.Position];
+				v.Position.z *= -1.0f;
+
+				if (corner.UV >= 0)
+				{
+					v.UV = uvs[corner.UV];
+					v.UV.y = 1.0f - v.UV.y;
+				}
+
+				if (corner.Normal >= 0)
+				{
+					v.Normal = normals[corner.Normal];
+					v.Normal.z *= -1.0f;
+				}
+				else
+				{
+					anyMissingNormals = true;
+				}
+
+				unsigned int index = (unsigned int)verts.size();
+				verts.push_back(v);
+				cornerToVertex.insert({ corner, index });
+				face.push_back(index);
+			}
+
+			// Fan the face into triangles (flipping the winding order)
+			for (size_t i = 2; i < face.size(); i++)
+			{
+				indices.push_back(face[0]);
+				indices.push_back(face[i]);
+				indices.push_back(face[i - 1]);
+			}
+		}
+
+		// On to the next line, skipping comments and anything we don't use
+		SkipLine(p);
+	}
+
+	if (indices.empty())
+		return false;
+
+	// Build smooth normals for any vertices the file didn't give
+	// normals to, by summing the (area weighted) normals of the
+	// faces around them
+	if (anyMissingNormals)
+	{
+		std::vector<bool> needsNormal(verts.size());
+		for (auto& c : cornerToVertex)
+			needsNormal[c.second] = c.first.Normal < 0;
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&verts[indices[i]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&verts[indices[i + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&verts[indices[i + 2]].Position);
+			XMFLOAT3 faceNormal;
+			XMStoreFloat3(&faceNormal, XMVector3Cross(p1 - p0, p2 - p0));
+
+			for (size_t c = 0; c < 3; c++)
+			{
+				Vertex& v = verts[indices[i + c]];
+				if (!needsNormal[indices[i + c]]) continue;
+				v.Normal.x += faceNormal.x;
+				v.Normal.y += faceNormal.y;
+				v.Normal.z += faceNormal.z;
+			}
+		}
+
+		for (size_t i = 0; i < verts.size(); i++)
+		{
+			if (needsNormal[i])
+				XMStoreFloat3(&verts[i].Normal, XMVector3Normalize(XMLoadFloat3(&verts[i].Normal)));
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Loads the geometry from a Wavefront OBJ file into
+// indexed, left-handed vertex data ready for a Mesh.
+//
+// The whole file is read at once and parsed in place.
+// Vertices that share a position/uv/normal triple are
+// emitted once and shared through the index list.  Faces
+// may omit uvs and/or normals (missing normals are
+// generated from the faces) and may have any number of
+// sides, which are fanned into triangles.
+//
+// Tangents are left for the Mesh to calculate.
+//
+// Returns false if the file can't be read or has no faces
+// --------------------------------------------------------
+bool LoadOBJ(const char* objFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
@@ -0,0 +1,26 @@
+// Include guard
+#ifndef _PACKED_VERTEX_HLSL
+#define _PACKED_VERTEX_HLSL
+
+// Helpers for decoding PackedVertex data (see Vertex.h)
+
+// Decodes an octahedral-encoded unit vector, which has already
+// been expanded from snorm to [-1, 1] by the input assembler
+float3 OctDecode(float2 e)
+{
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+
+	// Unfold the lower hemisphere
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+
+	return normalize(n);
+}
+
+// Rescales a bounds-relative position back to local space
+float3 DecodePosition(float3 packedPosition, float3 positionScale, float3 positionOffset)
+{
+	return positionOffset + packedPosition * positionScale;
+}
+
+#endif
@@ -1,8 +1,28 @@
 
 #include "Lighting.hlsli"
-
-// How many lights could we handle?
-#define MAX_LIGHTS 128
+#include "ClusteredLighting.hlsli"
+#include "Shadows.hlsli"
+
+// Features a permutation can leave out (see ShaderPermutations.h).
+// Without any macros, as precompiled, everything is on
+#ifndef FEATURE_NORMAL_MAP
+#define FEATURE_NORMAL_MAP 1
+#endif
+#ifndef FEATURE_ROUGHNESS_MAP
+#define FEATURE_ROUGHNESS_MAP 1
+#endif
+#ifndef FEATURE_METAL_MAP
+#define FEATURE_METAL_MAP 1
+#endif
+#ifndef FEATURE_IBL
+#define FEATURE_IBL 1
+#endif
+#ifndef FEATURE_SHADOWS
+#define FEATURE_SHADOWS 1
+#endif
+#ifndef MAX_LIGHTS_PER_PIXEL
+#define MAX_LIGHTS_PER_PIXEL MAX_LIGHTS_PER_CLUSTER
+#endif
 
 // Data that can change per material
 cbuffer perMaterial : register(b0)
@@ -13,24 +33,56 @@ cbuffer perMaterial : register(b0)
 	// UV adjustments
 	float2 uvScale;
 	float2 uvOffset;
+
+	// Used in place of the maps, by permutations without them
+	float materialRoughness;
+	float materialMetal;
+
+	// Which maps the material has bound (MATERIAL_*_MAP bits), for when
+	// this is the full shader standing in for a permutation without them
+	int materialMaps;
 };
 
+// Must match SHADER_FEATURE_ROUGHNESS_MAP and SHADER_FEATURE_METAL_MAP
+#define MATERIAL_ROUGHNESS_MAP	(1 << 1)
+#define MATERIAL_METAL_MAP		(1 << 2)
+
 // Data that only changes once per frame
+// - Shared by all lit pixel shaders, so must match
+//   PerFrameData in BufferStructs.h exactly
 cbuffer perFrame : register(b1)
 {
-	// An array of light data
-	Light lights[MAX_LIGHTS];
-
-	// The amount of lights THIS FRAME
-	int lightCount;
-
 	// Needed for specular (reflection) calculation
 	float3 cameraPosition;
 
 	// Total number of mip levels in specular IBL cube map
 	int SpecIBLTotalMipLevels;
+
+	// Mapping from pixels to light clusters
+	float clusterDepthScale;
+	float clusterDepthBias;
+	float2 clusterTileSize;
+
+	// Cascaded shadows for one directional light
+	float4x4 shadowMatrices[MAX_SHADOW_CASCADES];
+	float4 shadowSplits;
+	float4 shadowNormalOffsets;
+	int shadowLightIndex;
+	int shadowCascadeCount;
+	float shadowTexelSize;
+	float shadowPadding;
 };
 
+// All lights this frame, along with the per-cluster
+// lists built by LightCullingCS
+StructuredBuffer<Light> Lights					: register(t7);
+StructuredBuffer<uint2> ClusterLightGrid		: register(t8);
+StructuredBuffer<uint> ClusterLightIndices		: register(t9);
+
+// The shadow casting light's cascades
+Texture2DArray ShadowMap						: register(t10);
+SamplerComparisonState ShadowSampler			: register(s2);
+
 
 // Defines the input to this pixel shader
 // - Should match the output of our corresponding vertex shader
@@ -66,17 +118,31 @@ float4 main(VertexToPixel input) : SV_TARGET
 	input.normal = normalize(input.normal);
 	input.tangent = normalize(input.tangent);
 
+	// Shadow lookups use the surface's own normal, not the mapped one
+	float3 geometryNormal = input.normal;
+
 	// Apply the uv adjustments
 	input.uv = input.uv * uvScale + uvOffset;
 
 	// Sample various textures
+#if FEATURE_NORMAL_MAP
 	input.normal = NormalMapping(NormalMap, BasicSampler, input.uv, input.normal, input.tangent);
-	float roughness = RoughnessMap.Sample(BasicSampler, input.uv).r;
-	float metal = MetalMap.Sample(BasicSampler, input.uv).r;
-
-	// Gamma correct the texture back to linear space and apply the color tint
+#endif
+#if FEATURE_ROUGHNESS_MAP
+	float roughness = (materialMaps & MATERIAL_ROUGHNESS_MAP) ? RoughnessMap.Sample(BasicSampler, input.uv).r : materialRoughness;
+#else
+	float roughness = materialRoughness;
+#endif
+#if FEATURE_METAL_MAP
+	float metal = (materialMaps & MATERIAL_METAL_MAP) ? MetalMap.Sample(BasicSampler, input.uv).r : materialMetal;
+#else
+	float metal = materialMetal;
+#endif
+
+	// Albedo textures are sRGB, so sampling already returns linear
+	// values - just apply the color tint
 	float4 surfaceColor = Albedo.Sample(BasicSampler, input.uv);
-	surfaceColor.rgb = pow(surfaceColor.rgb, 2.2) * colorTint;
+	surfaceColor.rgb *= colorTint;
 
 	// Specular color - Assuming albedo texture is actually holding specular color if metal == 1
 	// Note the use of lerp here - metal is generally 0 or 1, but might be in between
@@ -86,26 +152,51 @@ float4 main(VertexToPixel input) : SV_TARGET
 	// Total color for this pixel
 	float3 totalColor = float3(0,0,0);
 
-	// Loop through all lights this frame
-	for(int i = 0; i < lightCount; i++)
+	// Find the lights affecting this pixel's cluster
+	uint cluster = GetClusterIndex(input.screenPosition.xy, input.screenPosition.w, clusterTileSize, clusterDepthScale, clusterDepthBias);
+	uint2 clusterLights = ClusterLightGrid[cluster];
+
+	// Loop through only those lights.  Small light counts get a
+	// permutation with a low enough cap to unroll the loop
+	uint lightCount = min(clusterLights.y, MAX_LIGHTS_PER_PIXEL);
+#if MAX_LIGHTS_PER_PIXEL <= 8
+	[unroll(MAX_LIGHTS_PER_PIXEL)]
+#endif
+	for(uint i = 0; i < lightCount; i++)
 	{
+		uint lightIndex = ClusterLightIndices[clusterLights.x + i];
+		Light light = Lights[lightIndex];
+
 		// Which kind of light?
-		switch (lights[i].Type)
+		switch (light.Type)
 		{
 		case LIGHT_TYPE_DIRECTIONAL:
-			totalColor += DirLightPBR(lights[i], input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+		{
+			float shadow = 1.0f;
+#if FEATURE_SHADOWS
+			if ((int)lightIndex == shadowLightIndex)
+			{
+				shadow = CascadedShadow(
+					ShadowMap, ShadowSampler,
+					shadowMatrices, shadowSplits, shadowNormalOffsets, shadowCascadeCount, shadowTexelSize,
+					input.worldPos, geometryNormal, input.screenPosition.w);
+			}
+#endif
+			totalColor += shadow * DirLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
 			break;
+		}
 
 		case LIGHT_TYPE_POINT:
-			totalColor += PointLightPBR(lights[i], input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+			totalColor += PointLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
 			break;
 
 		case LIGHT_TYPE_SPOT:
-			totalColor += SpotLightPBR(lights[i], input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
+			totalColor += SpotLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor.rgb, specColor);
 			break;
 		}
 	}
 
+#if FEATURE_IBL
 	// Calculate requisite reflection vectors
 	float3 viewToCam = normalize(cameraPosition - input.worldPos);
 	float3 viewRefl = normalize(reflect(-viewToCam, input.normal));
@@ -125,6 +216,7 @@ float4 main(VertexToPixel input) : SV_TARGET
 
 	// Add the indirect to the direct
 	totalColor += fullIndirect;
+#endif
 
 	// Gamma correction
 	return float4(pow(totalColor, 1.0f / 2.2f), 1);
@@ -0,0 +1,600 @@
+#include "RenderQueue.h"
+#include "Vertex.h"
+
+using namespace DirectX;
+
+// Bits for each part of the sort key
+#define SORT_SHADER_BITS	12
+#define SORT_MATERIAL_BITS	14
+#define SORT_MESH_BITS		12
+#define SORT_LOD_BITS		2
+#define SORT_DEPTH_BITS		24
+
+#define SORT_LOD_SHIFT		SORT_DEPTH_BITS
+#define SORT_MESH_SHIFT		(SORT_LOD_SHIFT + SORT_LOD_BITS)
+#define SORT_MATERIAL_SHIFT	(SORT_MESH_SHIFT + SORT_MESH_BITS)
+#define SORT_SHADER_SHIFT	(SORT_MATERIAL_SHIFT + SORT_MATERIAL_BITS)
+
+RenderQueue::RenderQueue(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: device(device), context(context)
+{
+	farClip = 1.0f;
+	cameraPosition = XMFLOAT3(0, 0, 0);
+	lodPixelScale = 0.0f;
+	lodScreenHeight = 0.0f;
+	lodMaxErrorPixels = 0.0f;
+	lodHysteresis = 0.25f;
+	memset(lodItemCounts, 0, sizeof(lodItemCounts));
+	minItemsPerChunk = 256;
+	instanceBufferCapacity = 0;
+	instanceBufferFilled = false;
+	drawCallCount = 0;
+	stateChangeCount = 0;
+	stateChangesAvoided = 0;
+	depthDrawCallCount = 0;
+	XMStoreFloat4x4(&view, XMMatrixIdentity());
+	XMStoreFloat4x4(&projection, XMMatrixIdentity());
+}
+
+// Empties the queue and saves the camera for this frame
+void RenderQueue::Begin(std::shared_ptr<Camera> camera)
+{
+	Begin(camera->GetView(), camera->GetProjection(), camera->GetTransform()->GetPosition(), camera->GetFarClip());
+	this->camera = camera;
+	lodPixelScale = lodScreenHeight * 0.5f / tanf(camera->GetFieldOfView() * 0.5f);
+}
+
+// Empties the queue for a view that isn't the camera's.  There's no
+// perspective to pick LODs from, so everything uses LOD 0
+void RenderQueue::Begin(const XMFLOAT4X4& view, const XMFLOAT4X4& projection, const XMFLOAT3& position, float farClip)
+{
+	this->camera = nullptr;
+	this->view = view;
+	this->projection = projection;
+	this->farClip = farClip;
+	cameraPosition = position;
+	lodPixelScale = 0.0f;
+	memset(lodItemCounts, 0, sizeof(lodItemCounts));
+	items.clear();
+	instanceBufferFilled = false;
+	depthDrawCallCount = 0;
+}
+
+// Adds an entity to this frame's queue
+void RenderQueue::Submit(GameEntity* entity)
+{
+	Material* mat = entity->GetMaterial().get();
+	Mesh* mesh = entity->GetMesh().get();
+
+	// View space depth of the entity's origin, quantized to the key's range
+	XMFLOAT3 pos = entity->GetTransform()->GetPosition();
+	float viewZ = XMVectorGetZ(XMVector3TransformCoord(XMLoadFloat3(&pos), XMLoadFloat4x4(&view)));
+	float depth01 = max(0.0f, min(viewZ / farClip, 1.0f));
+	unsigned long long depthBits = (unsigned long long)(depth01 * ((1 << SORT_DEPTH_BITS) - 1));
+
+	// IDs that don't fit are masked, which only affects sort quality;
+	// batching always compares the actual pointers
+	unsigned long long shaderBits = GetShaderPairID(mat->GetVertexShader().get(), mat->GetPixelShader().get()) & ((1 << SORT_SHADER_BITS) - 1);
+	unsigned long long materialBits = GetID(materialIDs, mat) & ((1 << SORT_MATERIAL_BITS) - 1);
+	unsigned long long meshBits = GetID(meshIDs, mesh) & ((1 << SORT_MESH_BITS) - 1);
+
+	// Pick the LOD from how big the bounding sphere is on screen.  Inside
+	// the sphere, the entity is as close as it gets
+	unsigned int lod = 0;
+	if (lodMaxErrorPixels > 0.0f && lodPixelScale > 0.0f && mesh->GetLodCount() > 1)
+	{
+		BoundingSphere sphere = entity->GetWorldBoundingSphere();
+		float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&sphere.Center), XMLoadFloat3(&cameraPosition))));
+		if (distance > sphere.Radius)
+		{
+			unsigned int current = min(entity->GetLod(), mesh->GetLodCount() - 1);
+			lod = mesh->SelectLod(sphere.Radius * lodPixelScale / distance, lodMaxErrorPixels, current, lodHysteresis);
+		}
+		entity->SetLod(lod);
+	}
+	lodItemCounts[lod]++;
+
+	RenderItem item = {};
+	item.Key =
+		(shaderBits << SORT_SHADER_SHIFT) |
+		(materialBits << SORT_MATERIAL_SHIFT) |
+		(meshBits << SORT_MESH_SHIFT) |
+		((unsigned long long)lod << SORT_LOD_SHIFT) |
+		depthBits;
+	item.Entity = entity;
+	item.Lod = lod;
+	items.push_back(item);
+}
+
+// Saves the LOD settings, which apply from the next Begin()
+void RenderQueue::SetLodSelection(float screenHeight, float maxErrorPixels, float hysteresis)
+{
+	lodScreenHeight = screenHeight;
+	lodMaxErrorPixels = maxErrorPixels;
+	lodHysteresis = hysteresis;
+}
+
+// LSD radix sort on the 64-bit keys, one byte per pass.  Passes where
+// every key has the same byte are skipped entirely
+void RenderQueue::Sort()
+{
+	instanceBufferFilled = false;
+
+	size_t count = items.size();
+	if (count < 2)
+		return;
+
+	sortScratch.resize(count);
+	RenderItem* src = items.data();
+	RenderItem* dst = sortScratch.data();
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		// Histogram of this byte
+		size_t offsets[256] = {};
+		for (size_t i = 0; i < count; i++)
+			offsets[(src[i].Key >> shift) & 0xFF]++;
+
+		// All the same?  Nothing to reorder
+		if (offsets[(src[0].Key >> shift) & 0xFF] == count)
+			continue;
+
+		// Turn counts into starting offsets
+		size_t total = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			size_t c = offsets[b];
+			offsets[b] = total;
+			total += c;
+		}
+
+		// Scatter and swap
+		for (size_t i = 0; i < count; i++)
+			dst[offsets[(src[i].Key >> shift) & 0xFF]++] = src[i];
+
+		RenderItem* temp = src;
+		src = dst;
+		dst = temp;
+	}
+
+	// Ensure the final order lives in the items vector
+	if (src != items.data())
+		memcpy(items.data(), src, sizeof(RenderItem) * count);
+}
+
+// Submits the queue, binding only the state that changes between items.
+// With a command recorder and enough items, the queue is split into
+// chunks that are recorded on several threads
+void RenderQueue::Draw(std::shared_ptr<SimpleVertexShader> instancedVS)
+{
+	drawCallCount = 0;
+	stateChangeCount = 0;
+	stateChangesAvoided = 0;
+
+	// Materials bind the camera's matrices themselves
+	if (items.empty() || !camera)
+		return;
+
+	// The per-instance data is the same for every instanced draw this frame
+	bool instanced = PrepareInstanceBuffer(instancedVS);
+	if (instanced) ResolvePackedHandles(instancedVS.get(), instancedHandles);
+	if (packedInstancedVS) ResolvePackedHandles(packedInstancedVS.get(), packedInstancedHandles);
+	if (packedVS) ResolvePackedHandles(packedVS.get(), packedHandles);
+
+	unsigned int count = (unsigned int)items.size();
+	unsigned int chunkCount = 1;
+	if (commandRecorder && minItemsPerChunk > 0)
+		chunkCount = max(1u, min(count / minItemsPerChunk, commandRecorder->GetContextCount()));
+	if (chunkCount == 1)
+	{
+		DrawStats stats = {};
+		DrawRange(0, count, instanced ? instancedVS : nullptr, context.Get(), stats);
+		drawCallCount = stats.DrawCalls;
+		stateChangeCount = stats.StateChanges;
+		stateChangesAvoided = stats.StateChangesAvoided;
+		RestoreDefaultStates();
+		return;
+	}
+
+	// Materials cache their bindings the first time they're bound, which
+	// can't happen on several threads at once, so get that done here
+	Material* lastMaterial = 0;
+	for (auto& item : items)
+	{
+		Material* mat = item.Entity->GetMaterial().get();
+		if (mat != lastMaterial) { mat->Bake(); lastMaterial = mat; }
+	}
+
+	std::vector<DrawStats> chunkStats(chunkCount);
+	commandRecorder->Record(chunkCount, [&](unsigned int chunk, ID3D11DeviceContext* chunkContext)
+	{
+		unsigned int begin = (unsigned int)((unsigned long long)count * chunk / chunkCount);
+		unsigned int end = (unsigned int)((unsigned long long)count * (chunk + 1) / chunkCount);
+		DrawRange(begin, end, instanced ? instancedVS : nullptr, chunkContext, chunkStats[chunk]);
+	});
+
+	for (auto& stats : chunkStats)
+	{
+		drawCallCount += stats.DrawCalls;
+		stateChangeCount += stats.StateChanges;
+		stateChangesAvoided += stats.StateChangesAvoided;
+	}
+}
+
+// Draws the depth of every item, batched the same way as Draw() batches
+// them so each one is transformed by the matching math
+void RenderQueue::DrawDepth(std::shared_ptr<SimpleVertexShader> instancedVS)
+{
+	depthDrawCallCount = 0;
+	if (items.empty())
+		return;
+
+	bool instanced = PrepareInstanceBuffer(instancedVS);
+	bool packedInstanced = instanced && packedInstancedVS;
+	if (instanced)
+	{
+		UINT stride = sizeof(InstanceData);
+		UINT offset = 0;
+		context->IASetVertexBuffers(1, 1, instanceBuffer.GetAddressOf(), &stride, &offset);
+	}
+
+	// Camera data, copied once each shader is set
+	for (int f = 0; f < 2; f++)
+	{
+		if (depthVS[f])
+		{
+			ResolvePackedHandles(depthVS[f].get(), depthHandles[f]);
+			depthVS[f]->SetMatrix4x4(depthHandles[f].View, view);
+			depthVS[f]->SetMatrix4x4(depthHandles[f].Projection, projection);
+		}
+		if (depthInstancedVS[f])
+		{
+			ResolvePackedHandles(depthInstancedVS[f].get(), depthInstancedHandles[f]);
+			depthInstancedVS[f]->SetMatrix4x4(depthInstancedHandles[f].View, view);
+			depthInstancedVS[f]->SetMatrix4x4(depthInstancedHandles[f].Projection, projection);
+		}
+	}
+
+	// Depth only, so there's no pixel shader at all
+	PipelineBinder binder(context.Get());
+	unsigned int count = (unsigned int)items.size();
+	unsigned int runStart = 0;
+	while (runStart < count)
+	{
+		// Runs break on material changes too, matching Draw()'s instances
+		GameEntity* first = items[runStart].Entity;
+		Material* mat = first->GetMaterial().get();
+		Mesh* mesh = first->GetMesh().get();
+		unsigned int lod = items[runStart].Lod;
+
+		unsigned int runEnd = runStart + 1;
+		while (runEnd < count &&
+			items[runEnd].Entity->GetMaterial().get() == mat &&
+			items[runEnd].Entity->GetMesh().get() == mesh &&
+			items[runEnd].Lod == lod)
+			runEnd++;
+
+		// Skip what Draw() would skip, and anything without a depth shader
+		bool packed = mesh->GetVertexFormat() == MESH_VERTEX_PACKED;
+		bool runInstanced = packed ? packedInstanced : instanced;
+		int format = packed ? MESH_VERTEX_PACKED : MESH_VERTEX_FULL;
+		SimpleVertexShader* vs = runInstanced ? depthInstancedVS[format].get() : depthVS[format].get();
+		if (!vs || (packed && !(runInstanced ? packedInstancedVS : packedVS)))
+		{
+			runStart = runEnd;
+			continue;
+		}
+
+		PackedShaderHandles& handles = runInstanced ? depthInstancedHandles[format] : depthHandles[format];
+		binder.Bind(MakeBundle(vs, 0));
+
+		// Full positions go through the same decode, as a no-op
+		XMFLOAT3 positionScale = packed ? mesh->GetPositionScale() : XMFLOAT3(1, 1, 1);
+		XMFLOAT3 positionOffset = packed ? mesh->GetPositionOffset() : XMFLOAT3(0, 0, 0);
+		vs->SetFloat3(handles.PositionScale, positionScale);
+		vs->SetFloat3(handles.PositionOffset, positionOffset);
+		mesh->SetPositionBuffers(context);
+
+		if (runInstanced)
+		{
+			vs->CopyAllBufferData();
+			mesh->DrawInstanced(context, runEnd - runStart, runStart, lod);
+			depthDrawCallCount++;
+		}
+		else
+		{
+			for (unsigned int i = runStart; i < runEnd; i++)
+			{
+				vs->SetMatrix4x4(handles.World, items[i].Entity->GetTransform()->GetWorldMatrix());
+				vs->CopyAllBufferData();
+				mesh->Draw(context, lod);
+				depthDrawCallCount++;
+			}
+		}
+
+		runStart = runEnd;
+	}
+
+	RestoreDefaultStates();
+}
+
+// Draws items [begin, end) of the sorted queue into a context.  Shader
+// data is only set from here, so this can run on any recording thread
+void RenderQueue::DrawRange(unsigned int begin, unsigned int end, std::shared_ptr<SimpleVertexShader> instancedVS, ID3D11DeviceContext* drawContext, DrawStats& stats)
+{
+	// Prepare the camera data, which is the same for every
+	// instanced draw this frame
+	bool instanced = instancedVS != nullptr;
+	if (instanced)
+	{
+		UINT stride = sizeof(InstanceData);
+		UINT offset = 0;
+		drawContext->IASetVertexBuffers(1, 1, instanceBuffer.GetAddressOf(), &stride, &offset);
+
+		// Copied once the shader is set, below
+		instancedVS->SetMatrix4x4(instancedHandles.View, camera->GetView());
+		instancedVS->SetMatrix4x4(instancedHandles.Projection, camera->GetProjection());
+	}
+
+	// Packed meshes draw with their own shaders, which also need
+	// the camera matrices
+	bool packedInstanced = instanced && packedInstancedVS;
+	if (packedInstancedVS)
+	{
+		packedInstancedVS->SetMatrix4x4(packedInstancedHandles.View, camera->GetView());
+		packedInstancedVS->SetMatrix4x4(packedInstancedHandles.Projection, camera->GetProjection());
+	}
+	if (packedVS)
+	{
+		packedVS->SetMatrix4x4(packedHandles.View, camera->GetView());
+		packedVS->SetMatrix4x4(packedHandles.Projection, camera->GetProjection());
+	}
+
+	// Nothing is known to be bound at the start of the range, since other
+	// drawing happens between frames (and other ranges use other contexts)
+	PipelineBinder binder(drawContext);
+	Material* lastMaterial = 0;
+	Mesh* lastMesh = 0;
+
+	unsigned int runStart = begin;
+	while (runStart < end)
+	{
+		GameEntity* first = items[runStart].Entity;
+		Material* mat = first->GetMaterial().get();
+		Mesh* mesh = first->GetMesh().get();
+		unsigned int lod = items[runStart].Lod;
+
+		// Find the run of items sharing this mesh, LOD and material
+		unsigned int runEnd = runStart + 1;
+		while (runEnd < end &&
+			items[runEnd].Entity->GetMaterial().get() == mat &&
+			items[runEnd].Entity->GetMesh().get() == mesh &&
+			items[runEnd].Lod == lod)
+			runEnd++;
+
+		// Pick the vertex shader for this run's mesh format.  Packed
+		// meshes only batch if there's a packed instanced shader
+		bool packed = mesh->GetVertexFormat() == MESH_VERTEX_PACKED;
+		bool runInstanced = packed ? packedInstanced : instanced;
+		std::shared_ptr<SimpleVertexShader> vs;
+		if (packed) vs = runInstanced ? packedInstancedVS : packedVS;
+		else vs = runInstanced ? instancedVS : mat->GetVertexShader();
+		if (!vs)
+		{
+			runStart = runEnd;
+			continue;
+		}
+
+		// Shaders and states
+		unsigned int bound = binder.Bind(MakeBundle(vs.get(), mat->GetPixelShader().get()));
+		bool vsChanged = (bound & PIPELINE_VERTEX_SHADER) != 0;
+		unsigned int changed = PipelineBinder::CountParts(bound);
+		stats.StateChanges += changed;
+		stats.StateChangesAvoided += PIPELINE_PART_COUNT - changed;
+
+		// Material data, textures and samplers
+		if (mat != lastMaterial) { mat->BindResources(); lastMaterial = mat; stats.StateChanges++; }
+		else stats.StateChangesAvoided += mat->GetResourceCount() + 1;
+
+		// Vertex and index buffers
+		if (mesh != lastMesh) { mesh->SetBuffers(drawContext); lastMesh = mesh; stats.StateChanges++; }
+		else stats.StateChangesAvoided++;
+
+		if (runInstanced)
+		{
+			// Camera data only needs to be re-sent when setting the shader
+			// re-bound its own constant buffer, but packed meshes each have
+			// their own position scale and offset
+			if (packed)
+			{
+				vs->SetFloat3(packedInstancedHandles.PositionScale, mesh->GetPositionScale());
+				vs->SetFloat3(packedInstancedHandles.PositionOffset, mesh->GetPositionOffset());
+				vs->CopyAllBufferData();
+			}
+			else if (vsChanged)
+			{
+				vs->CopyAllBufferData();
+			}
+
+			// One draw for the whole run
+			mesh->DrawInstanced(drawContext, runEnd - runStart, runStart, lod);
+			stats.DrawCalls++;
+		}
+		else
+		{
+			// One draw per item, with only the matrices changing between them
+			for (unsigned int i = runStart; i < runEnd; i++)
+			{
+				if (packed)
+				{
+					Transform* transform = items[i].Entity->GetTransform();
+					vs->SetMatrix4x4(packedHandles.World, transform->GetWorldMatrix());
+					vs->SetMatrix4x4(packedHandles.WorldInvTrans, transform->GetWorldInverseTransposeMatrix());
+					vs->SetFloat3(packedHandles.PositionScale, mesh->GetPositionScale());
+					vs->SetFloat3(packedHandles.PositionOffset, mesh->GetPositionOffset());
+					vs->CopyAllBufferData();
+				}
+				else
+				{
+					mat->BindVertexData(items[i].Entity->GetTransform(), camera);
+				}
+
+				mesh->Draw(drawContext, lod);
+				stats.DrawCalls++;
+			}
+
+			// Everything after the first draw in the run would have
+			// re-bound the pipeline, material and mesh
+			stats.StateChangesAvoided += (runEnd - runStart - 1) * (mat->GetResourceCount() + PIPELINE_PART_COUNT + 2);
+		}
+
+		runStart = runEnd;
+	}
+}
+
+// Sets the shaders used for meshes in the packed vertex format
+void RenderQueue::SetPackedVertexShaders(std::shared_ptr<SimpleVertexShader> packedVS, std::shared_ptr<SimpleVertexShader> packedInstancedVS)
+{
+	this->packedVS = packedVS;
+	this->packedInstancedVS = packedInstancedVS;
+	packedHandles = PackedShaderHandles();
+	packedInstancedHandles = PackedShaderHandles();
+}
+
+// Sets the depth only shaders for one mesh format
+void RenderQueue::SetDepthVertexShaders(MeshVertexFormat format, std::shared_ptr<SimpleVertexShader> depthVS, std::shared_ptr<SimpleVertexShader> depthInstancedVS)
+{
+	this->depthVS[format] = depthVS;
+	this->depthInstancedVS[format] = depthInstancedVS;
+	depthHandles[format] = PackedShaderHandles();
+	depthInstancedHandles[format] = PackedShaderHandles();
+}
+
+// Saves the states every item is drawn with
+void RenderQueue::SetRenderStates(
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizer,
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthStencil,
+	Microsoft::WRL::ComPtr<ID3D11BlendState> blend)
+{
+	rasterizerState = rasterizer;
+	depthStencilState = depthStencil;
+	blendState = blend;
+}
+
+// The bundle for a run drawn with these shaders
+PipelineBundle RenderQueue::MakeBundle(SimpleVertexShader* vs, SimplePixelShader* ps)
+{
+	PipelineBundle bundle;
+	bundle.VertexShader = vs;
+	bundle.PixelShader = ps;
+	bundle.Rasterizer = rasterizerState.Get();
+	bundle.Blend = blendState.Get();
+	bundle.DepthStencil = depthStencilState.Get();
+	return bundle;
+}
+
+// Puts back the defaults for any of the queue's states that aren't.
+// Recorded chunks never touch the immediate context's state, so this
+// only matters after drawing on this thread, but is cheap either way
+void RenderQueue::RestoreDefaultStates()
+{
+	if (rasterizerState) context->RSSetState(0);
+	if (depthStencilState) context->OMSetDepthStencilState(0, 0);
+	if (blendState) context->OMSetBlendState(0, 0, 0xFFFFFFFF);
+}
+
+// Records the queue on several threads once there are enough items
+// for each to get at least minItemsPerChunk (null to stop)
+void RenderQueue::SetCommandRecorder(std::shared_ptr<CommandRecorder> recorder, unsigned int minItemsPerChunk)
+{
+	this->commandRecorder = recorder;
+	this->minItemsPerChunk = minItemsPerChunk;
+}
+
+// Looks up a shader's variables, if it's a different shader or it's been
+// (re)loaded since they were last found
+void RenderQueue::ResolvePackedHandles(SimpleVertexShader* vs, PackedShaderHandles& handles)
+{
+	if (handles.Shader == vs && handles.Version == vs->GetReflectionVersion())
+		return;
+
+	handles.Shader = vs;
+	handles.Version = vs->GetReflectionVersion();
+	handles.World = vs->GetVariableHandle("world");
+	handles.WorldInvTrans = vs->GetVariableHandle("worldInverseTranspose");
+	handles.View = vs->GetVariableHandle("view");
+	handles.Projection = vs->GetVariableHandle("projection");
+	handles.PositionScale = vs->GetVariableHandle("positionScale");
+	handles.PositionOffset = vs->GetVariableHandle("positionOffset");
+}
+
+// Fills the instance buffer, if it hasn't been already since the queue
+// was last sorted.  Returns whether instanced drawing can go ahead
+bool RenderQueue::PrepareInstanceBuffer(std::shared_ptr<SimpleVertexShader> instancedVS)
+{
+	if (!instancedVS)
+		return false;
+	if (!instanceBufferFilled)
+		instanceBufferFilled = FillInstanceBuffer();
+	return instanceBufferFilled;
+}
+
+// Writes the matrices of every item, in sorted order, to the instance buffer
+bool RenderQueue::FillInstanceBuffer()
+{
+	unsigned int count = (unsigned int)items.size();
+
+	// Grow the buffer if necessary
+	if (count > instanceBufferCapacity)
+	{
+		instanceBufferCapacity = max(count, instanceBufferCapacity * 2);
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = sizeof(InstanceData) * instanceBufferCapacity;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		instanceBuffer.Reset();
+		if (FAILED(device->CreateBuffer(&desc, 0, instanceBuffer.GetAddressOf())))
+		{
+			instanceBufferCapacity = 0;
+			return false;
+		}
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+
+	InstanceData* instances = (InstanceData*)mapped.pData;
+	for (unsigned int i = 0; i < count; i++)
+		instances[i] = items[i].Entity->GetTransform()->GetMatrices();
+
+	context->Unmap(instanceBuffer.Get(), 0);
+	return true;
+}
+
+// Gets (or creates) the ID for a vertex and pixel shader combination
+unsigned int RenderQueue::GetShaderPairID(const void* vs, const void* ps)
+{
+	auto it = shaderPairIDs.find({ vs, ps });
+	if (it != shaderPairIDs.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)shaderPairIDs.size();
+	shaderPairIDs.insert({ { vs, ps }, id });
+	return id;
+}
+
+// Gets (or creates) the ID for a material or mesh
+unsigned int RenderQueue::GetID(std::unordered_map<const void*, unsigned int>& ids, const void* ptr)
+{
+	auto it = ids.find(ptr);
+	if (it != ids.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)ids.size();
+	ids.insert({ ptr, id });
+	return id;
+}
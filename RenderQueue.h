@@ -0,0 +1,192 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+#include "GameEntity.h"
+#include "Camera.h"
+#include "SimpleShader.h"
+#include "CommandRecorder.h"
+#include "RenderStateCache.h"
+
+// --------------------------------------------------------
+// Collects the entities to draw each frame, sorts them by a
+// 64-bit key so draws sharing state end up adjacent, and then
+// submits them while skipping any state that's already bound.
+// Each run of items binds its shaders and the queue's render
+// states as one PipelineBundle, so only what differs from
+// the run before reaches the context.
+//
+// Key layout (most to least significant):
+//  - 12 bits: shader pair (vertex + pixel shader)
+//  - 14 bits: material
+//  - 12 bits: mesh
+//  -  2 bits: mesh LOD
+//  - 24 bits: view depth (front to back)
+// --------------------------------------------------------
+class RenderQueue
+{
+public:
+	RenderQueue(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Building the queue each frame
+	void Begin(std::shared_ptr<Camera> camera);
+	void Submit(GameEntity* entity);
+	void Sort();
+
+	// Begins a queue seen from some other view, like a shadow map's.
+	// Without a camera for the materials, it can only DrawDepth()
+	void Begin(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection, const DirectX::XMFLOAT3& position, float farClip);
+
+	// Picks each submitted entity's mesh LOD so its simplification error
+	// covers at most maxErrorPixels on a screen this tall.  Zero (the
+	// default) draws everything at LOD 0, leaving entities' LODs alone
+	void SetLodSelection(float screenHeight, float maxErrorPixels, float hysteresis = 0.25f);
+
+	// Submits the sorted queue.  If an instanced vertex shader is
+	// given, consecutive items sharing a mesh and material are
+	// batched into a single instanced draw (per mesh LOD)
+	void Draw(std::shared_ptr<SimpleVertexShader> instancedVS = nullptr);
+
+	// Draws just the depth of the sorted queue, from the meshes' position
+	// only streams and with no pixel shader, so a following Draw() can
+	// test for equal depth and shade each pixel once.  Takes the same
+	// instanced shader as that Draw(), since the two have to batch (and
+	// so transform) every item the same way.  Items without a matching
+	// depth shader are skipped, so set them all before using this
+	void DrawDepth(std::shared_ptr<SimpleVertexShader> instancedVS = nullptr);
+
+	// Depth only vertex shaders for each mesh format, with and without
+	// instancing (see DepthOnlyVS and DepthOnlyInstancedVS)
+	void SetDepthVertexShaders(MeshVertexFormat format, std::shared_ptr<SimpleVertexShader> depthVS, std::shared_ptr<SimpleVertexShader> depthInstancedVS);
+
+	// Vertex shaders used in place of the material's (or the instanced
+	// one) for meshes in the packed vertex format.  Packed meshes are
+	// skipped entirely without a packed shader
+	void SetPackedVertexShaders(std::shared_ptr<SimpleVertexShader> packedVS, std::shared_ptr<SimpleVertexShader> packedInstancedVS);
+
+	// Records the sorted queue in chunks on several threads (see
+	// CommandRecorder), once there are enough items for each chunk to get
+	// minItemsPerChunk.  Null goes back to drawing on this thread
+	void SetCommandRecorder(std::shared_ptr<CommandRecorder> recorder, unsigned int minItemsPerChunk = 256);
+
+	// Fixed function states every item is drawn with, by both Draw() and
+	// DrawDepth() (null for D3D's defaults).  They're put back to the
+	// defaults once the queue is done, so later drawing doesn't inherit them
+	void SetRenderStates(
+		Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizer,
+		Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthStencil = nullptr,
+		Microsoft::WRL::ComPtr<ID3D11BlendState> blend = nullptr);
+
+	// Stats from the most recent Draw()
+	unsigned int GetItemCount() { return (unsigned int)items.size(); }
+	unsigned int GetDrawCallCount() { return drawCallCount; }
+	unsigned int GetStateChangeCount() { return stateChangeCount; }
+	unsigned int GetStateChangesAvoided() { return stateChangesAvoided; }
+	unsigned int GetDepthDrawCallCount() { return depthDrawCallCount; }
+
+	// How many of this frame's items picked each LOD
+	unsigned int GetLodItemCount(unsigned int lod) { return lodItemCounts[lod]; }
+
+private:
+	struct RenderItem
+	{
+		unsigned long long Key;
+		GameEntity* Entity;
+		unsigned int Lod;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	// This frame's items, plus scratch space for sorting
+	std::vector<RenderItem> items;
+	std::vector<RenderItem> sortScratch;
+
+	// Camera (if any) and view for the current frame
+	std::shared_ptr<Camera> camera;
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+	DirectX::XMFLOAT3 cameraPosition;
+	float farClip;
+
+	// LOD selection: pixels per unit of radius at a distance of one
+	float lodPixelScale;
+	float lodScreenHeight;
+	float lodMaxErrorPixels;
+	float lodHysteresis;
+	unsigned int lodItemCounts[MESH_MAX_LODS];
+
+	// Small, stable IDs for the pieces of the sort key
+	std::map<std::pair<const void*, const void*>, unsigned int> shaderPairIDs;
+	std::unordered_map<const void*, unsigned int> materialIDs;
+	std::unordered_map<const void*, unsigned int> meshIDs;
+	unsigned int GetShaderPairID(const void* vs, const void* ps);
+	unsigned int GetID(std::unordered_map<const void*, unsigned int>& ids, const void* ptr);
+
+	// Shaders for packed meshes, and their variables
+	struct PackedShaderHandles
+	{
+		const SimpleVertexShader* Shader = 0;
+		unsigned int Version = 0;
+		SimpleShaderHandle World;
+		SimpleShaderHandle WorldInvTrans;
+		SimpleShaderHandle View;
+		SimpleShaderHandle Projection;
+		SimpleShaderHandle PositionScale;
+		SimpleShaderHandle PositionOffset;
+	};
+	std::shared_ptr<SimpleVertexShader> packedVS;
+	std::shared_ptr<SimpleVertexShader> packedInstancedVS;
+	PackedShaderHandles packedHandles;
+	PackedShaderHandles packedInstancedHandles;
+
+	// The instanced shader passed to Draw(), which uses the same
+	// camera variables
+	PackedShaderHandles instancedHandles;
+	void ResolvePackedHandles(SimpleVertexShader* vs, PackedShaderHandles& handles);
+
+	// Depth only shaders, indexed by MeshVertexFormat.  They use the
+	// same variables as the packed shaders
+	std::shared_ptr<SimpleVertexShader> depthVS[2];
+	std::shared_ptr<SimpleVertexShader> depthInstancedVS[2];
+	PackedShaderHandles depthHandles[2];
+	PackedShaderHandles depthInstancedHandles[2];
+
+	// States for every bundle the queue binds
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizerState;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthStencilState;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> blendState;
+	PipelineBundle MakeBundle(SimpleVertexShader* vs, SimplePixelShader* ps);
+	void RestoreDefaultStates();
+
+	// Parallel recording
+	std::shared_ptr<CommandRecorder> commandRecorder;
+	unsigned int minItemsPerChunk;
+
+	struct DrawStats
+	{
+		unsigned int DrawCalls;
+		unsigned int StateChanges;
+		unsigned int StateChangesAvoided;
+	};
+	void DrawRange(unsigned int begin, unsigned int end, std::shared_ptr<SimpleVertexShader> instancedVS, ID3D11DeviceContext* drawContext, DrawStats& stats);
+
+	// Per-instance data for instanced draws
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer;
+	unsigned int instanceBufferCapacity;
+	bool instanceBufferFilled;
+	bool FillInstanceBuffer();
+	bool PrepareInstanceBuffer(std::shared_ptr<SimpleVertexShader> instancedVS);
+
+	// Stats
+	unsigned int drawCallCount;
+	unsigned int stateChangeCount;
+	unsigned int stateChangesAvoided;
+	unsigned int depthDrawCallCount;
+};
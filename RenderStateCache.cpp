@@ -0,0 +1,155 @@
+#include "RenderStateCache.h"
+#include "Hash.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Blend and depth stencil descriptions have padding after their byte
+// sized members, so they're copied field by field into zeroed ones
+// before being hashed or compared
+static D3D11_BLEND_DESC Normalize(const D3D11_BLEND_DESC& desc)
+{
+	D3D11_BLEND_DESC n;
+	memset(&n, 0, sizeof(n));
+	n.AlphaToCoverageEnable = desc.AlphaToCoverageEnable;
+	n.IndependentBlendEnable = desc.IndependentBlendEnable;
+	for (int i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+	{
+		const D3D11_RENDER_TARGET_BLEND_DESC& rt = desc.RenderTarget[i];
+		n.RenderTarget[i].BlendEnable = rt.BlendEnable;
+		n.RenderTarget[i].SrcBlend = rt.SrcBlend;
+		n.RenderTarget[i].DestBlend = rt.DestBlend;
+		n.RenderTarget[i].BlendOp = rt.BlendOp;
+		n.RenderTarget[i].SrcBlendAlpha = rt.SrcBlendAlpha;
+		n.RenderTarget[i].DestBlendAlpha = rt.DestBlendAlpha;
+		n.RenderTarget[i].BlendOpAlpha = rt.BlendOpAlpha;
+		n.RenderTarget[i].RenderTargetWriteMask = rt.RenderTargetWriteMask;
+	}
+	return n;
+}
+
+static D3D11_DEPTH_STENCIL_DESC Normalize(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	D3D11_DEPTH_STENCIL_DESC n;
+	memset(&n, 0, sizeof(n));
+	n.DepthEnable = desc.DepthEnable;
+	n.DepthWriteMask = desc.DepthWriteMask;
+	n.DepthFunc = desc.DepthFunc;
+	n.StencilEnable = desc.StencilEnable;
+	n.StencilReadMask = desc.StencilReadMask;
+	n.StencilWriteMask = desc.StencilWriteMask;
+	n.FrontFace = desc.FrontFace;
+	n.BackFace = desc.BackFace;
+	return n;
+}
+
+// The others are all 4 byte fields, with nothing in between
+static const D3D11_RASTERIZER_DESC& Normalize(const D3D11_RASTERIZER_DESC& desc) { return desc; }
+static const D3D11_SAMPLER_DESC& Normalize(const D3D11_SAMPLER_DESC& desc) { return desc; }
+
+
+RenderStateCache::RenderStateCache(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: device(device), requestCount(0)
+{
+}
+
+Microsoft::WRL::ComPtr<ID3D11RasterizerState> RenderStateCache::GetRasterizerState(const D3D11_RASTERIZER_DESC& desc)
+{
+	return Find(rasterizerStates, desc, [&](const D3D11_RASTERIZER_DESC& d, ID3D11RasterizerState** state)
+		{ return device->CreateRasterizerState(&d, state); });
+}
+
+Microsoft::WRL::ComPtr<ID3D11BlendState> RenderStateCache::GetBlendState(const D3D11_BLEND_DESC& desc)
+{
+	return Find(blendStates, desc, [&](const D3D11_BLEND_DESC& d, ID3D11BlendState** state)
+		{ return device->CreateBlendState(&d, state); });
+}
+
+Microsoft::WRL::ComPtr<ID3D11DepthStencilState> RenderStateCache::GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	return Find(depthStencilStates, desc, [&](const D3D11_DEPTH_STENCIL_DESC& d, ID3D11DepthStencilState** state)
+		{ return device->CreateDepthStencilState(&d, state); });
+}
+
+Microsoft::WRL::ComPtr<ID3D11SamplerState> RenderStateCache::GetSamplerState(const D3D11_SAMPLER_DESC& desc)
+{
+	return Find(samplerStates, desc, [&](const D3D11_SAMPLER_DESC& d, ID3D11SamplerState** state)
+		{ return device->CreateSamplerState(&d, state); });
+}
+
+unsigned int RenderStateCache::GetStateCount()
+{
+	return (unsigned int)(rasterizerStates.size() + blendStates.size() + depthStencilStates.size() + samplerStates.size());
+}
+
+// Looks the (normalized) description up by its hash, creating the state
+// the first time.  A hash collision just gets its own, uncached, object
+template<typename Desc, typename State, typename Create>
+Microsoft::WRL::ComPtr<State> RenderStateCache::Find(std::unordered_map<unsigned long long, Entry<Desc, State>>& states, const Desc& desc, Create create)
+{
+	requestCount++;
+
+	const Desc& normalized = Normalize(desc);
+	unsigned long long hash = HashBytes(&normalized, sizeof(Desc));
+
+	auto it = states.find(hash);
+	if (it != states.end() && memcmp(&it->second.Description, &normalized, sizeof(Desc)) == 0)
+		return it->second.Object;
+
+	Microsoft::WRL::ComPtr<State> state;
+	if (FAILED(create(normalized, state.GetAddressOf())))
+	{
+		printf("Couldn't create a render state\n");
+		return nullptr;
+	}
+
+	if (it == states.end())
+		states.insert({ hash, { normalized, state } });
+	return state;
+}
+
+
+PipelineBinder::PipelineBinder(ID3D11DeviceContext* context)
+	: context(context), valid(false)
+{
+}
+
+unsigned int PipelineBinder::Bind(const PipelineBundle& bundle)
+{
+	unsigned int parts = 0;
+	if (!valid || bundle.VertexShader != current.VertexShader) parts |= PIPELINE_VERTEX_SHADER;
+	if (!valid || bundle.PixelShader != current.PixelShader) parts |= PIPELINE_PIXEL_SHADER;
+	if (!valid || bundle.Rasterizer != current.Rasterizer) parts |= PIPELINE_RASTERIZER;
+	if (!valid || bundle.Blend != current.Blend) parts |= PIPELINE_BLEND;
+	if (!valid || bundle.DepthStencil != current.DepthStencil || bundle.StencilRef != current.StencilRef) parts |= PIPELINE_DEPTH_STENCIL;
+	if (!valid || bundle.Topology != current.Topology) parts |= PIPELINE_TOPOLOGY;
+
+	// Shaders go through SimpleShader, which binds to the context it's been
+	// pointed at (see SimpleShaderContextScope) along with its buffers
+	if (parts & PIPELINE_VERTEX_SHADER)
+	{
+		if (bundle.VertexShader) bundle.VertexShader->SetShader();
+		else context->VSSetShader(0, 0, 0);
+	}
+	if (parts & PIPELINE_PIXEL_SHADER)
+	{
+		if (bundle.PixelShader) bundle.PixelShader->SetShader();
+		else context->PSSetShader(0, 0, 0);
+	}
+	if (parts & PIPELINE_RASTERIZER) context->RSSetState(bundle.Rasterizer);
+	if (parts & PIPELINE_BLEND) context->OMSetBlendState(bundle.Blend, 0, 0xFFFFFFFF);
+	if (parts & PIPELINE_DEPTH_STENCIL) context->OMSetDepthStencilState(bundle.DepthStencil, bundle.StencilRef);
+	if (parts & PIPELINE_TOPOLOGY) context->IASetPrimitiveTopology(bundle.Topology);
+
+	current = bundle;
+	valid = true;
+	return parts;
+}
+
+unsigned int PipelineBinder::CountParts(unsigned int parts)
+{
+	unsigned int count = 0;
+	for (; parts; parts &= parts - 1)
+		count++;
+	return count;
+}
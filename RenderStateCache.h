@@ -0,0 +1,106 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <unordered_map>
+
+#include "SimpleShader.h"
+
+// --------------------------------------------------------
+// One place to get rasterizer, blend, depth stencil and
+// sampler states from.
+//
+// Each state is looked up by a hash of its description, so
+// identical descriptions anywhere in the program share one
+// object, and asking again is just a lookup.  Descriptions
+// should start zeroed (= {}), like anything else handed to
+// D3D, and the cache only lives on the main thread.
+//
+// Objects from here can be compared by pointer to tell
+// whether two states are the same (see PipelineBinder).
+// --------------------------------------------------------
+class RenderStateCache
+{
+public:
+	RenderStateCache(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> GetRasterizerState(const D3D11_RASTERIZER_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11BlendState> GetBlendState(const D3D11_BLEND_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> GetSamplerState(const D3D11_SAMPLER_DESC& desc);
+
+	// How many descriptions were asked for, and how many distinct objects
+	// they actually needed
+	unsigned int GetRequestCount() { return requestCount; }
+	unsigned int GetStateCount();
+
+private:
+	template<typename Desc, typename State>
+	struct Entry
+	{
+		Desc Description;
+		Microsoft::WRL::ComPtr<State> Object;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	std::unordered_map<unsigned long long, Entry<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>> rasterizerStates;
+	std::unordered_map<unsigned long long, Entry<D3D11_BLEND_DESC, ID3D11BlendState>> blendStates;
+	std::unordered_map<unsigned long long, Entry<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>> depthStencilStates;
+	std::unordered_map<unsigned long long, Entry<D3D11_SAMPLER_DESC, ID3D11SamplerState>> samplerStates;
+	unsigned int requestCount;
+
+	template<typename Desc, typename State, typename Create>
+	Microsoft::WRL::ComPtr<State> Find(std::unordered_map<unsigned long long, Entry<Desc, State>>& states, const Desc& desc, Create create);
+};
+
+
+// Parts of a PipelineBundle, as bits for what PipelineBinder::Bind() changed
+#define PIPELINE_VERTEX_SHADER	(1 << 0)
+#define PIPELINE_PIXEL_SHADER	(1 << 1)
+#define PIPELINE_RASTERIZER		(1 << 2)
+#define PIPELINE_BLEND			(1 << 3)
+#define PIPELINE_DEPTH_STENCIL	(1 << 4)
+#define PIPELINE_TOPOLOGY		(1 << 5)
+#define PIPELINE_PART_COUNT		6
+
+// --------------------------------------------------------
+// Everything a draw needs bound besides its resources: the
+// shaders (the vertex shader brings its input layout), the
+// fixed function states and the topology.  Null states are
+// D3D's defaults, and a null pixel shader draws depth only.
+//
+// Bundles just point at things, which have to outlive them.
+// --------------------------------------------------------
+struct PipelineBundle
+{
+	SimpleVertexShader* VertexShader = 0;
+	SimplePixelShader* PixelShader = 0;
+	ID3D11RasterizerState* Rasterizer = 0;
+	ID3D11BlendState* Blend = 0;
+	ID3D11DepthStencilState* DepthStencil = 0;
+	unsigned int StencilRef = 0;
+	D3D11_PRIMITIVE_TOPOLOGY Topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+};
+
+// --------------------------------------------------------
+// Binds bundles to one context, only sending the parts that
+// differ from the bundle bound before.  Nothing is known to
+// be bound to start with, so the first bundle is bound in
+// full.
+// --------------------------------------------------------
+class PipelineBinder
+{
+public:
+	PipelineBinder(ID3D11DeviceContext* context);
+
+	// Returns the PIPELINE_ bits for the parts that were bound
+	unsigned int Bind(const PipelineBundle& bundle);
+
+	// How many bits are set in a mask from Bind()
+	static unsigned int CountParts(unsigned int parts);
+
+private:
+	ID3D11DeviceContext* context;
+	PipelineBundle current;
+	bool valid;
+};
@@ -0,0 +1,585 @@
+#include "SceneBVH.h"
+
+#include <float.h>
+
+using namespace DirectX;
+
+// Helpers for box math
+static float SurfaceArea(const BoundingBox& box)
+{
+	XMFLOAT3 e = box.Extents;
+	return 8.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+static BoundingBox Merge(const BoundingBox& a, const BoundingBox& b)
+{
+	BoundingBox merged;
+	BoundingBox::CreateMerged(merged, a, b);
+	return merged;
+}
+
+
+SceneBVH::SceneBVH(float fatMargin)
+	: root(-1), freeList(-1), nodeCount(0), fatMargin(fatMargin), lastRefitCount(0), changeVersion(0), everythingChanged(false)
+{
+}
+
+// Adds an entity to the tree
+void SceneBVH::Insert(GameEntity* entity)
+{
+	if (!entity || entityToLeaf.find(entity) != entityToLeaf.end())
+		return;
+
+	int leaf = AllocateNode();
+	nodes[leaf].Bounds = FatBounds(entity);
+	nodes[leaf].Entity = entity;
+	nodes[leaf].Version = entity->GetTransform()->GetVersion();
+	nodes[leaf].Height = 0;
+	nodes[leaf].LeafIndex = (int)leaves.size();
+
+	leaves.push_back(leaf);
+	entityToLeaf.insert({ entity, leaf });
+	InsertLeaf(leaf);
+	AddChange(nodes[leaf].Bounds);
+	changeVersion++;
+}
+
+// Removes an entity from the tree
+void SceneBVH::Remove(GameEntity* entity)
+{
+	auto it = entityToLeaf.find(entity);
+	if (it == entityToLeaf.end())
+		return;
+
+	int leaf = it->second;
+	AddChange(nodes[leaf].Bounds);
+	RemoveLeaf(leaf);
+
+	// Swap-remove from the leaf list
+	int leafIndex = nodes[leaf].LeafIndex;
+	leaves[leafIndex] = leaves.back();
+	nodes[leaves[leafIndex]].LeafIndex = leafIndex;
+	leaves.pop_back();
+
+	entityToLeaf.erase(it);
+	FreeNode(leaf);
+	changeVersion++;
+}
+
+// Removes everything from the tree
+void SceneBVH::Clear()
+{
+	nodes.clear();
+	leaves.clear();
+	entityToLeaf.clear();
+	root = -1;
+	freeList = -1;
+	nodeCount = 0;
+	changedBounds.clear();
+	everythingChanged = true;
+	changeVersion++;
+}
+
+// Updates the leaves of any entities that have moved since the last refit.
+// Leaves are only reinserted if the entity leaves its fat bounds
+void SceneBVH::Refit()
+{
+	lastRefitCount = 0;
+	for (int leaf : leaves)
+	{
+		Node& node = nodes[leaf];
+		unsigned int version = node.Entity->GetTransform()->GetVersion();
+		if (version == node.Version)
+			continue;
+
+		// The fat box covers where it was, and where it is if it still fits
+		node.Version = version;
+		changeVersion++;
+		AddChange(node.Bounds);
+		BoundingBox box = node.Entity->GetWorldBoundingBox();
+		if (node.Bounds.Contains(box) == CONTAINS)
+			continue;
+
+		// Moved too far, so reinsert with new fat bounds
+		RemoveLeaf(leaf);
+		nodes[leaf].Bounds = FatBounds(nodes[leaf].Entity);
+		InsertLeaf(leaf);
+		AddChange(nodes[leaf].Bounds);
+		lastRefitCount++;
+	}
+}
+
+void SceneBVH::ClearChanges()
+{
+	changedBounds.clear();
+	everythingChanged = false;
+}
+
+void SceneBVH::AddChange(const BoundingBox& bounds)
+{
+	if (everythingChanged)
+		return;
+
+	if (changedBounds.size() >= SCENE_BVH_MAX_CHANGES)
+	{
+		changedBounds.clear();
+		everythingChanged = true;
+		return;
+	}
+	changedBounds.push_back(bounds);
+}
+
+// Finds all entities whose bounds intersect the frustum.  Subtrees that
+// are entirely inside the frustum are collected without further tests
+void SceneBVH::QueryFrustum(const BoundingFrustum& frustum, std::vector<GameEntity*>& results)
+{
+	if (root == -1)
+		return;
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+
+		ContainmentType c = frustum.Contains(node.Bounds);
+		if (c == DISJOINT)
+			continue;
+
+		if (c == CONTAINS)
+		{
+			CollectSubtree(index, results);
+		}
+		else if (node.IsLeaf())
+		{
+			// The fat box intersects, so check the actual bounds
+			if (frustum.Intersects(node.Entity->GetWorldBoundingBox()))
+				results.push_back(node.Entity);
+		}
+		else
+		{
+			stack.push_back(node.Child1);
+			stack.push_back(node.Child2);
+		}
+	}
+}
+
+// Finds all entities whose bounds intersect the (possibly rotated) box
+void SceneBVH::QueryBox(const BoundingOrientedBox& box, std::vector<GameEntity*>& results)
+{
+	if (root == -1)
+		return;
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+
+		ContainmentType c = box.Contains(node.Bounds);
+		if (c == DISJOINT)
+			continue;
+
+		if (c == CONTAINS)
+		{
+			CollectSubtree(index, results);
+		}
+		else if (node.IsLeaf())
+		{
+			if (box.Intersects(node.Entity->GetWorldBoundingBox()))
+				results.push_back(node.Entity);
+		}
+		else
+		{
+			stack.push_back(node.Child1);
+			stack.push_back(node.Child2);
+		}
+	}
+}
+
+// Finds all entities whose bounds intersect the sphere
+void SceneBVH::QuerySphere(const BoundingSphere& sphere, std::vector<GameEntity*>& results)
+{
+	if (root == -1)
+		return;
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+
+		if (!sphere.Intersects(node.Bounds))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			if (sphere.Intersects(node.Entity->GetWorldBoundingBox()))
+				results.push_back(node.Entity);
+		}
+		else
+		{
+			stack.push_back(node.Child1);
+			stack.push_back(node.Child2);
+		}
+	}
+}
+
+// Finds the closest entity whose bounds are hit by the ray, or null
+// if nothing is hit.  The direction must be normalized
+GameEntity* SceneBVH::Raycast(FXMVECTOR origin, FXMVECTOR direction, float* hitDistance)
+{
+	GameEntity* closest = 0;
+	float closestDist = FLT_MAX;
+
+	if (root == -1)
+		return 0;
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+
+		// Skip anything we miss, or that's further than our best hit
+		float dist = 0;
+		if (!node.Bounds.Intersects(origin, direction, dist) || dist > closestDist)
+			continue;
+
+		if (node.IsLeaf())
+		{
+			if (node.Entity->GetWorldBoundingBox().Intersects(origin, direction, dist) && dist < closestDist)
+			{
+				closestDist = dist;
+				closest = node.Entity;
+			}
+		}
+		else
+		{
+			stack.push_back(node.Child1);
+			stack.push_back(node.Child2);
+		}
+	}
+
+	if (closest && hitDistance)
+		*hitDistance = closestDist;
+	return closest;
+}
+
+// Gets a node from the free list, growing the pool if necessary
+int SceneBVH::AllocateNode()
+{
+	int index;
+	if (freeList != -1)
+	{
+		index = freeList;
+		freeList = nodes[index].Parent;
+	}
+	else
+	{
+		index = (int)nodes.size();
+		nodes.emplace_back();
+	}
+
+	Node& node = nodes[index];
+	node.Parent = -1;
+	node.Child1 = -1;
+	node.Child2 = -1;
+	node.Height = 0;
+	node.Entity = 0;
+	node.Version = 0;
+	node.LeafIndex = -1;
+	nodeCount++;
+	return index;
+}
+
+// Returns a node to the free list
+void SceneBVH::FreeNode(int index)
+{
+	nodes[index].Parent = freeList;
+	nodes[index].Height = -1;
+	nodes[index].Entity = 0;
+	freeList = index;
+	nodeCount--;
+}
+
+// Inserts a leaf, choosing the sibling that minimizes the total
+// surface area of the tree (the surface area heuristic)
+void SceneBVH::InsertLeaf(int leaf)
+{
+	if (root == -1)
+	{
+		root = leaf;
+		nodes[root].Parent = -1;
+		return;
+	}
+
+	// Find the best sibling for this leaf
+	BoundingBox leafBounds = nodes[leaf].Bounds;
+	int index = root;
+	while (!nodes[index].IsLeaf())
+	{
+		int child1 = nodes[index].Child1;
+		int child2 = nodes[index].Child2;
+
+		float area = SurfaceArea(nodes[index].Bounds);
+		float combinedArea = SurfaceArea(Merge(nodes[index].Bounds, leafBounds));
+
+		// Cost of creating a new parent for this node and the new leaf
+		float cost = 2.0f * combinedArea;
+
+		// Minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		// Cost of descending into each child
+		float cost1 = SurfaceArea(Merge(leafBounds, nodes[child1].Bounds)) + inheritanceCost;
+		if (!nodes[child1].IsLeaf()) cost1 -= SurfaceArea(nodes[child1].Bounds);
+
+		float cost2 = SurfaceArea(Merge(leafBounds, nodes[child2].Bounds)) + inheritanceCost;
+		if (!nodes[child2].IsLeaf()) cost2 -= SurfaceArea(nodes[child2].Bounds);
+
+		// Stop here?
+		if (cost < cost1 && cost < cost2)
+			break;
+
+		index = cost1 < cost2 ? child1 : child2;
+	}
+	int sibling = index;
+
+	// Create a new parent for the sibling and the leaf
+	int oldParent = nodes[sibling].Parent;
+	int newParent = AllocateNode();
+	nodes[newParent].Parent = oldParent;
+	nodes[newParent].Bounds = Merge(leafBounds, nodes[sibling].Bounds);
+	nodes[newParent].Height = nodes[sibling].Height + 1;
+	nodes[newParent].Child1 = sibling;
+	nodes[newParent].Child2 = leaf;
+	nodes[sibling].Parent = newParent;
+	nodes[leaf].Parent = newParent;
+
+	if (oldParent != -1)
+	{
+		if (nodes[oldParent].Child1 == sibling) nodes[oldParent].Child1 = newParent;
+		else nodes[oldParent].Child2 = newParent;
+	}
+	else
+	{
+		root = newParent;
+	}
+
+	// Walk back up the tree fixing heights and bounds
+	index = nodes[leaf].Parent;
+	while (index != -1)
+	{
+		index = Balance(index);
+
+		int child1 = nodes[index].Child1;
+		int child2 = nodes[index].Child2;
+		nodes[index].Height = 1 + max(nodes[child1].Height, nodes[child2].Height);
+		nodes[index].Bounds = Merge(nodes[child1].Bounds, nodes[child2].Bounds);
+
+		index = nodes[index].Parent;
+	}
+}
+
+// Unlinks a leaf from the tree (without freeing it)
+void SceneBVH::RemoveLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = -1;
+		return;
+	}
+
+	int parent = nodes[leaf].Parent;
+	int grandParent = nodes[parent].Parent;
+	int sibling = nodes[parent].Child1 == leaf ? nodes[parent].Child2 : nodes[parent].Child1;
+
+	if (grandParent != -1)
+	{
+		// Replace the parent with the sibling
+		if (nodes[grandParent].Child1 == parent) nodes[grandParent].Child1 = sibling;
+		else nodes[grandParent].Child2 = sibling;
+		nodes[sibling].Parent = grandParent;
+		FreeNode(parent);
+
+		// Fix up the ancestors
+		int index = grandParent;
+		while (index != -1)
+		{
+			index = Balance(index);
+
+			int child1 = nodes[index].Child1;
+			int child2 = nodes[index].Child2;
+			nodes[index].Bounds = Merge(nodes[child1].Bounds, nodes[child2].Bounds);
+			nodes[index].Height = 1 + max(nodes[child1].Height, nodes[child2].Height);
+
+			index = nodes[index].Parent;
+		}
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].Parent = -1;
+		FreeNode(parent);
+	}
+
+	nodes[leaf].Parent = -1;
+}
+
+// Performs a left or right rotation if node A is imbalanced.
+// Returns the index of the node now at A's position
+int SceneBVH::Balance(int iA)
+{
+	Node& A = nodes[iA];
+	if (A.IsLeaf() || A.Height < 2)
+		return iA;
+
+	int iB = A.Child1;
+	int iC = A.Child2;
+	Node& B = nodes[iB];
+	Node& C = nodes[iC];
+
+	int balance = C.Height - B.Height;
+
+	// Rotate C up
+	if (balance > 1)
+	{
+		int iF = C.Child1;
+		int iG = C.Child2;
+		Node& F = nodes[iF];
+		Node& G = nodes[iG];
+
+		// Swap A and C
+		C.Child1 = iA;
+		C.Parent = A.Parent;
+		A.Parent = iC;
+
+		// A's old parent should point to C
+		if (C.Parent != -1)
+		{
+			if (nodes[C.Parent].Child1 == iA) nodes[C.Parent].Child1 = iC;
+			else nodes[C.Parent].Child2 = iC;
+		}
+		else
+		{
+			root = iC;
+		}
+
+		// Rotate
+		if (F.Height > G.Height)
+		{
+			C.Child2 = iF;
+			A.Child2 = iG;
+			G.Parent = iA;
+			A.Bounds = Merge(B.Bounds, G.Bounds);
+			C.Bounds = Merge(A.Bounds, F.Bounds);
+			A.Height = 1 + max(B.Height, G.Height);
+			C.Height = 1 + max(A.Height, F.Height);
+		}
+		else
+		{
+			C.Child2 = iG;
+			A.Child2 = iF;
+			F.Parent = iA;
+			A.Bounds = Merge(B.Bounds, F.Bounds);
+			C.Bounds = Merge(A.Bounds, G.Bounds);
+			A.Height = 1 + max(B.Height, F.Height);
+			C.Height = 1 + max(A.Height, G.Height);
+		}
+
+		return iC;
+	}
+
+	// Rotate B up
+	if (balance < -1)
+	{
+		int iD = B.Child1;
+		int iE = B.Child2;
+		Node& D = nodes[iD];
+		Node& E = nodes[iE];
+
+		// Swap A and B
+		B.Child1 = iA;
+		B.Parent = A.Parent;
+		A.Parent = iB;
+
+		// A's old parent should point to B
+		if (B.Parent != -1)
+		{
+			if (nodes[B.Parent].Child1 == iA) nodes[B.Parent].Child1 = iB;
+			else nodes[B.Parent].Child2 = iB;
+		}
+		else
+		{
+			root = iB;
+		}
+
+		// Rotate
+		if (D.Height > E.Height)
+		{
+			B.Child2 = iD;
+			A.Child1 = iE;
+			E.Parent = iA;
+			A.Bounds = Merge(C.Bounds, E.Bounds);
+			B.Bounds = Merge(A.Bounds, D.Bounds);
+			A.Height = 1 + max(C.Height, E.Height);
+			B.Height = 1 + max(A.Height, D.Height);
+		}
+		else
+		{
+			B.Child2 = iE;
+			A.Child1 = iD;
+			D.Parent = iA;
+			A.Bounds = Merge(C.Bounds, D.Bounds);
+			B.Bounds = Merge(A.Bounds, E.Bounds);
+			A.Height = 1 + max(C.Height, D.Height);
+			B.Height = 1 + max(A.Height, E.Height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+// The entity's world space box, enlarged by the fat margin
+BoundingBox SceneBVH::FatBounds(GameEntity* entity)
+{
+	BoundingBox box = entity->GetWorldBoundingBox();
+	box.Extents.x += fatMargin;
+	box.Extents.y += fatMargin;
+	box.Extents.z += fatMargin;
+	return box;
+}
+
+// Adds every entity below the given node, without any tests
+void SceneBVH::CollectSubtree(int index, std::vector<GameEntity*>& results)
+{
+	// Uses a separate stack, as the caller's traversal is still in progress
+	subtreeStack.clear();
+	subtreeStack.push_back(index);
+	while (!subtreeStack.empty())
+	{
+		const Node& node = nodes[subtreeStack.back()];
+		subtreeStack.pop_back();
+
+		if (node.IsLeaf())
+		{
+			results.push_back(node.Entity);
+		}
+		else
+		{
+			subtreeStack.push_back(node.Child1);
+			subtreeStack.push_back(node.Child2);
+		}
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+#include <unordered_map>
+
+#include "GameEntity.h"
+
+// Changed regions kept before they collapse into "everything changed"
+#define SCENE_BVH_MAX_CHANGES 256
+
+// --------------------------------------------------------
+// A dynamic bounding volume hierarchy (AABB tree) over the
+// entities in the scene.
+//
+// Leaves store slightly enlarged ("fat") world space boxes so
+// small movements don't require touching the tree.  Refit()
+// compares each entity's transform version against the one the
+// leaf was built from and only reinserts leaves that moved
+// outside their fat box.  The tree is kept balanced with AVL
+// style rotations as leaves are inserted and removed.
+// --------------------------------------------------------
+class SceneBVH
+{
+public:
+	SceneBVH(float fatMargin = 0.1f);
+
+	// Tree management
+	void Insert(GameEntity* entity);
+	void Remove(GameEntity* entity);
+	void Clear();
+	void Refit();
+
+	// Queries - results are appended to the given vector
+	void QueryFrustum(const DirectX::BoundingFrustum& frustum, std::vector<GameEntity*>& results);
+	void QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<GameEntity*>& results);
+	void QueryBox(const DirectX::BoundingOrientedBox& box, std::vector<GameEntity*>& results);
+	GameEntity* Raycast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float* hitDistance = 0);
+
+	// Stats
+	unsigned int GetEntityCount() { return (unsigned int)leaves.size(); }
+	unsigned int GetNodeCount() { return nodeCount; }
+	int GetHeight() { return root == -1 ? 0 : nodes[root].Height; }
+	unsigned int GetLastRefitCount() { return lastRefitCount; }
+
+	// Changes whenever an entity is added, removed or moved at all, for
+	// anything that caches results built from the scene (like GPUDrivenRenderer)
+	unsigned int GetVersion() { return changeVersion; }
+
+	// Where the scene changed since the last ClearChanges(): the old and
+	// new bounds of everything added, removed or moved, for caches that
+	// only cover part of the scene (like shadow cascades).  Clear(), or
+	// too many changes, count as everything having changed instead
+	const std::vector<DirectX::BoundingBox>& GetChangedBounds() { return changedBounds; }
+	bool HasEverythingChanged() { return everythingChanged; }
+	void ClearChanges();
+
+private:
+	struct Node
+	{
+		DirectX::BoundingBox Bounds;
+		int Parent;		// Also used as "next" in the free list
+		int Child1;
+		int Child2;
+		int Height;		// Leaves are 0, free nodes are -1
+
+		// Leaf data
+		GameEntity* Entity;
+		unsigned int Version;
+		int LeafIndex;
+
+		bool IsLeaf() const { return Child1 == -1; }
+	};
+
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+	unsigned int nodeCount;
+	float fatMargin;
+
+	// Leaf node indices, for fast refitting
+	std::vector<int> leaves;
+	std::unordered_map<GameEntity*, int> entityToLeaf;
+	unsigned int lastRefitCount;
+	unsigned int changeVersion;
+	std::vector<DirectX::BoundingBox> changedBounds;
+	bool everythingChanged;
+
+	// Traversal stacks, reused between queries
+	std::vector<int> stack;
+	std::vector<int> subtreeStack;
+
+	int AllocateNode();
+	void FreeNode(int index);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int index);
+	DirectX::BoundingBox FatBounds(GameEntity* entity);
+	void AddChange(const DirectX::BoundingBox& bounds);
+	void CollectSubtree(int index, std::vector<GameEntity*>& results);
+};
@@ -0,0 +1,348 @@
+#include "ShaderManager.h"
+#include "Hash.h"
+
+#include <stdio.h>
+#include <chrono>
+
+// How often the watch thread looks for changed sources
+#define SHADER_WATCH_INTERVAL_MS 250
+
+#if defined(DEBUG) || defined(_DEBUG)
+#define SHADER_COMPILE_FLAGS (D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION)
+#else
+#define SHADER_COMPILE_FLAGS D3DCOMPILE_OPTIMIZATION_LEVEL3
+#endif
+
+// Marks a shader whose source couldn't be read, so it's only tried
+// again once something changes
+#define SHADER_HASH_UNREADABLE 1ull
+
+// The compiler wants file names as narrow strings
+static std::string ToNarrow(const std::wstring& text)
+{
+	int length = WideCharToMultiByte(CP_ACP, 0, text.c_str(), -1, 0, 0, 0, 0);
+	if (length <= 1)
+		return std::string();
+
+	std::string narrow(length - 1, '\0');
+	WideCharToMultiByte(CP_ACP, 0, text.c_str(), -1, &narrow[0], length, 0, 0);
+	return narrow;
+}
+
+ShaderManager::ShaderManager(const std::wstring& sourceDirectory, const std::wstring& cacheDirectory)
+	:
+	sourceDirectory(sourceDirectory),
+	cacheDirectory(cacheDirectory),
+	reloadCount(0),
+	stopping(false),
+	watching(true)
+{
+	// Fails harmlessly if it already exists
+	CreateDirectoryW(cacheDirectory.c_str(), 0);
+
+	// Changes are measured from here
+	SourcesChanged();
+	watchThread = std::thread(&ShaderManager::WatchMain, this);
+}
+
+ShaderManager::~ShaderManager()
+{
+	{
+		std::lock_guard<std::mutex> lock(watchMutex);
+		stopping = true;
+	}
+	stopRequested.notify_all();
+	watchThread.join();
+}
+
+// Runs the preprocessor over the source, which pulls in every include,
+// and hashes the result along with everything else that affects the code
+bool ShaderManager::Preprocess(
+	const std::wstring& sourceFile,
+	const std::vector<ShaderDefine>& defines,
+	const std::string& target,
+	Microsoft::WRL::ComPtr<ID3DBlob>& preprocessed,
+	unsigned long long* hash)
+{
+	std::wstring path = sourceDirectory + sourceFile;
+	Microsoft::WRL::ComPtr<ID3DBlob> source;
+	if (FAILED(D3DReadFileToBlob(path.c_str(), source.GetAddressOf())))
+	{
+		ReportError("Couldn't read shader source " + ToNarrow(path));
+		return false;
+	}
+
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (auto& d : defines)
+		macros.push_back({ d.first.c_str(), d.second.c_str() });
+	macros.push_back({ 0, 0 });
+
+	std::string name = ToNarrow(path);
+	Microsoft::WRL::ComPtr<ID3DBlob> errors;
+	HRESULT hr = D3DPreprocess(
+		source->GetBufferPointer(),
+		source->GetBufferSize(),
+		name.c_str(),
+		macros.data(),
+		D3D_COMPILE_STANDARD_FILE_INCLUDE,
+		preprocessed.ReleaseAndGetAddressOf(),
+		errors.GetAddressOf());
+	if (FAILED(hr))
+	{
+		ReportError(errors ? (const char*)errors->GetBufferPointer() : "Couldn't preprocess " + name);
+		return false;
+	}
+
+	unsigned int flags = SHADER_COMPILE_FLAGS;
+	unsigned long long h = HashBytes(preprocessed->GetBufferPointer(), preprocessed->GetBufferSize());
+	h = HashBytes(target.c_str(), target.size() + 1, h);
+	h = HashBytes(&flags, sizeof(flags), h);
+	for (auto& d : defines)
+	{
+		h = HashBytes(d.first.c_str(), d.first.size() + 1, h);
+		h = HashBytes(d.second.c_str(), d.second.size() + 1, h);
+	}
+
+	// Keep clear of the values that mean something else
+	if (h <= SHADER_HASH_UNREADABLE)
+		h += 2;
+
+	*hash = h;
+	return true;
+}
+
+Microsoft::WRL::ComPtr<ID3DBlob> ShaderManager::Compile(
+	const std::wstring& sourceFile,
+	const std::vector<ShaderDefine>& defines,
+	const std::string& target,
+	unsigned long long* hash)
+{
+	Microsoft::WRL::ComPtr<ID3DBlob> preprocessed;
+	unsigned long long sourceHash = 0;
+	if (!Preprocess(sourceFile, defines, target, preprocessed, &sourceHash))
+		return nullptr;
+	if (hash) *hash = sourceHash;
+
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto it = memoryCache.find(sourceHash);
+		if (it != memoryCache.end())
+			return it->second;
+	}
+
+	// Then the disk, and only then the compiler
+	wchar_t cacheName[32];
+	swprintf_s(cacheName, L"\\%016llx.cso", sourceHash);
+	std::wstring cachePath = cacheDirectory + cacheName;
+
+	Microsoft::WRL::ComPtr<ID3DBlob> blob;
+	if (FAILED(D3DReadFileToBlob(cachePath.c_str(), blob.GetAddressOf())))
+	{
+		std::string name = ToNarrow(sourceDirectory + sourceFile);
+		Microsoft::WRL::ComPtr<ID3DBlob> errors;
+		HRESULT hr = D3DCompile(
+			preprocessed->GetBufferPointer(),
+			preprocessed->GetBufferSize(),
+			name.c_str(),
+			0,
+			0,
+			"main",
+			target.c_str(),
+			SHADER_COMPILE_FLAGS,
+			0,
+			blob.ReleaseAndGetAddressOf(),
+			errors.GetAddressOf());
+		if (FAILED(hr))
+		{
+			ReportError(errors ? (const char*)errors->GetBufferPointer() : "Couldn't compile " + name);
+			return nullptr;
+		}
+
+		// Written under a temporary name, so a half written file is
+		// never picked up (see MeshCacheFile::Write)
+		std::wstring tempPath = cachePath + L".tmp";
+		if (FAILED(D3DWriteBlobToFile(blob.Get(), tempPath.c_str(), TRUE)) ||
+			!MoveFileExW(tempPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING))
+			DeleteFileW(tempPath.c_str());
+	}
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	memoryCache.insert({ sourceHash, blob });
+	return blob;
+}
+
+void ShaderManager::Watch(
+	std::shared_ptr<ISimpleShader> shader,
+	const std::wstring& sourceFile,
+	const std::vector<ShaderDefine>& defines,
+	unsigned long long hash)
+{
+	Microsoft::WRL::ComPtr<ID3DBlob> blob = shader->GetShaderBlob();
+	if (!blob)
+		return;
+
+	// Recompile for the same stage and shader model as the current code
+	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
+	if (FAILED(D3DReflect(blob->GetBufferPointer(), blob->GetBufferSize(), IID_ID3D11ShaderReflection, (void**)refl.GetAddressOf())))
+		return;
+
+	D3D11_SHADER_DESC desc = {};
+	refl->GetDesc(&desc);
+
+	static const char* stagePrefixes[] = { "ps", "vs", "gs", "hs", "ds", "cs" };
+	unsigned int stage = D3D11_SHVER_GET_TYPE(desc.Version);
+	if (stage >= ARRAYSIZE(stagePrefixes))
+		return;
+
+	char target[16];
+	sprintf_s(target, "%s_%u_%u", stagePrefixes[stage], D3D11_SHVER_GET_MAJOR(desc.Version), D3D11_SHVER_GET_MINOR(desc.Version));
+
+	std::lock_guard<std::mutex> lock(watchMutex);
+	watched.push_back({ shader, sourceFile, defines, target, hash });
+}
+
+unsigned int ShaderManager::Update()
+{
+	std::vector<Reload> ready;
+	{
+		std::lock_guard<std::mutex> lock(watchMutex);
+		ready.swap(reloads);
+	}
+
+	unsigned int count = 0;
+	for (auto& r : ready)
+	{
+		std::shared_ptr<ISimpleShader> shader;
+		std::wstring sourceFile;
+		{
+			std::lock_guard<std::mutex> lock(watchMutex);
+			shader = watched[r.Index].Shader.lock();
+			sourceFile = watched[r.Index].SourceFile;
+		}
+		if (!shader)
+			continue;
+
+		if (shader->ReplaceShaderBlob(r.Blob))
+		{
+			printf("Reloaded shader %ls\n", sourceFile.c_str());
+			count++;
+		}
+		else
+			ReportError("Couldn't create the reloaded " + ToNarrow(sourceFile) + ", so the old code is still in use");
+	}
+
+	reloadCount += count;
+	return count;
+}
+
+unsigned int ShaderManager::GetWatchedCount()
+{
+	std::lock_guard<std::mutex> lock(watchMutex);
+	return (unsigned int)watched.size();
+}
+
+std::string ShaderManager::GetLastError()
+{
+	std::lock_guard<std::mutex> lock(watchMutex);
+	return lastError;
+}
+
+void ShaderManager::ReportError(const std::string& message)
+{
+	printf("%s\n", message.c_str());
+
+	std::lock_guard<std::mutex> lock(watchMutex);
+	lastError = message;
+}
+
+// Whether any shader source or include in the directory was written (or
+// added) since the last check
+bool ShaderManager::SourcesChanged()
+{
+	bool changed = false;
+
+	WIN32_FIND_DATAW findData = {};
+	HANDLE find = FindFirstFileW((sourceDirectory + L"*.hlsl*").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+		return false;
+
+	do
+	{
+		unsigned long long writeTime =
+			((unsigned long long)findData.ftLastWriteTime.dwHighDateTime << 32) | findData.ftLastWriteTime.dwLowDateTime;
+
+		auto it = sourceWriteTimes.find(findData.cFileName);
+		if (it == sourceWriteTimes.end() || it->second != writeTime)
+		{
+			sourceWriteTimes[findData.cFileName] = writeTime;
+			changed = true;
+		}
+	} while (FindNextFileW(find, &findData));
+
+	FindClose(find);
+	return changed;
+}
+
+// Checks every watched shader whenever the sources change, and recompiles
+// the ones whose preprocessed source came out different
+void ShaderManager::WatchMain()
+{
+	struct Check
+	{
+		size_t Index;
+		WatchedShader Shader;
+		unsigned long long NewHash;
+		Microsoft::WRL::ComPtr<ID3DBlob> Blob;
+	};
+
+	std::unique_lock<std::mutex> lock(watchMutex);
+	while (!stopping)
+	{
+		stopRequested.wait_for(lock, std::chrono::milliseconds(SHADER_WATCH_INTERVAL_MS), [this]() { return stopping; });
+		if (stopping || !watching)
+			continue;
+
+		lock.unlock();
+		bool changed = SourcesChanged();
+		lock.lock();
+
+		// Shaders with unknown hashes are checked right away, but just to
+		// find their hash - their code is already current
+		std::vector<Check> checks;
+		for (size_t i = 0; i < watched.size(); i++)
+		{
+			if (changed || watched[i].Hash == 0)
+				checks.push_back({ i, watched[i], 0, nullptr });
+		}
+		if (checks.empty())
+			continue;
+
+		lock.unlock();
+		for (auto& c : checks)
+		{
+			Microsoft::WRL::ComPtr<ID3DBlob> preprocessed;
+			if (!Preprocess(c.Shader.SourceFile, c.Shader.Defines, c.Shader.Target, preprocessed, &c.NewHash))
+			{
+				c.NewHash = SHADER_HASH_UNREADABLE;
+				continue;
+			}
+
+			if (c.Shader.Hash != 0 && c.NewHash != c.Shader.Hash)
+			{
+				c.Blob = Compile(c.Shader.SourceFile, c.Shader.Defines, c.Shader.Target);
+
+				// Broken code is left out, and tried again on the next change
+				if (!c.Blob)
+					c.NewHash = c.Shader.Hash;
+			}
+		}
+		lock.lock();
+
+		for (auto& c : checks)
+		{
+			watched[c.Index].Hash = c.NewHash;
+			if (c.Blob)
+				reloads.push_back({ c.Index, c.Blob });
+		}
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3dcompiler.h>
+#include <wrl/client.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "SimpleShader.h"
+
+// A preprocessor define for compiling a shader: name and value
+typedef std::pair<std::string, std::string> ShaderDefine;
+
+// --------------------------------------------------------
+// Compiles shaders from their .hlsl sources and reloads
+// them while the game runs.
+//
+// Compiled code is cached on disk and in memory, keyed by
+// a hash of the preprocessed source (so includes count), the
+// defines and the target, so each version of each shader is
+// only ever compiled once.
+//
+// Watched shaders are checked on a background thread when
+// any source in the directory changes.  Ones that come out
+// different are recompiled there, and swapped into the
+// existing SimpleShader objects by Update() on the main
+// thread, so everything holding them keeps working.  Their
+// reflection versions change, so handles get re-resolved.
+// --------------------------------------------------------
+class ShaderManager
+{
+public:
+	ShaderManager(const std::wstring& sourceDirectory, const std::wstring& cacheDirectory);
+	~ShaderManager();
+
+	ShaderManager(const ShaderManager&) = delete;
+	ShaderManager& operator=(const ShaderManager&) = delete;
+
+	// Compiles (or finds in the cache) the given source, which is relative
+	// to the source directory.  Returns null if it doesn't compile.  The hash
+	// identifies this exact version, for Watch()
+	Microsoft::WRL::ComPtr<ID3DBlob> Compile(
+		const std::wstring& sourceFile,
+		const std::vector<ShaderDefine>& defines,
+		const std::string& target,
+		unsigned long long* hash = 0);
+
+	// Reloads the shader whenever its source changes.  The target comes
+	// from the shader's current code, and a hash of 0 means unknown (it's
+	// found on the next check, without recompiling)
+	void Watch(
+		std::shared_ptr<ISimpleShader> shader,
+		const std::wstring& sourceFile,
+		const std::vector<ShaderDefine>& defines = std::vector<ShaderDefine>(),
+		unsigned long long hash = 0);
+
+	// Watches a shader loaded from a .cso, whose source is the .hlsl of
+	// the same name.  Returns the shader, so it can wrap a load
+	template<typename T>
+	std::shared_ptr<T> Watch(std::shared_ptr<T> shader, const std::wstring& compiledFile)
+	{
+		size_t dot = compiledFile.find_last_of(L'.');
+		if (shader && shader->IsShaderValid())
+			Watch(std::static_pointer_cast<ISimpleShader>(shader), compiledFile.substr(0, dot) + L".hlsl");
+		return shader;
+	}
+
+	// Swaps any reloaded shaders in.  Call on the main thread, when no
+	// other thread is using the shaders.  Returns how many changed
+	unsigned int Update();
+
+	void SetWatching(bool watching) { this->watching = watching; }
+	bool IsWatching() { return watching; }
+
+	unsigned int GetWatchedCount();
+	unsigned int GetReloadCount() { return reloadCount; }
+	std::string GetLastError();
+
+private:
+	struct WatchedShader
+	{
+		std::weak_ptr<ISimpleShader> Shader;
+		std::wstring SourceFile;
+		std::vector<ShaderDefine> Defines;
+		std::string Target;
+		unsigned long long Hash;
+	};
+
+	struct Reload
+	{
+		size_t Index;
+		Microsoft::WRL::ComPtr<ID3DBlob> Blob;
+	};
+
+	std::wstring sourceDirectory;
+	std::wstring cacheDirectory;
+
+	// Compiled code by hash, so permutations and reloads that come
+	// back to a version already seen skip the disk too
+	std::mutex cacheMutex;
+	std::unordered_map<unsigned long long, Microsoft::WRL::ComPtr<ID3DBlob>> memoryCache;
+
+	// Guards everything below, which the watch thread shares
+	std::mutex watchMutex;
+	std::vector<WatchedShader> watched;
+	std::vector<Reload> reloads;
+	std::string lastError;
+	unsigned int reloadCount;
+
+	std::thread watchThread;
+	std::condition_variable stopRequested;
+	bool stopping;
+	std::atomic<bool> watching;
+	std::unordered_map<std::wstring, unsigned long long> sourceWriteTimes;
+
+	void WatchMain();
+	bool SourcesChanged();
+	bool Preprocess(
+		const std::wstring& sourceFile,
+		const std::vector<ShaderDefine>& defines,
+		const std::string& target,
+		Microsoft::WRL::ComPtr<ID3DBlob>& preprocessed,
+		unsigned long long* hash);
+	void ReportError(const std::string& message);
+};
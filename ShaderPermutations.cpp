@@ -0,0 +1,129 @@
+#include "ShaderPermutations.h"
+#include "ClusteredLightCuller.h"
+
+#include <stdio.h>
+
+// The most lights a pixel loops over in each tier.  Small tiers let the
+// loop be unrolled, and the last covers whatever the clusters can hold
+static const unsigned int lightTierCaps[SHADER_LIGHT_TIER_COUNT] = { 8, 64, MAX_LIGHTS_PER_CLUSTER };
+
+ShaderPermutations::ShaderPermutations(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<ShaderManager> shaderManager,
+	std::wstring sourceFile,
+	std::shared_ptr<SimplePixelShader> fullShader,
+	unsigned int supportedFeatures)
+	:
+	device(device),
+	context(context),
+	shaderManager(shaderManager),
+	sourceFile(sourceFile),
+	fullShader(fullShader),
+	supportedFeatures(supportedFeatures & ~SHADER_FRAME_FEATURES),
+	frameFeatures(SHADER_FEATURE_SHADOWS | ((SHADER_LIGHT_TIER_COUNT - 1) << SHADER_LIGHT_TIER_SHIFT)),
+	version(1),
+	compiledCount(0),
+	failedCount(0)
+{
+}
+
+std::shared_ptr<SimplePixelShader> ShaderPermutations::GetPixelShader(unsigned int materialFeatures)
+{
+	unsigned int features = (materialFeatures & supportedFeatures) | frameFeatures;
+
+	auto it = permutations.find(features);
+	if (it != permutations.end())
+		return it->second;
+
+	// Failures are kept too (as the full shader), so they aren't retried
+	std::shared_ptr<SimplePixelShader> ps = Compile(features);
+	if (ps)
+	{
+		compiledCount++;
+		if (constantBufferRing) ps->SetConstantBufferRing(constantBufferRing);
+		for (auto& b : sharedBuffers)
+			ps->SetSharedConstantBuffer(b.first, b.second);
+	}
+	else
+	{
+		failedCount++;
+		ps = fullShader;
+	}
+
+	permutations.insert({ features, ps });
+	return ps;
+}
+
+void ShaderPermutations::SetFrameFeatures(bool shadows, unsigned int lightCount)
+{
+	unsigned int features =
+		(shadows ? SHADER_FEATURE_SHADOWS : 0) |
+		(GetLightTier(lightCount) << SHADER_LIGHT_TIER_SHIFT);
+
+	if (features == frameFeatures)
+		return;
+
+	frameFeatures = features;
+	version++;
+}
+
+void ShaderPermutations::SetSharedConstantBuffer(std::string bufferName, Microsoft::WRL::ComPtr<ID3D11Buffer> buffer)
+{
+	sharedBuffers.push_back({ bufferName, buffer });
+	fullShader->SetSharedConstantBuffer(bufferName, buffer);
+	for (auto& p : permutations)
+		p.second->SetSharedConstantBuffer(bufferName, buffer);
+}
+
+void ShaderPermutations::SetConstantBufferRing(std::shared_ptr<ConstantBufferRing> ring)
+{
+	constantBufferRing = ring;
+	fullShader->SetConstantBufferRing(ring);
+	for (auto& p : permutations)
+		p.second->SetConstantBufferRing(ring);
+}
+
+unsigned int ShaderPermutations::GetLightTier(unsigned int lightCount)
+{
+	for (unsigned int i = 0; i < SHADER_LIGHT_TIER_COUNT - 1; i++)
+	{
+		if (lightCount <= lightTierCaps[i])
+			return i;
+	}
+	return SHADER_LIGHT_TIER_COUNT - 1;
+}
+
+// Compiles the source with one define per feature bit, and watches the
+// result for changes.  Returns null (the manager prints the compiler's
+// errors) if it doesn't compile
+std::shared_ptr<SimplePixelShader> ShaderPermutations::Compile(unsigned int features)
+{
+	char lightCap[16];
+	sprintf_s(lightCap, "%u", lightTierCaps[(features & SHADER_LIGHT_TIER_MASK) >> SHADER_LIGHT_TIER_SHIFT]);
+
+	std::vector<ShaderDefine> defines =
+	{
+		{ "FEATURE_NORMAL_MAP",		(features & SHADER_FEATURE_NORMAL_MAP) ? "1" : "0" },
+		{ "FEATURE_ROUGHNESS_MAP",	(features & SHADER_FEATURE_ROUGHNESS_MAP) ? "1" : "0" },
+		{ "FEATURE_METAL_MAP",		(features & SHADER_FEATURE_METAL_MAP) ? "1" : "0" },
+		{ "FEATURE_IBL",			(features & SHADER_FEATURE_IBL) ? "1" : "0" },
+		{ "FEATURE_SHADOWS",		(features & SHADER_FEATURE_SHADOWS) ? "1" : "0" },
+		{ "MAX_LIGHTS_PER_PIXEL",	lightCap },
+	};
+
+	unsigned long long hash = 0;
+	Microsoft::WRL::ComPtr<ID3DBlob> blob = shaderManager->Compile(sourceFile, defines, "ps_5_0", &hash);
+	if (!blob)
+	{
+		printf("Shader permutation %02X of %ls failed to compile\n", features, sourceFile.c_str());
+		return nullptr;
+	}
+
+	std::shared_ptr<SimplePixelShader> ps = std::make_shared<SimplePixelShader>(device, context, blob);
+	if (!ps->IsShaderValid())
+		return nullptr;
+
+	shaderManager->Watch(ps, sourceFile, defines, hash);
+	return ps;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SimpleShader.h"
+#include "ConstantBufferRing.h"
+#include "ShaderManager.h"
+
+// Feature bits for lit pixel shader permutations.  Each one sets the
+// matching FEATURE_ macro in the shader to 1 (or 0 when left out)
+#define SHADER_FEATURE_NORMAL_MAP		(1 << 0)
+#define SHADER_FEATURE_ROUGHNESS_MAP	(1 << 1)
+#define SHADER_FEATURE_METAL_MAP		(1 << 2)
+#define SHADER_FEATURE_IBL				(1 << 3)
+#define SHADER_FEATURE_SHADOWS			(1 << 4)
+
+// The light count tier sits in the two bits above the features
+#define SHADER_LIGHT_TIER_SHIFT			5
+#define SHADER_LIGHT_TIER_MASK			(3 << SHADER_LIGHT_TIER_SHIFT)
+#define SHADER_LIGHT_TIER_COUNT			3
+
+// Features that come from the frame rather than from each material
+#define SHADER_FRAME_FEATURES			(SHADER_FEATURE_SHADOWS | SHADER_LIGHT_TIER_MASK)
+
+// --------------------------------------------------------
+// Specialized variants of one pixel shader source
+//
+// Each combination of feature bits is compiled from the
+// .hlsl source (through the ShaderManager, so its bytecode
+// cache and hot reload cover them) the first time it's
+// asked for, and kept for as long as this object lives.
+//
+// Materials supply the bits for the textures they have
+// (see Material), and the frame supplies the rest, like
+// whether shadows are on and how many lights there are.
+//
+// The precompiled shader has every feature turned on, and
+// stands in for any permutation that fails to compile,
+// like when the source isn't next to the executable (the
+// maps a material doesn't have then just read as zero).
+// --------------------------------------------------------
+class ShaderPermutations
+{
+public:
+	// supportedFeatures are the material bits the source actually has
+	// switches for - the rest are ignored, so they don't make duplicates.
+	// The source is relative to the manager's source directory
+	ShaderPermutations(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<ShaderManager> shaderManager,
+		std::wstring sourceFile,
+		std::shared_ptr<SimplePixelShader> fullShader,
+		unsigned int supportedFeatures);
+
+	// The permutation for the given material bits and this frame's bits,
+	// compiled now if it hasn't been yet
+	std::shared_ptr<SimplePixelShader> GetPixelShader(unsigned int materialFeatures);
+	std::shared_ptr<SimplePixelShader> GetFullShader() { return fullShader; }
+
+	// Shadows and the light count tier, shared by every permutation.  The
+	// version goes up whenever they change, so materials know to reselect
+	void SetFrameFeatures(bool shadows, unsigned int lightCount);
+	unsigned int GetFrameFeatures() { return frameFeatures; }
+	unsigned int GetVersion() { return version; }
+
+	// Set up on every permutation, including ones compiled later
+	void SetSharedConstantBuffer(std::string bufferName, Microsoft::WRL::ComPtr<ID3D11Buffer> buffer);
+	void SetConstantBufferRing(std::shared_ptr<ConstantBufferRing> ring);
+
+	unsigned int GetCompiledCount() { return compiledCount; }
+	unsigned int GetFailedCount() { return failedCount; }
+
+	// The smallest tier whose light cap covers the given number of lights
+	static unsigned int GetLightTier(unsigned int lightCount);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<ShaderManager> shaderManager;
+	std::wstring sourceFile;
+	std::shared_ptr<SimplePixelShader> fullShader;
+	unsigned int supportedFeatures;
+
+	unsigned int frameFeatures;
+	unsigned int version;
+	unsigned int compiledCount;
+	unsigned int failedCount;
+	std::unordered_map<unsigned int, std::shared_ptr<SimplePixelShader>> permutations;
+
+	std::vector<std::pair<std::string, Microsoft::WRL::ComPtr<ID3D11Buffer>>> sharedBuffers;
+	std::shared_ptr<ConstantBufferRing> constantBufferRing;
+
+	std::shared_ptr<SimplePixelShader> Compile(unsigned int features);
+};
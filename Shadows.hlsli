@@ -0,0 +1,53 @@
+// Include guard
+#ifndef _SHADOWS_HLSL
+#define _SHADOWS_HLSL
+
+// Must match MAX_SHADOW_CASCADES in Lights.h
+#define MAX_SHADOW_CASCADES 4
+
+// How much of a directional light reaches a point, from the light's
+// cascaded shadow map (see CascadedShadowMap).  Picks the first cascade
+// that reaches the point's view depth, and filters a 3x3 grid of
+// comparisons there.  Anything past the last cascade is fully lit
+float CascadedShadow(
+	Texture2DArray shadowMap,
+	SamplerComparisonState shadowSampler,
+	float4x4 shadowMatrices[MAX_SHADOW_CASCADES],
+	float4 splits,
+	float4 normalOffsets,
+	int cascadeCount,
+	float texelSize,
+	float3 worldPos,
+	float3 normal,
+	float viewDepth)
+{
+	int cascade = cascadeCount;
+	for (int i = cascadeCount - 1; i >= 0; i--)
+	{
+		if (viewDepth <= splits[i])
+			cascade = i;
+	}
+	if (cascade >= cascadeCount)
+		return 1.0f;
+
+	// Look up from a little way out along the normal (about a texel
+	// of this cascade), which keeps surfaces from shadowing themselves
+	float3 offsetPos = worldPos + normal * normalOffsets[cascade];
+	float4 shadowPos = mul(shadowMatrices[cascade], float4(offsetPos, 1));
+
+	// Each comparison is itself a bilinear 2x2 filter
+	float lit = 0.0f;
+	[unroll]
+	for (int y = -1; y <= 1; y++)
+	{
+		[unroll]
+		for (int x = -1; x <= 1; x++)
+		{
+			float2 uv = shadowPos.xy + float2(x, y) * texelSize;
+			lit += shadowMap.SampleCmpLevelZero(shadowSampler, float3(uv, cascade), shadowPos.z);
+		}
+	}
+	return lit / 9.0f;
+}
+
+#endif
@@ -11,6 +11,58 @@ bool ISimpleShader::ReportWarnings = false;
 // ISimpleShader::ReportErrors = true;
 // ISimpleShader::ReportWarnings = true;
 
+// The context (and staging slot) shaders use on this thread, while a
+// SimpleShaderContextScope is alive.  Null means the shader's own context
+struct SimpleShaderThreadContext
+{
+	unsigned int Slot;
+	ID3D11DeviceContext* Context;
+	ID3D11DeviceContext1* Context1;
+	ConstantBufferRing* Ring;
+};
+static thread_local SimpleShaderThreadContext threadContext = {};
+
+// --------------------------------------------------------
+// Sends this thread's shader commands to another context
+// until the scope ends.  Scopes can nest (a job waiting on
+// other jobs may run one), so the outer one is put back
+// --------------------------------------------------------
+SimpleShaderContextScope::SimpleShaderContextScope(unsigned int slot, ID3D11DeviceContext* context, ConstantBufferRing* ring)
+{
+	previousSlot = threadContext.Slot;
+	previousContext = threadContext.Context;
+	previousContext1 = threadContext.Context1;
+	previousRing = threadContext.Ring;
+
+	// Slot 0 always belongs to the shaders' own contexts
+	if (slot == 0 || slot >= SIMPLE_SHADER_MAX_CONTEXTS || !context)
+	{
+		active = false;
+		return;
+	}
+
+	threadContext.Slot = slot;
+	threadContext.Context = context;
+	threadContext.Ring = ring && ring->IsSupported() ? ring : 0;
+	if (FAILED(context->QueryInterface(IID_PPV_ARGS(&threadContext.Context1))))
+		threadContext.Context1 = 0;
+	active = true;
+}
+
+SimpleShaderContextScope::~SimpleShaderContextScope()
+{
+	if (!active)
+		return;
+
+	if (threadContext.Context1)
+		threadContext.Context1->Release();
+
+	threadContext.Slot = previousSlot;
+	threadContext.Context = previousContext;
+	threadContext.Context1 = previousContext1;
+	threadContext.Ring = previousRing;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // ------ BASE SIMPLE SHADER --------------------------------------------------
@@ -29,6 +81,7 @@ ISimpleShader::ISimpleShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Micros
 	this->constantBufferCount = 0;
 	this->constantBuffers = 0;
 	this->shaderValid = false;
+	this->reflectionVersion = 0;
 }
 
 // --------------------------------------------------------
@@ -54,6 +107,7 @@ void ISimpleShader::CleanUp()
 	if (constantBuffers)
 	{
 		delete[] constantBuffers;
+		constantBuffers = 0;
 		constantBufferCount = 0;
 	}
 
@@ -63,7 +117,12 @@ void ISimpleShader::CleanUp()
 	for (unsigned int i = 0; i < samplerStates.size(); i++)
 		delete samplerStates[i];
 
+	// Cleared too, since a reload builds them again from scratch
+	shaderResourceViews.clear();
+	samplerStates.clear();
+
 	// Clean up tables
+	variables.clear();
 	varTable.clear();
 	cbTable.clear();
 	samplerTable.clear();
@@ -94,20 +153,35 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
+	bool loaded = LoadShaderBlob(shaderBlob);
+	if (!loaded && ReportErrors)
+	{
+		LogError("SimpleShader::LoadShaderFile() - Error creating shader from file '");
+		LogW(shaderFile);
+		LogError("'. Ensure the type of shader (vertex, pixel, etc.) matches the SimpleShader type (SimpleVertexShader, SimplePixelShader, etc.) you're using.\n");
+	}
+
+	return loaded;
+}
+
+// --------------------------------------------------------
+// Creates the shader from already compiled code (from a file,
+// or compiled at runtime) and builds the variable table
+// using shader reflection.
+//
+// blob - The compiled shader code
+//
+// Returns true if shader is created properly, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::LoadShaderBlob(Microsoft::WRL::ComPtr<ID3DBlob> blob)
+{
+	shaderBlob = blob;
+
 	// Create the shader - Calls an overloaded version of this abstract
 	// method in the appropriate child class
 	shaderValid = CreateShader(shaderBlob);
 	if (!shaderValid)
-	{
-		if (ReportErrors)
-		{
-			LogError("SimpleShader::LoadShaderFile() - Error creating shader from file '");
-			LogW(shaderFile);
-			LogError("'. Ensure the type of shader (vertex, pixel, etc.) matches the SimpleShader type (SimpleVertexShader, SimplePixelShader, etc.) you're using.\n");
-		}
-
 		return false;
-	}
 
 	// Set up shader reflection to get information about
 	// this shader and its variables,  buffers, etc.
@@ -200,8 +274,8 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 
 		// Set up the data buffer for this constant buffer
 		constantBuffers[b].Size = bufferDesc.Size;
-		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
-		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size * SIMPLE_SHADER_MAX_CONTEXTS];
+		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size * SIMPLE_SHADER_MAX_CONTEXTS);
 
 		// Loop through all variables in this buffer
 		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
@@ -219,6 +293,7 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 			varStruct.ConstantBufferIndex = b;
 			varStruct.ByteOffset = varDesc.StartOffset;
 			varStruct.Size = varDesc.Size;
+			varStruct.Index = (unsigned int)variables.size();
 			
 			// Get a string version
 			std::string varName(varDesc.Name);
@@ -226,13 +301,50 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 			// Add this variable to the table and the constant buffer
 			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
 			constantBuffers[b].Variables.push_back(varStruct);
+			variables.push_back(varStruct);
 		}
 	}
 
+	// Any handles resolved against the old reflection data are now stale
+	reflectionVersion++;
+
 	// All set
 	return true;
 }
 
+// --------------------------------------------------------
+// Swaps new compiled code into this shader in place (like
+// after a source file changes), re-running reflection.
+// Shared constant buffers and the constant buffer ring are
+// kept, but handles and data set before are not, so anyone
+// holding handles should check GetReflectionVersion().
+//
+// blob - The new compiled code, for the same type of shader
+//
+// Returns true if the new code is in use, or false if it
+// couldn't be created (and the old code is still in use)
+// --------------------------------------------------------
+bool ISimpleShader::ReplaceShaderBlob(Microsoft::WRL::ComPtr<ID3DBlob> blob)
+{
+	// Shared buffers are set up from outside, so carry them over
+	std::vector<std::pair<std::string, Microsoft::WRL::ComPtr<ID3D11Buffer>>> shared;
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		if (constantBuffers[i].Shared)
+			shared.push_back({ constantBuffers[i].Name, constantBuffers[i].ConstantBuffer });
+	}
+
+	Microsoft::WRL::ComPtr<ID3DBlob> previous = shaderBlob;
+	bool replaced = LoadShaderBlob(blob);
+	if (!replaced && previous)
+		LoadShaderBlob(previous);
+
+	for (auto& s : shared)
+		SetSharedConstantBuffer(s.first, s.second);
+
+	return replaced;
+}
+
 // --------------------------------------------------------
 // Helper for looking up a variable by name and also
 // verifying that it is the requested size
@@ -348,10 +460,12 @@ void ISimpleShader::CopyAllBufferData()
 	// Loop through the constant buffers and copy all data
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
+		// Shared buffers are filled by their owner, not by us
+		if (constantBuffers[i].Shared)
+			continue;
+
 		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
+		UploadConstantBuffer(&constantBuffers[i]);
 	}
 }
 
@@ -377,12 +491,10 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
-	if (!cb) return;
+	if (!cb || cb->Shared) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	UploadConstantBuffer(cb);
 }
 
 // --------------------------------------------------------
@@ -399,12 +511,162 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
-	if (!cb) return;
+	if (!cb || cb->Shared) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	UploadConstantBuffer(cb);
+}
+
+// --------------------------------------------------------
+// Copies a buffer's local data to the GPU.  With a ring, the
+// data goes to the ring's next chunk, which is then bound in
+// place of this shader's own buffer.  Otherwise (or if the
+// ring is full this frame) the shader's own buffer is updated.
+// --------------------------------------------------------
+void ISimpleShader::UploadConstantBuffer(SimpleConstantBuffer* cb)
+{
+	ConstantBufferRing* ring = GetConstantBufferRing();
+	if (ring && cb->Type == D3D11_CT_CBUFFER)
+	{
+		unsigned int firstConstant = 0;
+		unsigned int numConstants = 0;
+		if (ring->Allocate(GetLocalData(cb), cb->Size, &firstConstant, &numConstants))
+		{
+			BindConstantBuffer(cb->BindIndex, ring->GetBuffer(), &firstConstant, &numConstants);
+			return;
+		}
+	}
+
+	GetContext()->UpdateSubresource(
+		cb->ConstantBuffer.Get(), 0, 0,
+		GetLocalData(cb), 0, 0);
+
+	// The slot may still hold a ring chunk from an earlier upload
+	if (constantBufferRing && cb->Type == D3D11_CT_CBUFFER)
+		BindConstantBuffer(cb->BindIndex, cb->ConstantBuffer.Get(), 0, 0);
+}
+
+// --------------------------------------------------------
+// Has this shader upload its constant buffers through the
+// given ring.  SetShader() still binds the shader's own
+// buffers, so the ring's chunks are only bound once data is
+// copied - always set the shader before copying its data.
+//
+// ring - A ring that IsSupported(), or null to go back to
+//        this shader's own buffers
+// --------------------------------------------------------
+void ISimpleShader::SetConstantBufferRing(std::shared_ptr<ConstantBufferRing> ring)
+{
+	if (ring && !ring->IsSupported())
+	{
+		if (ReportWarnings)
+			LogWarning("SimpleShader::SetConstantBufferRing() - The ring isn't supported on this device, so this shader will keep using its own constant buffers.\n");
+		ring.reset();
+	}
+
+	constantBufferRing = ring;
+	deviceContext1 = ring ? ring->GetContext1() : 0;
+}
+
+// --------------------------------------------------------
+// The context commands go to on the calling thread: one from
+// a SimpleShaderContextScope, or the shader's own
+// --------------------------------------------------------
+ID3D11DeviceContext* ISimpleShader::GetContext()
+{
+	return threadContext.Context ? threadContext.Context : deviceContext.Get();
+}
+
+// --------------------------------------------------------
+// The 11.1 context for binding ring chunks, which is only
+// used by shaders with a ring
+// --------------------------------------------------------
+ID3D11DeviceContext1* ISimpleShader::GetContext1()
+{
+	if (!constantBufferRing)
+		return 0;
+	return threadContext.Context ? threadContext.Context1 : deviceContext1.Get();
+}
+
+// --------------------------------------------------------
+// The ring to upload to on the calling thread, if this
+// shader uses one.  Threads in a scope without a ring fall
+// back to the shader's own buffers
+// --------------------------------------------------------
+ConstantBufferRing* ISimpleShader::GetConstantBufferRing()
+{
+	if (!constantBufferRing)
+		return 0;
+	return threadContext.Context ? threadContext.Ring : constantBufferRing.get();
+}
+
+// --------------------------------------------------------
+// The calling thread's copy of a constant buffer's local
+// data.  Each buffer holds one copy per context slot
+// --------------------------------------------------------
+unsigned char* ISimpleShader::GetLocalData(SimpleConstantBuffer* cb)
+{
+	return cb->LocalDataBuffer + (size_t)cb->Size * threadContext.Slot;
+}
+
+// --------------------------------------------------------
+// Replaces the specified constant buffer with an externally
+// owned buffer.  The buffer will still be bound by SetShader(),
+// but its contents are never copied from this shader's local
+// data, so CopyAllBufferData() and CopyBufferData() skip it.
+//
+// This allows several shaders that declare the same cbuffer
+// (such as "perFrame") to share one buffer that is filled
+// exactly once per frame by its owner.
+//
+// bufferName - The name of the cbuffer in the shader
+// buffer     - The external buffer, which must be at least as
+//              large as the cbuffer declared in the shader
+//
+// Returns true if the buffer was found and replaced
+// --------------------------------------------------------
+bool ISimpleShader::SetSharedConstantBuffer(std::string bufferName, Microsoft::WRL::ComPtr<ID3D11Buffer> buffer)
+{
+	// Look for the buffer
+	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
+	if (!cb || !buffer)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::SetSharedConstantBuffer() - Constant buffer '");
+			Log(bufferName);
+			LogWarning("' not found. Ensure the name is spelled correctly and that it exists in the shader.\n");
+		}
+		return false;
+	}
+
+	// Verify the external buffer can hold everything the shader expects
+	D3D11_BUFFER_DESC desc = {};
+	buffer->GetDesc(&desc);
+	if (desc.ByteWidth < cb->Size)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::SetSharedConstantBuffer() - Shared buffer for '");
+			Log(bufferName);
+			LogWarning("' is smaller than the cbuffer declared in the shader.\n");
+		}
+		return false;
+	}
+
+	// Swap in the external buffer
+	cb->ConstantBuffer = buffer;
+	cb->Shared = true;
+	return true;
+}
+
+// --------------------------------------------------------
+// Determines if the specified constant buffer is shared
+// --------------------------------------------------------
+bool ISimpleShader::IsConstantBufferShared(std::string bufferName)
+{
+	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
+	return cb != 0 && cb->Shared;
 }
 
 
@@ -447,7 +709,7 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 
 	// Set the data in the local data buffer
 	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
+		GetLocalData(&constantBuffers[var->ConstantBufferIndex]) + var->ByteOffset,
 		data,
 		size);
 
@@ -535,6 +797,166 @@ bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 dat
 	return this->SetData(name, &data, sizeof(float) * 16);
 }
 
+// --------------------------------------------------------
+// Gets a handle to a variable, which can be used to set it
+// later without a string lookup.  Returns an invalid
+// handle if the variable doesn't exist.
+// --------------------------------------------------------
+SimpleShaderHandle ISimpleShader::GetVariableHandle(std::string name)
+{
+	SimpleShaderHandle handle;
+	SimpleShaderVariable* var = FindVariable(name, -1);
+	if (var != 0)
+		handle.Index = (int)var->Index;
+	return handle;
+}
+
+// --------------------------------------------------------
+// Gets a handle to an SRV (or an invalid handle)
+// --------------------------------------------------------
+SimpleShaderHandle ISimpleShader::GetShaderResourceViewHandle(std::string name)
+{
+	SimpleShaderHandle handle;
+	const SimpleSRV* srv = GetShaderResourceViewInfo(name);
+	if (srv != 0)
+		handle.Index = (int)srv->Index;
+	return handle;
+}
+
+// --------------------------------------------------------
+// Gets a handle to a sampler (or an invalid handle)
+// --------------------------------------------------------
+SimpleShaderHandle ISimpleShader::GetSamplerHandle(std::string name)
+{
+	SimpleShaderHandle handle;
+	const SimpleSampler* samp = GetSamplerInfo(name);
+	if (samp != 0)
+		handle.Index = (int)samp->Index;
+	return handle;
+}
+
+// --------------------------------------------------------
+// Sets any type of data by handle
+//
+// handle - A handle from GetVariableHandle()
+// data - The data to set in the buffer
+// size - The size of the data (this must be less than or equal to the variable's size)
+//
+// Returns true if data is copied, false if the handle is invalid
+// --------------------------------------------------------
+bool ISimpleShader::SetData(SimpleShaderHandle handle, const void* data, unsigned int size)
+{
+	// Verify the handle - an invalid one is silently ignored,
+	// since the name was already reported when it was resolved
+	if (!handle.IsValid() || handle.Index >= (int)variables.size())
+		return false;
+
+	const SimpleShaderVariable& var = variables[handle.Index];
+	if (size > var.Size)
+	{
+		if (ReportWarnings)
+			LogWarning("SimpleShader::SetData() - Data is larger than the variable referenced by the handle.\n");
+		return false;
+	}
+
+	// Set the data in the local data buffer
+	memcpy(
+		GetLocalData(&constantBuffers[var.ConstantBufferIndex]) + var.ByteOffset,
+		data,
+		size);
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Typed setters by handle
+// --------------------------------------------------------
+bool ISimpleShader::SetInt(SimpleShaderHandle handle, int data)
+{
+	return this->SetData(handle, &data, sizeof(int));
+}
+
+bool ISimpleShader::SetFloat(SimpleShaderHandle handle, float data)
+{
+	return this->SetData(handle, &data, sizeof(float));
+}
+
+bool ISimpleShader::SetFloat2(SimpleShaderHandle handle, const DirectX::XMFLOAT2 data)
+{
+	return this->SetData(handle, &data, sizeof(float) * 2);
+}
+
+bool ISimpleShader::SetFloat3(SimpleShaderHandle handle, const DirectX::XMFLOAT3 data)
+{
+	return this->SetData(handle, &data, sizeof(float) * 3);
+}
+
+bool ISimpleShader::SetFloat4(SimpleShaderHandle handle, const DirectX::XMFLOAT4 data)
+{
+	return this->SetData(handle, &data, sizeof(float) * 4);
+}
+
+bool ISimpleShader::SetMatrix4x4(SimpleShaderHandle handle, const DirectX::XMFLOAT4X4& data)
+{
+	return this->SetData(handle, &data, sizeof(float) * 16);
+}
+
+// --------------------------------------------------------
+// Sets a shader resource view by handle in this shader's stage
+//
+// handle - A handle from GetShaderResourceViewHandle()
+// srv - The shader resource view to bind
+// --------------------------------------------------------
+bool ISimpleShader::SetShaderResourceView(SimpleShaderHandle handle, ID3D11ShaderResourceView* srv)
+{
+	if (!handle.IsValid() || handle.Index >= (int)shaderResourceViews.size())
+		return false;
+
+	BindShaderResourceViews(shaderResourceViews[handle.Index]->BindIndex, 1, &srv);
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state by handle in this shader's stage
+//
+// handle - A handle from GetSamplerHandle()
+// samplerState - The sampler state to bind
+// --------------------------------------------------------
+bool ISimpleShader::SetSamplerState(SimpleShaderHandle handle, ID3D11SamplerState* samplerState)
+{
+	if (!handle.IsValid() || handle.Index >= (int)samplerStates.size())
+		return false;
+
+	BindSamplerStates(samplerStates[handle.Index]->BindIndex, 1, &samplerState);
+	return true;
+}
+
+// --------------------------------------------------------
+// Binds several SRVs to consecutive slots with one call
+//
+// startSlot - The first register (t#) to bind to
+// count - The number of SRVs in the array
+// srvs - The SRVs, in register order
+// --------------------------------------------------------
+void ISimpleShader::SetShaderResourceViewRange(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	if (!shaderValid || count == 0) return;
+	BindShaderResourceViews(startSlot, count, srvs);
+}
+
+// --------------------------------------------------------
+// Binds several samplers to consecutive slots with one call
+//
+// startSlot - The first register (s#) to bind to
+// count - The number of samplers in the array
+// samplerStates - The samplers, in register order
+// --------------------------------------------------------
+void ISimpleShader::SetSamplerStateRange(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates)
+{
+	if (!shaderValid || count == 0) return;
+	BindSamplerStates(startSlot, count, samplerStates);
+}
+
 // --------------------------------------------------------
 // Determines if the shader contains the specified
 // variable within one of its constant buffers
@@ -697,6 +1119,7 @@ SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> devi
 	// Ensure we set to zero to successfully trigger
 	// the Input Layout creation during LoadShaderFile()
 	this->perInstanceCompatible = false;
+	this->customInputLayout = false;
 
 	// Load the actual compiled shader file
 	this->LoadShaderFile(shaderFile);
@@ -713,6 +1136,7 @@ SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> devi
 {
 	// Save the custom input layout
 	this->inputLayout = inputLayout;
+	this->customInputLayout = inputLayout != 0;
 
 	// Unable to determine from an input layout, require user to tell us
 	this->perInstanceCompatible = perInstanceCompatible;
@@ -755,7 +1179,7 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		shader.ReleaseAndGetAddressOf());
 
 	// Did the creation work?
 	if (result != S_OK)
@@ -763,9 +1187,13 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 
 	// Do we already have an input layout?
 	// (This would come from one of the constructor overloads)
-	if (inputLayout)
+	if (customInputLayout)
 		return true;
 
+	// Otherwise it's rebuilt to match the new code
+	inputLayout.Reset();
+	perInstanceCompatible = false;
+
 	// Vertex shader was created successfully, so we now use the
 	// shader code to re-reflect and create an input layout that 
 	// matches what the vertex shader expects.  Code adapted from:
@@ -790,6 +1218,11 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
 		refl->GetInputParameterDesc(i, &paramDesc);
 
+		// System values (like SV_VertexID) come from the input
+		// assembler itself, not from a vertex buffer
+		if (paramDesc.SystemValueType != D3D_NAME_UNDEFINED)
+			continue;
+
 		// Check the semantic name for "_PER_INSTANCE"
 		std::string perInstanceStr = "_PER_INSTANCE";
 		std::string sem = paramDesc.SemanticName;
@@ -847,6 +1280,11 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 		inputLayoutDesc.push_back(elementDesc);
 	}
 
+	// Shaders that read no vertex data (like a fullscreen
+	// triangle made from vertex IDs) draw with no layout
+	if (inputLayoutDesc.empty())
+		return true;
+
 	// Try to create Input Layout
 	HRESULT hr = device->CreateInputLayout(
 		&inputLayoutDesc[0], 
@@ -869,8 +1307,8 @@ void SimpleVertexShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	GetContext()->IASetInputLayout(inputLayout.Get());
+	GetContext()->VSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -880,13 +1318,42 @@ void SimpleVertexShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
+		GetContext()->VSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Binds SRVs directly to slots in the vertex shader stage
+// --------------------------------------------------------
+void SimpleVertexShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	GetContext()->VSSetShaderResources(startSlot, count, srvs);
+}
+
+// --------------------------------------------------------
+// Binds samplers directly to slots in the vertex shader stage
+// --------------------------------------------------------
+void SimpleVertexShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates)
+{
+	GetContext()->VSSetSamplers(startSlot, count, samplerStates);
+}
+
+// --------------------------------------------------------
+// Binds a constant buffer (or a range of one, using the
+// D3D11.1 context) to a slot in the vertex shader stage
+// --------------------------------------------------------
+void SimpleVertexShader::BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants)
+{
+	ID3D11DeviceContext1* context1 = GetContext1();
+	if (context1)
+		context1->VSSetConstantBuffers1(bindIndex, 1, &buffer, firstConstant, numConstants);
+	else
+		GetContext()->VSSetConstantBuffers(bindIndex, 1, &buffer);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the vertex shader stage
 //
@@ -911,7 +1378,7 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -941,7 +1408,7 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -962,6 +1429,16 @@ SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device
 	this->LoadShaderFile(shaderFile);
 }
 
+// --------------------------------------------------------
+// Constructor - Creates the shader from compiled code that's
+// already in memory, such as a permutation compiled at runtime
+// --------------------------------------------------------
+SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
+	: ISimpleShader(device, context)
+{
+	this->LoadShaderBlob(shaderBlob);
+}
+
 // --------------------------------------------------------
 // Destructor - Clean up actual shader (base will be called automatically)
 // --------------------------------------------------------
@@ -996,7 +1473,7 @@ bool SimplePixelShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		shader.ReleaseAndGetAddressOf());
 
 	// Check the result
 	return (result == S_OK);
@@ -1012,7 +1489,7 @@ void SimplePixelShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	GetContext()->PSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1022,13 +1499,42 @@ void SimplePixelShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
+		GetContext()->PSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Binds SRVs directly to slots in the pixel shader stage
+// --------------------------------------------------------
+void SimplePixelShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	GetContext()->PSSetShaderResources(startSlot, count, srvs);
+}
+
+// --------------------------------------------------------
+// Binds samplers directly to slots in the pixel shader stage
+// --------------------------------------------------------
+void SimplePixelShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates)
+{
+	GetContext()->PSSetSamplers(startSlot, count, samplerStates);
+}
+
+// --------------------------------------------------------
+// Binds a constant buffer (or a range of one, using the
+// D3D11.1 context) to a slot in the pixel shader stage
+// --------------------------------------------------------
+void SimplePixelShader::BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants)
+{
+	ID3D11DeviceContext1* context1 = GetContext1();
+	if (context1)
+		context1->PSSetConstantBuffers1(bindIndex, 1, &buffer, firstConstant, numConstants);
+	else
+		GetContext()->PSSetConstantBuffers(bindIndex, 1, &buffer);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the pixel shader stage
 //
@@ -1053,7 +1559,7 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1083,7 +1589,7 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1140,7 +1646,7 @@ bool SimpleDomainShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		shader.ReleaseAndGetAddressOf());
 
 	// Check the result
 	return (result == S_OK);
@@ -1156,7 +1662,7 @@ void SimpleDomainShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->DSSetShader(shader.Get(), 0, 0);
+	GetContext()->DSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1166,13 +1672,42 @@ void SimpleDomainShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->DSSetConstantBuffers(
+		GetContext()->DSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Binds SRVs directly to slots in the domain shader stage
+// --------------------------------------------------------
+void SimpleDomainShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	GetContext()->DSSetShaderResources(startSlot, count, srvs);
+}
+
+// --------------------------------------------------------
+// Binds samplers directly to slots in the domain shader stage
+// --------------------------------------------------------
+void SimpleDomainShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates)
+{
+	GetContext()->DSSetSamplers(startSlot, count, samplerStates);
+}
+
+// --------------------------------------------------------
+// Binds a constant buffer (or a range of one, using the
+// D3D11.1 context) to a slot in the domain shader stage
+// --------------------------------------------------------
+void SimpleDomainShader::BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants)
+{
+	ID3D11DeviceContext1* context1 = GetContext1();
+	if (context1)
+		context1->DSSetConstantBuffers1(bindIndex, 1, &buffer, firstConstant, numConstants);
+	else
+		GetContext()->DSSetConstantBuffers(bindIndex, 1, &buffer);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the domain shader stage
 //
@@ -1197,7 +1732,7 @@ bool SimpleDomainShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->DSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1227,7 +1762,7 @@ bool SimpleDomainShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->DSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1283,7 +1818,7 @@ bool SimpleHullShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		shader.ReleaseAndGetAddressOf());
 
 	// Check the result
 	return (result == S_OK);
@@ -1299,7 +1834,7 @@ void SimpleHullShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->HSSetShader(shader.Get(), 0, 0);
+	GetContext()->HSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1309,13 +1844,42 @@ void SimpleHullShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->HSSetConstantBuffers(
+		GetContext()->HSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Binds SRVs directly to slots in the hull shader stage
+// --------------------------------------------------------
+void SimpleHullShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	GetContext()->HSSetShaderResources(startSlot, count, srvs);
+}
+
+// --------------------------------------------------------
+// Binds samplers directly to slots in the hull shader stage
+// --------------------------------------------------------
+void SimpleHullShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates)
+{
+	GetContext()->HSSetSamplers(startSlot, count, samplerStates);
+}
+
+// --------------------------------------------------------
+// Binds a constant buffer (or a range of one, using the
+// D3D11.1 context) to a slot in the hull shader stage
+// --------------------------------------------------------
+void SimpleHullShader::BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants)
+{
+	ID3D11DeviceContext1* context1 = GetContext1();
+	if (context1)
+		context1->HSSetConstantBuffers1(bindIndex, 1, &buffer, firstConstant, numConstants);
+	else
+		GetContext()->HSSetConstantBuffers(bindIndex, 1, &buffer);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the hull shader stage
 //
@@ -1340,7 +1904,7 @@ bool SimpleHullShader::SetShaderResourceView(std::string name, Microsoft::WRL::C
 	}
 
 	// Set the shader resource view
-	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->HSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1370,7 +1934,7 @@ bool SimpleHullShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<
 	}
 
 	// Set the shader resource view
-	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->HSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1435,7 +1999,7 @@ bool SimpleGeometryShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderB
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		shader.ReleaseAndGetAddressOf());
 
 	// Check the result
 	return (result == S_OK);
@@ -1507,7 +2071,7 @@ bool SimpleGeometryShader::CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3D
 		0,                              // No buffer strides
 		rast,                           // Index of the stream to rasterize (if any)
 		NULL,                           // Not using class linkage
-		shader.GetAddressOf());
+		shader.ReleaseAndGetAddressOf());
 	
 	return (result == S_OK);
 }
@@ -1573,7 +2137,7 @@ void SimpleGeometryShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->GSSetShader(shader.Get(), 0, 0);
+	GetContext()->GSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1583,13 +2147,42 @@ void SimpleGeometryShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->GSSetConstantBuffers(
+		GetContext()->GSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Binds SRVs directly to slots in the geometry shader stage
+// --------------------------------------------------------
+void SimpleGeometryShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	GetContext()->GSSetShaderResources(startSlot, count, srvs);
+}
+
+// --------------------------------------------------------
+// Binds samplers directly to slots in the geometry shader stage
+// --------------------------------------------------------
+void SimpleGeometryShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates)
+{
+	GetContext()->GSSetSamplers(startSlot, count, samplerStates);
+}
+
+// --------------------------------------------------------
+// Binds a constant buffer (or a range of one, using the
+// D3D11.1 context) to a slot in the geometry shader stage
+// --------------------------------------------------------
+void SimpleGeometryShader::BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants)
+{
+	ID3D11DeviceContext1* context1 = GetContext1();
+	if (context1)
+		context1->GSSetConstantBuffers1(bindIndex, 1, &buffer, firstConstant, numConstants);
+	else
+		GetContext()->GSSetConstantBuffers(bindIndex, 1, &buffer);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the Geometry shader stage
 //
@@ -1614,7 +2207,7 @@ bool SimpleGeometryShader::SetShaderResourceView(std::string name, Microsoft::WR
 	}
 
 	// Set the shader resource view
-	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->GSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1644,7 +2237,7 @@ bool SimpleGeometryShader::SetSamplerState(std::string name, Microsoft::WRL::Com
 	}
 
 	// Set the shader resource view
-	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->GSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1724,7 +2317,7 @@ bool SimpleComputeShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBl
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		shader.ReleaseAndGetAddressOf());
 
 	// Was the shader created correctly?
 	if (result != S_OK)
@@ -1783,7 +2376,7 @@ void SimpleComputeShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->CSSetShader(shader.Get(), 0, 0);
+	GetContext()->CSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1793,7 +2386,7 @@ void SimpleComputeShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->CSSetConstantBuffers(
+		GetContext()->CSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1822,7 +2415,7 @@ void SimpleComputeShader::SetShaderAndCBs()
 // --------------------------------------------------------
 void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
 {
-	deviceContext->Dispatch(groupsX, groupsY, groupsZ);
+	GetContext()->Dispatch(groupsX, groupsY, groupsZ);
 }
 
 // --------------------------------------------------------
@@ -1847,7 +2440,7 @@ void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int gr
 // --------------------------------------------------------
 void SimpleComputeShader::DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ)
 {
-	deviceContext->Dispatch(
+	GetContext()->Dispatch(
 		max((unsigned int)ceil((float)threadsX / this->threadsX), 1),
 		max((unsigned int)ceil((float)threadsY / this->threadsY), 1),
 		max((unsigned int)ceil((float)threadsZ / this->threadsZ), 1));
@@ -1861,6 +2454,35 @@ bool SimpleComputeShader::HasUnorderedAccessView(std::string name)
 	return GetUnorderedAccessViewIndex(name) != -1;
 }
 
+// --------------------------------------------------------
+// Binds SRVs directly to slots in the compute shader stage
+// --------------------------------------------------------
+void SimpleComputeShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	GetContext()->CSSetShaderResources(startSlot, count, srvs);
+}
+
+// --------------------------------------------------------
+// Binds samplers directly to slots in the compute shader stage
+// --------------------------------------------------------
+void SimpleComputeShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates)
+{
+	GetContext()->CSSetSamplers(startSlot, count, samplerStates);
+}
+
+// --------------------------------------------------------
+// Binds a constant buffer (or a range of one, using the
+// D3D11.1 context) to a slot in the compute shader stage
+// --------------------------------------------------------
+void SimpleComputeShader::BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants)
+{
+	ID3D11DeviceContext1* context1 = GetContext1();
+	if (context1)
+		context1->CSSetConstantBuffers1(bindIndex, 1, &buffer, firstConstant, numConstants);
+	else
+		GetContext()->CSSetConstantBuffers(bindIndex, 1, &buffer);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the Compute shader stage
 //
@@ -1885,7 +2507,7 @@ bool SimpleComputeShader::SetShaderResourceView(std::string name, Microsoft::WRL
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->CSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1915,7 +2537,7 @@ bool SimpleComputeShader::SetSamplerState(std::string name, Microsoft::WRL::ComP
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->CSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1946,12 +2568,38 @@ bool SimpleComputeShader::SetUnorderedAccessView(std::string name, Microsoft::WR
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetUnorderedAccessViews(bindIndex, 1, uav.GetAddressOf(), &appendConsumeOffset);
+	GetContext()->CSSetUnorderedAccessViews(bindIndex, 1, uav.GetAddressOf(), &appendConsumeOffset);
 
 	// Success
 	return true;
 }
 
+// --------------------------------------------------------
+// Gets a handle to a UAV (or an invalid handle)
+// --------------------------------------------------------
+SimpleShaderHandle SimpleComputeShader::GetUnorderedAccessViewHandle(std::string name)
+{
+	SimpleShaderHandle handle;
+	handle.Index = GetUnorderedAccessViewIndex(name);
+	return handle;
+}
+
+// --------------------------------------------------------
+// Sets an unordered access view by handle
+//
+// handle - A handle from GetUnorderedAccessViewHandle()
+// uav - The UAV to bind
+// appendConsumeOffset - Used for append or consume UAV's (optional)
+// --------------------------------------------------------
+bool SimpleComputeShader::SetUnorderedAccessView(SimpleShaderHandle handle, ID3D11UnorderedAccessView* uav, unsigned int appendConsumeOffset)
+{
+	if (!handle.IsValid())
+		return false;
+
+	GetContext()->CSSetUnorderedAccessViews(handle.Index, 1, &uav, &appendConsumeOffset);
+	return true;
+}
+
 // --------------------------------------------------------
 // Gets the index of the specified UAV (or -1)
 // --------------------------------------------------------
@@ -10,6 +10,13 @@
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <memory>
+
+#include "ConstantBufferRing.h"
+
+// Copies of each constant buffer's local data: one for the shader's
+// own context, and one for each SimpleShaderContextScope slot
+#define SIMPLE_SHADER_MAX_CONTEXTS 17
 
 
 // --------------------------------------------------------
@@ -21,6 +28,19 @@ struct SimpleShaderVariable
 	unsigned int ByteOffset;
 	unsigned int Size;
 	unsigned int ConstantBufferIndex;
+	unsigned int Index;		// The raw index of the variable (used by handles)
+};
+
+// --------------------------------------------------------
+// A pre-resolved reference to a variable, SRV or sampler,
+// so it can be set repeatedly without any string lookups.
+// Handles are only valid for the shader that created them,
+// until that shader's reflection version changes
+// --------------------------------------------------------
+struct SimpleShaderHandle
+{
+	int Index = -1;
+	bool IsValid() const { return Index >= 0; }
 };
 
 // --------------------------------------------------------
@@ -35,7 +55,8 @@ struct SimpleConstantBuffer
 	unsigned int Size = 0;
 	unsigned int BindIndex = 0;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
-	unsigned char* LocalDataBuffer = 0;
+	unsigned char* LocalDataBuffer = 0; // Size bytes per context slot
+	bool Shared = false; // Buffer is owned and filled externally (see SetSharedConstantBuffer)
 	std::vector<SimpleShaderVariable> Variables;
 };
 
@@ -57,6 +78,37 @@ struct SimpleSampler
 	unsigned int BindIndex; // The register of the Sampler
 };
 
+// --------------------------------------------------------
+// While alive, sends every shader's commands on the calling
+// thread to another context (like a worker's deferred
+// context) instead of the one it was created with.
+//
+// Constant data set on this thread goes to its own copy of
+// each buffer, picked by slot (1 to SIMPLE_SHADER_MAX_CONTEXTS
+// - 1), so several threads can record with the same shaders.
+// Each slot must only be used by one thread at a time, and
+// starts with whatever that slot last held - so set every
+// variable a draw needs on the recording thread.  Shaders
+// that use a constant buffer ring upload to the given ring
+// instead (or to their own buffers, without one).
+// --------------------------------------------------------
+class SimpleShaderContextScope
+{
+public:
+	SimpleShaderContextScope(unsigned int slot, ID3D11DeviceContext* context, ConstantBufferRing* ring);
+	~SimpleShaderContextScope();
+
+	SimpleShaderContextScope(const SimpleShaderContextScope&) = delete;
+	SimpleShaderContextScope& operator=(const SimpleShaderContextScope&) = delete;
+
+private:
+	bool active;
+	unsigned int previousSlot;
+	ID3D11DeviceContext* previousContext;
+	ID3D11DeviceContext1* previousContext1;
+	ConstantBufferRing* previousRing;
+};
+
 // --------------------------------------------------------
 // Base abstract class for simplifying shader handling
 // --------------------------------------------------------
@@ -75,6 +127,15 @@ public:
 	void CopyBufferData(unsigned int index);
 	void CopyBufferData(std::string bufferName);
 
+	// Replaces one of this shader's constant buffers with an externally
+	// owned buffer (like a per-frame buffer shared by many shaders)
+	bool SetSharedConstantBuffer(std::string bufferName, Microsoft::WRL::ComPtr<ID3D11Buffer> buffer);
+	bool IsConstantBufferShared(std::string bufferName);
+
+	// Uploads constant buffer data to chunks of a shared ring buffer
+	// instead of this shader's own buffers (null to stop)
+	void SetConstantBufferRing(std::shared_ptr<ConstantBufferRing> ring);
+
 	// Sets arbitrary shader data
 	bool SetData(std::string name, const void* data, unsigned int size);
 
@@ -89,9 +150,32 @@ public:
 	bool SetMatrix4x4(std::string name, const float data[16]);
 	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
 
+	// Resolving names to handles, once, ahead of time
+	SimpleShaderHandle GetVariableHandle(std::string name);
+	SimpleShaderHandle GetShaderResourceViewHandle(std::string name);
+	SimpleShaderHandle GetSamplerHandle(std::string name);
+	unsigned int GetReflectionVersion() { return reflectionVersion; }
+
+	// Sets shader data by handle, with no lookups
+	bool SetData(SimpleShaderHandle handle, const void* data, unsigned int size);
+
+	bool SetInt(SimpleShaderHandle handle, int data);
+	bool SetFloat(SimpleShaderHandle handle, float data);
+	bool SetFloat2(SimpleShaderHandle handle, const DirectX::XMFLOAT2 data);
+	bool SetFloat3(SimpleShaderHandle handle, const DirectX::XMFLOAT3 data);
+	bool SetFloat4(SimpleShaderHandle handle, const DirectX::XMFLOAT4 data);
+	bool SetMatrix4x4(SimpleShaderHandle handle, const DirectX::XMFLOAT4X4& data);
+
 	// Setting shader resources
 	virtual bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
 	virtual bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) = 0;
+	bool SetShaderResourceView(SimpleShaderHandle handle, ID3D11ShaderResourceView* srv);
+	bool SetSamplerState(SimpleShaderHandle handle, ID3D11SamplerState* samplerState);
+
+	// Binds a contiguous range of register slots in one call, such as a
+	// material's textures (use the BindIndex from the resource info)
+	void SetShaderResourceViewRange(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void SetSamplerStateRange(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates);
 
 	// Simple resource checking
 	bool HasVariable(std::string name);
@@ -118,6 +202,9 @@ public:
 	// Misc getters
 	Microsoft::WRL::ComPtr<ID3DBlob> GetShaderBlob() { return shaderBlob; }
 
+	// Swaps in new compiled code, such as after a hot reload
+	bool ReplaceShaderBlob(Microsoft::WRL::ComPtr<ID3DBlob> blob);
+
 	// Error reporting
 	static bool ReportErrors;
 	static bool ReportWarnings;
@@ -125,9 +212,12 @@ public:
 protected:
 	
 	bool shaderValid;
+	unsigned int reflectionVersion;
 	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> deviceContext1;
+	std::shared_ptr<ConstantBufferRing> constantBufferRing;
 
 	// Resource counts
 	unsigned int constantBufferCount;
@@ -136,18 +226,35 @@ protected:
 	SimpleConstantBuffer*		constantBuffers; // For index-based lookup
 	std::vector<SimpleSRV*>		shaderResourceViews;
 	std::vector<SimpleSampler*>	samplerStates;
+	std::vector<SimpleShaderVariable> variables; // For handle-based lookup
 	std::unordered_map<std::string, SimpleConstantBuffer*> cbTable;
 	std::unordered_map<std::string, SimpleShaderVariable> varTable;
 	std::unordered_map<std::string, SimpleSRV*> textureTable;
 	std::unordered_map<std::string, SimpleSampler*> samplerTable;
 
-	// Initialization method
+	// Initialization methods
 	bool LoadShaderFile(LPCWSTR shaderFile);
+	bool LoadShaderBlob(Microsoft::WRL::ComPtr<ID3DBlob> blob);
 
 	// Pure virtual functions for dealing with shader types
 	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0;
 	virtual void SetShaderAndCBs() = 0;
 
+	// Binds resources directly to this shader's stage
+	virtual void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs) = 0;
+	virtual void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates) = 0;
+	virtual void BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants) = 0;
+
+	// Copies a constant buffer's local data to the GPU
+	void UploadConstantBuffer(SimpleConstantBuffer* cb);
+
+	// Where the calling thread's commands and data go (see
+	// SimpleShaderContextScope)
+	ID3D11DeviceContext* GetContext();
+	ID3D11DeviceContext1* GetContext1();
+	ConstantBufferRing* GetConstantBufferRing();
+	unsigned char* GetLocalData(SimpleConstantBuffer* cb);
+
 	virtual void CleanUp();
 
 	// Helpers for finding data by name
@@ -180,13 +287,19 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 protected:
 	bool perInstanceCompatible;
+	bool customInputLayout;
 	 Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
 	 Microsoft::WRL::ComPtr<ID3D11VertexShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates);
+	void BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants);
 	void CleanUp();
 };
 
@@ -198,16 +311,22 @@ class SimplePixelShader : public ISimpleShader
 {
 public:
 	SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile);
+	SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	~SimplePixelShader();
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> GetDirectXShader() { return shader; }
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates);
+	void BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants);
 	void CleanUp();
 };
 
@@ -223,11 +342,16 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11DomainShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates);
+	void BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants);
 	void CleanUp();
 };
 
@@ -243,11 +367,16 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11HullShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates);
+	void BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants);
 	void CleanUp();
 };
 
@@ -263,6 +392,8 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 
 	bool CreateCompatibleStreamOutBuffer(Microsoft::WRL::ComPtr<ID3D11Buffer> buffer, int vertexCount);
 
@@ -280,6 +411,9 @@ protected:
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	bool CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates);
+	void BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants);
 	void CleanUp();
 
 	// Helpers
@@ -304,8 +438,14 @@ public:
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+	using ISimpleShader::SetShaderResourceView;
+	using ISimpleShader::SetSamplerState;
 	bool SetUnorderedAccessView(std::string name, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav, unsigned int appendConsumeOffset = -1);
 
+	// Handle-based UAV binding, like the other handle setters
+	SimpleShaderHandle GetUnorderedAccessViewHandle(std::string name);
+	bool SetUnorderedAccessView(SimpleShaderHandle handle, ID3D11UnorderedAccessView* uav, unsigned int appendConsumeOffset = -1);
+
 	int GetUnorderedAccessViewIndex(std::string name);
 
 protected:
@@ -319,5 +459,8 @@ protected:
 
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates);
+	void BindConstantBuffer(unsigned int bindIndex, ID3D11Buffer* buffer, const UINT* firstConstant, const UINT* numConstants);
 	void CleanUp();
 };
\ No newline at end of file
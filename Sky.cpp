@@ -12,10 +12,11 @@ Sky::Sky(
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions, 
 	Microsoft::WRL::ComPtr<ID3D11Device> device, 
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
-	std::shared_ptr<SimplePixelShader> irradianceMapPS,
-	std::shared_ptr<SimplePixelShader> convolvedSpecularMapPS,
-	std::shared_ptr<SimplePixelShader> brdfLookupTablePS,
-	std::shared_ptr<SimpleVertexShader> fullscreenVS)
+	std::shared_ptr<SimpleComputeShader> irradianceMapCS,
+	std::shared_ptr<SimpleComputeShader> convolvedSpecularMapCS,
+	std::shared_ptr<SimpleComputeShader> brdfLookupTableCS,
+	std::shared_ptr<IBLCache> iblCache,
+	std::shared_ptr<RenderStateCache> renderStates)
 {
 	// Save params
 	this->skyMesh = mesh;
@@ -24,16 +25,20 @@ Sky::Sky(
 	this->samplerOptions = samplerOptions;
 	this->skyVS = skyVS;
 	this->skyPS = skyPS;
+	this->irradianceMapCS = irradianceMapCS;
+	this->convolvedSpecularMapCS = convolvedSpecularMapCS;
+	this->brdfLookupTableCS = brdfLookupTableCS;
+	this->iblWorkItemCount = 0;
+	this->iblVersion = 0;
+	this->iblMsPerMegaSample = 0.05; // A guess, until the GPU has been timed
 
 	// Init render states
-	InitRenderStates();
+	InitRenderStates(renderStates);
 
 	// Load texture
 	CreateDDSTextureFromFile(device.Get(), cubemapDDSFile, 0, skySRV.GetAddressOf());
 
-	IBLCreateIrradianceMap(irradianceMapPS, fullscreenVS);
-	IBLCreateConvolvedSpecularMap(convolvedSpecularMapPS, fullscreenVS);
-	IBLCreateBRDFLookupTexture(brdfLookupTablePS, fullscreenVS);
+	CreateIBLResources(iblCache);
 }
 
 Sky::Sky(
@@ -49,10 +54,11 @@ Sky::Sky(
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
 	Microsoft::WRL::ComPtr<ID3D11Device> device,
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
-	std::shared_ptr<SimplePixelShader> irradianceMapPS,
-	std::shared_ptr<SimplePixelShader> convolvedSpecularMapPS,
-	std::shared_ptr<SimplePixelShader> brdfLookupTablePS,
-	std::shared_ptr<SimpleVertexShader> fullscreenVS)
+	std::shared_ptr<SimpleComputeShader> irradianceMapCS,
+	std::shared_ptr<SimpleComputeShader> convolvedSpecularMapCS,
+	std::shared_ptr<SimpleComputeShader> brdfLookupTableCS,
+	std::shared_ptr<IBLCache> iblCache,
+	std::shared_ptr<RenderStateCache> renderStates)
 {
 	// Save params
 	this->skyMesh = mesh;
@@ -61,16 +67,57 @@ Sky::Sky(
 	this->samplerOptions = samplerOptions;
 	this->skyVS = skyVS;
 	this->skyPS = skyPS;
+	this->irradianceMapCS = irradianceMapCS;
+	this->convolvedSpecularMapCS = convolvedSpecularMapCS;
+	this->brdfLookupTableCS = brdfLookupTableCS;
+	this->iblWorkItemCount = 0;
+	this->iblVersion = 0;
+	this->iblMsPerMegaSample = 0.05; // A guess, until the GPU has been timed
 
 	// Init render states
-	InitRenderStates();
+	InitRenderStates(renderStates);
 
 	// Create texture from 6 images
 	skySRV = CreateCubemap(right, left, up, down, front, back);
 
-	IBLCreateIrradianceMap(irradianceMapPS, fullscreenVS);
-	IBLCreateConvolvedSpecularMap(convolvedSpecularMapPS, fullscreenVS);
-	IBLCreateBRDFLookupTexture(brdfLookupTablePS, fullscreenVS);
+	CreateIBLResources(iblCache);
+}
+
+Sky::Sky(
+	const Microsoft::WRL::ComPtr<ID3D11Texture2D> faces[6],
+	std::shared_ptr<Mesh> mesh,
+	std::shared_ptr<SimpleVertexShader> skyVS,
+	std::shared_ptr<SimplePixelShader> skyPS,
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<SimpleComputeShader> irradianceMapCS,
+	std::shared_ptr<SimpleComputeShader> convolvedSpecularMapCS,
+	std::shared_ptr<SimpleComputeShader> brdfLookupTableCS,
+	std::shared_ptr<IBLCache> iblCache,
+	std::shared_ptr<RenderStateCache> renderStates)
+{
+	// Save params
+	this->skyMesh = mesh;
+	this->device = device;
+	this->context = context;
+	this->samplerOptions = samplerOptions;
+	this->skyVS = skyVS;
+	this->skyPS = skyPS;
+	this->irradianceMapCS = irradianceMapCS;
+	this->convolvedSpecularMapCS = convolvedSpecularMapCS;
+	this->brdfLookupTableCS = brdfLookupTableCS;
+	this->iblWorkItemCount = 0;
+	this->iblVersion = 0;
+	this->iblMsPerMegaSample = 0.05; // A guess, until the GPU has been timed
+
+	// Init render states
+	InitRenderStates(renderStates);
+
+	// Create texture from the 6 faces
+	skySRV = CreateCubemap(faces);
+
+	CreateIBLResources(iblCache);
 }
 
 Sky::~Sky()
@@ -104,28 +151,31 @@ void Sky::Draw(std::shared_ptr<Camera> camera)
 	context->OMSetDepthStencilState(0, 0);
 }
 
-void Sky::InitRenderStates()
+// Gets the states from the cache if there is one, or makes its own
+void Sky::InitRenderStates(std::shared_ptr<RenderStateCache> renderStates)
 {
 	// Rasterizer to reverse the cull mode
 	D3D11_RASTERIZER_DESC rastDesc = {};
 	rastDesc.CullMode = D3D11_CULL_FRONT; // Draw the inside instead of the outside!
 	rastDesc.FillMode = D3D11_FILL_SOLID;
 	rastDesc.DepthClipEnable = true;
-	device->CreateRasterizerState(&rastDesc, skyRasterState.GetAddressOf());
+	if (renderStates) skyRasterState = renderStates->GetRasterizerState(rastDesc);
+	else device->CreateRasterizerState(&rastDesc, skyRasterState.GetAddressOf());
 
 	// Depth state so that we ACCEPT pixels with a depth == 1
 	D3D11_DEPTH_STENCIL_DESC depthDesc = {};
 	depthDesc.DepthEnable = true;
 	depthDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
 	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
-	device->CreateDepthStencilState(&depthDesc, skyDepthState.GetAddressOf());
+	if (renderStates) skyDepthState = renderStates->GetDepthStencilState(depthDesc);
+	else device->CreateDepthStencilState(&depthDesc, skyDepthState.GetAddressOf());
 }
 
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const wchar_t* right, const wchar_t* left, const wchar_t* up, const wchar_t* down, const wchar_t* front, const wchar_t* back)
 {
 	// Load the 6 textures into an array.
 	// - We need references to the TEXTURES, not the SHADER RESOURCE VIEWS!
-	// - Specifically NOT generating mipmaps, as we don't need them for the sky!
+	// - Not generating mipmaps here, as the cube map makes its own
 	// - Order matters here!  +X, -X, +Y, -Y, +Z, -Z
 	Microsoft::WRL::ComPtr<ID3D11Texture2D> textures[6] = {};
 	CreateWICTextureFromFile(device.Get(), right, (ID3D11Resource**)textures[0].GetAddressOf(), 0);
@@ -135,6 +185,15 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const wchar_
 	CreateWICTextureFromFile(device.Get(), front, (ID3D11Resource**)textures[4].GetAddressOf(), 0);
 	CreateWICTextureFromFile(device.Get(), back, (ID3D11Resource**)textures[5].GetAddressOf(), 0);
 
+	return CreateCubemap(textures);
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const Microsoft::WRL::ComPtr<ID3D11Texture2D> textures[6])
+{
+	// Every face is needed
+	for (int i = 0; i < 6; i++)
+		if (!textures[i]) return 0;
+
 	// We'll assume all of the textures are the same color format and resolution,
 	// so get the description of the first shader resource view
 	D3D11_TEXTURE2D_DESC faceDesc = {};
@@ -145,13 +204,13 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const wchar_
 	// NOT just a C++ array of textures!!!
 	D3D11_TEXTURE2D_DESC cubeDesc = {};
 	cubeDesc.ArraySize = 6; // Cube map!
-	cubeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE; // We'll be using as a texture in a shader
+	cubeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET; // Texture in a shader (and a target for GenerateMips)
 	cubeDesc.CPUAccessFlags = 0; // No read back
 	cubeDesc.Format = faceDesc.Format; // Match the loaded texture's color format
 	cubeDesc.Width = faceDesc.Width;  // Match the size
 	cubeDesc.Height = faceDesc.Height; // Match the size
-	cubeDesc.MipLevels = 1; // Only need 1
-	cubeDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE; // This should be treated as a CUBE, not 6 separate textures
+	cubeDesc.MipLevels = 0; // A full chain, so the IBL convolution can take filtered samples
+	cubeDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE | D3D11_RESOURCE_MISC_GENERATE_MIPS; // This should be treated as a CUBE, not 6 separate textures
 	cubeDesc.Usage = D3D11_USAGE_DEFAULT; // Standard usage
 	cubeDesc.SampleDesc.Count = 1;
 	cubeDesc.SampleDesc.Quality = 0;
@@ -159,6 +218,7 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const wchar_
 	// Create the actual texture resource
 	Microsoft::WRL::ComPtr<ID3D11Texture2D> cubeMapTexture;
 	device->CreateTexture2D(&cubeDesc, 0, &cubeMapTexture);
+	cubeMapTexture->GetDesc(&cubeDesc); // For the actual mip count
 
 	// Loop through the individual face textures and copy them,
 	// one at a time, to the cube map texure
@@ -166,9 +226,9 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const wchar_
 	{
 		// Calculate the subresource position to copy into
 		unsigned int subresource = D3D11CalcSubresource(
-			0,	// Which mip (zero, since there's only one)
+			0,	// Which mip (the top one - the rest are generated)
 			i,	// Which array element?
-			1); // How many mip levels are in the texture?
+			cubeDesc.MipLevels); // How many mip levels are in the texture?
 
 		// Copy from one resource (texture) to another
 		context->CopySubresourceRegion(
@@ -185,208 +245,349 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const wchar_
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = cubeDesc.Format; // Same format as texture
 	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE; // Treat this as a cube!
-	srvDesc.TextureCube.MipLevels = 1;	// Only need access to 1 mip
+	srvDesc.TextureCube.MipLevels = (UINT)-1;	// Access to every mip
 	srvDesc.TextureCube.MostDetailedMip = 0; // Index of the first mip we want to see
 
-	// Make the SRV
+	// Make the SRV and fill in the rest of the mips
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeSRV;
 	device->CreateShaderResourceView(cubeMapTexture.Get(), &srvDesc, cubeSRV.GetAddressOf());
+	context->GenerateMips(cubeSRV.Get());
 
 	// Send back the SRV, which is what we need for our shaders
 	return cubeSRV;
 }
 
-void Sky::IBLCreateIrradianceMap(std::shared_ptr<SimplePixelShader> irradianceMapPS, std::shared_ptr<SimpleVertexShader> fullscreenVS)
+void Sky::CreateIBLResources(std::shared_ptr<IBLCache> iblCache)
 {
-	// Create a texture for the irradiance map
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> irradianceMapTexture;
-	D3D11_TEXTURE2D_DESC texDesc = {};
-	texDesc.Width = iblMapFaceSize;
-	texDesc.Height = iblMapFaceSize;
-	texDesc.ArraySize = 6;
-	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	texDesc.MipLevels = 1;
-	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-	texDesc.SampleDesc.Count = 1;
-	device->CreateTexture2D(&texDesc, 0, irradianceMapTexture.GetAddressOf());
+	// Calculate how many mip levels we'll need, potentially skipping a few of the smaller
+	// mip levels (1x1, 2x2, etc.) because, with such low resolutions, they're mostly the same.
+	// (The +1 is necessary to account for the 1x1 mip level)
+	convolvedSpecularMipLevels = max((int)(log2(iblMapFaceSize)) + 1 - convolvedSpecularSkippedMips, 1);
 
-	// Create an SRV for the irradiance texture
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-	srvDesc.TextureCube.MipLevels = 1;
-	srvDesc.TextureCube.MostDetailedMip = 0;
-	srvDesc.Format = texDesc.Format;
-	device->CreateShaderResourceView(irradianceMapTexture.Get(), &srvDesc, irradianceMap.GetAddressOf());
-
-	// Save current render target and depth buffer
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> prevRTV;
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> prevDSV;
-	context->OMGetRenderTargets(1, prevRTV.GetAddressOf(), prevDSV.GetAddressOf());
-
-	// Save current viewport
-	unsigned int vpCount = 1;
-	D3D11_VIEWPORT prevVP = {};
-	context->RSGetViewports(&vpCount, &prevVP);
-
-	// Make sure the viewport matches the texture size
-	D3D11_VIEWPORT vp = {};
-	vp.Width = (float)iblMapFaceSize;
-	vp.Height = (float)iblMapFaceSize;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-	context->RSSetViewports(1, &vp);
-
-	// Set states that may or may not be set yet
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-	fullscreenVS->SetShader();
-	irradianceMapPS->SetShader();
-	irradianceMapPS->SetShaderResourceView("EnvironmentMap", skySRV.Get()); // Skybox texture itself
-	irradianceMapPS->SetSamplerState("BasicSampler", samplerOptions.Get());
-
-	for (int face = 0; face < 6; face++) 
+	// The maps always live in writable targets, so the SRVs handed out
+	// stay the same when they're rebuilt later
+	IBLCreateTargets(irradianceMap, irradianceMapUAV, convolvedSpecularMap, convolvedSpecularMapUAVs);
+
+	if (!iblCache)
 	{
-		// Make a render target view for this face
-		D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-		rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY; // This points to a Texture2D Array
-		rtvDesc.Texture2DArray.ArraySize = 1; // How much of the array do we need access to?
-		rtvDesc.Texture2DArray.FirstArraySlice = face; // Which texture are we rendering into?
-		rtvDesc.Texture2DArray.MipSlice = 0; // Which mip are we rendering into?
-		rtvDesc.Format = texDesc.Format; // Same format as texture
-
-		// Create the RTV itself
-		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtv;
-		device->CreateRenderTargetView(irradianceMapTexture.Get(), &rtvDesc, rtv.GetAddressOf());
-
-		// Clear and set this render target 
-		float black[4] = {}; // Initialize to all zeroes 
-		context->ClearRenderTargetView(rtv.Get(), black); 
-		context->OMSetRenderTargets(1, rtv.GetAddressOf(), 0); 
-
-		// Per-face shader data and copy
-		irradianceMapPS->SetInt("faceIndex", face);
-		irradianceMapPS->CopyAllBufferData();
-
-		// Render exactly 3 vertices
-		context->Draw(3, 0);
-
-		// Ensure we flush the graphics pipe to so that we don't cause 
-		// a hardware timeout which can result in a driver crash
-		// NOTE: This might make C++ sit and wait for a sec!  Better than a crash!
-		context->Flush();
-
-		// Restore the old render target and viewport
-		context->OMSetRenderTargets(1, prevRTV.GetAddressOf(), prevDSV.Get());
-		context->RSSetViewports(1, &prevVP);
+		RegenerateIBL();
+		IBLCreateBRDFLookupTexture();
+		return;
+	}
+
+	// The environment maps depend on this sky's pixels ...
+	unsigned long long environmentKey = iblCache->HashEnvironment(
+		skySRV,
+		irradianceMapCS,
+		convolvedSpecularMapCS,
+		irradianceMapFaceSize,
+		iblMapFaceSize,
+		convolvedSpecularMipLevels);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cachedIrradiance;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cachedSpecular;
+	if (environmentKey != 0 &&
+		iblCache->Load(L"Irradiance", environmentKey, cachedIrradiance) &&
+		iblCache->Load(L"Specular", environmentKey, cachedSpecular))
+	{
+		CopyTexture(cachedIrradiance, irradianceMap);
+		CopyTexture(cachedSpecular, convolvedSpecularMap);
+	}
+	else
+	{
+		RegenerateIBL();
+		if (environmentKey != 0)
+		{
+			iblCache->Save(L"Irradiance", environmentKey, irradianceMap);
+			iblCache->Save(L"Specular", environmentKey, convolvedSpecularMap);
+		}
+	}
+
+	// ... but the look-up table is the same for every sky
+	unsigned long long brdfKey = iblCache->HashBRDFLookupTable(brdfLookupTableCS, brdfLookupTextureSize);
+	if (!iblCache->Load(L"BRDFLookup", brdfKey, brdfLookupTextureSRV))
+	{
+		IBLCreateBRDFLookupTexture();
+		iblCache->Save(L"BRDFLookup", brdfKey, brdfLookupTextureSRV);
 	}
 }
 
-void Sky::IBLCreateConvolvedSpecularMap(std::shared_ptr<SimplePixelShader> convolvedSpecularMapPS, std::shared_ptr<SimpleVertexShader> fullscreenVS)
+// Rebuilds the irradiance and convolved specular maps, in place,
+// from the sky's current cube map
+void Sky::RegenerateIBL()
 {
-	// Calculate how many mip levels we'll need, potentially skipping a few of the smaller
-	// mip levels (1x1, 2x2, etc.) because, with such low resolutions, they're mostly the same.
-	// (The +1 is necessary to account for the 1x1 mip level)
-	convolvedSpecularMipLevels = max((int)(log2(iblMapFaceSize)) + 1 - convolvedSpecularSkippedMips, 1);
+	// All six faces in each dispatch
+	IBLDispatchIrradiance(skySRV, irradianceMapUAV, 0, 6);
+	for (int mip = 0; mip < convolvedSpecularMipLevels; mip++)
+		IBLDispatchSpecular(skySRV, convolvedSpecularMapUAVs[mip], mip, 0, 6);
+}
 
-	// Create a texture for the convolved specular map
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> convolvedSpecularMapTexture;
+// Copies one view's whole texture into another's.  The cache key
+// guarantees the two have the same size, format and mip count
+void Sky::CopyTexture(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> source, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> dest)
+{
+	Microsoft::WRL::ComPtr<ID3D11Resource> sourceTexture;
+	Microsoft::WRL::ComPtr<ID3D11Resource> destTexture;
+	source->GetResource(sourceTexture.GetAddressOf());
+	dest->GetResource(destTexture.GetAddressOf());
+	context->CopyResource(destTexture.Get(), sourceTexture.Get());
+}
+
+// Makes a cube texture the IBL compute shaders can write to, with an SRV
+// for the whole thing and a UAV (over all six faces) per mip
+static void CreateIBLCubeTarget(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	int faceSize,
+	int mipLevels,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv,
+	std::vector<Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>>& uavs)
+{
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
 	D3D11_TEXTURE2D_DESC texDesc = {};
-	texDesc.Width = iblMapFaceSize;
-	texDesc.Height = iblMapFaceSize;
+	texDesc.Width = faceSize;
+	texDesc.Height = faceSize;
 	texDesc.ArraySize = 6;
-	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
 	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	texDesc.MipLevels = convolvedSpecularMipLevels;
+	texDesc.MipLevels = mipLevels;
 	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
 	texDesc.SampleDesc.Count = 1;
-	device->CreateTexture2D(&texDesc, 0, convolvedSpecularMapTexture.GetAddressOf());
+	device->CreateTexture2D(&texDesc, 0, texture.GetAddressOf());
 
-	// Create an SRV for the convolved specular map texture
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-	srvDesc.TextureCube.MipLevels = convolvedSpecularMipLevels;
+	srvDesc.TextureCube.MipLevels = mipLevels;
 	srvDesc.TextureCube.MostDetailedMip = 0;
 	srvDesc.Format = texDesc.Format;
-	device->CreateShaderResourceView(convolvedSpecularMapTexture.Get(), &srvDesc, convolvedSpecularMap.GetAddressOf());
+	device->CreateShaderResourceView(texture.Get(), &srvDesc, srv.GetAddressOf());
 
-	// Save current render target and depth buffer
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> prevRTV;
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> prevDSV;
-	context->OMGetRenderTargets(1, prevRTV.GetAddressOf(), prevDSV.GetAddressOf());
+	uavs.resize(mipLevels);
+	for (int mip = 0; mip < mipLevels; mip++)
+	{
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY; // The faces, as slices
+		uavDesc.Texture2DArray.MipSlice = mip;
+		uavDesc.Texture2DArray.FirstArraySlice = 0;
+		uavDesc.Texture2DArray.ArraySize = 6;
+		uavDesc.Format = texDesc.Format;
+		device->CreateUnorderedAccessView(texture.Get(), &uavDesc, uavs[mip].GetAddressOf());
+	}
+}
 
-	// Save current viewport
-	unsigned int vpCount = 1;
-	D3D11_VIEWPORT prevVP = {};
-	context->RSGetViewports(&vpCount, &prevVP);
+void Sky::IBLCreateTargets(
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& irradiance,
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>& irradianceUAV,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& specular,
+	std::vector<Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>>& specularUAVs)
+{
+	std::vector<Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>> irradianceUAVs;
+	CreateIBLCubeTarget(device, irradianceMapFaceSize, 1, irradiance, irradianceUAVs);
+	irradianceUAV = irradianceUAVs[0];
 
-	// Set states that may or may not be set yet
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	CreateIBLCubeTarget(device, iblMapFaceSize, convolvedSpecularMipLevels, specular, specularUAVs);
+}
 
-	fullscreenVS->SetShader();
-	convolvedSpecularMapPS->SetShader();
-	convolvedSpecularMapPS->SetShaderResourceView("EnvironmentMap", skySRV.Get()); // Skybox texture itself
-	convolvedSpecularMapPS->SetSamplerState("BasicSampler", samplerOptions.Get());
+void Sky::IBLDispatchIrradiance(
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment,
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> target,
+	int firstFace,
+	int faceCount)
+{
+	// One thread per texel, with the faces in z
+	irradianceMapCS->SetShader();
+	irradianceMapCS->SetShaderResourceView("EnvironmentMap", environment.Get());
+	irradianceMapCS->SetSamplerState("BasicSampler", samplerOptions.Get());
+	irradianceMapCS->SetUnorderedAccessView("IrradianceMap", target);
+	irradianceMapCS->SetInt("faceSize", irradianceMapFaceSize);
+	irradianceMapCS->SetInt("firstFace", firstFace);
+	irradianceMapCS->CopyAllBufferData();
+
+	irradianceMapCS->DispatchByThreads(irradianceMapFaceSize, irradianceMapFaceSize, faceCount);
+
+	// Unbind the output so it can be read by the pixel shaders
+	irradianceMapCS->SetUnorderedAccessView("IrradianceMap", nullptr);
+}
+
+void Sky::IBLDispatchSpecular(
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment,
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> target,
+	int mip,
+	int firstFace,
+	int faceCount)
+{
+	int faceSize = max(iblMapFaceSize >> mip, 1);
+	convolvedSpecularMapCS->SetShader();
+	convolvedSpecularMapCS->SetShaderResourceView("EnvironmentMap", environment.Get());
+	convolvedSpecularMapCS->SetSamplerState("BasicSampler", samplerOptions.Get());
+	convolvedSpecularMapCS->SetUnorderedAccessView("SpecularMap", target);
+	convolvedSpecularMapCS->SetFloat("roughness", mip / (float)max(convolvedSpecularMipLevels - 1, 1));
+	convolvedSpecularMapCS->SetInt("faceSize", faceSize);
+	convolvedSpecularMapCS->SetInt("firstFace", firstFace);
+	convolvedSpecularMapCS->CopyAllBufferData();
+
+	convolvedSpecularMapCS->DispatchByThreads(faceSize, faceSize, faceCount);
+
+	// Unbind the output so it can be read by the pixel shaders
+	convolvedSpecularMapCS->SetUnorderedAccessView("SpecularMap", nullptr);
+}
+
+// Swaps to a new environment without stalling.  Its IBL maps are built
+// into a second set of targets, a face and mip at a time, by UpdateIBL()
+void Sky::ChangeEnvironment(const Microsoft::WRL::ComPtr<ID3D11Texture2D> faces[6])
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubemap = CreateCubemap(faces);
+	if (cubemap)
+		ChangeEnvironment(cubemap);
+}
 
+void Sky::ChangeEnvironment(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubemap)
+{
+	if (!pendingIrradianceMapUAV)
+		IBLCreateTargets(pendingIrradianceMap, pendingIrradianceMapUAV, pendingConvolvedSpecularMap, pendingConvolvedSpecularMapUAVs);
+
+	// Anything left from an earlier change is simply started over
+	pendingSkySRV = cubemap;
+	iblWorkItems.clear();
+	for (int face = 0; face < 6; face++)
+		iblWorkItems.push_back({ true, 0, face });
 	for (int mip = 0; mip < convolvedSpecularMipLevels; mip++)
-	{
 		for (int face = 0; face < 6; face++)
+			iblWorkItems.push_back({ false, mip, face });
+	iblWorkItemCount = (unsigned int)iblWorkItems.size();
+}
+
+float Sky::GetIBLUpdateProgress()
+{
+	if (iblWorkItems.empty())
+		return 1.0f;
+	return 1.0f - iblWorkItems.size() / (float)iblWorkItemCount;
+}
+
+// The number of environment samples a work item takes, which is
+// roughly what it costs on the GPU
+double Sky::GetIBLWorkItemSamples(const IBLWorkItem& item)
+{
+	if (item.Irradiance)
+		return (double)irradianceMapFaceSize * irradianceMapFaceSize * iblIrradianceSampleCount;
+
+	// The mirror-like top mip is a single sample per texel
+	double faceSize = max(iblMapFaceSize >> item.Mip, 1);
+	return faceSize * faceSize * (item.Mip == 0 ? 1 : iblSpecularSampleCount);
+}
+
+// Picks up any timings the GPU has finished, without waiting, and
+// folds them into the cost estimate
+void Sky::ReadIBLTimings()
+{
+	for (auto& t : iblTimings)
+	{
+		if (!t.InFlight)
+			continue;
+
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+		UINT64 start = 0;
+		UINT64 end = 0;
+		if (context->GetData(t.Disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+			context->GetData(t.Start.Get(), &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+			context->GetData(t.End.Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			continue;
+
+		t.InFlight = false;
+		if (disjoint.Disjoint || disjoint.Frequency == 0 || end <= start || t.Samples <= 0)
+			continue;
+
+		// Smoothed, since a single frame's timing can be noisy
+		double ms = (end - start) * 1000.0 / disjoint.Frequency;
+		double msPerMegaSample = ms / (t.Samples / 1000000.0);
+		iblMsPerMegaSample = iblMsPerMegaSample * 0.75 + msPerMegaSample * 0.25;
+	}
+}
+
+// Runs as many of the pending work items as fit in the GPU budget,
+// and swaps the new maps in once they're all done
+void Sky::UpdateIBL(float gpuBudgetMs)
+{
+	ReadIBLTimings();
+	if (iblWorkItems.empty())
+		return;
+
+	// Time this frame's slice, if a query set is free
+	IBLTimingQuery* timing = 0;
+	for (auto& t : iblTimings)
+	{
+		if (t.InFlight)
+			continue;
+
+		if (!t.Disjoint)
 		{
-			// Make sure the viewport matches the texture size
-			D3D11_VIEWPORT vp = {};
-			vp.Width = (float)pow(2, convolvedSpecularMipLevels + convolvedSpecularSkippedMips - 1 - mip);
-			vp.Height = vp.Width; // Square
-			vp.MinDepth = 0.0f;
-			vp.MaxDepth = 1.0f;
-			context->RSSetViewports(1, &vp);
-
-			// Make a render target view for this face
-			D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-			rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY; // This points to a Texture2D Array
-			rtvDesc.Texture2DArray.ArraySize = 1; // How much of the array do we need access to?
-			rtvDesc.Texture2DArray.FirstArraySlice = face; // Which texture are we rendering into?
-			rtvDesc.Texture2DArray.MipSlice = mip; // Which mip are we rendering into?
-			rtvDesc.Format = texDesc.Format; // Same format as texture
-
-			// Create the RTV itself
-			Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtv;
-			device->CreateRenderTargetView(convolvedSpecularMapTexture.Get(), &rtvDesc, rtv.GetAddressOf());
-
-			// Clear and set this render target 
-			float black[4] = {}; // Initialize to all zeroes 
-			context->ClearRenderTargetView(rtv.Get(), black);
-			context->OMSetRenderTargets(1, rtv.GetAddressOf(), 0);
-
-			// Handle per-face shader data and copy
-			convolvedSpecularMapPS->SetFloat("roughness", mip / (float)(convolvedSpecularMipLevels - 1));
-			convolvedSpecularMapPS->SetInt("faceIndex", face);
-			convolvedSpecularMapPS->SetInt("mipLevel", mip);
-			convolvedSpecularMapPS->CopyAllBufferData();
-
-			// Render exactly 3 vertices
-			context->Draw(3, 0);
-
-			// Ensure we flush the graphics pipe to so that we don't cause 
-			// a hardware timeout which can result in a driver crash
-			// NOTE: This might make C++ sit and wait for a sec!  Better than a crash!
-			context->Flush();
-
-			// Restore the old render target and viewport
-			context->OMSetRenderTargets(1, prevRTV.GetAddressOf(), prevDSV.Get());
-			context->RSSetViewports(1, &prevVP);
+			D3D11_QUERY_DESC queryDesc = {};
+			queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+			device->CreateQuery(&queryDesc, t.Disjoint.GetAddressOf());
+			queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+			device->CreateQuery(&queryDesc, t.Start.GetAddressOf());
+			device->CreateQuery(&queryDesc, t.End.GetAddressOf());
 		}
+		timing = &t;
+		break;
+	}
+
+	if (timing)
+	{
+		context->Begin(timing->Disjoint.Get());
+		context->End(timing->Start.Get());
+	}
+
+	// Always do at least one item, so every update finishes
+	double samples = 0;
+	double estimatedMs = 0;
+	do
+	{
+		IBLWorkItem item = iblWorkItems.front();
+		double itemSamples = GetIBLWorkItemSamples(item);
+		double itemMs = itemSamples / 1000000.0 * iblMsPerMegaSample;
+		if (samples > 0 && estimatedMs + itemMs > gpuBudgetMs)
+			break;
+
+		if (item.Irradiance)
+			IBLDispatchIrradiance(pendingSkySRV, pendingIrradianceMapUAV, item.Face, 1);
+		else
+			IBLDispatchSpecular(pendingSkySRV, pendingConvolvedSpecularMapUAVs[item.Mip], item.Mip, item.Face, 1);
+
+		iblWorkItems.pop_front();
+		samples += itemSamples;
+		estimatedMs += itemMs;
+	} while (!iblWorkItems.empty());
+
+	if (timing)
+	{
+		context->End(timing->End.Get());
+		context->End(timing->Disjoint.Get());
+		timing->Samples = samples;
+		timing->InFlight = true;
+	}
+
+	// All done, so the sky and both maps change together.  The GPU runs
+	// the work above before anything drawn with them
+	if (iblWorkItems.empty())
+	{
+		skySRV.Swap(pendingSkySRV);
+		irradianceMap.Swap(pendingIrradianceMap);
+		irradianceMapUAV.Swap(pendingIrradianceMapUAV);
+		convolvedSpecularMap.Swap(pendingConvolvedSpecularMap);
+		convolvedSpecularMapUAVs.swap(pendingConvolvedSpecularMapUAVs);
+		pendingSkySRV.Reset();
+		iblVersion++;
 	}
 }
 
-void Sky::IBLCreateBRDFLookupTexture(std::shared_ptr<SimplePixelShader> brdfLookupTexturePS, std::shared_ptr<SimpleVertexShader> fullscreenVS)
+void Sky::IBLCreateBRDFLookupTexture()
 {
-	// Create a texture for the convolved specular map
+	// Create a texture for the BRDF look-up table
 	Microsoft::WRL::ComPtr<ID3D11Texture2D> brdfLookupTableTexture;
 	D3D11_TEXTURE2D_DESC texDesc = {};
 	texDesc.Width = brdfLookupTextureSize;
 	texDesc.Height = brdfLookupTextureSize;
 	texDesc.ArraySize = 1;
-	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
 	texDesc.Format = DXGI_FORMAT_R16G16_UNORM;
 	texDesc.MipLevels = 1;
 	texDesc.MiscFlags = 0;
@@ -399,57 +600,14 @@ void Sky::IBLCreateBRDFLookupTexture(std::shared_ptr<SimplePixelShader> brdfLook
 	srvDesc.Texture2D.MipLevels = 1;              // Just one mip
 	srvDesc.Texture2D.MostDetailedMip = 0;              // Accessing the first (and only) mip
 	srvDesc.Format = texDesc.Format; // Same format as texture
-	device->CreateShaderResourceView(brdfLookupTableTexture.Get(), &srvDesc, brdfLookupTextureSRV.GetAddressOf());
-
-	// Save current render target and depth buffer
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> prevRTV;
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> prevDSV;
-	context->OMGetRenderTargets(1, prevRTV.GetAddressOf(), prevDSV.GetAddressOf());
-
-	// Save current viewport
-	unsigned int vpCount = 1;
-	D3D11_VIEWPORT prevVP = {};
-	context->RSGetViewports(&vpCount, &prevVP);
-
-	// Make sure the viewport matches the texture size
-	D3D11_VIEWPORT vp = {};
-	vp.Width = (float)brdfLookupTextureSize;
-	vp.Height = (float)brdfLookupTextureSize;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-	context->RSSetViewports(1, &vp);
-
-	// Set states that may or may not be set yet
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-	// Make a render target view for this face
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY; // This points to a Texture2D Array
-	rtvDesc.Texture2DArray.MipSlice = 0; // Which mip are we rendering into?
-	rtvDesc.Texture2DArray.ArraySize = 1;
-	rtvDesc.Format = texDesc.Format; // Same format as texture
-
-	// Create the RTV itself
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtv;
-	device->CreateRenderTargetView(brdfLookupTableTexture.Get(), &rtvDesc, rtv.GetAddressOf());
-
-	// Clear and set this render target 
-	float black[4] = {}; // Initialize to all zeroes 
-	context->ClearRenderTargetView(rtv.Get(), black);
-	context->OMSetRenderTargets(1, rtv.GetAddressOf(), 0);
-
-	fullscreenVS->SetShader();
-	brdfLookupTexturePS->SetShader();
-
-	// Render exactly 3 vertices
-	context->Draw(3, 0);
-
-	// Ensure we flush the graphics pipe to so that we don't cause 
-	// a hardware timeout which can result in a driver crash
-	// NOTE: This might make C++ sit and wait for a sec!  Better than a crash!
-	context->Flush();
-
-	// Restore the old render target and viewport
-	context->OMSetRenderTargets(1, prevRTV.GetAddressOf(), prevDSV.Get());
-	context->RSSetViewports(1, &prevVP);
+	device->CreateShaderResourceView(brdfLookupTableTexture.Get(), &srvDesc, brdfLookupTextureSRV.ReleaseAndGetAddressOf());
+
+	// And a UAV for the compute shader to write to
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav;
+	device->CreateUnorderedAccessView(brdfLookupTableTexture.Get(), 0, uav.GetAddressOf());
+
+	brdfLookupTableCS->SetShader();
+	brdfLookupTableCS->SetUnorderedAccessView("BrdfLookUpTable", uav);
+	brdfLookupTableCS->DispatchByThreads(brdfLookupTextureSize, brdfLookupTextureSize, 1);
+	brdfLookupTableCS->SetUnorderedAccessView("BrdfLookUpTable", nullptr);
 }
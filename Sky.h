@@ -1,10 +1,14 @@
 #pragma once
 
 #include <memory>
+#include <vector>
+#include <deque>
 
 #include "Mesh.h"
 #include "SimpleShader.h"
 #include "Camera.h"
+#include "IBLCache.h"
+#include "RenderStateCache.h"
 
 #include <wrl/client.h> // Used for ComPtr
 
@@ -21,10 +25,11 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
 		Microsoft::WRL::ComPtr<ID3D11Device> device,
 		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
-		std::shared_ptr<SimplePixelShader> irradianceMapPS,
-		std::shared_ptr<SimplePixelShader> convolvedSpecularMapPS,
-		std::shared_ptr<SimplePixelShader> brdfLookupTablePS,
-		std::shared_ptr<SimpleVertexShader> fullscreenVS
+		std::shared_ptr<SimpleComputeShader> irradianceMapCS,
+		std::shared_ptr<SimpleComputeShader> convolvedSpecularMapCS,
+		std::shared_ptr<SimpleComputeShader> brdfLookupTableCS,
+		std::shared_ptr<IBLCache> iblCache = 0,
+		std::shared_ptr<RenderStateCache> renderStates = 0
 	);
 
 	// Constructor that loads 6 textures and makes a cube map
@@ -41,10 +46,28 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
 		Microsoft::WRL::ComPtr<ID3D11Device> device,
 		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
-		std::shared_ptr<SimplePixelShader> irradianceMapPS,
-		std::shared_ptr<SimplePixelShader> convolvedSpecularMapPS,
-		std::shared_ptr<SimplePixelShader> brdfLookupTablePS,
-		std::shared_ptr<SimpleVertexShader> fullscreenVS
+		std::shared_ptr<SimpleComputeShader> irradianceMapCS,
+		std::shared_ptr<SimpleComputeShader> convolvedSpecularMapCS,
+		std::shared_ptr<SimpleComputeShader> brdfLookupTableCS,
+		std::shared_ptr<IBLCache> iblCache = 0,
+		std::shared_ptr<RenderStateCache> renderStates = 0
+	);
+
+	// Constructor that makes a cube map from 6 already loaded
+	// textures, in +X, -X, +Y, -Y, +Z, -Z order
+	Sky(
+		const Microsoft::WRL::ComPtr<ID3D11Texture2D> faces[6],
+		std::shared_ptr<Mesh> mesh,
+		std::shared_ptr<SimpleVertexShader> skyVS,
+		std::shared_ptr<SimplePixelShader> skyPS,
+		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<SimpleComputeShader> irradianceMapCS,
+		std::shared_ptr<SimpleComputeShader> convolvedSpecularMapCS,
+		std::shared_ptr<SimpleComputeShader> brdfLookupTableCS,
+		std::shared_ptr<IBLCache> iblCache = 0,
+		std::shared_ptr<RenderStateCache> renderStates = 0
 	);
 
 	~Sky();
@@ -56,9 +79,30 @@ public:
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetBRDFLookupTexture() { return brdfLookupTextureSRV; }
 	int GetConvolvedSpecularMipLevels() { return convolvedSpecularMipLevels; }
 
+	// Re-convolves the irradiance and specular maps from the sky's
+	// cube map - cheap enough (a few ms) to do at runtime
+	void RegenerateIBL();
+
+	// Changes to a new cube map over several frames.  Its IBL maps are
+	// built a face and mip at a time by UpdateIBL(), and the old maps are
+	// kept until the whole new set (sky included) swaps in at once.
+	// Changing again mid-update starts over with the newer cube map
+	void ChangeEnvironment(const Microsoft::WRL::ComPtr<ID3D11Texture2D> faces[6]);
+	void ChangeEnvironment(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubemap);
+
+	// Call once per frame, before drawing.  Runs as much of a change as
+	// should fit in the GPU budget (always at least one face)
+	void UpdateIBL(float gpuBudgetMs);
+	bool IsIBLUpdatePending() { return !iblWorkItems.empty(); }
+	float GetIBLUpdateProgress();
+
+	// Goes up each time new maps are swapped in, so anything holding
+	// the old ones knows to rebind
+	unsigned int GetIBLVersion() { return iblVersion; }
+
 private:
 
-	void InitRenderStates();
+	void InitRenderStates(std::shared_ptr<RenderStateCache> renderStates);
 
 	// Helper for creating a cubemap from 6 individual textures
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(
@@ -68,6 +112,7 @@ private:
 		const wchar_t* down,
 		const wchar_t* front,
 		const wchar_t* back);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(const Microsoft::WRL::ComPtr<ID3D11Texture2D> faces[6]);
 
 	// Skybox related resources
 	std::shared_ptr<SimpleVertexShader> skyVS;
@@ -87,14 +132,77 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> convolvedSpecularMap;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> brdfLookupTextureSRV;
 
+	// IBL compute shaders, kept so the maps can be rebuilt
+	std::shared_ptr<SimpleComputeShader> irradianceMapCS;
+	std::shared_ptr<SimpleComputeShader> convolvedSpecularMapCS;
+	std::shared_ptr<SimpleComputeShader> brdfLookupTableCS;
+
+	// Where the compute shaders write the irradiance and specular maps
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> irradianceMapUAV;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>> convolvedSpecularMapUAVs; // One per mip
+
 	int convolvedSpecularMipLevels;
 
+	// A change's maps, built here before being swapped in
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> pendingSkySRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> pendingIrradianceMap;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> pendingConvolvedSpecularMap;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> pendingIrradianceMapUAV;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>> pendingConvolvedSpecularMapUAVs;
+
+	// What's left of a change: one face of one map's mip each
+	struct IBLWorkItem
+	{
+		bool Irradiance;
+		int Mip;
+		int Face;
+	};
+	std::deque<IBLWorkItem> iblWorkItems;
+	unsigned int iblWorkItemCount;
+	unsigned int iblVersion;
+
+	// Timestamps of recent slices, read back a few frames later to
+	// learn how long the work takes on this GPU
+	struct IBLTimingQuery
+	{
+		Microsoft::WRL::ComPtr<ID3D11Query> Disjoint;
+		Microsoft::WRL::ComPtr<ID3D11Query> Start;
+		Microsoft::WRL::ComPtr<ID3D11Query> End;
+		double Samples;
+		bool InFlight;
+	};
+	IBLTimingQuery iblTimings[4] = {};
+	double iblMsPerMegaSample;
+
 	const int convolvedSpecularSkippedMips = 3;
 	const int iblMapFaceSize = 512;
+	const int irradianceMapFaceSize = 64; // Irradiance is very low frequency
 	const int brdfLookupTextureSize = 512;
-
-	void IBLCreateIrradianceMap(std::shared_ptr<SimplePixelShader> irradianceMapPS, std::shared_ptr<SimpleVertexShader> fullscreenVS);
-	void IBLCreateConvolvedSpecularMap(std::shared_ptr<SimplePixelShader> convolvedSpecularMapPS, std::shared_ptr<SimpleVertexShader> fullscreenVS);
-	void IBLCreateBRDFLookupTexture(std::shared_ptr<SimplePixelShader> brdfLookupTexturePS, std::shared_ptr<SimpleVertexShader> fullscreenVS);
+	const int iblIrradianceSampleCount = 256; // IRRADIANCE_FILTERED_SAMPLES in Lighting.hlsli
+	const int iblSpecularSampleCount = 128;   // IBL_FILTERED_SAMPLES in Lighting.hlsli
+
+	// Loads the IBL maps from the cache (if given), or renders them
+	// and saves them there for next time
+	void CreateIBLResources(std::shared_ptr<IBLCache> iblCache);
+	void IBLCreateTargets(
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& irradiance,
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>& irradianceUAV,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& specular,
+		std::vector<Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>>& specularUAVs);
+	void CopyTexture(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> source, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> dest);
+	void IBLDispatchIrradiance(
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment,
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> target,
+		int firstFace,
+		int faceCount);
+	void IBLDispatchSpecular(
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment,
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> target,
+		int mip,
+		int firstFace,
+		int faceCount);
+	double GetIBLWorkItemSamples(const IBLWorkItem& item);
+	void ReadIBLTimings();
+	void IBLCreateBRDFLookupTexture();
 };
 
@@ -0,0 +1,638 @@
+#include "TextureCooker.h"
+
+#include <Windows.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+
+// --------------------------------------------------------
+// Mip generation
+//
+// Levels are filtered as floats, in the space that makes
+// averaging correct for the usage: linear light for albedo,
+// unit vectors for normal maps, plain values otherwise
+// --------------------------------------------------------
+
+static float SRGBToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSRGB(float c)
+{
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static unsigned char ToByte(float v)
+{
+	return (unsigned char)(max(0.0f, min(v, 1.0f)) * 255.0f + 0.5f);
+}
+
+// Decodes RGBA8 pixels into 4 floats each, in the usage's filtering space
+static void DecodeForFiltering(const unsigned char* rgba, size_t pixelCount, TextureUsage usage, float* out)
+{
+	float srgbTable[256];
+	for (int i = 0; i < 256; i++)
+		srgbTable[i] = SRGBToLinear(i / 255.0f);
+
+	for (size_t i = 0; i < pixelCount * 4; i += 4)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			float v = rgba[i + c] / 255.0f;
+			if (usage == TEXTURE_ALBEDO && c < 3) v = srgbTable[rgba[i + c]];
+			else if (usage == TEXTURE_NORMAL_MAP && c < 3) v = v * 2.0f - 1.0f;
+			out[i + c] = v;
+		}
+	}
+}
+
+// Turns filtered floats back into RGBA8 for compression
+static void EncodeAfterFiltering(const float* pixels, size_t pixelCount, TextureUsage usage, unsigned char* out)
+{
+	for (size_t i = 0; i < pixelCount * 4; i += 4)
+	{
+		float p[4] = { pixels[i], pixels[i + 1], pixels[i + 2], pixels[i + 3] };
+		if (usage == TEXTURE_ALBEDO)
+		{
+			for (int c = 0; c < 3; c++) p[c] = LinearToSRGB(max(p[c], 0.0f));
+		}
+		else if (usage == TEXTURE_NORMAL_MAP)
+		{
+			// Averaged normals get shorter, so put them back on the sphere
+			float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+			if (length > 0.0f) { p[0] /= length; p[1] /= length; p[2] /= length; }
+			for (int c = 0; c < 3; c++) p[c] = p[c] * 0.5f + 0.5f;
+		}
+
+		for (int c = 0; c < 4; c++)
+			out[i + c] = ToByte(p[c]);
+	}
+}
+
+// Halves a float image with a box filter, reusing the last row or
+// column on odd edges
+static void DownsampleFloat(const float* src, unsigned int srcWidth, unsigned int srcHeight, float* dst)
+{
+	unsigned int dstWidth = max(srcWidth / 2, 1u);
+	unsigned int dstHeight = max(srcHeight / 2, 1u);
+
+	for (unsigned int y = 0; y < dstHeight; y++)
+	{
+		unsigned int y0 = min(y * 2, srcHeight - 1);
+		unsigned int y1 = min(y * 2 + 1, srcHeight - 1);
+		for (unsigned int x = 0; x < dstWidth; x++)
+		{
+			unsigned int x0 = min(x * 2, srcWidth - 1);
+			unsigned int x1 = min(x * 2 + 1, srcWidth - 1);
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				dst[(y * dstWidth + x) * 4 + c] = 0.25f * (
+					src[(y0 * srcWidth + x0) * 4 + c] +
+					src[(y0 * srcWidth + x1) * 4 + c] +
+					src[(y1 * srcWidth + x0) * 4 + c] +
+					src[(y1 * srcWidth + x1) * 4 + c]);
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// BC1: two RGB565 endpoints and a 2-bit index per pixel.
+//
+// Endpoints start at the extremes of the block along its
+// principal axis, then get one least squares refit against
+// the chosen indices, which is kept if it lowers the error
+// --------------------------------------------------------
+
+static unsigned short PackRGB565(const float c[3])
+{
+	int r = (int)(max(0.0f, min(c[0], 255.0f)) * 31.0f / 255.0f + 0.5f);
+	int g = (int)(max(0.0f, min(c[1], 255.0f)) * 63.0f / 255.0f + 0.5f);
+	int b = (int)(max(0.0f, min(c[2], 255.0f)) * 31.0f / 255.0f + 0.5f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(unsigned short c, float out[3])
+{
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+	out[0] = (float)((r << 3) | (r >> 2));
+	out[1] = (float)((g << 2) | (g >> 4));
+	out[2] = (float)((b << 3) | (b >> 2));
+}
+
+// Picks the nearest of the 4 palette colors for each pixel, returning
+// the total squared error
+static float ChooseBC1Indices(const float pixels[16][3], unsigned short c0, unsigned short c1, unsigned int* indices)
+{
+	float palette[4][3];
+	UnpackRGB565(c0, palette[0]);
+	UnpackRGB565(c1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+
+	float totalError = 0.0f;
+	*indices = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		float bestError = FLT_MAX;
+		unsigned int best = 0;
+		for (unsigned int p = 0; p < 4; p++)
+		{
+			float dr = pixels[i][0] - palette[p][0];
+			float dg = pixels[i][1] - palette[p][1];
+			float db = pixels[i][2] - palette[p][2];
+			float error = dr * dr + dg * dg + db * db;
+			if (error < bestError) { bestError = error; best = p; }
+		}
+		totalError += bestError;
+		*indices |= best << (i * 2);
+	}
+	return totalError;
+}
+
+void CompressBC1Block(const unsigned char rgba[64], unsigned char out[8])
+{
+	float pixels[16][3];
+	float mean[3] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			pixels[i][c] = rgba[i * 4 + c];
+			mean[c] += pixels[i][c] / 16.0f;
+		}
+	}
+
+	// Covariance of the block's colors
+	float cov[6] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float r = pixels[i][0] - mean[0];
+		float g = pixels[i][1] - mean[1];
+		float b = pixels[i][2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	// Principal axis, by power iteration
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iter = 0; iter < 8; iter++)
+	{
+		float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+		float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+		float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+		float length = max(fabsf(x), max(fabsf(y), fabsf(z)));
+		if (length <= 0.0f) break;
+		axis[0] = x / length;
+		axis[1] = y / length;
+		axis[2] = z / length;
+	}
+
+	// The pixels furthest along the axis become the endpoints
+	float minDot = FLT_MAX;
+	float maxDot = -FLT_MAX;
+	int minIndex = 0;
+	int maxIndex = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		float d = pixels[i][0] * axis[0] + pixels[i][1] * axis[1] + pixels[i][2] * axis[2];
+		if (d < minDot) { minDot = d; minIndex = i; }
+		if (d > maxDot) { maxDot = d; maxIndex = i; }
+	}
+
+	unsigned short c0 = PackRGB565(pixels[maxIndex]);
+	unsigned short c1 = PackRGB565(pixels[minIndex]);
+	unsigned int indices = 0;
+	if (c0 < c1) { unsigned short temp = c0; c0 = c1; c1 = temp; }
+	float error = ChooseBC1Indices(pixels, c0, c1, &indices);
+
+	// One least squares refit of both endpoints to the chosen indices
+	if (c0 != c1)
+	{
+		const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0, bb = 0, ab = 0;
+		float ax[3] = {}, bx[3] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float a = weights[(indices >> (i * 2)) & 3];
+			float b = 1.0f - a;
+			aa += a * a; bb += b * b; ab += a * b;
+			for (int c = 0; c < 3; c++) { ax[c] += a * pixels[i][c]; bx[c] += b * pixels[i][c]; }
+		}
+
+		float det = aa * bb - ab * ab;
+		if (fabsf(det) > 1e-6f)
+		{
+			float end0[3], end1[3];
+			for (int c = 0; c < 3; c++)
+			{
+				end0[c] = (ax[c] * bb - bx[c] * ab) / det;
+				end1[c] = (bx[c] * aa - ax[c] * ab) / det;
+			}
+
+			unsigned short r0 = PackRGB565(end0);
+			unsigned short r1 = PackRGB565(end1);
+			if (r0 < r1) { unsigned short temp = r0; r0 = r1; r1 = temp; }
+			if (r0 != r1)
+			{
+				unsigned int refitIndices = 0;
+				float refitError = ChooseBC1Indices(pixels, r0, r1, &refitIndices);
+				if (refitError < error)
+				{
+					c0 = r0;
+					c1 = r1;
+					indices = refitIndices;
+				}
+			}
+		}
+	}
+
+	// Equal endpoints would mean 3 color mode, where index 3 is
+	// black, so everything points at the first endpoint instead
+	if (c0 == c1)
+		indices = 0;
+
+	out[0] = (unsigned char)(c0 & 0xFF);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xFF);
+	out[3] = (unsigned char)(c1 >> 8);
+	out[4] = (unsigned char)(indices & 0xFF);
+	out[5] = (unsigned char)((indices >> 8) & 0xFF);
+	out[6] = (unsigned char)((indices >> 16) & 0xFF);
+	out[7] = (unsigned char)(indices >> 24);
+}
+
+// --------------------------------------------------------
+// BC4: two 8-bit endpoints and a 3-bit index per pixel,
+// always in 8 value mode (r0 > r1).  BC5 is two of these
+// --------------------------------------------------------
+void CompressBC4Block(const unsigned char values[16], unsigned char out[8])
+{
+	unsigned char lo = 255;
+	unsigned char hi = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		lo = min(lo, values[i]);
+		hi = max(hi, values[i]);
+	}
+
+	unsigned long long indices = 0;
+	if (hi > lo)
+	{
+		float palette[8];
+		palette[0] = hi;
+		palette[1] = lo;
+		for (int p = 2; p < 8; p++)
+			palette[p] = ((8 - p) * hi + (p - 1) * lo) / 7.0f;
+
+		for (int i = 0; i < 16; i++)
+		{
+			unsigned long long best = 0;
+			float bestError = FLT_MAX;
+			for (int p = 0; p < 8; p++)
+			{
+				float error = fabsf(values[i] - palette[p]);
+				if (error < bestError) { bestError = error; best = p; }
+			}
+			indices |= best << (i * 3);
+		}
+	}
+
+	out[0] = hi;
+	out[1] = lo;
+	for (int b = 0; b < 6; b++)
+		out[2 + b] = (unsigned char)((indices >> (b * 8)) & 0xFF);
+}
+
+// Gathers a 4x4 block of RGBA8 pixels, clamping at the image edges
+// so levels smaller than a block still fill one
+static void GatherBlock(const unsigned char* rgba, unsigned int width, unsigned int height, unsigned int bx, unsigned int by, unsigned char block[64])
+{
+	for (unsigned int y = 0; y < 4; y++)
+	{
+		unsigned int sy = min(by * 4 + y, height - 1);
+		for (unsigned int x = 0; x < 4; x++)
+		{
+			unsigned int sx = min(bx * 4 + x, width - 1);
+			const unsigned char* p = &rgba[(sy * width + sx) * 4];
+			unsigned char* b = &block[(y * 4 + x) * 4];
+			b[0] = p[0]; b[1] = p[1]; b[2] = p[2]; b[3] = p[3];
+		}
+	}
+}
+
+// Compresses one mip level in the usage's format, appending
+// the blocks to the output
+static void CompressLevel(const unsigned char* rgba, unsigned int width, unsigned int height, TextureUsage usage, std::vector<unsigned char>& out)
+{
+	unsigned int blocksWide = (width + 3) / 4;
+	unsigned int blocksHigh = (height + 3) / 4;
+
+	unsigned char block[64];
+	unsigned char channel[16];
+	unsigned char encoded[8];
+	for (unsigned int by = 0; by < blocksHigh; by++)
+	{
+		for (unsigned int bx = 0; bx < blocksWide; bx++)
+		{
+			GatherBlock(rgba, width, height, bx, by, block);
+			if (usage == TEXTURE_ALBEDO)
+			{
+				CompressBC1Block(block, encoded);
+				out.insert(out.end(), encoded, encoded + 8);
+				continue;
+			}
+
+			// BC4 is red only, BC5 is red then green
+			int channelCount = usage == TEXTURE_NORMAL_MAP ? 2 : 1;
+			for (int c = 0; c < channelCount; c++)
+			{
+				for (int i = 0; i < 16; i++)
+					channel[i] = block[i * 4 + c];
+				CompressBC4Block(channel, encoded);
+				out.insert(out.end(), encoded, encoded + 8);
+			}
+		}
+	}
+}
+
+bool CookTexture(const unsigned char* rgba, unsigned int width, unsigned int height, TextureUsage usage, CookedTexture& cooked)
+{
+	if (usage == TEXTURE_UNCOMPRESSED || width == 0 || height == 0 || width % 4 != 0 || height % 4 != 0)
+		return false;
+
+	switch (usage)
+	{
+	case TEXTURE_ALBEDO: cooked.Format = DXGI_FORMAT_BC1_UNORM_SRGB; break;
+	case TEXTURE_NORMAL_MAP: cooked.Format = DXGI_FORMAT_BC5_UNORM; break;
+	default: cooked.Format = DXGI_FORMAT_BC4_UNORM; break;
+	}
+	unsigned int blockSize = usage == TEXTURE_NORMAL_MAP ? 16 : 8;
+
+	cooked.Width = width;
+	cooked.Height = height;
+	cooked.MipLevels = 1;
+	for (unsigned int size = max(width, height); size > 1; size /= 2)
+		cooked.MipLevels++;
+
+	cooked.Data.clear();
+	cooked.LevelOffsets.clear();
+	cooked.LevelPitches.clear();
+
+	// Level 0 is compressed straight from the source, and each level
+	// after that is filtered down from the one above it
+	std::vector<float> level((size_t)width * height * 4);
+	std::vector<float> nextLevel;
+	std::vector<unsigned char> levelBytes(rgba, rgba + (size_t)width * height * 4);
+	DecodeForFiltering(rgba, (size_t)width * height, usage, level.data());
+
+	unsigned int levelWidth = width;
+	unsigned int levelHeight = height;
+	for (unsigned int mip = 0; mip < cooked.MipLevels; mip++)
+	{
+		if (mip > 0)
+		{
+			unsigned int nextWidth = max(levelWidth / 2, 1u);
+			unsigned int nextHeight = max(levelHeight / 2, 1u);
+			nextLevel.resize((size_t)nextWidth * nextHeight * 4);
+			DownsampleFloat(level.data(), levelWidth, levelHeight, nextLevel.data());
+			level.swap(nextLevel);
+			levelWidth = nextWidth;
+			levelHeight = nextHeight;
+
+			levelBytes.resize((size_t)levelWidth * levelHeight * 4);
+			EncodeAfterFiltering(level.data(), (size_t)levelWidth * levelHeight, usage, levelBytes.data());
+		}
+
+		cooked.LevelOffsets.push_back(cooked.Data.size());
+		cooked.LevelPitches.push_back(((levelWidth + 3) / 4) * blockSize);
+		CompressLevel(levelBytes.data(), levelWidth, levelHeight, usage, cooked.Data);
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------
+// DDS files, always written with the DX10 header extension
+// so the exact DXGI format (including sRGB) is preserved
+// --------------------------------------------------------
+
+#define DDS_MAGIC			0x20534444 // "DDS "
+#define DDS_FOURCC_DX10		0x30315844 // "DX10"
+#define DDSD_CAPS			0x1
+#define DDSD_HEIGHT			0x2
+#define DDSD_WIDTH			0x4
+#define DDSD_PIXELFORMAT	0x1000
+#define DDSD_MIPMAPCOUNT	0x20000
+#define DDPF_FOURCC			0x4
+#define DDSCAPS_COMPLEX		0x8
+#define DDSCAPS_TEXTURE		0x1000
+#define DDSCAPS_MIPMAP		0x400000
+#define DDSCAPS2_CUBEMAP_ALL	0xFE00 // The cube flag and all six faces
+#define DDS_MISC_TEXTURECUBE	0x4 // D3D11_RESOURCE_MISC_TEXTURECUBE
+
+struct CookedDDSHeader
+{
+	unsigned int Magic;
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int Height;
+	unsigned int Width;
+	unsigned int PitchOrLinearSize;
+	unsigned int Depth;
+	unsigned int MipMapCount;
+	unsigned int Reserved1[11];
+
+	// Pixel format
+	unsigned int FormatSize;
+	unsigned int FormatFlags;
+	unsigned int FourCC;
+	unsigned int RGBBitCount;
+	unsigned int BitMasks[4];
+
+	unsigned int Caps[4];
+	unsigned int Reserved2;
+
+	// DX10 extension
+	DXGI_FORMAT DXGIFormat;
+	unsigned int ResourceDimension;
+	unsigned int MiscFlag;
+	unsigned int ArraySize;
+	unsigned int MiscFlags2;
+};
+
+std::wstring GetCookedTexturePath(const std::wstring& sourceFile, TextureUsage usage)
+{
+	switch (usage)
+	{
+	case TEXTURE_ALBEDO: return sourceFile + L".bc1.dds";
+	case TEXTURE_NORMAL_MAP: return sourceFile + L".bc5.dds";
+	default: return sourceFile + L".bc4.dds";
+	}
+}
+
+// The cooked file is current if it was written after the source
+bool IsCookedTextureCurrent(const std::wstring& sourceFile, const std::wstring& cookedFile)
+{
+	WIN32_FILE_ATTRIBUTE_DATA source = {};
+	WIN32_FILE_ATTRIBUTE_DATA cooked = {};
+	if (!GetFileAttributesExW(sourceFile.c_str(), GetFileExInfoStandard, &source) ||
+		!GetFileAttributesExW(cookedFile.c_str(), GetFileExInfoStandard, &cooked))
+		return false;
+
+	return CompareFileTime(&cooked.ftLastWriteTime, &source.ftLastWriteTime) >= 0;
+}
+
+// Writes to a temporary file first and then swaps it in, so a failed
+// write never leaves a truncated file behind that looks current
+bool WriteDDSFile(
+	const std::wstring& file,
+	DXGI_FORMAT format,
+	unsigned int width,
+	unsigned int height,
+	unsigned int mipLevels,
+	unsigned int arraySize,
+	bool cube,
+	const void* data,
+	size_t dataSize)
+{
+	CookedDDSHeader h = {};
+	h.Magic = DDS_MAGIC;
+	h.Size = 124;
+	h.Flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+	h.Height = height;
+	h.Width = width;
+	h.MipMapCount = mipLevels;
+	h.FormatSize = 32;
+	h.FormatFlags = DDPF_FOURCC;
+	h.FourCC = DDS_FOURCC_DX10;
+	h.Caps[0] = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	h.Caps[1] = cube ? DDSCAPS2_CUBEMAP_ALL : 0;
+	h.DXGIFormat = format;
+	h.ResourceDimension = 3; // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+	h.MiscFlag = cube ? DDS_MISC_TEXTURECUBE : 0;
+	h.ArraySize = cube ? arraySize / 6 : arraySize; // Cubes count whole cubes
+
+	std::wstring tempFile = file + L".tmp";
+	FILE* out = 0;
+	if (_wfopen_s(&out, tempFile.c_str(), L"wb") != 0 || !out)
+		return false;
+
+	bool written =
+		fwrite(&h, sizeof(h), 1, out) == 1 &&
+		fwrite(data, 1, dataSize, out) == dataSize;
+	fclose(out);
+
+	if (!written || !MoveFileExW(tempFile.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(tempFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool WriteCookedTexture(const std::wstring& cookedFile, const CookedTexture& cooked)
+{
+	return WriteDDSFile(cookedFile, cooked.Format, cooked.Width, cooked.Height, cooked.MipLevels, 1, false, cooked.Data.data(), cooked.Data.size());
+}
+
+static bool IsCookedFormat(DXGI_FORMAT format)
+{
+	return
+		format == DXGI_FORMAT_BC1_UNORM_SRGB ||
+		format == DXGI_FORMAT_BC4_UNORM ||
+		format == DXGI_FORMAT_BC5_UNORM;
+}
+
+// Only files laid out the way WriteCookedTexture() writes them are read back
+static bool ReadCookedHeader(FILE* in, CookedDDSHeader& h)
+{
+	return
+		fread(&h, sizeof(h), 1, in) == 1 &&
+		h.Magic == DDS_MAGIC &&
+		h.FourCC == DDS_FOURCC_DX10 &&
+		h.ArraySize == 1 &&
+		h.Width > 0 && h.Height > 0 &&
+		h.MipMapCount > 0 && h.MipMapCount <= 15 && // D3D11_REQ_MIP_LEVELS
+		IsCookedFormat(h.DXGIFormat);
+}
+
+bool ReadCookedTextureInfo(const std::wstring& cookedFile, CookedTexture& info)
+{
+	FILE* in = 0;
+	if (_wfopen_s(&in, cookedFile.c_str(), L"rb") != 0 || !in)
+		return false;
+
+	CookedDDSHeader h = {};
+	bool valid = ReadCookedHeader(in, h);
+	fclose(in);
+	if (!valid)
+		return false;
+
+	info.Format = h.DXGIFormat;
+	info.Width = h.Width;
+	info.Height = h.Height;
+	info.MipLevels = h.MipMapCount;
+	info.Data.clear();
+	info.LevelOffsets.clear();
+	info.LevelPitches.clear();
+	return true;
+}
+
+// Reads a cooked file starting at the given mip, skipping everything
+// above it, so the result is a smaller texture with its own level 0
+bool ReadCookedTexture(const std::wstring& cookedFile, unsigned int firstMip, CookedTexture& cooked)
+{
+	FILE* in = 0;
+	if (_wfopen_s(&in, cookedFile.c_str(), L"rb") != 0 || !in)
+		return false;
+
+	CookedDDSHeader h = {};
+	if (!ReadCookedHeader(in, h) || firstMip >= h.MipMapCount)
+	{
+		fclose(in);
+		return false;
+	}
+
+	// Where the first wanted level starts, and how much follows it
+	unsigned int blockSize = h.DXGIFormat == DXGI_FORMAT_BC5_UNORM ? 16 : 8;
+	size_t skipped = 0;
+	size_t wanted = 0;
+	cooked.LevelOffsets.clear();
+	cooked.LevelPitches.clear();
+	for (unsigned int mip = 0; mip < h.MipMapCount; mip++)
+	{
+		unsigned int blocksWide = (max(h.Width >> mip, 1u) + 3) / 4;
+		unsigned int blocksHigh = (max(h.Height >> mip, 1u) + 3) / 4;
+		size_t levelSize = (size_t)blocksWide * blocksHigh * blockSize;
+		if (mip < firstMip)
+		{
+			skipped += levelSize;
+			continue;
+		}
+
+		cooked.LevelOffsets.push_back(wanted);
+		cooked.LevelPitches.push_back(blocksWide * blockSize);
+		wanted += levelSize;
+	}
+
+	cooked.Data.resize(wanted);
+	bool read =
+		_fseeki64(in, (__int64)(sizeof(h) + skipped), SEEK_SET) == 0 &&
+		fread(cooked.Data.data(), 1, wanted, in) == wanted;
+	fclose(in);
+	if (!read)
+		return false;
+
+	cooked.Format = h.DXGIFormat;
+	cooked.Width = max(h.Width >> firstMip, 1u);
+	cooked.Height = max(h.Height >> firstMip, 1u);
+	cooked.MipLevels = h.MipMapCount - firstMip;
+	return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <dxgiformat.h>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// How a texture is used, which decides how it's cooked
+// into a block-compressed DDS file (see CookTexture())
+// --------------------------------------------------------
+enum TextureUsage
+{
+	TEXTURE_UNCOMPRESSED,	// Not cooked: RGBA8, or R8 for grayscale files
+	TEXTURE_ALBEDO,			// BC1 sRGB, mips filtered in linear space
+	TEXTURE_NORMAL_MAP,		// BC5 (x and y only - the shader rebuilds z)
+	TEXTURE_SINGLE_CHANNEL	// BC4 from the red channel (roughness, metal)
+};
+
+// --------------------------------------------------------
+// A cooked texture: every mip level, block-compressed and
+// packed one after another, top level first
+// --------------------------------------------------------
+struct CookedTexture
+{
+	DXGI_FORMAT Format;
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int MipLevels;
+	std::vector<unsigned char> Data;
+	std::vector<size_t> LevelOffsets;	// Into Data
+	std::vector<unsigned int> LevelPitches;	// Bytes per row of blocks
+};
+
+// Builds a full mip chain from RGBA8 pixels and compresses each level.
+// The top level must be a multiple of 4 pixels in each dimension
+bool CookTexture(const unsigned char* rgba, unsigned int width, unsigned int height, TextureUsage usage, CookedTexture& cooked);
+
+// Compresses one 4x4 block, with pixels in row order
+void CompressBC1Block(const unsigned char rgba[64], unsigned char out[8]);
+void CompressBC4Block(const unsigned char values[16], unsigned char out[8]);
+
+// The cooked DDS files live next to their sources, and are rebuilt
+// whenever the source is newer
+std::wstring GetCookedTexturePath(const std::wstring& sourceFile, TextureUsage usage);
+bool IsCookedTextureCurrent(const std::wstring& sourceFile, const std::wstring& cookedFile);
+bool WriteCookedTexture(const std::wstring& cookedFile, const CookedTexture& cooked);
+
+// Writes any 2D texture, array or cube as a DDS file.  The data holds
+// each array slice's whole mip chain in turn, with rows tightly packed
+bool WriteDDSFile(
+	const std::wstring& file,
+	DXGI_FORMAT format,
+	unsigned int width,
+	unsigned int height,
+	unsigned int mipLevels,
+	unsigned int arraySize,
+	bool cube,
+	const void* data,
+	size_t dataSize);
+
+// Reads a cooked file back.  The info version only fills in the format,
+// size and mip count.  The other skips the levels above firstMip, which
+// is how the texture streamer loads partial mip chains
+bool ReadCookedTextureInfo(const std::wstring& cookedFile, CookedTexture& info);
+bool ReadCookedTexture(const std::wstring& cookedFile, unsigned int firstMip, CookedTexture& cooked);
@@ -0,0 +1,383 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+
+using namespace DirectX;
+
+TextureStreamer::TextureStreamer(
+	std::shared_ptr<AssetLoader> loader,
+	size_t budgetBytes,
+	unsigned int baseMipSize,
+	unsigned int maxLoadsInFlight)
+	:
+	loader(loader),
+	budgetBytes(budgetBytes),
+	baseMipSize(baseMipSize),
+	maxLoadsInFlight(maxLoadsInFlight),
+	frame(0),
+	streamedInCount(0),
+	evictionCount(0)
+{
+}
+
+// Creates the texture from the given mips of a cooked file
+static StreamedMipChain LoadMipChain(AssetLoader* loader, const std::wstring& cookedFile, unsigned int firstMip)
+{
+	StreamedMipChain chain = {};
+	chain.Streamable = true;
+
+	CookedTexture cooked;
+	if (!ReadCookedTexture(cookedFile, firstMip, cooked))
+		return chain;
+
+	std::vector<D3D11_SUBRESOURCE_DATA> initialData(cooked.MipLevels);
+	for (unsigned int i = 0; i < cooked.MipLevels; i++)
+	{
+		initialData[i].pSysMem = &cooked.Data[cooked.LevelOffsets[i]];
+		initialData[i].SysMemPitch = cooked.LevelPitches[i];
+	}
+
+	chain.SRV = loader->CreateTextureSRV(cooked.Width, cooked.Height, cooked.MipLevels, cooked.Format, initialData.data());
+	chain.FirstMip = firstMip;
+	chain.Bytes = cooked.Data.size();
+	return chain;
+}
+
+// The finest mip that's still small enough to always keep resident.
+// Block-compressed textures need a top level that's a multiple of 4
+static unsigned int GetBaseMip(const CookedTexture& info, unsigned int baseMipSize)
+{
+	unsigned int mip = 0;
+	while (mip + 1 < info.MipLevels &&
+		max(info.Width >> mip, info.Height >> mip) > baseMipSize &&
+		(info.Width >> (mip + 1)) % 4 == 0 &&
+		(info.Height >> (mip + 1)) % 4 == 0)
+		mip++;
+	return mip;
+}
+
+// Queues the texture's first load: its base mips, cooking its DDS file
+// first if needed.  Anything that can't be cooked is loaded whole
+std::shared_ptr<StreamedTexture> TextureStreamer::Load(const std::wstring& file, TextureUsage usage)
+{
+	std::shared_ptr<StreamedTexture> texture = std::make_shared<StreamedTexture>();
+	texture->SourceFile = file;
+	texture->Usage = usage;
+	texture->Streamable = false;
+	texture->Format = DXGI_FORMAT_UNKNOWN;
+	texture->Width = 0;
+	texture->Height = 0;
+	texture->MipLevels = 0;
+	texture->BaseMip = 0;
+	texture->Version = 0;
+	texture->ResidentMip = 0;
+	texture->ResidentBytes = 0;
+	texture->RequestedMip = 0;
+	texture->LastUsedFrame = 0;
+	texture->PendingMip = 0;
+
+	AssetLoader* loader = this->loader.get();
+	unsigned int baseMipSize = this->baseMipSize;
+	texture->Pending = loader->Run<StreamedMipChain>([loader, file, usage, baseMipSize]()
+	{
+		StreamedMipChain chain = {};
+		if (usage != TEXTURE_UNCOMPRESSED)
+		{
+			std::wstring cookedFile = GetCookedTexturePath(file, usage);
+			if (!IsCookedTextureCurrent(file, cookedFile))
+				loader->CookTextureFile(file, usage);
+
+			CookedTexture info;
+			if (ReadCookedTextureInfo(cookedFile, info))
+			{
+				chain = LoadMipChain(loader, cookedFile, GetBaseMip(info, baseMipSize));
+				chain.Format = info.Format;
+				chain.Width = info.Width;
+				chain.Height = info.Height;
+				chain.MipLevels = info.MipLevels;
+			}
+		}
+		if (chain.SRV)
+			return chain;
+
+		// Not streamable, so it's resident at full size from here on
+		chain = {};
+		chain.SRV = loader->CreateTexture(file, usage, true);
+		if (chain.SRV)
+		{
+			Microsoft::WRL::ComPtr<ID3D11Texture2D> resource;
+			chain.SRV->GetResource((ID3D11Resource**)resource.GetAddressOf());
+
+			D3D11_TEXTURE2D_DESC desc = {};
+			resource->GetDesc(&desc);
+			size_t bytesPerPixel = desc.Format == DXGI_FORMAT_R8_UNORM ? 1 : 4;
+			for (unsigned int i = 0; i < desc.MipLevels; i++)
+				chain.Bytes += (size_t)max(desc.Width >> i, 1u) * max(desc.Height >> i, 1u) * bytesPerPixel;
+
+			chain.Format = desc.Format;
+			chain.Width = desc.Width;
+			chain.Height = desc.Height;
+			chain.MipLevels = desc.MipLevels;
+		}
+		return chain;
+	});
+
+	textures.push_back(texture);
+	return texture;
+}
+
+// Starts a new frame of requests.  Nothing needs more than its base
+// mips until a visible entity asks for more
+void TextureStreamer::BeginFrame()
+{
+	frame++;
+	for (auto& t : textures)
+		t->RequestedMip = t->BaseMip;
+}
+
+// Works out the mip each of the entity's textures needs from how many
+// pixels tall its bounding sphere is, compared to how many texels cover
+// it (after the material's UV scale)
+void TextureStreamer::RequestMips(GameEntity* entity, std::shared_ptr<Camera> camera, float screenHeight)
+{
+	std::shared_ptr<Material> material = entity->GetMaterial();
+	const auto& streamed = material->GetStreamedTextures();
+	if (streamed.empty())
+		return;
+
+	BoundingSphere sphere = entity->GetWorldBoundingSphere();
+	XMFLOAT3 cameraPos = camera->GetTransform()->GetPosition();
+	float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&sphere.Center), XMLoadFloat3(&cameraPos))));
+
+	// Inside the sphere, everything is as close as it gets
+	float pixels = screenHeight;
+	if (distance > sphere.Radius)
+		pixels = sphere.Radius * screenHeight / (distance * tanf(camera->GetFieldOfView() * 0.5f));
+
+	XMFLOAT2 uvScale = material->GetUVScale();
+	float repeats = max(fabsf(uvScale.x), fabsf(uvScale.y));
+
+	for (auto& s : streamed)
+	{
+		StreamedTexture* t = s.second.get();
+		t->LastUsedFrame = frame;
+		if (!t->Streamable)
+			continue;
+
+		float texels = max(t->Width, t->Height) * repeats;
+		unsigned int mip = 0;
+		if (texels > pixels && pixels > 0)
+			mip = (unsigned int)floorf(log2f(texels / pixels));
+
+		t->RequestedMip = min(t->RequestedMip, min(mip, t->BaseMip));
+	}
+}
+
+// Swaps in finished loads, then starts new ones for textures that need
+// finer mips, evicting the least recently used ones to stay in budget
+void TextureStreamer::Update()
+{
+	for (auto& t : textures)
+	{
+		if (t->Pending.valid() &&
+			t->Pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			Apply(t.get());
+	}
+
+	size_t committed = GetCommittedBytes();
+	unsigned int inFlight = GetStreamingCount();
+
+	// Over budget (say, after the budget was lowered) - drop whatever
+	// hasn't been needed in a while
+	if (committed > budgetBytes)
+		MakeRoom(committed - budgetBytes, 0);
+
+	// Textures furthest from what they need go first
+	std::vector<StreamedTexture*> wanted;
+	for (auto& t : textures)
+	{
+		if (t->Streamable && !t->Pending.valid() && t->RequestedMip < t->ResidentMip)
+			wanted.push_back(t.get());
+	}
+	std::sort(wanted.begin(), wanted.end(), [](StreamedTexture* a, StreamedTexture* b)
+	{
+		return a->ResidentMip - a->RequestedMip > b->ResidentMip - b->RequestedMip;
+	});
+
+	for (auto t : wanted)
+	{
+		if (inFlight >= maxLoadsInFlight)
+			break;
+
+		// Settle for a coarser mip if the one that's needed won't fit
+		committed = GetCommittedBytes();
+		unsigned int mip = t->RequestedMip;
+		while (mip < t->ResidentMip)
+		{
+			size_t needed = GetChainBytes(t, mip) - t->ResidentBytes;
+			if (committed + needed <= budgetBytes ||
+				MakeRoom(committed + needed - budgetBytes, t))
+				break;
+			mip++;
+		}
+		if (mip >= t->ResidentMip)
+			continue;
+
+		Stream(t, mip);
+		streamedInCount++;
+		inFlight++;
+	}
+}
+
+// Swaps a finished load in.  The old texture is released here, and
+// D3D keeps it alive until the GPU is done with it
+void TextureStreamer::Apply(StreamedTexture* texture)
+{
+	StreamedMipChain chain = texture->Pending.get();
+	texture->Pending = std::shared_future<StreamedMipChain>();
+
+	// A failed load leaves whatever was resident in place
+	if (!chain.SRV)
+		return;
+
+	// The first load is also where the texture's details come from
+	if (texture->MipLevels == 0)
+	{
+		texture->Streamable = chain.Streamable;
+		texture->Format = chain.Format;
+		texture->Width = chain.Width;
+		texture->Height = chain.Height;
+		texture->MipLevels = chain.MipLevels;
+		texture->BaseMip = chain.FirstMip;
+		texture->RequestedMip = chain.FirstMip;
+	}
+
+	texture->SRV = chain.SRV;
+	texture->ResidentMip = chain.FirstMip;
+	texture->ResidentBytes = chain.Bytes;
+	texture->Version++;
+}
+
+// Queues a load of the texture from the given mip down, finer or coarser
+void TextureStreamer::Stream(StreamedTexture* texture, unsigned int mip)
+{
+	AssetLoader* loader = this->loader.get();
+	std::wstring cookedFile = GetCookedTexturePath(texture->SourceFile, texture->Usage);
+	texture->PendingMip = mip;
+	texture->Pending = loader->Run<StreamedMipChain>([loader, cookedFile, mip]()
+	{
+		return LoadMipChain(loader, cookedFile, mip);
+	});
+}
+
+// Frees at least the given number of bytes (once the loads finish),
+// least recently used textures first.  Those drop back to their base
+// mips, while ones used this frame only drop the mips they no longer
+// need.  Returns false if there isn't enough to free, and then frees
+// nothing
+bool TextureStreamer::MakeRoom(size_t needed, StreamedTexture* keep)
+{
+	std::vector<std::pair<StreamedTexture*, unsigned int>> candidates;
+	size_t freeable = 0;
+	for (auto& t : textures)
+	{
+		if (t.get() == keep || !t->Streamable || t->Pending.valid())
+			continue;
+
+		unsigned int target = t->LastUsedFrame == frame ? t->RequestedMip : t->BaseMip;
+		if (t->ResidentMip >= target)
+			continue;
+
+		candidates.push_back({ t.get(), target });
+		freeable += t->ResidentBytes - GetChainBytes(t.get(), target);
+	}
+	if (freeable < needed)
+		return false;
+
+	std::sort(candidates.begin(), candidates.end(),
+		[](const std::pair<StreamedTexture*, unsigned int>& a, const std::pair<StreamedTexture*, unsigned int>& b)
+		{ return a.first->LastUsedFrame < b.first->LastUsedFrame; });
+
+	size_t freed = 0;
+	for (auto& c : candidates)
+	{
+		if (freed >= needed)
+			break;
+
+		freed += c.first->ResidentBytes - GetChainBytes(c.first, c.second);
+		Stream(c.first, c.second);
+		evictionCount++;
+	}
+	return true;
+}
+
+// Waits for every load, so nothing is missing once this returns
+void TextureStreamer::Flush()
+{
+	for (auto& t : textures)
+	{
+		if (t->Pending.valid())
+			Apply(t.get());
+	}
+}
+
+// VRAM in use once every load in flight has been swapped in
+size_t TextureStreamer::GetCommittedBytes()
+{
+	size_t total = 0;
+	for (auto& t : textures)
+	{
+		if (t->Pending.valid() && t->MipLevels > 0)
+			total += GetChainBytes(t.get(), t->PendingMip);
+		else
+			total += t->ResidentBytes;
+	}
+	return total;
+}
+
+// The size of a cooked texture's mips from the given level down
+size_t TextureStreamer::GetChainBytes(const StreamedTexture* texture, unsigned int firstMip)
+{
+	size_t blockSize = texture->Format == DXGI_FORMAT_BC5_UNORM ? 16 : 8;
+	size_t total = 0;
+	for (unsigned int mip = firstMip; mip < texture->MipLevels; mip++)
+	{
+		size_t blocksWide = (max(texture->Width >> mip, 1u) + 3) / 4;
+		size_t blocksHigh = (max(texture->Height >> mip, 1u) + 3) / 4;
+		total += blocksWide * blocksHigh * blockSize;
+	}
+	return total;
+}
+
+unsigned int TextureStreamer::GetStreamingCount()
+{
+	unsigned int count = 0;
+	for (auto& t : textures)
+	{
+		if (t->Pending.valid())
+			count++;
+	}
+	return count;
+}
+
+// Textures with their entire mip chain on the GPU
+unsigned int TextureStreamer::GetFullyResidentCount()
+{
+	unsigned int count = 0;
+	for (auto& t : textures)
+	{
+		if (t->MipLevels > 0 && t->ResidentMip == 0)
+			count++;
+	}
+	return count;
+}
+
+size_t TextureStreamer::GetResidentBytes()
+{
+	size_t total = 0;
+	for (auto& t : textures)
+		total += t->ResidentBytes;
+	return total;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <future>
+
+#include "AssetLoader.h"
+#include "TextureCooker.h"
+#include "GameEntity.h"
+#include "Camera.h"
+
+// --------------------------------------------------------
+// The mips of one texture that a streaming load produced:
+// a texture holding every level from FirstMip down
+// --------------------------------------------------------
+struct StreamedMipChain
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+	unsigned int FirstMip;
+	size_t Bytes;
+
+	// Filled in by the first load, from the cooked file
+	bool Streamable;
+	DXGI_FORMAT Format;
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int MipLevels;
+};
+
+// --------------------------------------------------------
+// A texture whose finer mips are streamed in and out.
+//
+// Materials hold these in place of an SRV (see Material::
+// AddTextureSRV()) and rebind whenever Version changes.
+// Everything here is owned and updated by TextureStreamer
+// on the main thread - other code should only read it.
+// --------------------------------------------------------
+struct StreamedTexture
+{
+	std::wstring SourceFile;
+	TextureUsage Usage;
+
+	// The full mip chain, known once the first load finishes.
+	// Textures that couldn't be cooked are loaded whole instead,
+	// and are never streamed
+	bool Streamable;
+	DXGI_FORMAT Format;
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int MipLevels;
+	unsigned int BaseMip;		// Always resident, and never evicted
+
+	// What's on the GPU right now, swapped whole when a load finishes
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+	unsigned int Version;
+	unsigned int ResidentMip;
+	size_t ResidentBytes;
+
+	// What the visible entities need, and when it was last needed
+	unsigned int RequestedMip;
+	unsigned int LastUsedFrame;
+
+	// At most one load in flight per texture
+	std::shared_future<StreamedMipChain> Pending;
+	unsigned int PendingMip;
+};
+
+// --------------------------------------------------------
+// Streams texture mips based on how large the entities
+// using them are on screen.
+//
+// Each texture first loads only its low mips (BaseMip and
+// coarser), straight from its cooked DDS file.  Every frame
+// the visible entities request the mip their screen size
+// needs, and finer mips are read on the asset loader's
+// workers into a new texture, which replaces the old one
+// between frames.  A VRAM budget is kept by dropping the
+// least recently used textures back to their base mips.
+// --------------------------------------------------------
+class TextureStreamer
+{
+public:
+	TextureStreamer(
+		std::shared_ptr<AssetLoader> loader,
+		size_t budgetBytes = 128 * 1024 * 1024,
+		unsigned int baseMipSize = 64,
+		unsigned int maxLoadsInFlight = 4);
+
+	// Queues the first (low mip) load of a texture
+	std::shared_ptr<StreamedTexture> Load(const std::wstring& file, TextureUsage usage);
+
+	// Called each frame: BeginFrame(), RequestMips() for each
+	// visible entity, then Update() before drawing
+	void BeginFrame();
+	void RequestMips(GameEntity* entity, std::shared_ptr<Camera> camera, float screenHeight);
+	void Update();
+
+	// Waits for every load in flight and swaps them all in
+	void Flush();
+
+	size_t GetBudget() { return budgetBytes; }
+	void SetBudget(size_t bytes) { budgetBytes = bytes; }
+
+	// Stats
+	unsigned int GetTextureCount() { return (unsigned int)textures.size(); }
+	unsigned int GetStreamingCount();
+	unsigned int GetFullyResidentCount();
+	size_t GetResidentBytes();
+	unsigned int GetStreamedInCount() { return streamedInCount; }
+	unsigned int GetEvictionCount() { return evictionCount; }
+
+private:
+	std::shared_ptr<AssetLoader> loader;
+	std::vector<std::shared_ptr<StreamedTexture>> textures;
+
+	size_t budgetBytes;
+	unsigned int baseMipSize;
+	unsigned int maxLoadsInFlight;
+	unsigned int frame;
+
+	unsigned int streamedInCount;
+	unsigned int evictionCount;
+
+	void Apply(StreamedTexture* texture);
+	void Stream(StreamedTexture* texture, unsigned int mip);
+	size_t GetCommittedBytes();
+	bool MakeRoom(size_t needed, StreamedTexture* keep);
+
+	static size_t GetChainBytes(const StreamedTexture* texture, unsigned int firstMip);
+};
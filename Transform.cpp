@@ -1,122 +1,115 @@
 #include "Transform.h"
+#include "TransformPool.h"
 
 using namespace DirectX;
 
 
 Transform::Transform()
 {
-	// Start with an identity matrix and basic transform data
-	XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
-	XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixIdentity());
-
-	position = XMFLOAT3(0, 0, 0);
-	pitchYawRoll = XMFLOAT3(0, 0, 0);
-	scale = XMFLOAT3(1, 1, 1);
+	// Starts as an identity transform
+	pool = &TransformPool::GetInstance();
+	handle = pool->Allocate();
+}
 
-	// No need to recalc yet
-	matricesDirty = false;
+Transform::~Transform()
+{
+	pool->Free(handle);
 }
 
 void Transform::MoveAbsolute(float x, float y, float z)
 {
+	XMFLOAT3& position = pool->positions[pool->slots[handle]];
 	position.x += x;
 	position.y += y;
 	position.z += z;
-	matricesDirty = true;
+	pool->MarkDirty(pool->slots[handle]);
 }
 
 void Transform::MoveRelative(float x, float y, float z)
 {
 	// Create a direction vector from the params
-	// and a rotation quaternion
+	// and rotate it by the rotation quaternion
 	XMVECTOR movement = XMVectorSet(x, y, z, 0);
-	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
-
-	// Rotate the movement by the quaternion
-	XMVECTOR dir = XMVector3Rotate(movement, rotQuat);
+	XMVECTOR dir = XMVector3Rotate(movement, XMLoadFloat4(&pool->rotations[pool->slots[handle]]));
 
 	// Add and store, and invalidate the matrices
+	XMFLOAT3& position = pool->positions[pool->slots[handle]];
 	XMStoreFloat3(&position, XMLoadFloat3(&position) + dir);
-	matricesDirty = true;
+	pool->MarkDirty(pool->slots[handle]);
 }
 
 void Transform::Rotate(float p, float y, float r)
 {
+	XMFLOAT3& pitchYawRoll = pool->pitchYawRolls[pool->slots[handle]];
 	pitchYawRoll.x += p;
 	pitchYawRoll.y += y;
 	pitchYawRoll.z += r;
-	matricesDirty = true;
+	UpdateRotation();
 }
 
 void Transform::Scale(float x, float y, float z)
 {
+	XMFLOAT3& scale = pool->scales[pool->slots[handle]];
 	scale.x *= x;
 	scale.y *= y;
 	scale.z *= z;
-	matricesDirty = true;
+	pool->MarkDirty(pool->slots[handle]);
 }
 
 void Transform::SetPosition(float x, float y, float z)
 {
-	position.x = x;
-	position.y = y;
-	position.z = z;
-	matricesDirty = true;
+	pool->positions[pool->slots[handle]] = XMFLOAT3(x, y, z);
+	pool->MarkDirty(pool->slots[handle]);
 }
 
 void Transform::SetRotation(float p, float y, float r)
 {
-	pitchYawRoll.x = p;
-	pitchYawRoll.y = y;
-	pitchYawRoll.z = r;
-	matricesDirty = true;
+	pool->pitchYawRolls[pool->slots[handle]] = XMFLOAT3(p, y, r);
+	UpdateRotation();
 }
 
 void Transform::SetScale(float x, float y, float z)
 {
-	scale.x = x;
-	scale.y = y;
-	scale.z = z;
-	matricesDirty = true;
+	pool->scales[pool->slots[handle]] = XMFLOAT3(x, y, z);
+	pool->MarkDirty(pool->slots[handle]);
+}
+
+void Transform::UpdateRotation()
+{
+	XMStoreFloat4(&pool->rotations[pool->slots[handle]], XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pool->pitchYawRolls[pool->slots[handle]])));
+	pool->MarkDirty(pool->slots[handle]);
 }
 
-DirectX::XMFLOAT3 Transform::GetPosition() { return position; }
+bool Transform::SetParent(Transform* parent)
+{
+	return pool->SetParent(handle, parent ? parent->handle : TransformPool::InvalidHandle);
+}
+
+bool Transform::HasParent()
+{
+	return pool->GetParent(handle) != TransformPool::InvalidHandle;
+}
+
+DirectX::XMFLOAT3 Transform::GetPosition() { return pool->positions[pool->slots[handle]]; }
+
+DirectX::XMFLOAT3 Transform::GetPitchYawRoll() { return pool->pitchYawRolls[pool->slots[handle]]; }
 
-DirectX::XMFLOAT3 Transform::GetPitchYawRoll() { return pitchYawRoll; }
+DirectX::XMFLOAT3 Transform::GetScale() { return pool->scales[pool->slots[handle]]; }
 
-DirectX::XMFLOAT3 Transform::GetScale() { return scale; }
+unsigned int Transform::GetVersion() { return pool->versions[pool->slots[handle]]; }
 
 
 DirectX::XMFLOAT4X4 Transform::GetWorldMatrix()
 {
-	UpdateMatrices();
-	return worldMatrix;
+	return pool->GetMatrices(handle).World;
 }
 
 DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
 {
-	UpdateMatrices();
-	return worldMatrix;
+	return pool->GetMatrices(handle).WorldInverseTranspose;
 }
 
-void Transform::UpdateMatrices()
+const InstanceData& Transform::GetMatrices()
 {
-	// Are the matrices out of date (dirty)?
-	if (matricesDirty)
-	{
-		// Create the three transformation pieces
-		XMMATRIX trans = XMMatrixTranslationFromVector(XMLoadFloat3(&position));
-		XMMATRIX rot = XMMatrixRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
-		XMMATRIX sc = XMMatrixScalingFromVector(XMLoadFloat3(&scale));
-
-		// Combine and store the world
-		XMMATRIX wm = sc * rot * trans;
-		XMStoreFloat4x4(&worldMatrix, wm);
-
-		// Invert and transpose, too
-		XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixInverse(0, XMMatrixTranspose(wm)));
-
-		// All set
-		matricesDirty = false;
-	}
+	return pool->GetMatrices(handle);
 }
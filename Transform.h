@@ -1,11 +1,24 @@
 #pragma once
 
 #include <DirectXMath.h>
+#include "Vertex.h"
 
+class TransformPool;
+
+// --------------------------------------------------------
+// A handle to one transform in the TransformPool, which
+// holds the actual data and matrices.  Position, rotation
+// and scale are relative to the parent, if there is one
+// --------------------------------------------------------
 class Transform
 {
 public:
 	Transform();
+	~Transform();
+
+	// Each transform owns its slot in the pool
+	Transform(const Transform&) = delete;
+	Transform& operator=(const Transform&) = delete;
 
 	void MoveAbsolute(float x, float y, float z);
 	void MoveRelative(float x, float y, float z);
@@ -16,24 +29,30 @@ public:
 	void SetRotation(float p, float y, float r);
 	void SetScale(float x, float y, float z);
 
+	// Moves with the parent from then on, or detaches given null.
+	// Fails if the parent is this or is attached to it
+	bool SetParent(Transform* parent);
+	bool HasParent();
+
 	DirectX::XMFLOAT3 GetPosition();
 	DirectX::XMFLOAT3 GetPitchYawRoll();
 	DirectX::XMFLOAT3 GetScale();
 	DirectX::XMFLOAT4X4 GetWorldMatrix();
 	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
 
+	// Both matrices, laid out as instance data
+	const InstanceData& GetMatrices();
+
+	// Incremented every time the transform changes, so other
+	// systems can tell when cached data (like bounds) is stale
+	unsigned int GetVersion();
+
+	unsigned int GetHandle() { return handle; }
+
 private:
-	// Raw transformation data
-	DirectX::XMFLOAT3 position;
-	DirectX::XMFLOAT3 pitchYawRoll;
-	DirectX::XMFLOAT3 scale;
-
-	// World matrix and inverse transpose of the world matrix
-	bool matricesDirty;
-	DirectX::XMFLOAT4X4 worldMatrix;
-	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
-
-	// Helper to update both matrices if necessary
-	void UpdateMatrices();
-};
+	TransformPool* pool;
+	unsigned int handle;
 
+	// Keeps the quaternion in sync with the angles
+	void UpdateRotation();
+};
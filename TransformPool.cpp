@@ -0,0 +1,290 @@
+#include "TransformPool.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <intrin.h>
+
+using namespace DirectX;
+
+// Singleton requirement
+TransformPool* TransformPool::instance;
+
+// New transforms go at the end, as roots of their own subtree
+unsigned int TransformPool::Allocate()
+{
+	unsigned int handle;
+	if (!freeHandles.empty())
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else
+	{
+		handle = (unsigned int)slots.size();
+		slots.push_back(0);
+	}
+
+	unsigned int slot = (unsigned int)handles.size();
+	slots[handle] = slot;
+	handles.push_back(handle);
+	parents.push_back(InvalidHandle);
+	subtreeSizes.push_back(1);
+
+	// Start with an identity transform
+	positions.push_back(XMFLOAT3(0, 0, 0));
+	pitchYawRolls.push_back(XMFLOAT3(0, 0, 0));
+	rotations.push_back(XMFLOAT4(0, 0, 0, 1));
+	scales.push_back(XMFLOAT3(1, 1, 1));
+	versions.push_back(0);
+
+	InstanceData identity;
+	XMStoreFloat4x4(&identity.World, XMMatrixIdentity());
+	XMStoreFloat4x4(&identity.WorldInverseTranspose, XMMatrixIdentity());
+	matrices.push_back(identity);
+
+	if (slot % 32 == 0)
+		dirtyWords.push_back(0);
+	return handle;
+}
+
+void TransformPool::Free(unsigned int handle)
+{
+	// Children become roots, which moves them out from under this
+	unsigned int slot = slots[handle];
+	while (subtreeSizes[slot] > 1)
+	{
+		SetParent(handles[slot + 1], InvalidHandle);
+		slot = slots[handle];
+	}
+
+	SetParent(handle, InvalidHandle);
+	MoveSubtree(slots[handle], (unsigned int)handles.size());
+
+	// Now it's the last slot, so just drop it
+	handles.pop_back();
+	parents.pop_back();
+	subtreeSizes.pop_back();
+	positions.pop_back();
+	pitchYawRolls.pop_back();
+	rotations.pop_back();
+	scales.pop_back();
+	versions.pop_back();
+	matrices.pop_back();
+
+	unsigned int count = (unsigned int)handles.size();
+	dirtyWords.resize((count + 31) / 32);
+	if (count % 32 != 0)
+		dirtyWords.back() &= (1u << (count % 32)) - 1;
+
+	slots[handle] = InvalidHandle;
+	freeHandles.push_back(handle);
+}
+
+bool TransformPool::SetParent(unsigned int handle, unsigned int parent)
+{
+	unsigned int slot = slots[handle];
+	unsigned int count = subtreeSizes[slot];
+	if (parents[slot] == parent)
+		return true;
+
+	// Can't attach to anything in its own subtree
+	if (parent != InvalidHandle && slots[parent] >= slot && slots[parent] < slot + count)
+		return false;
+
+	// Go at the end of the new parent's subtree.  That's measured before
+	// the sizes change, since it's where the subtree physically ends, even
+	// when the new parent is one of the old ones (and so still counts this)
+	unsigned int destination = (unsigned int)handles.size();
+	if (parent != InvalidHandle)
+	{
+		unsigned int parentSlot = slots[parent];
+		destination = parentSlot + subtreeSizes[parentSlot];
+	}
+	MoveSubtree(slot, destination);
+
+	// Leave the old parent's subtree and join the new one's
+	slot = slots[handle];
+	for (unsigned int a = parents[slot]; a != InvalidHandle; a = parents[slots[a]])
+		subtreeSizes[slots[a]] -= count;
+	parents[slot] = parent;
+	for (unsigned int a = parent; a != InvalidHandle; a = parents[slots[a]])
+		subtreeSizes[slots[a]] += count;
+
+	MarkRangeDirty(slot, count);
+	return true;
+}
+
+// Moves the subtree at slot so it sits just before destination (a slot
+// outside of it), shifting everything in between over
+template<typename T>
+static void MoveRange(std::vector<T>& v, unsigned int first, unsigned int count, unsigned int destination)
+{
+	if (destination < first)
+		std::rotate(v.begin() + destination, v.begin() + first, v.begin() + first + count);
+	else
+		std::rotate(v.begin() + first, v.begin() + first + count, v.begin() + destination);
+}
+
+void TransformPool::MoveSubtree(unsigned int slot, unsigned int destination)
+{
+	unsigned int count = subtreeSizes[slot];
+	if (destination >= slot && destination <= slot + count)
+		return;
+
+	MoveRange(handles, slot, count, destination);
+	MoveRange(parents, slot, count, destination);
+	MoveRange(subtreeSizes, slot, count, destination);
+	MoveRange(positions, slot, count, destination);
+	MoveRange(pitchYawRolls, slot, count, destination);
+	MoveRange(rotations, slot, count, destination);
+	MoveRange(scales, slot, count, destination);
+	MoveRange(versions, slot, count, destination);
+	MoveRange(matrices, slot, count, destination);
+
+	// Everything that shifted has a new slot.  Dirty bits don't move
+	// with the data, so rebuild the whole shifted range
+	unsigned int first = min(slot, destination);
+	unsigned int end = max(slot + count, destination);
+	for (unsigned int i = first; i < end; i++)
+		slots[handles[i]] = i;
+	MarkRangeDirty(first, end - first);
+}
+
+void TransformPool::MarkDirty(unsigned int slot)
+{
+	dirtyWords[slot / 32] |= 1u << (slot % 32);
+	versions[slot]++;
+}
+
+void TransformPool::MarkRangeDirty(unsigned int first, unsigned int count)
+{
+	for (unsigned int i = first; i < first + count; i++)
+		dirtyWords[i / 32] |= 1u << (i % 32);
+}
+
+// Finds the first dirty slot at or after start
+bool TransformPool::FindDirty(unsigned int start, unsigned int* slot)
+{
+	unsigned int word = start / 32;
+	if (word >= dirtyWords.size())
+		return false;
+
+	unsigned int bits = dirtyWords[word] & (0xFFFFFFFFu << (start % 32));
+	while (true)
+	{
+		unsigned long bit;
+		if (_BitScanForward(&bit, bits))
+		{
+			*slot = word * 32 + bit;
+			return true;
+		}
+
+		if (++word >= dirtyWords.size())
+			return false;
+		bits = dirtyWords[word];
+	}
+}
+
+// One pass over the dirty set finds each dirty subtree that isn't inside
+// another.  Their parents are clean, so the runs are independent, and each
+// is rebuilt in order, parents first.  Versions go up for everything
+// rebuilt, since children move with their parents
+void TransformPool::UpdateMatrices(JobSystem* jobSystem)
+{
+	dirtyRuns.clear();
+	unsigned int slot = 0;
+	while (FindDirty(slot, &slot))
+	{
+		dirtyRuns.push_back({ slot, subtreeSizes[slot] });
+		slot += subtreeSizes[slot];
+	}
+	std::fill(dirtyWords.begin(), dirtyWords.end(), 0);
+
+	lastUpdateCount = 0;
+	auto updateRuns = [this](size_t begin, size_t end)
+	{
+		unsigned int updated = 0;
+		for (size_t r = begin; r < end; r++)
+		{
+			unsigned int first = dirtyRuns[r].first;
+			unsigned int count = dirtyRuns[r].second;
+			for (unsigned int i = first; i < first + count; i++)
+			{
+				ComputeMatrices(i);
+				versions[i]++;
+			}
+			updated += count;
+		}
+		lastUpdateCount += updated;
+	};
+
+	if (jobSystem)
+		jobSystem->ParallelFor(0, dirtyRuns.size(), 64, updateRuns);
+	else
+		updateRuns(0, dirtyRuns.size());
+}
+
+// Whether this or any parent has changed since the last update
+bool TransformPool::IsStale(unsigned int slot)
+{
+	while (true)
+	{
+		if (IsDirty(slot))
+			return true;
+		if (parents[slot] == InvalidHandle)
+			return false;
+		slot = slots[parents[slot]];
+	}
+}
+
+// Reads before the next update rebuild the chain up to the root.  This
+// leaves the dirty bits alone, so the update still covers the subtree
+const InstanceData& TransformPool::GetMatrices(unsigned int handle)
+{
+	unsigned int slot = slots[handle];
+	if (IsStale(slot))
+	{
+		if (parents[slot] != InvalidHandle)
+			GetMatrices(parents[slot]);
+		ComputeMatrices(slot);
+	}
+	return matrices[slot];
+}
+
+// Builds scale * rotation * translation directly from the parts, and the
+// inverse transpose from the inverted parts rather than a general 4x4
+// inverse: the rotation's rows over each axis' scale (for a uniform scale,
+// just the world rows over the scale squared), with the inverted
+// translation in the last column.  Both are then combined with the
+// parent's, which is already up to date
+void TransformPool::ComputeMatrices(unsigned int slot)
+{
+	XMVECTOR position = XMLoadFloat3(&positions[slot]);
+	XMVECTOR scale = XMLoadFloat3(&scales[slot]);
+	XMMATRIX rotation = XMMatrixRotationQuaternion(XMLoadFloat4(&rotations[slot]));
+
+	XMMATRIX world;
+	world.r[0] = rotation.r[0] * XMVectorSplatX(scale);
+	world.r[1] = rotation.r[1] * XMVectorSplatY(scale);
+	world.r[2] = rotation.r[2] * XMVectorSplatZ(scale);
+	world.r[3] = XMVectorSetW(position, 1.0f);
+
+	XMVECTOR inverseScale = XMVectorReciprocal(scale);
+	XMMATRIX inverseTranspose;
+	inverseTranspose.r[0] = rotation.r[0] * XMVectorSplatX(inverseScale);
+	inverseTranspose.r[1] = rotation.r[1] * XMVectorSplatY(inverseScale);
+	inverseTranspose.r[2] = rotation.r[2] * XMVectorSplatZ(inverseScale);
+	for (int i = 0; i < 3; i++)
+		inverseTranspose.r[i] = XMVectorSetW(inverseTranspose.r[i], -XMVectorGetX(XMVector3Dot(inverseTranspose.r[i], position)));
+	inverseTranspose.r[3] = g_XMIdentityR3;
+
+	if (parents[slot] != InvalidHandle)
+	{
+		const InstanceData& parent = matrices[slots[parents[slot]]];
+		world = world * XMLoadFloat4x4(&parent.World);
+		inverseTranspose = inverseTranspose * XMLoadFloat4x4(&parent.WorldInverseTranspose);
+	}
+
+	XMStoreFloat4x4(&matrices[slot].World, world);
+	XMStoreFloat4x4(&matrices[slot].WorldInverseTranspose, inverseTranspose);
+}
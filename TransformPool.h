@@ -0,0 +1,115 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include <atomic>
+
+#include "Vertex.h"
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// Storage for every Transform, kept as one array per field
+// rather than one object per transform, so the per-frame
+// matrix update streams through just the data it needs.
+//
+// Transforms can have parents.  The arrays are kept in
+// depth first order, so parents come before their children
+// and every subtree is one contiguous run of slots.  Each
+// Transform holds a handle that stays valid until it's
+// freed, and maps to whichever slot it currently occupies.
+//
+// Changes set a bit in the dirty set.  UpdateMatrices()
+// then sweeps the arrays once, rebuilding each dirty
+// subtree (and nothing else) with the runs split across
+// the job system.  The matrices are stored in the same
+// layout as the instance buffer, so they can be copied
+// straight into it.
+// --------------------------------------------------------
+class TransformPool
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static TransformPool& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new TransformPool();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	TransformPool(TransformPool const&) = delete;
+	void operator=(TransformPool const&) = delete;
+
+private:
+	static TransformPool* instance;
+	TransformPool() : lastUpdateCount(0) {};
+#pragma endregion
+
+public:
+	static const unsigned int InvalidHandle = 0xFFFFFFFF;
+
+	// Handles are reused once freed.  Freeing a transform
+	// leaves its children without a parent
+	unsigned int Allocate();
+	void Free(unsigned int handle);
+
+	// Attaches a transform (and its children) to a new parent, or
+	// detaches it given InvalidHandle.  Fails if the parent is
+	// the transform itself or one of its children
+	bool SetParent(unsigned int handle, unsigned int parent);
+	unsigned int GetParent(unsigned int handle) { return parents[slots[handle]]; }
+
+	// Rebuilds the matrices of everything that changed (or whose
+	// parent changed) since the last call.  Work is split across the
+	// job system, if one is given.  Once this returns, matrices can be
+	// read from several threads at once
+	void UpdateMatrices(JobSystem* jobSystem);
+
+	// World and inverse transpose matrices, rebuilt first if stale
+	const InstanceData& GetMatrices(unsigned int handle);
+
+	unsigned int GetCount() { return (unsigned int)handles.size(); }
+	unsigned int GetLastUpdateCount() { return lastUpdateCount; }
+
+private:
+	friend class Transform;
+
+	// Slot of each handle, and handle in each slot
+	std::vector<unsigned int> slots;
+	std::vector<unsigned int> handles;
+	std::vector<unsigned int> freeHandles;
+
+	// Everything below is indexed by slot.  Parents are handles, so
+	// they survive moves.  Transform data is relative to the parent,
+	// and rotations are kept as both the angles they were set with and
+	// the quaternion the matrices are built from
+	std::vector<unsigned int> parents;
+	std::vector<unsigned int> subtreeSizes;
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT3> pitchYawRolls;
+	std::vector<DirectX::XMFLOAT4> rotations;
+	std::vector<DirectX::XMFLOAT3> scales;
+	std::vector<unsigned int> versions;
+
+	// Results, in instance buffer layout
+	std::vector<InstanceData> matrices;
+
+	// One bit per slot, 32 slots to a word
+	std::vector<unsigned int> dirtyWords;
+
+	// Dirty subtrees found by the last sweep, as first slot and count
+	std::vector<std::pair<unsigned int, unsigned int>> dirtyRuns;
+	std::atomic<unsigned int> lastUpdateCount;
+
+	void MarkDirty(unsigned int slot);
+	void MarkRangeDirty(unsigned int first, unsigned int count);
+	bool IsDirty(unsigned int slot) { return (dirtyWords[slot / 32] & (1u << (slot % 32))) != 0; }
+	bool FindDirty(unsigned int start, unsigned int* slot);
+	bool IsStale(unsigned int slot);
+	void MoveSubtree(unsigned int slot, unsigned int destination);
+	void ComputeMatrices(unsigned int slot);
+};
@@ -0,0 +1,28 @@
+cbuffer externalData : register(b0)
+{
+	// The part of the scene target that was drawn to, in uvs
+	float2 uvScale;
+
+	// Half a texel inside that, so the filter never reaches past it
+	float2 uvMax;
+}
+
+Texture2D Scene				: register(t0);
+SamplerState LinearClamp	: register(s0);
+
+// Matches FullscreenVS's output
+struct VertexToPixel
+{
+	float4 position : SV_POSITION;
+	float2 uv       : TEXCOORD0;
+};
+
+// --------------------------------------------------------
+// Stretches the scaled scene over the whole screen (see
+// DynamicResolution), with bilinear filtering
+// --------------------------------------------------------
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	float2 uv = min(input.uv * uvScale, uvMax);
+	return float4(Scene.Sample(LinearClamp, uv).rgb, 1);
+}
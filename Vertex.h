@@ -13,4 +13,45 @@ struct Vertex
 	DirectX::XMFLOAT2 UV;			// Texture mapping
 	DirectX::XMFLOAT3 Normal;		// Lighting
 	DirectX::XMFLOAT3 Tangent;		// Normal mapping
-};
\ No newline at end of file
+};
+
+// --------------------------------------------------------
+// Which vertex layout a mesh stores on the GPU
+// --------------------------------------------------------
+enum MeshVertexFormat
+{
+	MESH_VERTEX_FULL,	// Vertex, as-is
+	MESH_VERTEX_PACKED	// PackedVertex
+};
+
+// --------------------------------------------------------
+// A compressed vertex, for meshes that are bound by vertex
+// fetch bandwidth (20 bytes instead of 44)
+//
+// - Position is 16-bit unorm relative to the mesh's bounds,
+//   rescaled in the vertex shader (W is unused padding)
+// - UV is a pair of half floats
+// - Normal and tangent are octahedral-encoded unit vectors,
+//   each a pair of 16-bit snorms
+//
+// Must match the input layout from Mesh::CreatePackedInputLayout
+// and the inputs of VertexShaderPacked(Instanced)
+// --------------------------------------------------------
+struct PackedVertex
+{
+	unsigned short Position[4];
+	unsigned short UV[2];
+	short Normal[2];
+	short Tangent[2];
+};
+
+// --------------------------------------------------------
+// Per-instance data for instanced drawing
+//
+// Must match the _PER_INSTANCE inputs of VertexShaderInstanced
+// --------------------------------------------------------
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+};
@@ -37,7 +37,9 @@ VertexToPixel main(VertexShaderInput input)
 
 	// Calculate output position
 	matrix worldViewProj = mul(projection, mul(view, world));
-	output.screenPosition = mul(worldViewProj, float4(input.position, 1.0f));
+	// Precise, so the depth pre-pass (see DepthOnlyVS) gets the exact same depth
+	precise float4 screenPosition = mul(worldViewProj, float4(input.position, 1.0f));
+	output.screenPosition = screenPosition;
 
 	// Calculate the world position of this vertex (to be used
 	// in the pixel shader when we do point/spot lights)
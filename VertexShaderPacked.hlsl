@@ -0,0 +1,67 @@
+#include "PackedVertex.hlsli"
+
+// Constant Buffer for external (C++) data
+cbuffer externalData : register(b0)
+{
+	matrix world;
+	matrix worldInverseTranspose;
+	matrix view;
+	matrix projection;
+
+	// Maps the mesh's 0-1 positions back to local space
+	float3 positionScale;
+	float3 positionOffset;
+};
+
+// Struct representing a single packed vertex (see PackedVertex in Vertex.h)
+// - The input assembler expands each component to a float
+struct VertexShaderInput
+{
+	float4 position		: POSITION;	// unorm, W unused
+	float2 uv			: TEXCOORD;	// half
+	float2 normal		: NORMAL;	// snorm, octahedral
+	float2 tangent		: TANGENT;	// snorm, octahedral
+};
+
+// Out of the vertex shader (and eventually input to the PS)
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float2 uv				: TEXCOORD;
+	float3 normal			: NORMAL;
+	float3 tangent			: TANGENT;
+	float3 worldPos			: POSITION; // The world position of this vertex
+};
+
+// --------------------------------------------------------
+// The entry point (main method) for our packed vertex shader
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput input)
+{
+	// Set up output
+	VertexToPixel output;
+
+	// Unpack the vertex
+	float3 position = DecodePosition(input.position.xyz, positionScale, positionOffset);
+	float3 normal = OctDecode(input.normal);
+	float3 tangent = OctDecode(input.tangent);
+
+	// Calculate output position
+	matrix worldViewProj = mul(projection, mul(view, world));
+	// Precise, so the depth pre-pass (see DepthOnlyVS) gets the exact same depth
+	precise float4 screenPosition = mul(worldViewProj, float4(position, 1.0f));
+	output.screenPosition = screenPosition;
+
+	// Calculate the world position of this vertex (to be used
+	// in the pixel shader when we do point/spot lights)
+	output.worldPos = mul(world, float4(position, 1.0f)).xyz;
+
+	// Make sure the other vectors are in WORLD space, not "local" space
+	output.normal = normalize(mul((float3x3)worldInverseTranspose, normal));
+	output.tangent = normalize(mul((float3x3)world, tangent)); // Tangent doesn't need inverse transpose!
+
+	// Pass the UV through
+	output.uv = input.uv;
+
+	return output;
+}
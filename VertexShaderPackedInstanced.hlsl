@@ -0,0 +1,86 @@
+#include "PackedVertex.hlsli"
+
+// Constant Buffer for external (C++) data
+// - World matrices come from the per-instance vertex stream instead
+cbuffer externalData : register(b0)
+{
+	matrix view;
+	matrix projection;
+
+	// Maps the mesh's 0-1 positions back to local space
+	float3 positionScale;
+	float3 positionOffset;
+};
+
+// Struct representing a single packed vertex (see PackedVertex in Vertex.h),
+// along with the data for the instance this vertex belongs to
+// - Semantics ending in _PER_INSTANCE are read from input slot 1
+//   (see Mesh::CreatePackedInputLayout)
+struct VertexShaderInput
+{
+	float4 position		: POSITION;	// unorm, W unused
+	float2 uv			: TEXCOORD;	// half
+	float2 normal		: NORMAL;	// snorm, octahedral
+	float2 tangent		: TANGENT;	// snorm, octahedral
+
+	// Rows of the instance matrices, exactly as they're laid
+	// out in the C++ InstanceData struct (see Vertex.h)
+	float4 world0		: WORLD_PER_INSTANCE0;
+	float4 world1		: WORLD_PER_INSTANCE1;
+	float4 world2		: WORLD_PER_INSTANCE2;
+	float4 world3		: WORLD_PER_INSTANCE3;
+	float4 worldInvTr0	: WORLDINVTRANS_PER_INSTANCE0;
+	float4 worldInvTr1	: WORLDINVTRANS_PER_INSTANCE1;
+	float4 worldInvTr2	: WORLDINVTRANS_PER_INSTANCE2;
+	float4 worldInvTr3	: WORLDINVTRANS_PER_INSTANCE3;
+};
+
+// Out of the vertex shader (and eventually input to the PS)
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float2 uv				: TEXCOORD;
+	float3 normal			: NORMAL;
+	float3 tangent			: TANGENT;
+	float3 worldPos			: POSITION; // The world position of this vertex
+};
+
+// --------------------------------------------------------
+// The entry point (main method) for our packed, instanced vertex shader
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput input)
+{
+	// Set up output
+	VertexToPixel output;
+
+	// Unpack the vertex
+	float3 position = DecodePosition(input.position.xyz, positionScale, positionOffset);
+	float3 normal = OctDecode(input.normal);
+	float3 tangent = OctDecode(input.tangent);
+
+	// Rebuild the instance matrices.  Unlike cbuffer matrices, these
+	// are not transposed on the way in, so they're used with the
+	// vector on the left side of mul()
+	float4x4 world = float4x4(input.world0, input.world1, input.world2, input.world3);
+	float4x4 worldInverseTranspose = float4x4(input.worldInvTr0, input.worldInvTr1, input.worldInvTr2, input.worldInvTr3);
+
+	// Calculate the world position of this vertex (to be used
+	// in the pixel shader when we do point/spot lights)
+	float4 worldPos = mul(float4(position, 1.0f), world);
+	output.worldPos = worldPos.xyz;
+
+	// Calculate output position
+	matrix viewProj = mul(projection, view);
+	// Precise, so the depth pre-pass (see DepthOnlyInstancedVS) gets the exact same depth
+	precise float4 screenPosition = mul(viewProj, worldPos);
+	output.screenPosition = screenPosition;
+
+	// Make sure the other vectors are in WORLD space, not "local" space
+	output.normal = normalize(mul(normal, (float3x3)worldInverseTranspose));
+	output.tangent = normalize(mul(tangent, (float3x3)world)); // Tangent doesn't need inverse transpose!
+
+	// Pass the UV through
+	output.uv = input.uv;
+
+	return output;
+}